@@ -0,0 +1,80 @@
+// Class ConstantBuffer pairs a ConstantBufferShadow with its ID3D11Buffer and uploads the shadow with one
+// Map(WRITE_DISCARD), or one UpdateSubresource for default buffers, whenever it is dirty. Class ShaderConstants
+// holds the constant buffers shader reflection finds in one shader's bytecode and looks variables up by name
+// across all of them, which is what Shader::setConstant() goes through.
+
+#pragma once
+
+#include <vector>
+#include <string>
+
+#include "dx11/dx11.h"
+#include "dx11/ConstantBufferLayout.h"
+
+#include <boost/noncopyable.hpp>
+#include <boost/unordered_map.hpp>
+
+namespace cinder { namespace dx11 {
+
+class ConstantBuffer;
+typedef std::shared_ptr<ConstantBuffer> ConstantBufferRef;
+
+class ConstantBuffer : private boost::noncopyable
+{
+public:
+    //! Dynamic buffers are uploaded with Map(WRITE_DISCARD), the others with UpdateSubresource. Empty when the
+    //! ID3D11Buffer can't be created.
+    static ConstantBufferRef create(const ConstantBufferDesc& desc, bool dynamic = true);
+
+    //! The layouts of all cbuffers \a bytecode declares, in slot order
+    static HRESULT reflect(const void* bytecode, size_t bytecodeLength, std::vector<ConstantBufferDesc>* descs);
+
+    const ConstantBufferDesc&   getDesc() const { return mShadow.getDesc(); }
+    ConstantBufferShadow&       getShadow() { return mShadow; }
+    const ConstantBufferShadow& getShadow() const { return mShadow; }
+    ID3D11Buffer*               getBuffer() const { return mBuffer; }
+
+    bool    set(const std::string& name, const void* data, size_t size);
+    template <typename T>
+    bool    set(const std::string& name, const T& value) { return set(name, &value, sizeof(T)); }
+
+    //! True once anything was set, buffers nobody feeds are left for setConstBuffer()
+    bool    isUsed() const { return mUsed; }
+    //! Uploads the shadow when it is dirty, does nothing otherwise
+    HRESULT flush(ID3D11DeviceContext* context);
+
+private:
+    friend class ShaderConstants;
+
+    ConstantBuffer(const ConstantBufferDesc& desc, bool dynamic);
+    HRESULT setup();
+
+    ConstantBufferShadow    mShadow;
+    CComPtr<ID3D11Buffer>   mBuffer;
+    bool                    mDynamic;
+    bool                    mUsed;
+};
+
+class ShaderConstants
+{
+public:
+    //! Reflects \a bytecode and creates one dynamic buffer per cbuffer
+    HRESULT setup(const void* bytecode, size_t bytecodeLength);
+    void    clear();
+
+    //! False when no cbuffer declares \a name or \a size is larger than the variable
+    bool    set(const std::string& name, const void* data, size_t size);
+    //! NULL when there's no cbuffer \a name
+    ConstantBufferRef   getBuffer(const std::string& name) const;
+    const std::vector<ConstantBufferRef>&   getBuffers() const { return mBuffers; }
+
+    //! Copies the values \a other has under the same names, so a recompiled shader starts where the old one was
+    void    copyVariables(const ShaderConstants& other);
+
+private:
+    std::vector<ConstantBufferRef>  mBuffers;
+    //! The buffer index of each variable
+    boost::unordered_map<std::string, size_t>   mVariables;
+};
+
+} } // namespace cinder::dx11
@@ -0,0 +1,99 @@
+// The D3D-free half of the constant buffer system. ConstantBufferDesc is the layout shader reflection reports for
+// one cbuffer: its slot, its size and the offset and size of every variable. It converts to and from a plain text
+// form, so layouts reflected on Windows can be saved and checked elsewhere. ConstantBufferShadow is the CPU copy
+// of one cbuffer: variables are written by name, and only bytes that actually changed are recorded as dirty, so an
+// upload happens only when something changed.
+
+#pragma once
+
+#include <vector>
+#include <string>
+
+#include "cinder/Cinder.h"
+
+#include <boost/unordered_map.hpp>
+
+namespace cinder { namespace dx11 {
+
+struct ConstantBufferVariable
+{
+    ConstantBufferVariable():offset(0), size(0){}
+    ConstantBufferVariable(const std::string& name, uint32_t offset, uint32_t size):name(name), offset(offset), size(size){}
+
+    std::string name;
+    uint32_t    offset;
+    //! With HLSL packing, e.g. 12 for a float3 and 52 for a float3[2]
+    uint32_t    size;
+};
+
+struct ConstantBufferDesc
+{
+    ConstantBufferDesc():slot(0), size(0){}
+
+    std::string     name;
+    //! The register, b<slot>
+    uint32_t        slot;
+    //! A multiple of 16
+    uint32_t        size;
+    std::vector<ConstantBufferVariable> variables;
+
+    //! False when the size isn't a multiple of 16 or a variable doesn't fit the buffer, \a error says which
+    bool    validate(std::string* error = NULL) const;
+
+    //! One "cbuffer <name> <slot> <size>" line per buffer, followed by one "<name> <offset> <size>" line per variable
+    static std::string  serialize(const std::vector<ConstantBufferDesc>& descs);
+    //! Reads what serialize() wrote and validates every buffer, false on malformed text
+    static bool         parse(const std::string& text, std::vector<ConstantBufferDesc>* descs, std::string* error = NULL);
+};
+
+class ConstantBufferShadow
+{
+public:
+    //! A half-open byte range
+    struct Range
+    {
+        Range():begin(0), end(0){}
+        Range(uint32_t begin, uint32_t end):begin(begin), end(end){}
+
+        uint32_t    begin;
+        uint32_t    end;
+    };
+
+    //! Zero filled, with nothing dirty
+    explicit ConstantBufferShadow(const ConstantBufferDesc& desc);
+
+    const ConstantBufferDesc&   getDesc() const { return mDesc; }
+
+    //! The index of variable \a name, -1 when the buffer has none
+    int     findVariable(const std::string& name) const;
+
+    //! Writes the first \a size bytes of a variable. False when the variable doesn't exist or is smaller than \a size.
+    bool    set(const std::string& name, const void* data, size_t size);
+    bool    set(int variable, const void* data, size_t size);
+    template <typename T>
+    bool    set(const std::string& name, const T& value) { return set(name, &value, sizeof(T)); }
+    //! Writes bytes at \a offset, false when they don't fit
+    bool    write(uint32_t offset, const void* data, size_t size);
+
+    //! Copies every variable \a other has under the same name, e.g. to keep values across a shader reload
+    void    copyVariables(const ConstantBufferShadow& other);
+
+    const uint8_t*  getData() const { return mData.empty() ? NULL : &mData[0]; }
+    size_t          getSize() const { return mData.size(); }
+
+    bool    isDirty() const { return !mDirty.empty(); }
+    //! Sorted, with overlapping and touching ranges merged
+    const std::vector<Range>&   getDirtyRanges() const { return mDirty; }
+    //! Called once the buffer was uploaded
+    void    clearDirty() { mDirty.clear(); }
+
+private:
+    void    markDirty(uint32_t begin, uint32_t end);
+
+    ConstantBufferDesc          mDesc;
+    std::vector<uint8_t>        mData;
+    std::vector<Range>          mDirty;
+    boost::unordered_map<std::string, int>  mVariables;
+};
+
+} } // namespace cinder::dx11
@@ -0,0 +1,36 @@
+// Class FileWatcher reports files that were written, created or renamed into a set of directories. Windows
+// uses ReadDirectoryChangesW, Linux uses inotify, both behind the same blocking wait() so a background thread
+// can sleep until something changes.
+
+#pragma once
+
+#include <vector>
+
+#include "cinder/Cinder.h"
+#include "cinder/Filesystem.h"
+
+#include <boost/noncopyable.hpp>
+
+namespace cinder { namespace dx11 {
+
+class FileWatcher;
+typedef std::shared_ptr<FileWatcher> FileWatcherRef;
+
+class FileWatcher : private boost::noncopyable
+{
+public:
+    //! NULL when the platform has no way to watch files
+    static FileWatcherRef create();
+
+    virtual ~FileWatcher() {}
+
+    //! Starts watching the files directly in \a directory. Watching a directory twice is harmless.
+    //! Safe to call while another thread is in wait().
+    virtual bool    addDirectory( const fs::path& directory ) = 0;
+
+    //! Waits up to \a timeoutMs for changes and appends the paths of the changed files to \a changed, a file
+    //! written several times may show up more than once. False when the wait timed out.
+    virtual bool    wait( uint32_t timeoutMs, std::vector<fs::path>* changed ) = 0;
+};
+
+} } // namespace cinder::dx11
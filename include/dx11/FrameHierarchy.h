@@ -0,0 +1,78 @@
+// Class FrameHierarchy is the frame tree of an SdkMesh flattened so parents come before their children, with
+// the animation of every frame compressed into one AnimationClip. Posing a character is one linear pass of SSE
+// matrix products between interpolated keys, and evaluate() over many instances spreads the characters over
+// the worker pool.
+
+#pragma once
+
+#include <vector>
+
+#include "cinder/Cinder.h"
+#include "cinder/Matrix.h"
+
+#include "dx11/AnimationClip.h"
+
+class CDXUTSDKMesh;
+
+namespace cinder { namespace dx11 {
+
+class FrameHierarchy
+{
+public:
+    //! One animated character
+    struct Instance
+    {
+        Instance():time(0){}
+        Instance(double time, const Matrix44f& world):time(time), world(world){}
+
+        double      time;
+        Matrix44f   world;
+    };
+
+    FrameHierarchy():mNumFrames(0), mNumKeys(0), mFps(0), mAbsolute(false), mHasUnreachable(false){}
+
+    //! Copies the frames, the bind pose and the animation, if one is loaded, out of \a sdkMesh.
+    //! The animation is compressed with \a options.
+    void    create( CDXUTSDKMesh& sdkMesh, const AnimationClip::Options& options = AnimationClip::Options() );
+
+    //! Frames in file order, which is how the skinning matrices are indexed
+    size_t  getNumFrames() const { return mNumFrames; }
+    size_t  getNumKeys() const { return mNumKeys; }
+    //! The key CDXUTSDKMesh::GetAnimationKeyFromTime() picks for \a time, negative times loop backwards
+    size_t  getKey( double time ) const;
+    const AnimationClip&    getClip() const { return mClip; }
+
+    //! Writes getNumFrames() skinning matrices, bind pose to animated pose, to \a skin. Poses between keys are
+    //! interpolated, and the loop blends from the last key back to key 1, since key 0 is the rest pose.
+    //! \a worldPose optionally receives the animated world matrix of every frame.
+    void    evaluate( double time, const Matrix44f& world, Matrix44f* skin, Matrix44f* worldPose = NULL ) const;
+    //! Evaluates \a count instances in parallel, writing getNumFrames() skinning matrices per instance to \a skin
+    void    evaluate( const Instance* instances, size_t count, Matrix44f* skin ) const;
+
+private:
+    struct Batch;
+
+    void    evaluate( double time, const Matrix44f& world, Matrix44f* skin, Matrix44f* worldPose, float* scratch ) const;
+    void    computeLocal( size_t slot, float position, float* local ) const;
+    //! getKey() without the rounding down, in [1, getNumKeys())
+    double  getPosition( double time ) const;
+
+    size_t                  mNumFrames;
+    size_t                  mNumKeys;
+    float                   mFps;
+    bool                    mAbsolute;          // FTT_ABSOLUTE animations don't go through the hierarchy
+    bool                    mHasUnreachable;    // frames not below frame 0 keep identity matrices
+
+    // per slot, parents first
+    std::vector<uint32_t>   mFrames;            // the frame in file order
+    std::vector<int32_t>    mParents;           // slot of the parent, -1 for roots
+    std::vector<int32_t>    mTracks;            // animation track, -1 for static frames
+    std::vector<float>      mLocal;             // 16 floats per slot, the static local matrix
+    std::vector<float>      mInvBind;           // 16 floats per slot, inverse of the bind pose world matrix
+
+    AnimationClip           mClip;
+    // per track, the inverse of the first key for FTT_ABSOLUTE animations
+    std::vector<float>      mInvFirstKeys;
+};
+
+} } // namespace cinder::dx11
@@ -0,0 +1,79 @@
+// Class IncludeCache reads the files shaders include once per process and hands every later compile the same
+// shared contents. Entries are keyed by include name and carry the file's size and modification time at the
+// finest resolution the file system keeps, so an edited include is read again on its next use while everything
+// else costs one lookup and one stat. Whoever learns of an edit first, like the ShaderReloader, can invalidate()
+// the file outright, which also covers edits that keep both size and time stamp.
+
+#pragma once
+
+#include <string>
+
+#include "cinder/Cinder.h"
+#include "cinder/Filesystem.h"
+#include "cinder/Thread.h"
+
+#include "dx11/ShaderCache.h"
+
+#include <boost/function.hpp>
+#include <boost/unordered_map.hpp>
+
+namespace cinder { namespace dx11 {
+
+class IncludeCache : public ShaderIncludes
+{
+public:
+    //! Finds the file of an include name, an empty path when there is none
+    typedef boost::function<fs::path (const std::string&)> Resolver;
+
+    struct Stats
+    {
+        Stats():hits(0), loads(0), reloads(0){}
+
+        size_t  hits;
+        //! Includes read for the first time
+        size_t  loads;
+        //! Includes read again because their file changed
+        size_t  reloads;
+    };
+
+    explicit IncludeCache( const Resolver& resolve );
+
+    Contents    open( const std::string& name );
+
+    //! Forgets the includes read from \a path, the next open() reads them again whatever the file stamp says
+    void        invalidate( const fs::path& path );
+    //! Forgets every include, the next open() of each reads its file again
+    void        clear();
+    Stats       getStats() const;
+
+private:
+    //! last_write_time() has whole seconds, an include saved twice within one would look unchanged
+    struct Stamp
+    {
+        Stamp():size(0), modified(0){}
+
+        bool operator==( const Stamp& other ) const { return size == other.size && modified == other.modified; }
+
+        uint64_t    size;
+        //! In the ticks of the platform, 100ns on Windows and 1ns elsewhere
+        uint64_t    modified;
+    };
+
+    struct Entry
+    {
+        fs::path    path;
+        Stamp       stamp;
+        Contents    contents;
+    };
+
+    static bool getStamp( const fs::path& path, Stamp* stamp );
+    static bool readFile( const fs::path& path, std::string* contents );
+
+    Resolver            mResolve;
+
+    mutable std::mutex  mMutex;
+    boost::unordered_map<std::string, Entry>    mEntries;
+    Stats               mStats;
+};
+
+} } // namespace cinder::dx11
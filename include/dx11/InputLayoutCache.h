@@ -0,0 +1,70 @@
+// Class InputLayoutCache shares ID3D11InputLayout objects between meshes. Layouts are keyed by the element
+// descriptions and the input signature of the vertex shader, so every shader with the same inputs reuses them.
+
+#pragma once
+
+#include <vector>
+#include <string>
+#include <d3d11.h>
+#include <atlbase.h>
+
+#include "cinder/Thread.h"
+
+#include <boost/noncopyable.hpp>
+#include <boost/unordered_map.hpp>
+
+namespace cinder { namespace dx11 {
+
+class InputLayoutCache : private boost::noncopyable
+{
+public:
+    //! Returns the process-wide cache
+    static InputLayoutCache& get();
+
+    //! Returns the layout of \a pElementDescs for the vertex shader \a pShaderBytecode, creating it on the first request. Safe to call from any thread.
+    HRESULT getInputLayout(const D3D11_INPUT_ELEMENT_DESC* pElementDescs, UINT NumElements,
+        const void* pShaderBytecode, SIZE_T BytecodeLength, ID3D11InputLayout** ppInputLayout);
+
+    //! Drops every layout, call it before the device goes away
+    void    clear();
+
+    size_t  getNumLayouts() const;
+    size_t  getHits() const;
+    size_t  getMisses() const;
+
+private:
+    InputLayoutCache():mHits(0), mMisses(0){}
+
+    struct Element
+    {
+        std::string semanticName;
+        UINT        semanticIndex;
+        DXGI_FORMAT format;
+        UINT        inputSlot;
+        UINT        alignedByteOffset;
+        D3D11_INPUT_CLASSIFICATION  inputSlotClass;
+        UINT        instanceDataStepRate;
+
+        bool operator==(const Element& rhs) const;
+    };
+
+    // the full key is kept to rule out hash collisions
+    struct Entry
+    {
+        std::vector<Element>        elements;
+        std::vector<uint8_t>        signature;
+        CComPtr<ID3D11InputLayout>  layout;
+    };
+
+    typedef boost::unordered_multimap<uint64_t, Entry> LayoutMap;
+
+    static void     getSignature(const void* pShaderBytecode, SIZE_T BytecodeLength, const uint8_t** ppSignature, size_t* pSize);
+    ID3D11InputLayout*  find(uint64_t hash, const std::vector<Element>& elements, const uint8_t* signature, size_t signatureSize) const;
+
+    mutable std::mutex  mMutex;
+    LayoutMap           mLayouts;
+    size_t              mHits;
+    size_t              mMisses;
+};
+
+} } // namespace cinder::dx11
@@ -0,0 +1,53 @@
+// Class MappedFile maps a whole file read-only into memory, for loaders that use file contents in place.
+// A copy-on-write mapping also lets loaders patch the contents in place without touching the file.
+// It builds anywhere, with mmap where there's no Win32, so portable readers like ShaderArchive share it.
+
+#pragma once
+
+#include <string>
+
+#if defined( _WIN32 )
+#include <windows.h>
+#endif
+
+#include <boost/noncopyable.hpp>
+
+namespace cinder { namespace dx11 {
+
+class MappedFile : private boost::noncopyable
+{
+public:
+    MappedFile();
+    ~MappedFile() { close(); }
+
+    //! Maps \a path, closing whatever was mapped before. Empty files cannot be mapped and fail.
+    //! With \a copyOnWrite the pages written to become private copies, see getWritableData().
+    //! On failure getError() says why.
+    bool    open(const std::string& path, bool copyOnWrite = false);
+    void    close();
+
+    bool        isOpen() const { return mData != NULL; }
+    const void* getData() const { return mData; }
+    size_t      getSize() const { return mSize; }
+    //! NULL unless opened copy-on-write
+    void*       getWritableData() const { return mCopyOnWrite ? mData : NULL; }
+
+    //! The Win32 error code of the last failed open(), errno elsewhere
+    unsigned long   getError() const { return mError; }
+#if defined( _WIN32 )
+    //! getError() as an HRESULT, for the D3D loaders
+    HRESULT         getResult() const { return mError ? HRESULT_FROM_WIN32(mError) : E_FAIL; }
+#endif
+
+private:
+#if defined( _WIN32 )
+    HANDLE      mFile;
+    HANDLE      mMapping;
+#endif
+    void*       mData;
+    size_t      mSize;
+    bool        mCopyOnWrite;
+    unsigned long   mError;
+};
+
+} } // namespace cinder::dx11
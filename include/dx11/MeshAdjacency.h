@@ -0,0 +1,27 @@
+// Adjacency for geometry shader techniques such as silhouette edges and shadow volumes.
+// Vertices are welded by position, so seams in normals or texture coordinates don't break the edge matching.
+// Both passes are hash based, linear in the mesh size and spread over the worker pool.
+
+#pragma once
+
+#include <vector>
+
+#include "cinder/Cinder.h"
+
+namespace cinder { namespace dx11 {
+
+//! Sets \a remap[i] to the lowest index of an item whose key equals the one of item \a i.
+//! Keys are \a keyWords consecutive words each, compared bit for bit.
+void    buildKeyRemap( std::vector<uint32_t>& remap, const uint32_t* keys, size_t count, size_t keyWords );
+
+//! Sets \a remap[i] to the lowest index of a vertex at the same position as vertex \a i.
+//! \a positions points at the first float3 position, consecutive positions are \a stride bytes apart.
+void    buildPositionRemap( std::vector<uint32_t>& remap, const void* positions, size_t numVertices, size_t stride );
+
+//! Builds D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST_ADJ indices for a triangle list, six per triangle: each corner
+//! followed by the far vertex of the neighbour across the edge to the next corner. Boundary and non-manifold edges
+//! without a matching neighbour repeat the triangle's own opposite corner.
+void    buildAdjacencyIndices( std::vector<uint32_t>& adjacency, const uint32_t* indices, size_t numIndices,
+            const void* positions, size_t numVertices, size_t stride );
+
+} } // namespace cinder::dx11
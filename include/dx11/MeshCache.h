@@ -0,0 +1,66 @@
+// Class MeshCacheFile reads and writes GPU-ready mesh containers: the vertex streams exactly as VboMesh uploads them,
+// the input element table, the index buffer in its final width, bounds, LOD levels and clusters.
+// Every section starts 16-byte aligned, so a mapped file feeds D3D11_SUBRESOURCE_DATA without copies.
+// Streams and indices can instead be stored with the MeshCodec; those are decoded into memory owned by the file on open.
+
+#pragma once
+
+#include <vector>
+#include <string>
+#include <d3d11.h>
+
+#include "cinder/AxisAlignedBox.h"
+
+#include "dx11/MappedFile.h"
+#include "dx11/MeshSimplifier.h"
+#include "dx11/MeshCluster.h"
+
+namespace cinder { namespace dx11 {
+
+//! Contents of a mesh cache. Read from a file, the data pointers point into the mapping or the decoded copies.
+struct MeshCacheData
+{
+    MeshCacheData():numVertices(0), numIndices(0), indexFormat(DXGI_FORMAT_UNKNOWN), indexData(NULL), indexDataSize(0){}
+
+    struct Stream
+    {
+        const void* data;
+        UINT        stride;
+    };
+
+    UINT        numVertices;
+    //! Indices dx11::draw() renders, the index data may hold more for a LOD chain
+    UINT        numIndices;
+    DXGI_FORMAT indexFormat;
+    const void* indexData;
+    size_t      indexDataSize;
+    //! One stream per input slot, slot 0 first
+    std::vector<Stream> streams;
+    //! Per-vertex elements only. Semantic names read from a file stay valid for the life of the process.
+    std::vector<D3D11_INPUT_ELEMENT_DESC> elements;
+    AxisAlignedBox3f            bounds;
+    std::vector<LodLevel>       lods;
+    std::vector<MeshCluster>    clusters;
+};
+
+class MeshCacheFile
+{
+public:
+    static const uint32_t kVersion = 2;
+
+    //! Maps \a path and checks its header and section table. The data stays valid while the file is open.
+    HRESULT open( const std::string& path );
+    void    close();
+
+    const MeshCacheData& getData() const { return mData; }
+
+    //! With \a compress the vertex streams and the triangle indices are stored with the MeshCodec
+    static HRESULT write( const std::string& path, const MeshCacheData& data, bool compress = false );
+
+private:
+    MappedFile      mFile;
+    MeshCacheData   mData;
+    std::vector<std::vector<uint8_t> >  mDecoded;
+};
+
+} } // namespace cinder::dx11
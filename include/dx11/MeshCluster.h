@@ -0,0 +1,104 @@
+// Class Clusterizer splits a triangle list into small spatially coherent clusters with culling bounds,
+// class ClusterCuller tests those bounds against a frustum and the eye point and returns what is left
+// as index ranges. Nothing here touches the device, VboMesh::setClusters uploads the result.
+
+#pragma once
+
+#include <vector>
+
+#include "cinder/Vector.h"
+#include "cinder/Matrix.h"
+
+namespace cinder {
+	class TriMesh;
+}
+
+namespace cinder { namespace dx11 {
+
+//! A contiguous range of an index buffer
+struct DrawRange
+{
+    DrawRange():startIndex(0), indexCount(0){}
+    DrawRange(size_t start, size_t count):startIndex(start), indexCount(count){}
+
+    size_t  startIndex;
+    size_t  indexCount;
+};
+
+//! A cluster of triangles with its bounding sphere and normal cone. The cone lets a cluster be skipped
+//! when dot(normalize(coneApex - eye), coneAxis) >= coneCutoff; a cutoff above 1 means it always faces the eye somewhere.
+struct MeshCluster
+{
+    size_t  startIndex;
+    size_t  indexCount;
+    Vec3f   center;
+    float   radius;
+    Vec3f   coneApex;
+    Vec3f   coneAxis;
+    float   coneCutoff;
+};
+
+//! The cluster ordered indices together with their clusters
+struct ClusterMesh
+{
+    std::vector<uint32_t>       indices;
+    std::vector<MeshCluster>    clusters;
+};
+
+class Clusterizer
+{
+public:
+    struct Options
+    {
+        Options():maxVertices(64), maxTriangles(124), coneWeight(0.5f), clockwise(false){}
+
+        size_t  maxVertices;
+        size_t  maxTriangles;
+        //! How much triangles facing away from the cluster are avoided, tighter cones cull better
+        float   coneWeight;
+        //! Set when front faces wind clockwise, which is how VboMesh uploads flipped TriMesh indices
+        bool    clockwise;
+    };
+
+    static ClusterMesh build( const Vec3f* positions, size_t numVertices, const uint32_t* indices, size_t numIndices,
+        const Options& options = Options() );
+
+    //! Computes the bounds of the triangles in [\a startIndex, \a startIndex + \a indexCount)
+    static MeshCluster computeBounds( const Vec3f* positions, const uint32_t* indices, size_t startIndex, size_t indexCount, bool clockwise );
+};
+
+//! Builds clusters for a TriMesh. \a flipOrder has to match the value given to the VboMesh constructor.
+ClusterMesh buildClusters( const TriMesh& triMesh, const Clusterizer::Options& options = Clusterizer::Options(), bool flipOrder = true );
+
+class ClusterCuller
+{
+public:
+    ClusterCuller():mNumClusters(0), mBackfaceCulling(true){}
+    explicit ClusterCuller( const std::vector<MeshCluster>& clusters );
+
+    //! Takes the frustum planes from \a worldViewProj (D3D clip space, 0 <= z <= w), so they are in object space
+    void    setFrustum( const Matrix44f& worldViewProj );
+    //! The eye point in object space, used for the normal cone test
+    void    setEyePoint( const Vec3f& eye ) { mEye = eye; }
+    void    enableBackfaceCulling( bool enable = true ) { mBackfaceCulling = enable; }
+
+    //! Appends the ranges of the visible clusters to \a ranges, merging clusters that follow each other in the index buffer.
+    //! Returns the number of visible clusters.
+    size_t  cull( std::vector<DrawRange>& ranges ) const;
+
+    size_t  getNumClusters() const { return mNumClusters; }
+
+private:
+    size_t  mNumClusters;
+    bool    mBackfaceCulling;
+    Vec3f   mEye;
+    Vec4f   mPlanes[6];
+
+    // bounds in SoA layout, padded to a multiple of four with clusters that never pass
+    std::vector<float>  mCenterX, mCenterY, mCenterZ, mRadius;
+    std::vector<float>  mApexX, mApexY, mApexZ;
+    std::vector<float>  mAxisX, mAxisY, mAxisZ, mCutoff;
+    std::vector<DrawRange>  mRanges;
+};
+
+} } // namespace cinder::dx11
@@ -0,0 +1,26 @@
+// Lossless compression of vertex and index buffers.
+// Vertices are split into byte planes of zigzag deltas between neighbouring vertices and bit-packed in groups of 16,
+// which suits the smooth attributes of cache-ordered meshes. Triangles are coded against a FIFO of recent edges
+// and vertices, so a typical triangle of an optimized mesh takes one byte. Nothing here touches the device.
+// Known limitation: decoding runs at roughly 1-2 GB/s of vertices and 1 GB/s of indices on one core, short of the
+// several GB/s a loader would need to never wait on it. The index decoder is serial by nature, one triangle at a time.
+
+#pragma once
+
+#include <vector>
+
+#include "cinder/Cinder.h"
+
+namespace cinder { namespace dx11 {
+
+//! Appends the encoding of \a count vertices of \a stride bytes (at most 256) to \a out
+void    encodeVertexBuffer( std::vector<uint8_t>& out, const void* vertices, size_t count, size_t stride );
+//! Decodes \a count vertices into \a destination. Returns false when \a data is not a valid encoding of that many vertices.
+bool    decodeVertexBuffer( void* destination, size_t count, size_t stride, const uint8_t* data, size_t size );
+
+//! Appends the encoding of a triangle list to \a out. The decoded indices match the input exactly.
+void    encodeIndexBuffer( std::vector<uint8_t>& out, const uint32_t* indices, size_t count );
+//! Decodes \a count indices into \a destination as 16-bit (\a indexSize 2) or 32-bit (\a indexSize 4) values
+bool    decodeIndexBuffer( void* destination, size_t count, size_t indexSize, const uint8_t* data, size_t size );
+
+} } // namespace cinder::dx11
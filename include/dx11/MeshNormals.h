@@ -0,0 +1,52 @@
+// Class NormalGenerator computes smooth vertex normals for triangle lists. Face normals and weights come four
+// triangles at a time with SSE, then every vertex gathers from the faces around it, so workers never write to
+// the same vertex. A crease angle keeps hard edges hard by splitting the vertices on them.
+
+#pragma once
+
+#include <vector>
+
+#include "cinder/Vector.h"
+
+namespace cinder {
+	class TriMesh;
+}
+
+namespace cinder { namespace dx11 {
+
+class NormalGenerator
+{
+public:
+    struct Options
+    {
+        Options():angleWeighted(true), creaseAngle(180.0f), weldPositions(true), clockwise(false){}
+
+        //! Weighs faces by their angle at the vertex instead of their area, which doesn't depend on the tessellation
+        bool    angleWeighted;
+        //! Faces meeting at a larger angle, in degrees, don't smooth across and their shared vertices are split. 180 turns creases off.
+        float   creaseAngle;
+        //! Smooths across vertices that only share a position, e.g. along texture seams
+        bool    weldPositions;
+        //! Set when front faces wind clockwise, which is how VboMesh uploads flipped TriMesh indices
+        bool    clockwise;
+    };
+
+    struct Result
+    {
+        //! One per output vertex
+        std::vector<Vec3f>      normals;
+        //! The input vertex every output vertex copies its other attributes from. The input vertices come first,
+        //! vertices split along creases are appended.
+        std::vector<uint32_t>   vertexSources;
+        //! The triangle list over the output vertices
+        std::vector<uint32_t>   indices;
+    };
+
+    static Result build( const Vec3f* positions, size_t numVertices, const uint32_t* indices, size_t numIndices,
+        const Options& options = Options() );
+};
+
+//! Replaces the normals of \a triMesh, copying texture coordinates and colors to the vertices split along creases
+void generateNormals( TriMesh* triMesh, const NormalGenerator::Options& options = NormalGenerator::Options() );
+
+} } // namespace cinder::dx11
@@ -0,0 +1,147 @@
+// Class MeshSimplifier builds level-of-detail chains with quadric error metrics.
+// Every level is made of half-edge collapses only, so all levels index the vertex buffer of LOD 0
+// and VboMesh::setLodChain can put them in one shared index buffer.
+
+#pragma once
+
+#include <vector>
+
+#include "cinder/Vector.h"
+
+namespace cinder {
+	class TriMesh;
+}
+
+namespace cinder { namespace dx11 {
+
+//! One level of detail, a range of the shared index buffer. \a error is the geometric error relative to the mesh radius.
+struct LodLevel
+{
+    LodLevel():startIndex(0), indexCount(0), error(0){}
+
+    size_t  startIndex;
+    size_t  indexCount;
+    float   error;
+};
+
+//! The indices of every level back to back, LOD 0 first
+struct LodChain
+{
+    std::vector<uint32_t>   indices;
+    std::vector<LodLevel>   levels;
+};
+
+class MeshSimplifier
+{
+public:
+    struct Options
+    {
+        Options():numLods(4), reduction(0.5f), maxError(0.05f), attributeWeight(0.1f), lockBorder(false){}
+
+        //! Number of levels including LOD 0
+        size_t  numLods;
+        //! Target index count of a level relative to the previous one
+        float   reduction;
+        //! Collapses above this error (relative to the mesh radius) are never made
+        float   maxError;
+        //! Penalty for collapsing across different normals / uvs, only used to order collapses. 0 disables it.
+        float   attributeWeight;
+        //! Keeps open borders untouched, e.g. for meshes that tile with neighbours
+        bool    lockBorder;
+    };
+
+    //! \a normals and \a texCoords are optional. They are not copied and have to stay alive while the simplifier is in use.
+    MeshSimplifier( const Vec3f* positions, size_t numVertices, const uint32_t* indices, size_t numIndices,
+        const Vec3f* normals = NULL, const Vec2f* texCoords = NULL, const Options& options = Options() );
+
+    //! Collapses edges of the current level until it has at most \a targetIndexCount indices or the next collapse would cost more than \a maxError.
+    //! Returns the largest error reached so far.
+    float   simplify( size_t targetIndexCount, float maxError );
+
+    //! Builds LOD 0 followed by up to Options::numLods - 1 progressively coarser levels
+    LodChain buildLodChain();
+
+    const std::vector<uint32_t>& getIndices() const { return mIndices; }
+    float   getError() const { return mError; }
+    float   getRadius() const { return mRadius; }
+
+private:
+    enum VertexKind
+    {
+        Kind_Manifold,  // interior vertex, can collapse anywhere
+        Kind_Border,    // on an open border, only slides along it
+        Kind_Seam,      // two wedges that differ in normal / uv, slides along the seam with its twin
+        Kind_Locked,    // never moves
+        Kind_Count
+    };
+
+    struct Quadric
+    {
+        float a00, a11, a22;
+        float a10, a20, a21;
+        float b0, b1, b2;
+        float c;
+        float w;
+    };
+
+    struct Collapse
+    {
+        uint32_t    v0;
+        uint32_t    v1;
+        bool        bidirectional;
+        float       error;  // geometric, used for the error limit
+        float       cost;   // error plus attribute penalty, used for ordering
+    };
+
+    // per vertex list of the triangles around it, stored as (next, prev) corner pairs
+    struct Adjacency
+    {
+        std::vector<uint32_t>   offsets;
+        std::vector<uint32_t>   counts;
+        std::vector<uint32_t>   data;
+    };
+
+    void    buildPositionRemap();
+    void    buildAdjacency( Adjacency& adjacency, bool welded ) const;
+    void    classifyVertices();
+    void    computeQuadrics();
+    void    gatherQuadrics( size_t begin, size_t end );
+    void    pickCollapses( std::vector<Collapse>& collapses ) const;
+    void    rankCollapses( std::vector<Collapse>& collapses ) const;
+    void    rankRange( std::vector<Collapse>* collapses, size_t begin, size_t end ) const;
+    size_t  performCollapses( const std::vector<Collapse>& collapses, size_t triangleGoal, float errorLimit );
+    bool    hasTriangleFlips( uint32_t i0, uint32_t i1 ) const;
+    bool    hasEdge( const Adjacency& adjacency, uint32_t a, uint32_t b ) const;
+    static const uint32_t* getCorners( const Adjacency& adjacency, uint32_t v );
+    float   collapseError( uint32_t i0, uint32_t i1 ) const;
+    float   attributeCost( uint32_t i0, uint32_t i1 ) const;
+
+    static void     addQuadric( Quadric& q, const Quadric& r );
+    static void     planeQuadric( Quadric& q, const Vec3f& n, float d, float w );
+    static float    evalQuadric( const Quadric& q, const Vec3f& p );
+
+    Options                 mOptions;
+    std::vector<Vec3f>      mPositions;     // recentred and scaled to the unit sphere
+    const Vec3f*            mNormals;
+    const Vec2f*            mTexCoords;
+    size_t                  mNumVertices;
+    float                   mRadius;
+    float                   mError;
+
+    std::vector<uint32_t>   mIndices;
+    std::vector<uint32_t>   mRemap;         // first vertex with the same position
+    std::vector<uint32_t>   mWedge;         // next vertex with the same position, forms a ring
+    std::vector<uint32_t>   mLoop;          // open edge i -> mLoop[i] along a border or seam
+    std::vector<uint8_t>    mKind;
+    std::vector<Quadric>    mQuadrics;      // indexed by mRemap
+
+    // scratch state of the current pass
+    Adjacency               mAdjacency;
+    std::vector<uint32_t>   mCollapseRemap;
+    std::vector<uint8_t>    mCollapseLocked;
+};
+
+//! Builds a LOD chain for a TriMesh. \a flipOrder has to match the value given to the VboMesh constructor.
+LodChain buildLodChain( const TriMesh& triMesh, const MeshSimplifier::Options& options = MeshSimplifier::Options(), bool flipOrder = true );
+
+} } // namespace cinder::dx11
@@ -0,0 +1,92 @@
+// Class MorphTargets blends facial and corrective shapes into the vertices of a mesh. A target only stores the
+// vertices it moves, each as its index and 16-bit position and normal deltas scaled per target, so memory grows
+// with what the shapes touch instead of vertex count times target count. Blending adds the deltas of the targets
+// with non-zero weight with SSE and writes whole vertices, so the output can fill a dynamic vertex buffer.
+
+#pragma once
+
+#include <vector>
+#include <string>
+#include <d3d11.h>
+
+#include "cinder/Cinder.h"
+#include "cinder/Vector.h"
+
+namespace cinder { namespace dx11 {
+
+class MorphTargets
+{
+public:
+    //! Where positions and normals are within a vertex, in bytes, -1 when absent
+    struct Format
+    {
+        Format():stride(0), position(-1), normal(-1){}
+
+        UINT    stride;
+        int     position;
+        int     normal;
+
+        //! Finds the R32G32B32_FLOAT POSITION and NORMAL of input slot \a slot, POSITION is required
+        static HRESULT fromElements( const D3D11_INPUT_ELEMENT_DESC* elements, size_t numElements, UINT stride,
+            Format* format, UINT slot = 0 );
+    };
+
+    //! One character to blend, see apply()
+    struct Instance
+    {
+        Instance():weights(NULL), dest(NULL){}
+        Instance(const float* weights, void* dest):weights(weights), dest(dest){}
+
+        //! One per target
+        const float*    weights;
+        void*           dest;
+    };
+
+    //! Adds a target and returns its index. \a positionDeltas and the optional \a normalDeltas hold \a count
+    //! offsets from the base mesh, for the vertices in \a indices or, without indices, for vertices 0 to count - 1.
+    //! Vertices that move less than \a threshold are not stored.
+    size_t  addTarget( const std::string& name, size_t count, const Vec3f* positionDeltas, const Vec3f* normalDeltas = NULL,
+        const uint32_t* indices = NULL, float threshold = 1e-5f );
+
+    size_t              getNumTargets() const { return mTargets.size(); }
+    const std::string&  getName( size_t target ) const { return mTargets[target].name; }
+    //! The number of vertices \a target moves
+    size_t              getNumDeltas( size_t target ) const { return mTargets[target].count; }
+    size_t              getMemorySize() const { return mDeltas.size() * sizeof(Delta); }
+
+    //! Writes \a numVertices vertices of \a base, laid out as \a format, to \a dest with the targets added by
+    //! \a weights, one per target. Normals that move are renormalized. Vertex chunks run on the worker pool.
+    void    apply( const float* weights, const void* base, void* dest, const Format& format, size_t numVertices ) const;
+    //! Blends \a count characters sharing \a base in parallel
+    void    apply( const Instance* instances, size_t count, const void* base, const Format& format, size_t numVertices ) const;
+    //! Blends into \a buffer, a D3D11_USAGE_DYNAMIC vertex buffer, mapped with D3D11_MAP_WRITE_DISCARD
+    HRESULT apply( const float* weights, const void* base, ID3D11Buffer* buffer, const Format& format, size_t numVertices ) const;
+
+private:
+    struct Job;
+
+    // 16 bytes, so a delta is one SSE load
+    struct Delta
+    {
+        uint32_t    index;
+        int16_t     position[3];
+        int16_t     normal[3];
+    };
+
+    struct Target
+    {
+        std::string name;
+        size_t      first;          // into mDeltas, sorted by vertex
+        size_t      count;
+        float       positionScale;
+        float       normalScale;
+    };
+
+    void    applyRange( const float* weights, const uint8_t* base, uint8_t* dest, const Format& format,
+        size_t begin, size_t end ) const;
+
+    std::vector<Target> mTargets;
+    std::vector<Delta>  mDeltas;
+};
+
+} } // namespace cinder::dx11
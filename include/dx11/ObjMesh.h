@@ -0,0 +1,80 @@
+// Class ObjMesh loads Wavefront OBJ files and their MTL material libraries straight into GPU-ready arrays.
+// The file is mapped and cut into chunks at line boundaries that are parsed on the worker pool. Identical
+// position/texcoord/normal tuples become one vertex, and triangles are grouped into one index range per material.
+
+#pragma once
+
+#include <vector>
+#include <string>
+
+#include "cinder/Cinder.h"
+#include "cinder/Color.h"
+
+#include "dx11/VertexTypes.h"
+
+namespace cinder { namespace dx11 {
+
+class VboMesh;
+
+//! The MTL properties of one material. Texture names are relative to the MTL file.
+struct ObjMaterial
+{
+    ObjMaterial():ambient(0, 0, 0), diffuse(1, 1, 1), specular(0, 0, 0), shininess(0), opacity(1), illum(2), bumpScale(1){}
+
+    std::string name;
+    Color       ambient;
+    Color       diffuse;
+    Color       specular;
+    float       shininess;
+    float       opacity;
+    int         illum;
+    std::string diffuseMap;
+    std::string specularMap;
+    std::string normalMap;
+    std::string opacityMap;
+    float       bumpScale;
+};
+
+class ObjMesh
+{
+public:
+    //! The triangles of one material
+    struct Range
+    {
+        size_t  material;
+        size_t  startIndex;
+        size_t  indexCount;
+    };
+
+    ObjMesh():mHasNormals(false), mHasTexCoords(false){}
+
+    //! Parses \a path and the MTL libraries it references, which are looked up next to it.
+    //! Faces with more than three corners are fanned, negative (relative) indices are supported.
+    HRESULT load( const std::string& path );
+
+    const std::vector<VertexPNT>&   getVertices() const { return mVertices; }
+    const std::vector<uint32_t>&    getIndices() const { return mIndices; }
+    //! One range per used material, in material order
+    const std::vector<Range>&       getRanges() const { return mRanges; }
+    const std::vector<ObjMaterial>& getMaterials() const { return mMaterials; }
+
+    //! False when no face referenced a normal, the normals are zero then
+    bool    hasNormals() const { return mHasNormals; }
+    bool    hasTexCoords() const { return mHasTexCoords; }
+
+    //! Uploads the vertices as VertexPNT, with 16-bit indices when they fit
+    HRESULT createVboMesh( VboMesh* vbo ) const;
+
+    //! Appends the materials of the MTL file \a path to \a materials
+    static HRESULT loadMaterials( const std::string& path, std::vector<ObjMaterial>* materials );
+
+private:
+    std::vector<VertexPNT>      mVertices;
+    std::vector<uint32_t>       mIndices;
+    std::vector<Range>          mRanges;
+    std::vector<ObjMaterial>    mMaterials;
+    bool                        mHasNormals;
+    bool                        mHasTexCoords;
+};
+
+} } // namespace cinder::dx11
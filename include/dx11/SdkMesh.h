@@ -1,23 +1,180 @@
 // Class SdkMesh is the only interface to deal with CDXUTSDKmesh
 // SdkMesh::load is used to initialize VboMesh from CDXUTSDKmesh
+// Every mesh, vertex stream and subset of the file is pooled into one vertex buffer and one index buffer,
+// so a whole scene draws with one bind per vertex layout and one DrawIndexed per subset.
+// Files are mapped and patched in place, and the material textures load in parallel with the buffers, either
+// blocking in the constructor or in the background through SdkMesh::loadAsync.
 
 #pragma once
 
+#include <vector>
+#include <string>
+#include <atlbase.h>
+#include <d3d11.h>
+
 #include "cinder/DataSource.h"
+#include "cinder/Thread.h"
+#include "cinder/Color.h"
+#include "cinder/AxisAlignedBox.h"
+#include "cinder/Sphere.h"
+
+#include "dx11/FrameHierarchy.h"
+
+#include <boost/function.hpp>
 
 class CDXUTSDKMesh;
 
 namespace cinder { namespace dx11{
 
+class Shader;
+class MappedFile;
+
+typedef std::shared_ptr<class SdkMesh> SdkMeshRef;
+
 class SdkMesh
 {
 public:
+	//! The vertex format some of the meshes share. Stream \a i of those meshes is read from input slot \a i.
+	struct Layout
+	{
+		Layout():numVertices(0){}
+
+		std::vector<D3D11_INPUT_ELEMENT_DESC>	elements;
+		std::vector<UINT>			strides;
+		//! Byte offset of each stream in the pooled vertex buffer
+		std::vector<UINT>			offsets;
+		size_t						numVertices;
+		CComPtr<ID3D11InputLayout>	inputLayout;
+	};
+
+	struct Mesh
+	{
+		std::string	name;
+		size_t		layout;
+		//! The subsets of a mesh are consecutive in getSubsets()
+		size_t		firstSubset;
+		size_t		numSubsets;
+	};
+
+	//! One SDKMESH_SUBSET as a draw range of the pooled buffers
+	struct Subset
+	{
+		size_t		mesh;
+		size_t		material;
+		D3D11_PRIMITIVE_TOPOLOGY	topology;
+		size_t		startIndex;
+		size_t		indexCount;
+		int			baseVertex;
+		//! Of the vertices the subset draws, in mesh space
+		AxisAlignedBox3f	bounds;
+		Sphere		sphere;
+	};
+
+	//! Texture names are relative to the mesh file
+	struct Material
+	{
+		std::string	name;
+		std::string	diffuseTexture;
+		std::string	normalTexture;
+		std::string	specularTexture;
+		ColorA		diffuse;
+		ColorA		ambient;
+		ColorA		specular;
+		ColorA		emissive;
+		float		power;
+		//! NULL when there is no such texture or it failed to load. Materials naming the same file share a view.
+		CComPtr<ID3D11ShaderResourceView>	diffuseView;
+		CComPtr<ID3D11ShaderResourceView>	normalView;
+		CComPtr<ID3D11ShaderResourceView>	specularView;
+	};
+
+	//! Tracks a mesh loading in the background, see loadAsync()
+	class AsyncLoad
+	{
+	public:
+		AsyncLoad():mReady(false), mResult(E_PENDING){}
+
+		bool		isReady() const;
+		//! Blocks until loading is done
+		void		wait() const;
+		//! Waits, then returns S_OK or why loading failed
+		HRESULT		getResult() const;
+		//! Waits, then returns the mesh, NULL when loading failed
+		SdkMeshRef	getMesh() const;
+
+	private:
+		friend class SdkMesh;
+		void		finish( SdkMeshRef mesh, HRESULT result );
+
+		mutable std::mutex				mMutex;
+		mutable std::condition_variable	mCondition;
+		bool		mReady;
+		HRESULT		mResult;
+		SdkMeshRef	mMesh;
+	};
+	typedef std::shared_ptr<AsyncLoad>	AsyncLoadRef;
+	//! Called on a worker thread with the mesh, NULL on failure, and the result of loading
+	typedef boost::function<void(SdkMeshRef, HRESULT)>	LoadCallback;
+
 	SdkMesh( DataSourceRef dataSource, bool includeUVs = true );
+	//! Loads \a dataSource on the worker pool and returns right away. The file is read and its textures are
+	//! decoded and created on the device in parallel, so a level can start loading many meshes at once.
+	//! \a callback, if any, is called once the mesh is ready or failed to load.
+	static AsyncLoadRef loadAsync( DataSourceRef dataSource, const LoadCallback& callback = LoadCallback() );
+
+	//! Copies the first vertex stream and the indices of mesh \a iMesh into buffers of \a target's own
 	void load( uint32_t iMesh, class VboMesh* target ) const;
 
+	const std::vector<Layout>&		getLayouts() const { return mLayouts; }
+	//! In file order
+	const std::vector<Mesh>&		getMeshes() const { return mMeshes; }
+	//! Grouped by layout, so drawing them in order binds each layout once
+	const std::vector<Subset>&		getSubsets() const { return mSubsets; }
+	const std::vector<Material>&	getMaterials() const { return mMaterials; }
+
+	//! Vertex stream \a stream of mesh \a mesh as stored in the file, for CPU work like Skinner
+	const void*	getVertexData( size_t mesh, size_t stream = 0 ) const;
+	size_t		getNumVertices( size_t mesh ) const;
+	//! The number of frames whose matrices the BLENDINDICES of \a mesh refer to
+	size_t		getNumInfluences( size_t mesh ) const;
+	//! Picks the getNumInfluences() matrices of \a mesh out of \a frameMatrices, one per frame in file order like
+	//! FrameHierarchy::evaluate() writes them, into \a palette
+	void		getInfluences( size_t mesh, const Matrix44f* frameMatrices, Matrix44f* palette ) const;
+
+	//! Loads an .sdkmesh_animation file for the frames of this mesh and rebuilds getFrameHierarchy(),
+	//! compressing the keys with \a options
+	HRESULT loadAnimation( DataSourceRef dataSource, const AnimationClip::Options& options = AnimationClip::Options() );
+	//! The flattened frames, for posing one or many instances, see FrameHierarchy::evaluate()
+	const FrameHierarchy&			getFrameHierarchy() const { return mFrameHierarchy; }
+
+	HRESULT createInputLayout( size_t layout, Shader* shader );
+	//! Binds the pooled buffers with the strides and offsets of \a layout
+	void bind( size_t layout ) const;
+	//! Draws one subset, the layout of its mesh has to be bound
+	void drawSubset( size_t subset ) const;
+	//! Draws every subset, binding each layout once. Materials are up to the caller, see drawSubset().
+	void draw() const;
+
 private:
+	struct Loader;
 
+	SdkMesh();
+	HRESULT loadFile( const std::string& path );
+	HRESULT createPooledBuffers();
+	static void runAsyncLoad( const std::string& path, AsyncLoadRef load, LoadCallback callback );
+
+	// declared first, so it outlives the mesh that points into it
+	std::shared_ptr<MappedFile>		mFile;
 	std::shared_ptr<CDXUTSDKMesh> mSdkMesh;
+
+	std::vector<Layout>		mLayouts;
+	std::vector<Mesh>		mMeshes;
+	std::vector<Subset>		mSubsets;
+	std::vector<Material>	mMaterials;
+	CComPtr<ID3D11Buffer>	mVertexBuffer;
+	CComPtr<ID3D11Buffer>	mIndexBuffer;
+	DXGI_FORMAT				mIBFormat;
+	FrameHierarchy			mFrameHierarchy;
 };
 
-}}
\ No newline at end of file
+}}
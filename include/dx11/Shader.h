@@ -28,13 +28,19 @@ POSSIBILITY OF SUCH DAMAGE.
 #include <fstream>
 #include <exception>
 #include <map>
+#include <vector>
 
 #include "cinder/Vector.h"
 #include "cinder/Color.h"
 #include "cinder/Matrix.h"
 #include "cinder/DataSource.h"
+#include "cinder/Filesystem.h"
+#include "cinder/Thread.h"
 
 #include "dx11.h"
+#include "dx11/ShaderCache.h"
+#include "dx11/ShaderArchive.h"
+#include "dx11/ConstantBuffer.h"
 #include <boost/noncopyable.hpp>
 
 namespace cinder { namespace dx11 {
@@ -50,23 +56,118 @@ enum ShaderType
 class Shader;
 typedef std::shared_ptr<Shader> ShaderRef;
 
+//! Everything a shader is created from, e.g. one shader of a Shader::createBatch() call
+struct ShaderDesc
+{
+    ShaderDesc(){}
+    ShaderDesc(ShaderType type, DataSourceRef dataSrc, const std::string& entryName,
+        const std::vector<ShaderMacro>& macros = std::vector<ShaderMacro>())
+        :type(type), dataSrc(dataSrc), entryName(entryName), macros(macros){}
+
+    ShaderType      type;
+    DataSourceRef   dataSrc;
+    std::string     entryName;
+    std::vector<ShaderMacro>    macros;
+};
+
 class Shader : private boost::noncopyable
 {
 public: 
     static ShaderRef create(ShaderType type, DataSourceRef dataSrc, const std::string& entryName);
+    static ShaderRef create(const ShaderDesc& desc);
+    //! Creates the variant of \a macros from the precompiled bytecode in \a archive, without copying it. The shader
+    //! keeps the archive mapped. \a name is the name the archive builder was given for the source file.
+    static ShaderRef create(ShaderArchiveRef archive, ShaderType type, const std::string& name, const std::string& entryName,
+        const std::vector<ShaderMacro>& macros = std::vector<ShaderMacro>());
+    //! Returns at once and compiles on the worker pool. Until the shader is ready, bind() binds \a fallback,
+    //! or unbinds the stage when there is none. D3DCompile and the device are free-threaded, so any number of
+    //! shaders may be in flight.
+    static ShaderRef createAsync(ShaderType type, DataSourceRef dataSrc, const std::string& entryName,
+        ShaderRef fallback = ShaderRef());
+    static ShaderRef createAsync(const ShaderDesc& desc, ShaderRef fallback = ShaderRef());
+    //! Compiles all of \a descs on the worker pool, with the calling thread helping, and returns when all
+    //! are done. The shaders come back in the order of \a descs, getResult() tells which of them failed.
+    static std::vector<ShaderRef> createBatch(const std::vector<ShaderDesc>& descs);
 
     HRESULT setup(DataSourceRef dataSrc, const std::string& entryName);
+    //! Compiles with \a macros defined, they are kept for hot reloads
+    HRESULT setup(DataSourceRef dataSrc, const std::string& entryName, const std::vector<ShaderMacro>& macros);
+    //! Fails when \a archive has no such variant for the profile of the shader
+    HRESULT setup(ShaderArchiveRef archive, const std::string& name, const std::string& entryName,
+        const std::vector<ShaderMacro>& macros);
     void    bind();
     void    unbind();
     void    setConstBuffer(uint32_t slot, ID3D11Buffer* buffer);
 
+    //! Writes variable \a name of whichever cbuffer declares it into the CPU copy of that cbuffer. bind() uploads
+    //! the cbuffers that changed and binds every cbuffer that was ever set, the others are left to setConstBuffer().
+    //! False when no cbuffer declares \a name or \a size is larger than the variable.
+    bool    setConstant(const std::string& name, const void* data, size_t size);
+    template <typename T>
+    bool    setConstant(const std::string& name, const T& value) { return setConstant(name, &value, sizeof(T)); }
+    //! NULL when the shader declares no cbuffer \a name
+    ConstantBufferRef   getConstantBuffer(const std::string& name) const;
+    //! Uploads and binds like bind() does, for constants set while the shader stays bound
+    void    commitConstants();
+
+    //! False while a createAsync() compilation is still running
+    bool    isReady() const;
+    //! Blocks until the shader is ready, running queued WorkerPool tasks meanwhile, so pool tasks may call it
+    void    wait() const;
+    //! The result of the last setup(), after waiting for it
+    HRESULT getResult() const;
+
+    //! The file the shader was compiled from, empty when its source wasn't a file
+    fs::path            getSourcePath() const;
+    //! The includes of the compile the shader currently runs
+    ShaderDependencies  getDependencies() const;
+
 protected:
-    virtual HRESULT doCreateShader(ID3DBlob* blob, ID3D11DeviceChild** pHandle) = 0;
+    Shader();
+
+    virtual HRESULT doCreateShader(const void* pBytecode, size_t bytecodeLength, ID3D11DeviceChild** pHandle) = 0;
     virtual void doBind(ID3D11DeviceChild* handle) = 0;
     virtual void doSetConstBuffer(uint32_t slot, ID3D11Buffer* buffer) = 0;
     virtual const char* getProfileName() const = 0;
 
     CComPtr<ID3D11DeviceChild> mHandle;
+    CComPtr<ID3DBlob>          mBytecode;
+    //! Where the bytecode is when the shader came from an archive instead
+    ShaderArchiveRef           mArchive;
+    const void*                mArchiveBytecode;
+    size_t                     mArchiveBytecodeLength;
+
+private:
+    friend class ShaderReloader;
+
+    HRESULT build(const Buffer& source, const std::string& entryName, const std::vector<ShaderMacro>& macros,
+        ID3D11DeviceChild** pHandle, ID3DBlob** ppBytecode, ShaderDependencies* dependencies, ShaderConstants* constants);
+    void    runAsync(ShaderDesc desc);
+    //! Compiles the source file again for swapPending(), the current shader stays on failure. Any thread.
+    HRESULT recompile();
+    //! Makes the last successful recompile() current, on the thread that binds. False when there was none.
+    bool    swapPending();
+    //! Counts the compiles that were made current, so the reloader knows when the dependencies changed
+    uint32_t getGeneration() const;
+
+    mutable std::mutex              mMutex;
+    mutable std::condition_variable mReadyCond;
+    bool        mReady;
+    HRESULT     mResult;
+    //! Only touched by the thread that binds, the worker leaves it alone
+    bool        mPending;
+    ShaderRef   mFallback;
+
+    fs::path            mSourcePath;
+    std::string         mEntryName;
+    std::vector<ShaderMacro>    mMacros;
+    ShaderDependencies  mDependencies;
+    ShaderConstants     mConstants;
+    uint32_t            mGeneration;
+    CComPtr<ID3D11DeviceChild>  mReloadedHandle;
+    CComPtr<ID3DBlob>           mReloadedBytecode;
+    ShaderDependencies          mReloadedDependencies;
+    ShaderConstants             mReloadedConstants;
 };
 
 // VertexShader is exposed for the use of VboMesh::createInputLayout
@@ -77,12 +178,9 @@ public:
     size_t getBytecodeLength() const;
 
 protected:
-    HRESULT doCreateShader(ID3DBlob* blob, ID3D11DeviceChild** pHandle);
+    HRESULT doCreateShader(const void* pBytecode, size_t bytecodeLength, ID3D11DeviceChild** pHandle);
     void doBind(ID3D11DeviceChild* handle);
     void doSetConstBuffer(uint32_t slot, ID3D11Buffer* buffer);
     const char* getProfileName() const;
-
-private:
-    CComPtr<ID3DBlob> mShaderBytecode;
 };
 } } // namespace cinder::dx11
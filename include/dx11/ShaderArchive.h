@@ -0,0 +1,122 @@
+// Class ShaderArchive reads the packed shader archives ShaderArchiveBuilder writes: one file holding every
+// precompiled shader variant a program ships, so loading them costs one open instead of one per variant. The file
+// is mapped and shaders are created straight from pointers into the mapping. The index is sorted by name, entry
+// point, profile and variant hash for a binary search, and every blob starts 16-byte aligned.
+//
+// Layout, little-endian:
+//   Header                                 32 bytes
+//   Entry[numEntries]                      40 bytes each, sorted
+//   string table                           NUL terminated names, entry points and profiles
+//   blobs                                  16-byte aligned
+
+#pragma once
+
+#include <vector>
+#include <string>
+
+#include "cinder/Cinder.h"
+
+#include "dx11/ShaderCache.h"
+
+#include <boost/noncopyable.hpp>
+
+namespace cinder { namespace dx11 {
+
+class ShaderArchive;
+class MappedFile;
+typedef std::shared_ptr<ShaderArchive> ShaderArchiveRef;
+
+class ShaderArchive : private boost::noncopyable
+{
+public:
+    static const uint32_t kMagic = 0x41535844; // "DXSA"
+    static const uint32_t kVersion = 1;
+    static const size_t   kBlobAlignment = 16;
+
+    struct Header
+    {
+        uint32_t    magic;
+        uint32_t    version;
+        uint32_t    numEntries;
+        uint32_t    stringsOffset;
+        uint32_t    stringsSize;
+        uint32_t    reserved;
+        uint64_t    fileSize;
+    };
+
+    struct Entry
+    {
+        //! Offsets into the string table
+        uint32_t    name;
+        uint32_t    entry;
+        uint32_t    profile;
+        uint32_t    size;
+        uint64_t    variantHash;
+        uint64_t    offset;
+        //! Of the blob, checked by verify()
+        uint64_t    checksum;
+    };
+
+    //! Maps \a path and checks that the header and the index fit the file, NULL when they don't
+    static ShaderArchiveRef create(const std::string& path);
+    ~ShaderArchive();
+
+    //! The bytecode of a variant, pointing into the mapping, which lives as long as the archive
+    bool    find(const std::string& name, const std::string& entry, const std::string& profile, uint64_t variantHash,
+        const void** ppBytecode, size_t* pSize) const;
+    bool    find(const std::string& name, const std::string& entry, const std::string& profile,
+        const std::vector<ShaderMacro>& macros, const void** ppBytecode, size_t* pSize) const;
+
+    //! Checks the whole archive: the string table, the order of the index, the alignment and bounds of every
+    //! blob and its checksum, and that every blob is DXBC bytecode. On failure \a error says what's wrong.
+    bool    verify(std::string* error) const;
+
+    size_t          getNumEntries() const { return mHeader->numEntries; }
+    const Entry&    getEntry(size_t index) const { return mEntries[index]; }
+    //! A string of the string table, e.g. getString(getEntry(i).name)
+    const char*     getString(uint32_t offset) const { return mStrings + offset; }
+    const void*     getBlob(const Entry& entry) const { return mData + entry.offset; }
+
+    //! The variant hash of a macro set. The order of \a macros doesn't matter.
+    static uint64_t hashMacros(const std::vector<ShaderMacro>& macros);
+    //! The blob checksum of the index entries
+    static uint64_t checksum(const void* data, size_t size);
+
+private:
+    ShaderArchive();
+
+    std::shared_ptr<MappedFile> mFile;
+    const uint8_t*  mData;
+    size_t          mSize;
+    const Header*   mHeader;
+    const Entry*    mEntries;
+    const char*     mStrings;
+};
+
+//! Builds an archive in memory and writes it out in one go
+class ShaderArchiveWriter
+{
+public:
+    //! Copies \a size bytes of \a bytecode. A second add() of the same key replaces the first.
+    void    add(const std::string& name, const std::string& entry, const std::string& profile,
+        const std::vector<ShaderMacro>& macros, const void* bytecode, size_t size);
+
+    //! Writes a temporary file next to \a path and renames it over \a path, false on failure
+    bool    write(const std::string& path) const;
+
+    size_t  getNumEntries() const { return mEntries.size(); }
+
+private:
+    struct Item
+    {
+        std::string             name;
+        std::string             entry;
+        std::string             profile;
+        uint64_t                variantHash;
+        std::vector<uint8_t>    bytecode;
+    };
+
+    std::vector<Item>   mEntries;
+};
+
+} } // namespace cinder::dx11
@@ -0,0 +1,141 @@
+// Class ShaderCache keeps compiled shader bytecode on disk so later launches skip the compiler. An entry is found
+// by a hash of the source, entry point, profile, compile flags and compiler version, and only used while every
+// file the source included still hashes the same. Entries are written to a temporary file and renamed into place,
+// so a crash or a second process never leaves a torn entry. The compiler and the include reader are interfaces,
+// which keeps the cache free of D3D and testable with a stub compiler. Entries keep the include graph of their
+// compile, so a hit reports the same dependencies as the compile did.
+
+#pragma once
+
+#include <vector>
+#include <string>
+
+#include "cinder/Cinder.h"
+#include "cinder/Thread.h"
+
+#include <boost/unordered_map.hpp>
+
+namespace cinder { namespace dx11 {
+
+//! A preprocessor define the shader is compiled with
+struct ShaderMacro
+{
+    ShaderMacro(){}
+    ShaderMacro(const std::string& name, const std::string& definition = "1"):name(name), definition(definition){}
+
+    std::string name;
+    std::string definition;
+};
+
+//! Everything that decides the bytecode of a shader, besides its includes
+struct ShaderRequest
+{
+    ShaderRequest():source(NULL), sourceSize(0), flags(0){}
+
+    const void*     source;
+    size_t          sourceSize;
+    std::string     entry;
+    //! e.g. "vs_4_0", see Shader::getProfileName()
+    std::string     profile;
+    uint32_t        flags;
+    std::vector<ShaderMacro>    macros;
+};
+
+//! Which file included which during one compile
+struct ShaderDependencies
+{
+    struct Edge
+    {
+        //! Empty when the source being compiled did the including
+        std::string includer;
+        std::string included;
+    };
+
+    std::vector<Edge>   edges;
+
+    //! Every file the compile read, each once, in the order they were first read
+    std::vector<std::string>    getFiles() const;
+    //! The files \a includer includes directly, pass "" for the source itself
+    std::vector<std::string>    getIncludes( const std::string& includer ) const;
+    //! True when the compile read \a name, directly or through other includes
+    bool    dependsOn( const std::string& name ) const;
+    void    clear() { edges.clear(); }
+};
+
+class ShaderIncludes
+{
+public:
+    //! Never changes once returned, a file that changed comes back as new contents
+    typedef std::shared_ptr<const std::string> Contents;
+
+    virtual ~ShaderIncludes() {}
+
+    //! The file a shader includes as \a name, NULL when it doesn't exist. Safe to call from many threads at once.
+    virtual Contents    open( const std::string& name ) = 0;
+};
+
+class ShaderCompiler
+{
+public:
+    virtual ~ShaderCompiler() {}
+
+    //! Compiles \a request, reading its includes through \a includes. On failure \a errors says why.
+    //! \a dependencies, when not NULL, receives the include graph.
+    virtual bool        compile( const ShaderRequest& request, ShaderIncludes* includes, std::vector<uint8_t>* bytecode,
+        std::string* errors, ShaderDependencies* dependencies ) = 0;
+    //! Part of every key, so bytecode of another compiler version is never reused
+    virtual uint32_t    getVersion() const = 0;
+};
+
+class ShaderCache
+{
+public:
+    struct Stats
+    {
+        Stats():hits(0), misses(0), writeFailures(0){}
+
+        size_t  hits;
+        //! Requests that ran the compiler, because there was no entry or an include changed
+        size_t  misses;
+        size_t  writeFailures;
+    };
+
+    //! Entries go to \a directory, which has to exist. \a compiler and \a includes have to outlive the cache.
+    ShaderCache( const std::string& directory, ShaderCompiler* compiler, ShaderIncludes* includes );
+
+    //! Returns the bytecode of \a request from its entry, or compiles it and writes the entry. Safe to call from
+    //! many threads at once.
+    bool    get( const ShaderRequest& request, std::vector<uint8_t>* bytecode, std::string* errors,
+        ShaderDependencies* dependencies = NULL );
+
+    Stats   getStats() const;
+    const std::string&  getDirectory() const { return mDirectory; }
+
+    //! The file the entry of \a request goes to
+    std::string         getPath( const ShaderRequest& request ) const;
+
+private:
+    // the last contents of an include seen and their hash, which stays valid while open() returns the same contents
+    struct HashedInclude
+    {
+        ShaderIncludes::Contents    contents;
+        uint64_t                    hash;
+    };
+    class RecordingIncludes;
+
+    uint64_t    hashInclude( const std::string& name, const ShaderIncludes::Contents& contents );
+    bool    load( const std::string& path, std::vector<uint8_t>* bytecode, ShaderDependencies* dependencies );
+    bool    store( const std::string& path, const ShaderDependencies& dependencies, const RecordingIncludes& includes,
+        const std::vector<uint8_t>& bytecode );
+
+    std::string         mDirectory;
+    ShaderCompiler*     mCompiler;
+    ShaderIncludes*     mIncludes;
+
+    mutable std::mutex  mMutex;
+    Stats               mStats;
+    uint32_t            mNextTemp;
+    boost::unordered_map<std::string, HashedInclude>    mHashes;
+};
+
+} } // namespace cinder::dx11
@@ -0,0 +1,63 @@
+// Class ShaderPermutations builds the variants of one shader that differ in which feature keywords are defined,
+// so a pixel shader branches at compile time instead of at run time. A variant is asked for by a bitmask over the
+// keywords and compiled the first time it is asked for, which keeps startup from paying for every combination.
+// prewarm() compiles the variants a scene is known to need on the worker pool ahead of their first use.
+
+#pragma once
+
+#include <vector>
+#include <string>
+
+#include "cinder/Cinder.h"
+#include "cinder/Thread.h"
+
+#include "dx11/Shader.h"
+
+#include <boost/noncopyable.hpp>
+#include <boost/unordered_map.hpp>
+
+namespace cinder { namespace dx11 {
+
+class ShaderPermutations;
+typedef std::shared_ptr<ShaderPermutations> ShaderPermutationsRef;
+
+class ShaderPermutations : private boost::noncopyable
+{
+public:
+    //! Bit i of a variant mask defines \a keywords[i], at most 32 of them. A keyword is defined as 1, or as what
+    //! follows its '=', so "NUM_LIGHTS=4" and "NUM_LIGHTS=8" can be two exclusive choices of the same shader.
+    static ShaderPermutationsRef create(ShaderType type, DataSourceRef dataSrc, const std::string& entryName,
+        const std::vector<std::string>& keywords);
+
+    //! The bit of \a keyword, 0 when the shader doesn't declare it
+    uint32_t    getMask(const std::string& keyword) const;
+    const std::vector<std::string>& getKeywords() const { return mKeywords; }
+    //! The macros the variant of \a mask is compiled with
+    std::vector<ShaderMacro>        getMacros(uint32_t mask) const;
+
+    //! The variant of \a mask, compiled on the first request. Bits past the declared keywords are ignored.
+    //! Waits when prewarm() is still compiling the variant. Safe to call from many threads at once.
+    ShaderRef   get(uint32_t mask);
+    //! Starts compiling the variants of \a masks on the worker pool and returns at once
+    void        prewarm(const std::vector<uint32_t>& masks);
+
+    //! The variants compiled or compiling so far
+    size_t      getNumVariants() const;
+
+private:
+    ShaderPermutations(ShaderType type, DataSourceRef dataSrc, const std::string& entryName,
+        const std::vector<std::string>& keywords);
+
+    uint32_t    getValidMask(uint32_t mask) const;
+
+    ShaderType                  mType;
+    DataSourceRef               mDataSrc;
+    std::string                 mEntryName;
+    std::vector<std::string>    mKeywords;
+    std::vector<ShaderMacro>    mKeywordMacros;
+
+    mutable std::mutex          mMutex;
+    boost::unordered_map<uint32_t, ShaderRef>   mVariants;
+};
+
+} } // namespace cinder::dx11
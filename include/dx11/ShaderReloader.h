@@ -0,0 +1,97 @@
+// Class ShaderReloader recompiles shaders while the app runs. It watches the source file of every shader created
+// from a file and every include that shader read, recompiles on a background thread the shaders whose sources or
+// includes changed, and swaps the new shaders into the existing Shader objects at the start of the next frame.
+// A shader that fails to compile keeps running the last version that compiled.
+
+#pragma once
+
+#include <vector>
+#include <string>
+
+#include "cinder/Cinder.h"
+#include "cinder/Filesystem.h"
+#include "cinder/Thread.h"
+#include "cinder/Timer.h"
+
+#include "dx11/Shader.h"
+#include "dx11/FileWatcher.h"
+
+#include <boost/noncopyable.hpp>
+
+namespace cinder { namespace dx11 {
+
+class ShaderReloader : private boost::noncopyable
+{
+public:
+    struct Stats
+    {
+        Stats():reloads(0), failures(0), lastLatency(0), averageLatency(0), maxLatency(0){}
+
+        size_t  reloads;
+        //! Changes that didn't compile, the shaders kept their previous version
+        size_t  failures;
+        //! Seconds from noticing a change to the new shader being swapped in
+        double  lastLatency;
+        double  averageLatency;
+        double  maxLatency;
+    };
+
+    static ShaderReloader& get();
+    ~ShaderReloader();
+
+    //! Starts watching the shaders. False when files can't be watched on this platform.
+    bool    start();
+    void    stop();
+    bool    isRunning() const;
+
+    //! Tracks \a shader, which Shader's factories do for every shader they create. The reloader doesn't keep
+    //! shaders alive, a shader the app lets go is dropped from the watch list.
+    void    add(const ShaderRef& shader);
+
+    //! Swaps in the shaders recompiled since the last call, and returns how many. RendererDX11 calls it at
+    //! the start of every frame, so a shader never changes in the middle of one.
+    size_t  update();
+
+    Stats   getStats() const;
+
+private:
+    typedef std::weak_ptr<Shader> ShaderWeakRef;
+
+    struct Tracked
+    {
+        ShaderWeakRef           shader;
+        //! Only touched by the reloader thread
+        uint32_t                generation;
+        std::vector<fs::path>   files;
+    };
+    typedef std::shared_ptr<Tracked> TrackedRef;
+
+    struct Reloaded
+    {
+        ShaderWeakRef   shader;
+        //! mTimer seconds when the change was noticed
+        double      noticed;
+    };
+
+    ShaderReloader();
+
+    void    threadLoop();
+    //! Drops the shaders that were released, with mMutex held
+    void    pruneReleased();
+    void    refreshWatches(const std::vector<TrackedRef>& tracked);
+    void    recompile(const std::vector<ShaderRef>* affected, std::vector<HRESULT>* results, size_t begin, size_t end);
+    bool    shouldQuit() const;
+
+    FileWatcherRef                  mWatcher;
+    std::shared_ptr<std::thread>    mThread;
+    Timer                           mTimer;
+
+    mutable std::mutex          mMutex;
+    bool                        mQuit;
+    std::vector<TrackedRef>     mTracked;
+    std::vector<Reloaded>       mReloaded;
+    std::vector<fs::path>       mFailed;
+    Stats                       mStats;
+};
+
+} } // namespace cinder::dx11
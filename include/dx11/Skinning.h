@@ -0,0 +1,48 @@
+// Class Skinner deforms the positions, normals and tangents of skinned vertices on the CPU, for picking, headless
+// tests or machines where the vertex shader is the bottleneck. Every vertex blends the palette matrices of its
+// four influences with SSE, and chunks of vertices are spread over the worker pool. The output keeps the vertex
+// layout of the input, so it can go straight into a dynamic vertex buffer.
+
+#pragma once
+
+#include <d3d11.h>
+
+#include "cinder/Cinder.h"
+#include "cinder/Matrix.h"
+
+namespace cinder { namespace dx11 {
+
+class Skinner
+{
+public:
+    //! Where the attributes are within a vertex, in bytes, -1 when absent
+    struct Format
+    {
+        Format():stride(0), position(-1), normal(-1), tangent(-1), weights(-1), indices(-1), weightFormat(DXGI_FORMAT_UNKNOWN){}
+
+        UINT        stride;
+        int         position;
+        int         normal;
+        int         tangent;
+        int         weights;
+        int         indices;
+        //! R32G32B32A32_FLOAT, R8G8B8A8_UNORM, or R32G32B32_FLOAT with the fourth weight making the sum 1
+        DXGI_FORMAT weightFormat;
+
+        //! Finds the attributes of input slot \a slot by semantic. POSITION, BLENDWEIGHT and BLENDINDICES are
+        //! required; positions, normals and tangents have to be R32G32B32_FLOAT and indices four bytes.
+        static HRESULT fromElements( const D3D11_INPUT_ELEMENT_DESC* elements, size_t numElements, UINT stride,
+            Format* format, UINT slot = 0 );
+    };
+
+    //! Skins \a numVertices vertices of \a source into \a dest, both laid out as \a format. Attributes that
+    //! aren't skinned are copied. The blend indices of a vertex refer to the \a paletteSize matrices of \a palette,
+    //! see SdkMesh::getInfluences(). Normals and tangents are renormalized. An empty palette copies \a source as is.
+    static void     skin( const Format& format, const void* source, void* dest, size_t numVertices,
+        const Matrix44f* palette, size_t paletteSize );
+    //! Skins into \a buffer, a D3D11_USAGE_DYNAMIC vertex buffer, mapped with D3D11_MAP_WRITE_DISCARD
+    static HRESULT  skin( const Format& format, const void* source, ID3D11Buffer* buffer, size_t numVertices,
+        const Matrix44f* palette, size_t paletteSize );
+};
+
+} } // namespace cinder::dx11
@@ -0,0 +1,100 @@
+// Class StaticBatcher bakes many placed copies of small static meshes into one shared vertex and index buffer.
+// Positions, normals and tangents are pre-transformed on the worker pool, and instances are grouped by
+// material key and spatial cell so each group draws as a single index range.
+
+#pragma once
+
+#include <vector>
+#include <d3d11.h>
+
+#include "cinder/Cinder.h"
+#include "cinder/Matrix.h"
+#include "cinder/AxisAlignedBox.h"
+
+namespace cinder { namespace dx11 {
+
+class VboMesh;
+
+class StaticBatcher
+{
+public:
+    //! One merged draw: every instance of \a materialKey in one cell
+    struct Range
+    {
+        uint32_t            materialKey;
+        size_t              startIndex;
+        size_t              indexCount;
+        size_t              numInstances;
+        AxisAlignedBox3f    bounds;
+    };
+
+    struct Result
+    {
+        Result():numVertices(0){}
+
+        std::vector<uint8_t>    vertices;
+        size_t                  numVertices;
+        std::vector<uint32_t>   indices;
+        //! Sorted by material key, so material changes are minimal when drawn in order
+        std::vector<Range>      ranges;
+    };
+
+    //! Every source shares this vertex layout, use one batcher per vertex format.
+    //! POSITION, NORMAL, TANGENT and BINORMAL elements stored as float3 or float4 are transformed, the rest is copied.
+    StaticBatcher( const D3D11_INPUT_ELEMENT_DESC* pElementDescs, UINT NumElements, UINT VertexStride );
+
+    //! Copies a mesh into the batcher and returns the id addInstance() takes
+    size_t  addSource( const void* pVertices, size_t numVertices, const uint32_t* pIndices, size_t numIndices );
+    //! Reads \a vbo back from the GPU, its layout has to match the batcher's
+    HRESULT addSource( const VboMesh& vbo, size_t* pSourceId );
+
+    void    addInstance( size_t sourceId, const Matrix44f& world, uint32_t materialKey );
+
+    size_t  getNumInstances() const { return mInstances.size(); }
+
+    //! Bakes every instance. Instances sharing a material whose bounds centers fall in the same cube of \a cellSize merge into one range.
+    Result  build( float cellSize ) const;
+
+    //! Uploads \a result into \a vbo with this batcher's layout, using 16-bit indices when they fit
+    HRESULT createVboMesh( const Result& result, VboMesh* vbo ) const;
+
+private:
+    struct Source
+    {
+        std::vector<uint8_t>    vertices;
+        std::vector<uint32_t>   indices;
+        size_t                  numVertices;
+        AxisAlignedBox3f        bounds;
+    };
+
+    struct Instance
+    {
+        size_t      source;
+        Matrix44f   world;
+        uint32_t    materialKey;
+        int         cell[3];
+        Vec3f       boundsMin;
+        Vec3f       boundsMax;
+        size_t      baseVertex;
+        size_t      baseIndex;
+    };
+
+    struct InstanceLess
+    {
+        bool operator()( const Instance& a, const Instance& b ) const;
+    };
+
+    void    bakeRange( Result* result, const std::vector<Instance>* instances, size_t begin, size_t end ) const;
+    void    bakeInstance( Result* result, const Instance& instance ) const;
+
+    std::vector<D3D11_INPUT_ELEMENT_DESC>   mElements;
+    UINT                                    mVertexStride;
+    std::vector<UINT>                       mPointOffsets;      // positions, xyz of float3 or float4
+    std::vector<UINT>                       mNormalOffsets;     // float3 normals, use the inverse transpose
+    std::vector<UINT>                       mVectorOffsets;     // float3 or float4 tangents, w flips with mirroring
+    std::vector<bool>                       mVectorHasW;
+    std::vector<std::shared_ptr<Source> >   mSources;
+    std::vector<Instance>                   mInstances;
+};
+
+} } // namespace cinder::dx11
@@ -1,6 +1,9 @@
 #pragma once
 
 #include "dx11/dx11.h"
+#include "cinder/AxisAlignedBox.h"
+#include "dx11/MeshSimplifier.h"
+#include "dx11/MeshCluster.h"
 
 namespace cinder {
 	class TriMesh;
@@ -32,7 +35,7 @@ class VboMesh
 private:
 	struct Obj 
     {
-		Obj():mVertexStride(0), mNumIndices(0), mNumVertices(0), mIBFormat(DXGI_FORMAT_UNKNOWN){}
+		Obj():mVertexStride(0), mNumIndices(0), mNumVertices(0), mIBFormat(DXGI_FORMAT_UNKNOWN), mAttributeStride(0), mInstanceStride(0), mInstanceCapacity(0), mInstanceSlot(1), mNumAdjacencyIndices(0), mAdjacencyIBFormat(DXGI_FORMAT_UNKNOWN){}
 
 		CComPtr<ID3D11InputLayout>  mInputLayout;
 		CComPtr<ID3D11Buffer>       mVertexBuffer;
@@ -42,6 +45,19 @@ private:
 		size_t			mNumVertices;
         std::vector<D3D11_INPUT_ELEMENT_DESC> InputElementDescs;
 		DXGI_FORMAT		mIBFormat;
+		std::vector<LodLevel>	mLods;
+		std::vector<MeshCluster>	mClusters;
+		CComPtr<ID3D11InputLayout>  mDepthInputLayout;
+		CComPtr<ID3D11Buffer>       mAttributeBuffer;   // slot 1, everything but the position when it is split off
+		size_t			mAttributeStride;
+		CComPtr<ID3D11Buffer>       mInstanceBuffer;
+		size_t			mInstanceStride;
+		size_t			mInstanceCapacity;
+		UINT			mInstanceSlot;
+		AxisAlignedBox3f	mBounds;
+		CComPtr<ID3D11Buffer>       mAdjacencyIndexBuffer;
+		size_t			mNumAdjacencyIndices;
+		DXGI_FORMAT		mAdjacencyIBFormat;
 	};
 
 	std::shared_ptr<Obj>	mObj;
@@ -49,23 +65,45 @@ private:
 public:
 	VboMesh(){}
 
-	VboMesh( const TriMesh& triMesh, bool normalMap = false, bool flipOrder = true );
+	//! \a splitPositions puts positions in their own stream, see createVertexBuffer()
+	VboMesh( const TriMesh& triMesh, bool normalMap = false, bool flipOrder = true, bool splitPositions = false );
 	VboMesh( const SdkMesh& sdkMesh, bool normalMap = false, bool flipOrder = true );
 
 	HRESULT createInputLayout(dx11::Shader* shader);
+	//! Creates the layout bindDepthOnly() uses, holding the POSITION element and the instance elements only
+	HRESULT createDepthInputLayout(dx11::Shader* shader);
 
 	size_t	getNumIndices() const { return mObj->mNumIndices; }
 	size_t	getNumVertices() const { return mObj->mNumVertices; }
+	size_t	getVertexStride() const { return mObj->mVertexStride; }
+	const std::vector<D3D11_INPUT_ELEMENT_DESC>& getInputElementDescs() const { return mObj->InputElementDescs; }
 
 	template <typename VertexType>
-	HRESULT createVertexBuffer(const VertexType* pVertices, UINT nVertices)
+	HRESULT createVertexBuffer(const VertexType* pVertices, UINT nVertices, bool splitPositions = false)
 	{
 		return createVertexBuffer(pVertices, nVertices,
 			VertexType::InputElements,  VertexType::InputElementCount,
-			sizeof(VertexType));
+			sizeof(VertexType), splitPositions);
 	}
 
-	HRESULT createVertexBuffer(const void* pVertices, UINT nVertices, const D3D11_INPUT_ELEMENT_DESC* pElementDescs, UINT NumInputElements, UINT VertexSize);
+	//! With \a splitPositions a leading POSITION element goes to a buffer of its own in slot 0 and the other elements to slot 1,
+	//! so depth and shadow passes fetch positions only
+	HRESULT createVertexBuffer(const void* pVertices, UINT nVertices, const D3D11_INPUT_ELEMENT_DESC* pElementDescs, UINT NumInputElements, UINT VertexSize, bool splitPositions = false);
+
+	bool	hasSplitPositions() const { return mObj->mAttributeBuffer != NULL; }
+
+	//! Bounds of the POSITION element, empty when the layout has no float3 position
+	const AxisAlignedBox3f& getBounds() const { return mObj->mBounds; }
+
+	//! Writes the vertex streams, element table, indices, bounds, LODs and clusters to a MeshCacheFile.
+	//! The buffers are read back from the GPU, so this is meant for an offline or first-run step.
+	//! \a compress stores the streams and indices with the MeshCodec, loadCache() decodes them transparently.
+	HRESULT writeCache(const std::string& path, bool compress = false) const;
+	//! Creates the buffers straight from a mapped MeshCacheFile written by writeCache()
+	HRESULT loadCache(const std::string& path);
+
+	//! Reads the interleaved vertices and the indices dx11::draw() renders back from the GPU. Fails for split positions.
+	HRESULT readBack(std::vector<uint8_t>* vertices, std::vector<uint32_t>* indices) const;
 
 	template <typename IndexType>
 	HRESULT createIndexBuffer(const IndexType* pIndices, UINT nIndices)
@@ -79,7 +117,50 @@ public:
 		return dx11::getDevice()->CreateBuffer( &bd, &InitData, &mObj->mIndexBuffer );
 	}
 
+	//! Creates a dynamic buffer for up to \a capacity instances, read from input slot 1 with D3D11_INPUT_PER_INSTANCE_DATA.
+	//! Call it after createVertexBuffer() and before createInputLayout(), the instance elements become part of the layout.
+	template <typename InstanceType>
+	HRESULT createInstanceBuffer(UINT capacity)
+	{
+		return createInstanceBuffer(InstanceType::InputElements, InstanceType::InputElementCount,
+			sizeof(InstanceType), capacity);
+	}
+
+	HRESULT createInstanceBuffer(const D3D11_INPUT_ELEMENT_DESC* pElementDescs, UINT NumInputElements, UINT InstanceSize, UINT capacity);
+
+	//! Replaces the contents of the instance buffer with \a nInstances instances, at most getInstanceCapacity()
+	HRESULT updateInstanceBuffer(const void* pInstances, UINT nInstances) const;
+
+	size_t	getInstanceStride() const { return mObj->mInstanceStride; }
+	size_t	getInstanceCapacity() const { return mObj->mInstanceCapacity; }
+
+	//! Replaces the index buffer with all levels of \a chain, which share this mesh's vertex buffer. LOD 0 is what dx11::draw() renders.
+	HRESULT setLodChain(const LodChain& chain);
+
+	size_t	getNumLods() const { return mObj->mLods.size(); }
+	const LodLevel& getLod(size_t lod) const { return mObj->mLods[lod]; }
+	//! Returns the coarsest level whose error stays below \a pixelError when the bounding sphere of the mesh is \a screenSize pixels across
+	size_t	selectLod(float screenSize, float pixelError = 1.0f) const;
+
+	//! Replaces the index buffer with the cluster ordered indices of \a clusters, see ClusterCuller for picking the visible ones. Drops the LOD chain.
+	HRESULT setClusters(const ClusterMesh& clusters);
+
+	const std::vector<MeshCluster>& getClusters() const { return mObj->mClusters; }
+
+	//! Builds a D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST_ADJ index buffer next to the regular one, for geometry shaders that look at
+	//! neighbouring triangles. Edges are matched by position, so it works across normal and texture seams. Replacing the indices drops it.
+	HRESULT createAdjacency();
+
+	size_t	getNumAdjacencyIndices() const { return mObj->mNumAdjacencyIndices; }
+
 	void bind(D3D_PRIMITIVE_TOPOLOGY Topology = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST) const;
+	//! Binds the position stream, the instance stream if any and the depth input layout
+	void bindDepthOnly(D3D_PRIMITIVE_TOPOLOGY Topology = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST) const;
+	//! Binds like bind(), with the adjacency index buffer and the TRIANGLELIST_ADJ topology
+	void bindAdjacency() const;
+
+private:
+	HRESULT uploadIndices(const std::vector<uint32_t>& indices);
 
 public:
 	//@{
@@ -15,9 +15,14 @@
 
 #include "cinder/Vector.h"
 #include "cinder/Color.h"
+#include "cinder/Matrix.h"
 #include <d3d11.h>
 
 namespace cinder { namespace dx11 {
+
+// Size in bytes of a vertex element format, 0 for formats vertex buffers do not use.
+UINT getFormatSize(DXGI_FORMAT format);
+
 // Vertex struct holding position and color information.
 struct VertexPC
 {
@@ -181,4 +186,24 @@ struct VertexNMap
 	static const int InputElementCount = 4;
 	static const D3D11_INPUT_ELEMENT_DESC InputElements[InputElementCount];
 };
+
+
+// Instance struct holding a world transform and a color, see VboMesh::createInstanceBuffer().
+// INSTANCE_WORLD0-3 are the matrix columns, so mul(position, float4x4(w0, w1, w2, w3)) transforms like gWorld.
+struct InstanceWorldColor
+{
+    InstanceWorldColor()
+    { }
+
+    InstanceWorldColor(const Matrix44f& world, const ColorA& color)
+        : world(world),
+        color(color)
+    { }
+
+    Matrix44f world;
+    ColorA color;
+
+    static const int InputElementCount = 5;
+    static const D3D11_INPUT_ELEMENT_DESC InputElements[InputElementCount];
+};
 } } // namespace cinder::dx11
\ No newline at end of file
@@ -0,0 +1,59 @@
+// Class WorkerPool is a small fixed-size thread pool shared by the CPU-side mesh,
+// animation and shader pipelines. WorkerPool::get() returns the process-wide instance.
+
+#pragma once
+
+#include <vector>
+#include <deque>
+
+#include "cinder/Cinder.h"
+#include "cinder/Thread.h"
+
+#include <boost/function.hpp>
+#include <boost/noncopyable.hpp>
+
+namespace cinder { namespace dx11 {
+
+class WorkerPool : private boost::noncopyable
+{
+public:
+    typedef boost::function<void()> Task;
+    typedef boost::function<void(size_t, size_t)> RangeTask;
+
+    //! Returns the process-wide pool, sized to the number of hardware threads
+    static WorkerPool& get();
+
+    //! Creates a pool with \a numThreads workers. Zero means one per hardware thread.
+    explicit WorkerPool(size_t numThreads = 0);
+    ~WorkerPool();
+
+    //! Queues \a task to run on a worker thread
+    void    submit(const Task& task);
+
+    //! Splits [0, \a count) into chunks of at least \a grainSize elements and calls \a fn(begin, end) for each of them.
+    //! The calling thread works on chunks too and the call returns once every chunk is done, so it is safe to nest.
+    void    parallelFor(size_t count, size_t grainSize, const RangeTask& fn);
+
+    //! Runs one queued task on the calling thread, false when none is queued. For threads that wait on queued work,
+    //! so a wait inside a task can't leave every worker blocked on a task none of them will get to.
+    bool    runQueuedTask();
+
+    size_t  getNumThreads() const { return mThreads.size(); }
+
+private:
+    void    workerLoop();
+
+    std::vector<std::shared_ptr<std::thread> > mThreads;
+    std::deque<Task>            mTasks;
+    std::mutex                  mMutex;
+    std::condition_variable     mCondition;
+    bool                        mQuit;
+};
+
+//! Shortcut for WorkerPool::get().parallelFor()
+inline void parallelFor(size_t count, size_t grainSize, const WorkerPool::RangeTask& fn)
+{
+    WorkerPool::get().parallelFor(count, grainSize, fn);
+}
+
+} } // namespace cinder::dx11
@@ -31,7 +31,7 @@
 namespace cinder {
 	class Camera; class TriMesh2d; class TriMesh; class Sphere;
 	namespace dx11 {
-		 class VboMesh; class Texture;
+		 class VboMesh; class Texture; struct DrawRange; class ShaderCache; class IncludeCache; struct ShaderDependencies; struct ShaderMacro;
 	}
 } // namespace cinder
 
@@ -58,7 +58,18 @@ DXGI_FORMAT getBackBufferFormat();
 //! Clears the DX9 color buffer using \a color and optionally clears the depth buffer when \a clearDepthBuffer
 void clear( const ColorA &color = ColorA::black(), bool clearDepthBuffer = true, float clearZValue = 1.0f);
 
-HRESULT compileShader(const Buffer& data, const std::string& entryName, const std::string& shaderModel, ID3DBlob** ppShaderBytecode);
+//! Includes are read through a process-wide cache, so a file every shader includes is only read again after it
+//! changed. \a dependencies, when not NULL, receives which file included which. \a macros are defined for the
+//! preprocessor, e.g. the feature keywords of a ShaderPermutations variant.
+HRESULT compileShader(const Buffer& data, const std::string& entryName, const std::string& shaderModel, ID3DBlob** ppShaderBytecode,
+	ShaderDependencies* dependencies = NULL, const std::vector<ShaderMacro>* macros = NULL);
+//! Keeps the bytecode compileShader() produces in \a directory, created if needed, and reuses it on later launches
+//! while the source, its includes, the entry point, the profile and the flags are unchanged. An empty path turns the cache off.
+void setShaderCacheDirectory( const fs::path& directory );
+//! The cache setShaderCacheDirectory() set up, NULL while it is off. Valid until the next setShaderCacheDirectory().
+ShaderCache* getShaderCache();
+//! The includes every shader compile shares, whether the disk cache is on or not
+IncludeCache* getIncludeCache();
 
 void blendFunction(D3D11_BLEND  src, D3D11_BLEND dst);
 
@@ -229,8 +240,39 @@ void drawRange( const TriMesh &mesh, size_t startTriangle, size_t triangleCount
 //! Draws a cinder::gl::VboMesh \a mesh at the origin.
 
 void draw( const VboMesh &vbo );
-//! Draws a range of vertices and elements of cinder::gl::VboMesh \a mesh at the origin. Default parameters for \a vertexStart and \a vertexEnd imply the VboMesh's full range of vertices.
-void drawRange( const VboMesh &vbo, size_t startIndex, size_t indexCount, int vertexStart = -1, int vertexEnd = -1 );
+//! Draws \a vbo with VboMesh::bindDepthOnly(), for depth pre-passes and shadow maps. Needs VboMesh::createDepthInputLayout().
+void drawDepth( const VboMesh &vbo );
+//! Draws \a vbo with its adjacency indices, see VboMesh::createAdjacency(). Bind a geometry shader taking triangleadj input first.
+void drawAdjacency( const VboMesh &vbo );
+//! Draws \a indexCount indices of cinder::gl::VboMesh \a mesh, starting with index # \a startIndex, at the origin.
+void drawRange( const VboMesh &vbo, size_t startIndex, size_t indexCount );
+//! Draws the level of detail of \a vbo that suits \a screenSize, the projected diameter in pixels of the mesh bounding sphere. Falls back to draw() when the mesh has no LOD chain.
+void drawLod( const VboMesh &vbo, float screenSize, float pixelError = 1.0f );
+//! Draws \a numInstances copies of \a vbo, taking the per-instance data from \a instances. Batches are split by VboMesh::getInstanceCapacity().
+void drawInstanced( const VboMesh &vbo, const void *instances, size_t numInstances );
+template <typename InstanceType>
+void drawInstanced( const VboMesh &vbo, const std::vector<InstanceType> &instances )
+{
+	if (!instances.empty())
+		drawInstanced(vbo, &instances[0], instances.size());
+}
+
+//! Counters of drawInstanced() since the last resetInstancingStats()
+struct InstancingStats
+{
+	InstancingStats():instances(0), drawCalls(0){}
+
+	size_t	instances;
+	size_t	drawCalls;
+	//! Draw calls a loop of draw() would have needed on top of the instanced ones
+	size_t	getDrawsSaved() const { return instances - drawCalls; }
+};
+
+const InstancingStats& getInstancingStats();
+void resetInstancingStats();
+
+//! Draws each of \a ranges of \a vbo with a single bind, e.g. the visible clusters returned by ClusterCuller::cull()
+void drawRanges( const VboMesh &vbo, const std::vector<DrawRange> &ranges );
 
 void drawBillboard( const Vec3f &pos, const Vec2f &scale, float rotationDegrees, const Vec3f &bbRight, const Vec3f &bbUp );
 //! Draws \a texture on the XY-plane
@@ -0,0 +1,319 @@
+#include "dx11/AnimationClip.h"
+#include "dx11/WorkerPool.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <boost/bind.hpp>
+
+namespace cinder { namespace dx11 {
+
+namespace
+{
+    const float kSqrtHalf = 0.70710678f;
+    const float kRotationSteps = 32767.0f;
+
+    // The three smallest components of a unit quaternion lie in [-sqrt(1/2), sqrt(1/2)] and are stored with
+    // 15 bits each. The index of the largest one goes in the top bits of the first two words, its sign is
+    // made positive since q and -q are the same rotation.
+    void encodeRotation( const float* q, uint16_t* out )
+    {
+        int largest = 0;
+        for (int i=1;i<4;i++)
+        {
+            if (std::abs(q[i]) > std::abs(q[largest]))
+                largest = i;
+        }
+        float sign = q[largest] < 0 ? -1.0f : 1.0f;
+
+        uint16_t values[3];
+        for (int i=0, c=0;i<4;i++)
+        {
+            if (i == largest)
+                continue;
+            float x = (q[i] * sign / kSqrtHalf) * 0.5f + 0.5f;
+            x = std::min(1.0f, std::max(0.0f, x));
+            values[c++] = (uint16_t)(x * kRotationSteps + 0.5f);
+        }
+        out[0] = (uint16_t)(((largest >> 1) << 15) | values[0]);
+        out[1] = (uint16_t)(((largest & 1) << 15) | values[1]);
+        out[2] = values[2];
+    }
+
+    void decodeRotation( const uint16_t* in, float* q )
+    {
+        int largest = ((in[0] >> 15) << 1) | (in[1] >> 15);
+        float values[3];
+        float sum = 0;
+        for (int c=0;c<3;c++)
+        {
+            values[c] = ((in[c] & 0x7fff) / kRotationSteps * 2.0f - 1.0f) * kSqrtHalf;
+            sum += values[c] * values[c];
+        }
+        for (int i=0, c=0;i<4;i++)
+            q[i] = i == largest ? std::sqrt(std::max(0.0f, 1.0f - sum)) : values[c++];
+    }
+
+    float dot4( const float* a, const float* b )
+    {
+        return a[0] * b[0] + a[1] * b[1] + a[2] * b[2] + a[3] * b[3];
+    }
+}
+
+// Quantizes and thins out the keys of one track. Tracks are independent, so they are encoded in parallel.
+struct AnimationClip::Encoder
+{
+    struct Track
+    {
+        float                   range[6];
+        std::vector<uint16_t>   translationKeys;
+        std::vector<uint16_t>   translations;
+        std::vector<uint16_t>   rotationKeys;
+        std::vector<uint16_t>   rotations;
+    };
+
+    const float*        keys;
+    size_t              numKeys;
+    Options             options;
+    std::vector<Track>  tracks;
+
+    void encodeRange( size_t begin, size_t end )
+    {
+        for (size_t i=begin;i<end;i++)
+            encodeTrack(keys + i * numKeys * 8, tracks[i]);
+    }
+
+    // Keeps the first and last key, and in between the keys interpolation of their kept neighbours misses
+    template <typename Fits>
+    static void reduce( size_t numKeys, bool compress, const Fits& fits, std::vector<uint16_t>& kept )
+    {
+        kept.push_back(0);
+        size_t last = 0;
+        for (size_t end=2;end<numKeys && compress;end++)
+        {
+            for (size_t i=last+1;i<end;i++)
+            {
+                if (!fits(last, end, i))
+                {
+                    last = end - 1;
+                    kept.push_back((uint16_t)last);
+                    break;
+                }
+            }
+        }
+        for (size_t i=last+1;i<numKeys && !compress;i++)
+            kept.push_back((uint16_t)i);
+        if (compress && numKeys > 1)
+            kept.push_back((uint16_t)(numKeys - 1));
+    }
+
+    // Kept keys are interpolated decoded, dropped ones are compared undecoded, so the tolerance comes on top of
+    // the quantization. Comparing against decoded keys would count their rounding twice and keep nearly every
+    // key of a track whose 16-bit step is coarser than the tolerance.
+    struct TranslationFits
+    {
+        const std::vector<float>*   decoded;
+        const float*                source;
+        float                       toleranceSq;
+
+        bool operator()( size_t a, size_t b, size_t i ) const
+        {
+            const float* pa = &(*decoded)[a * 3];
+            const float* pb = &(*decoded)[b * 3];
+            const float* pi = source + i * 8;
+            float s = (float)(i - a) / (float)(b - a);
+            float errorSq = 0;
+            for (int c=0;c<3;c++)
+            {
+                float d = pa[c] + (pb[c] - pa[c]) * s - pi[c];
+                errorSq += d * d;
+            }
+            return errorSq <= toleranceSq;
+        }
+    };
+
+    struct RotationFits
+    {
+        const std::vector<float>*   decoded;
+        // the tolerated angle as a chord between unit quaternions, dot products lack the precision near 1
+        float                       maxChordSq;
+
+        bool operator()( size_t a, size_t b, size_t i ) const
+        {
+            const float* qa = &(*decoded)[a * 4];
+            const float* qb = &(*decoded)[b * 4];
+            const float* qi = &(*decoded)[i * 4];
+            float q[4], t[3] = {0, 0, 0};
+            AnimationClip::interpolate(t, qa, t, qb, (float)(i - a) / (float)(b - a), t, q);
+            float sign = dot4(q, qi) < 0 ? -1.0f : 1.0f;
+            float chordSq = 0;
+            for (int c=0;c<4;c++)
+                chordSq += (q[c] - qi[c] * sign) * (q[c] - qi[c] * sign);
+            return chordSq <= maxChordSq;
+        }
+    };
+
+    void encodeTrack( const float* source, Track& track ) const
+    {
+        float* minimum = track.range;
+        float* scale = track.range + 3;
+        for (int c=0;c<3;c++)
+        {
+            float lo = source[c], hi = source[c];
+            for (size_t k=1;k<numKeys;k++)
+            {
+                lo = std::min(lo, source[k * 8 + c]);
+                hi = std::max(hi, source[k * 8 + c]);
+            }
+            minimum[c] = lo;
+            scale[c] = (hi - lo) / 65535.0f;
+        }
+
+        std::vector<uint16_t> translations(numKeys * 3);
+        std::vector<uint16_t> rotations(numKeys * 3);
+        std::vector<float> decodedTranslations(numKeys * 3);
+        std::vector<float> decodedRotations(numKeys * 4);
+        for (size_t k=0;k<numKeys;k++)
+        {
+            const float* key = source + k * 8;
+            for (int c=0;c<3;c++)
+            {
+                float steps = scale[c] > 0 ? (key[c] - minimum[c]) / scale[c] : 0.0f;
+                translations[k * 3 + c] = (uint16_t)std::min(65535.0f, std::max(0.0f, steps + 0.5f));
+                decodedTranslations[k * 3 + c] = minimum[c] + translations[k * 3 + c] * scale[c];
+            }
+
+            float q[4] = {key[3], key[4], key[5], key[6]};
+            float length = std::sqrt(dot4(q, q));
+            for (int c=0;c<4;c++)
+                q[c] = length > 0 ? q[c] / length : (c == 3 ? 1.0f : 0.0f);
+            encodeRotation(q, &rotations[k * 3]);
+            decodeRotation(&rotations[k * 3], &decodedRotations[k * 4]);
+        }
+
+        // the rounding of a decoded key is at most half a step per component
+        float rounding = 0.5f * std::sqrt(scale[0] * scale[0] + scale[1] * scale[1] + scale[2] * scale[2]);
+        float tolerance = options.translationTolerance + rounding;
+        TranslationFits translationFits = {&decodedTranslations, source, tolerance * tolerance};
+        reduce(numKeys, options.compress, translationFits, track.translationKeys);
+        for (size_t i=0;i<track.translationKeys.size();i++)
+            track.translations.insert(track.translations.end(), &translations[track.translationKeys[i] * 3],
+                &translations[track.translationKeys[i] * 3] + 3);
+
+        float chord = 2.0f * std::sin(options.rotationTolerance * 0.25f);
+        RotationFits rotationFits = {&decodedRotations, chord * chord};
+        reduce(numKeys, options.compress, rotationFits, track.rotationKeys);
+        for (size_t i=0;i<track.rotationKeys.size();i++)
+            track.rotations.insert(track.rotations.end(), &rotations[track.rotationKeys[i] * 3],
+                &rotations[track.rotationKeys[i] * 3] + 3);
+    }
+};
+
+void AnimationClip::create( const float* keys, size_t numTracks, size_t numKeys, const Options& options )
+{
+    assert(numKeys <= 65536 && "key indices are stored with 16 bits");
+
+    mNumTracks = numKeys > 0 ? numTracks : 0;
+    mNumKeys = numKeys;
+    mTranslationStart.assign(1, 0);
+    mRotationStart.assign(1, 0);
+    mTranslationRange.clear();
+    mTranslationKeys.clear();
+    mTranslations.clear();
+    mRotationKeys.clear();
+    mRotations.clear();
+
+    Encoder encoder;
+    encoder.keys = keys;
+    encoder.numKeys = numKeys;
+    encoder.options = options;
+    encoder.tracks.resize(mNumTracks);
+    parallelFor(mNumTracks, 1, boost::bind(&Encoder::encodeRange, &encoder, _1, _2));
+
+    for (size_t i=0;i<mNumTracks;i++)
+    {
+        const Encoder::Track& track = encoder.tracks[i];
+        mTranslationRange.insert(mTranslationRange.end(), track.range, track.range + 6);
+        mTranslationKeys.insert(mTranslationKeys.end(), track.translationKeys.begin(), track.translationKeys.end());
+        mTranslations.insert(mTranslations.end(), track.translations.begin(), track.translations.end());
+        mRotationKeys.insert(mRotationKeys.end(), track.rotationKeys.begin(), track.rotationKeys.end());
+        mRotations.insert(mRotations.end(), track.rotations.begin(), track.rotations.end());
+        mTranslationStart.push_back((uint32_t)mTranslationKeys.size());
+        mRotationStart.push_back((uint32_t)mRotationKeys.size());
+    }
+}
+
+void AnimationClip::sample( size_t track, float position, float* translation, float* rotation ) const
+{
+    // below the first key upper_bound() would find no previous one, NaN counts as below
+    if (!(position >= 0))
+        position = 0;
+    position = std::min(position, (float)(mNumKeys - 1));
+
+    // the kept keys around position, and how far between them it is
+    const uint16_t* keys = &mTranslationKeys[0] + mTranslationStart[track];
+    size_t count = mTranslationStart[track + 1] - mTranslationStart[track];
+    size_t next = std::upper_bound(keys, keys + count, position) - keys;
+    size_t prev = next - 1;
+    float s = 0;
+    if (next < count)
+        s = (position - keys[prev]) / (float)(keys[next] - keys[prev]);
+    else
+        next = prev;
+
+    const float* minimum = &mTranslationRange[track * 6];
+    const float* scale = minimum + 3;
+    const uint16_t* t0 = &mTranslations[(mTranslationStart[track] + prev) * 3];
+    const uint16_t* t1 = &mTranslations[(mTranslationStart[track] + next) * 3];
+    for (int c=0;c<3;c++)
+    {
+        float a = minimum[c] + t0[c] * scale[c];
+        float b = minimum[c] + t1[c] * scale[c];
+        translation[c] = a + (b - a) * s;
+    }
+
+    keys = &mRotationKeys[0] + mRotationStart[track];
+    count = mRotationStart[track + 1] - mRotationStart[track];
+    next = std::upper_bound(keys, keys + count, position) - keys;
+    prev = next - 1;
+    s = 0;
+    if (next < count)
+        s = (position - keys[prev]) / (float)(keys[next] - keys[prev]);
+    else
+        next = prev;
+
+    float r0[4], r1[4], t[3] = {0, 0, 0};
+    decodeRotation(&mRotations[(mRotationStart[track] + prev) * 3], r0);
+    decodeRotation(&mRotations[(mRotationStart[track] + next) * 3], r1);
+    interpolate(t, r0, t, r1, s, t, rotation);
+}
+
+void AnimationClip::interpolate( const float* t0, const float* r0, const float* t1, const float* r1, float s,
+    float* translation, float* rotation )
+{
+    for (int c=0;c<3;c++)
+        translation[c] = t0[c] + (t1[c] - t0[c]) * s;
+
+    // nlerp, through the nearer of r1 and -r1
+    float sign = dot4(r0, r1) < 0 ? -1.0f : 1.0f;
+    float q[4];
+    for (int c=0;c<4;c++)
+        q[c] = r0[c] + (r1[c] * sign - r0[c]) * s;
+    float length = std::sqrt(dot4(q, q));
+    for (int c=0;c<4;c++)
+        rotation[c] = q[c] / length;
+}
+
+size_t AnimationClip::getMemorySize() const
+{
+    return (mTranslationStart.size() + mRotationStart.size()) * sizeof(uint32_t) + mTranslationRange.size() * sizeof(float) +
+        (mTranslationKeys.size() + mTranslations.size() + mRotationKeys.size() + mRotations.size()) * sizeof(uint16_t);
+}
+
+size_t AnimationClip::getRawSize() const
+{
+    // translation, orientation and scaling in floats
+    return mNumTracks * mNumKeys * 10 * sizeof(float);
+}
+
+} } // namespace cinder::dx11
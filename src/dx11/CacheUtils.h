@@ -0,0 +1,44 @@
+// Helpers the cache files of the DX11 block share, not part of the public headers. FNV-1a 64 hashes the keys,
+// checksums and variant hashes, renameFile() puts a finished temporary file in place of the old one.
+
+#pragma once
+
+#include <string>
+#include <cstdio>
+
+#include "cinder/Cinder.h"
+
+#if defined( _WIN32 )
+#include <windows.h>
+#endif
+
+namespace cinder { namespace dx11 { namespace detail {
+
+const uint64_t kFnvOffset = 14695981039346656037ULL;
+const uint64_t kFnvPrime = 1099511628211ULL;
+
+inline uint64_t hashBytes(uint64_t hash, const void* data, size_t size)
+{
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    for (size_t i=0;i<size;i++)
+        hash = (hash ^ bytes[i]) * kFnvPrime;
+    return hash;
+}
+
+//! With the terminator, so "ab" + "c" and "a" + "bc" differ
+inline uint64_t hashString(uint64_t hash, const std::string& value)
+{
+    return hashBytes(hash, value.c_str(), value.size() + 1);
+}
+
+//! Replaces \a to if it exists, in one step
+inline bool renameFile(const std::string& from, const std::string& to)
+{
+#if defined( _WIN32 )
+    return MoveFileExA(from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+    return std::rename(from.c_str(), to.c_str()) == 0;
+#endif
+}
+
+} } } // namespace cinder::dx11::detail
@@ -0,0 +1,171 @@
+#include "dx11/ConstantBuffer.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace cinder { namespace dx11 {
+
+namespace
+{
+    bool lessSlot(const ConstantBufferDesc& a, const ConstantBufferDesc& b)
+    {
+        return a.slot < b.slot;
+    }
+}
+
+ConstantBufferRef ConstantBuffer::create(const ConstantBufferDesc& desc, bool dynamic)
+{
+    HRESULT hr = S_OK;
+    ConstantBufferRef buffer(new ConstantBuffer(desc, dynamic));
+    HR( buffer->setup() );
+    return SUCCEEDED(hr) ? buffer : ConstantBufferRef();
+}
+
+ConstantBuffer::ConstantBuffer(const ConstantBufferDesc& desc, bool dynamic)
+:mShadow(desc), mDynamic(dynamic), mUsed(false)
+{
+}
+
+HRESULT ConstantBuffer::setup()
+{
+    HRESULT hr = S_OK;
+    CD3D11_BUFFER_DESC bd(getDesc().size, D3D11_BIND_CONSTANT_BUFFER);
+    if (mDynamic)
+    {
+        bd.Usage = D3D11_USAGE_DYNAMIC;
+        bd.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+    }
+    D3D11_SUBRESOURCE_DATA InitData = {0};
+    InitData.pSysMem = mShadow.getData();
+    V_RETURN(getDevice()->CreateBuffer( &bd, &InitData, &mBuffer ));
+    return hr;
+}
+
+HRESULT ConstantBuffer::reflect(const void* bytecode, size_t bytecodeLength, std::vector<ConstantBufferDesc>* descs)
+{
+    HRESULT hr = S_OK;
+    descs->clear();
+
+    CComPtr<ID3D11ShaderReflection> reflection;
+    V_RETURN( D3DReflect(bytecode, bytecodeLength, IID_ID3D11ShaderReflection, reinterpret_cast<void**>(&reflection)) );
+    D3D11_SHADER_DESC shaderDesc;
+    V_RETURN( reflection->GetDesc(&shaderDesc) );
+
+    // the bind points come from the resource bindings, the buffer descriptions don't have them
+    for (UINT i=0;i<shaderDesc.BoundResources;i++)
+    {
+        D3D11_SHADER_INPUT_BIND_DESC bindDesc;
+        V_RETURN( reflection->GetResourceBindingDesc(i, &bindDesc) );
+        if (bindDesc.Type != D3D_SIT_CBUFFER)
+            continue;
+
+        // reflection sub-objects aren't reference counted, they live as long as the reflection
+        ID3D11ShaderReflectionConstantBuffer* constantBuffer = reflection->GetConstantBufferByName(bindDesc.Name);
+        D3D11_SHADER_BUFFER_DESC bufferDesc;
+        V_RETURN( constantBuffer->GetDesc(&bufferDesc) );
+
+        ConstantBufferDesc desc;
+        desc.name = bufferDesc.Name;
+        desc.slot = bindDesc.BindPoint;
+        desc.size = bufferDesc.Size;
+        for (UINT j=0;j<bufferDesc.Variables;j++)
+        {
+            D3D11_SHADER_VARIABLE_DESC variableDesc;
+            V_RETURN( constantBuffer->GetVariableByIndex(j)->GetDesc(&variableDesc) );
+            desc.variables.push_back(ConstantBufferVariable(variableDesc.Name, variableDesc.StartOffset, variableDesc.Size));
+        }
+        descs->push_back(desc);
+    }
+
+    std::sort(descs->begin(), descs->end(), lessSlot);
+    return hr;
+}
+
+bool ConstantBuffer::set(const std::string& name, const void* data, size_t size)
+{
+    if (!mShadow.set(name, data, size))
+        return false;
+    mUsed = true;
+    return true;
+}
+
+HRESULT ConstantBuffer::flush(ID3D11DeviceContext* context)
+{
+    if (!mShadow.isDirty())
+        return S_OK;
+
+    // the whole buffer goes up either way, WRITE_DISCARD leaves the rest undefined and 11.0 can't update part of a
+    // constant buffer, the dirty ranges only decide whether there is an upload at all
+    HRESULT hr = S_OK;
+    if (mDynamic)
+    {
+        D3D11_MAPPED_SUBRESOURCE mapped;
+        V_RETURN( context->Map(mBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped) );
+        memcpy(mapped.pData, mShadow.getData(), mShadow.getSize());
+        context->Unmap(mBuffer, 0);
+    }
+    else
+    {
+        context->UpdateSubresource(mBuffer, 0, NULL, mShadow.getData(), 0, 0);
+    }
+    mShadow.clearDirty();
+    return hr;
+}
+
+//////////////////////////////////////////////////////////////////////////
+HRESULT ShaderConstants::setup(const void* bytecode, size_t bytecodeLength)
+{
+    HRESULT hr = S_OK;
+    clear();
+
+    std::vector<ConstantBufferDesc> descs;
+    V_RETURN( ConstantBuffer::reflect(bytecode, bytecodeLength, &descs) );
+    for (size_t i=0;i<descs.size();i++)
+    {
+        ConstantBufferRef buffer(new ConstantBuffer(descs[i], true));
+        V_RETURN( buffer->setup() );
+        mBuffers.push_back(buffer);
+        for (size_t j=0;j<descs[i].variables.size();j++)
+            mVariables[descs[i].variables[j].name] = i;
+    }
+    return hr;
+}
+
+void ShaderConstants::clear()
+{
+    mBuffers.clear();
+    mVariables.clear();
+}
+
+bool ShaderConstants::set(const std::string& name, const void* data, size_t size)
+{
+    boost::unordered_map<std::string, size_t>::const_iterator it = mVariables.find(name);
+    return it != mVariables.end() && mBuffers[it->second]->set(name, data, size);
+}
+
+ConstantBufferRef ShaderConstants::getBuffer(const std::string& name) const
+{
+    for (size_t i=0;i<mBuffers.size();i++)
+    {
+        if (mBuffers[i]->getDesc().name == name)
+            return mBuffers[i];
+    }
+    return ConstantBufferRef();
+}
+
+void ShaderConstants::copyVariables(const ShaderConstants& other)
+{
+    for (size_t i=0;i<other.mBuffers.size();i++)
+    {
+        if (!other.mBuffers[i]->isUsed())
+            continue;
+        ConstantBufferRef buffer = getBuffer(other.mBuffers[i]->getDesc().name);
+        if (buffer)
+        {
+            buffer->getShadow().copyVariables(other.mBuffers[i]->getShadow());
+            buffer->mUsed = true;
+        }
+    }
+}
+
+} } // namespace cinder::dx11
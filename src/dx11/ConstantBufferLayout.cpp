@@ -0,0 +1,173 @@
+#include "dx11/ConstantBufferLayout.h"
+
+#include <algorithm>
+#include <cstring>
+#include <sstream>
+
+namespace cinder { namespace dx11 {
+
+bool ConstantBufferDesc::validate(std::string* error) const
+{
+    std::ostringstream message;
+    if (size == 0 || size % 16 != 0)
+        message << "cbuffer " << name << ": size " << size << " isn't a multiple of 16";
+    for (size_t i=0;i<variables.size() && message.str().empty();i++)
+    {
+        const ConstantBufferVariable& variable = variables[i];
+        if (variable.offset > size || variable.size > size - variable.offset)
+            message << "cbuffer " << name << ": " << variable.name << " ends past the buffer";
+        // HLSL packing never lets a variable straddle a 16-byte register unless it starts one
+        else if (variable.offset % 16 != 0 && variable.offset / 16 != (variable.offset + variable.size - 1) / 16)
+            message << "cbuffer " << name << ": " << variable.name << " straddles a register";
+    }
+
+    if (error)
+        *error = message.str();
+    return message.str().empty();
+}
+
+std::string ConstantBufferDesc::serialize(const std::vector<ConstantBufferDesc>& descs)
+{
+    std::ostringstream text;
+    for (size_t i=0;i<descs.size();i++)
+    {
+        text << "cbuffer " << descs[i].name << " " << descs[i].slot << " " << descs[i].size << "\n";
+        for (size_t j=0;j<descs[i].variables.size();j++)
+        {
+            const ConstantBufferVariable& variable = descs[i].variables[j];
+            text << "    " << variable.name << " " << variable.offset << " " << variable.size << "\n";
+        }
+    }
+    return text.str();
+}
+
+bool ConstantBufferDesc::parse(const std::string& text, std::vector<ConstantBufferDesc>* descs, std::string* error)
+{
+    descs->clear();
+
+    std::istringstream lines(text);
+    std::string line;
+    for (int lineNumber = 1; std::getline(lines, line); lineNumber++)
+    {
+        std::istringstream fields(line);
+        std::string first;
+        if (!(fields >> first))
+            continue;
+
+        bool valid;
+        if (first == "cbuffer")
+        {
+            descs->push_back(ConstantBufferDesc());
+            valid = !(fields >> descs->back().name >> descs->back().slot >> descs->back().size).fail();
+        }
+        else
+        {
+            ConstantBufferVariable variable;
+            variable.name = first;
+            valid = !descs->empty() && !(fields >> variable.offset >> variable.size).fail();
+            if (valid)
+                descs->back().variables.push_back(variable);
+        }
+
+        std::string rest;
+        if (!valid || fields >> rest)
+        {
+            if (error)
+            {
+                std::ostringstream message;
+                message << "line " << lineNumber << ": expected \"cbuffer <name> <slot> <size>\" or \"<variable> <offset> <size>\"";
+                *error = message.str();
+            }
+            return false;
+        }
+    }
+
+    for (size_t i=0;i<descs->size();i++)
+    {
+        if (!(*descs)[i].validate(error))
+            return false;
+    }
+    return true;
+}
+
+//////////////////////////////////////////////////////////////////////////
+ConstantBufferShadow::ConstantBufferShadow(const ConstantBufferDesc& desc)
+:mDesc(desc), mData(desc.size, 0)
+{
+    for (size_t i=0;i<desc.variables.size();i++)
+        mVariables[desc.variables[i].name] = (int)i;
+}
+
+int ConstantBufferShadow::findVariable(const std::string& name) const
+{
+    boost::unordered_map<std::string, int>::const_iterator it = mVariables.find(name);
+    return it == mVariables.end() ? -1 : it->second;
+}
+
+bool ConstantBufferShadow::set(const std::string& name, const void* data, size_t size)
+{
+    return set(findVariable(name), data, size);
+}
+
+bool ConstantBufferShadow::set(int variable, const void* data, size_t size)
+{
+    if (variable < 0 || variable >= (int)mDesc.variables.size() || size > mDesc.variables[variable].size)
+        return false;
+    return write(mDesc.variables[variable].offset, data, size);
+}
+
+bool ConstantBufferShadow::write(uint32_t offset, const void* data, size_t size)
+{
+    if (offset > mData.size() || size > mData.size() - offset)
+        return false;
+    if (size == 0)
+        return true;
+
+    // only the bytes that differ get dirty, setting the same value every frame costs no upload
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    uint8_t* shadow = &mData[offset];
+    size_t first = 0;
+    while (first < size && shadow[first] == bytes[first])
+        first++;
+    if (first == size)
+        return true;
+    size_t last = size;
+    while (shadow[last - 1] == bytes[last - 1])
+        last--;
+
+    memcpy(shadow + first, bytes + first, last - first);
+    // whole 32-bit components, or a float whose low bytes happened to match would split the range
+    uint32_t end = std::min((offset + (uint32_t)last + 3) & ~3u, (uint32_t)mData.size());
+    markDirty((offset + (uint32_t)first) & ~3u, end);
+    return true;
+}
+
+void ConstantBufferShadow::copyVariables(const ConstantBufferShadow& other)
+{
+    for (size_t i=0;i<other.mDesc.variables.size();i++)
+    {
+        const ConstantBufferVariable& source = other.mDesc.variables[i];
+        int variable = findVariable(source.name);
+        if (variable >= 0)
+            set(variable, &other.mData[source.offset], std::min(source.size, mDesc.variables[variable].size));
+    }
+}
+
+void ConstantBufferShadow::markDirty(uint32_t begin, uint32_t end)
+{
+    // the ranges stay sorted and disjoint, a new one swallows every range it overlaps or touches
+    std::vector<Range>::iterator first = mDirty.begin();
+    while (first != mDirty.end() && first->end < begin)
+        ++first;
+    std::vector<Range>::iterator last = first;
+    while (last != mDirty.end() && last->begin <= end)
+    {
+        begin = std::min(begin, last->begin);
+        end = std::max(end, last->end);
+        ++last;
+    }
+    first = mDirty.erase(first, last);
+    mDirty.insert(first, Range(begin, end));
+}
+
+} } // namespace cinder::dx11
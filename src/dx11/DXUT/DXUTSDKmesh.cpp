@@ -10,6 +10,11 @@
 //--------------------------------------------------------------------------------------
 #include "dx11/dx11.h"
 #include "DXUTSDKMesh.h"
+#include "dx11/WorkerPool.h"
+
+#include <vector>
+#include <boost/bind.hpp>
+#include <xmmintrin.h>
 
 #ifdef _DEBUG
 #pragma comment(lib, "d3dx9d.lib")
@@ -74,20 +79,20 @@ void CDXUTSDKMesh::LoadMaterials( ID3D11Device* pd3dDevice, SDKMESH_MATERIAL* pM
             if( pMaterials[m].DiffuseTexture[0] != 0 )
             {
                 sprintf_s( strPath, MAX_PATH, "%s%s", m_strPath, pMaterials[m].DiffuseTexture );
-				if (FAILED(D3DX11CreateShaderResourceViewFromFileA( pd3dDevice, m_strPath, NULL, NULL, &pMaterials[m].pDiffuseRV, NULL )))
+				if (FAILED(D3DX11CreateShaderResourceViewFromFileA( pd3dDevice, strPath, NULL, NULL, &pMaterials[m].pDiffuseRV, NULL )))
 					pMaterials[m].pDiffuseRV = ( ID3D11ShaderResourceView* )ERROR_RESOURCE_VALUE;
 
             }
             if( pMaterials[m].NormalTexture[0] != 0 )
             {
                 sprintf_s( strPath, MAX_PATH, "%s%s", m_strPath, pMaterials[m].NormalTexture );
-				if (FAILED(D3DX11CreateShaderResourceViewFromFileA( pd3dDevice, m_strPath, NULL, NULL, &pMaterials[m].pNormalRV, NULL )))
+				if (FAILED(D3DX11CreateShaderResourceViewFromFileA( pd3dDevice, strPath, NULL, NULL, &pMaterials[m].pNormalRV, NULL )))
                     pMaterials[m].pNormalRV = ( ID3D11ShaderResourceView* )ERROR_RESOURCE_VALUE;
             }
             if( pMaterials[m].SpecularTexture[0] != 0 )
             {
                 sprintf_s( strPath, MAX_PATH, "%s%s", m_strPath, pMaterials[m].SpecularTexture );
-				if (FAILED(D3DX11CreateShaderResourceViewFromFileA( pd3dDevice, m_strPath, NULL, NULL, &pMaterials[m].pSpecularRV, NULL )))
+				if (FAILED(D3DX11CreateShaderResourceViewFromFileA( pd3dDevice, strPath, NULL, NULL, &pMaterials[m].pSpecularRV, NULL )))
                     pMaterials[m].pSpecularRV = ( ID3D11ShaderResourceView* )ERROR_RESOURCE_VALUE;
             }
         }
@@ -157,11 +162,198 @@ HRESULT CDXUTSDKMesh::CreateIndexBuffer( ID3D11Device* pd3dDevice, SDKMESH_INDEX
 
 
 
+namespace
+{
+    // Reads the float3 at p into xyz, the last vertex of a buffer can't be read with 16 bytes
+    inline __m128 loadPosition( const BYTE* p )
+    {
+        const FLOAT* f = ( const FLOAT* )p;
+        return _mm_setr_ps( f[0], f[1], f[2], 0.0f );
+    }
+
+    // SIMD min/max and farthest distance over count positions stride bytes apart
+    void ComputeVertexBounds( const BYTE* pPositions, size_t count, size_t stride, SDKMESH_BOUNDS* pBounds )
+    {
+        ZeroMemory( pBounds, sizeof( SDKMESH_BOUNDS ) );
+        if( count == 0 )
+            return;
+
+        // all but the last position can be loaded with 16 bytes, the fourth lane is ignored
+        const BYTE* pLast = pPositions + ( count - 1 ) * stride;
+        __m128 lo0 = loadPosition( pLast ), hi0 = lo0, lo1 = lo0, hi1 = lo0;
+        const BYTE* p = pPositions;
+        for( ; p + stride < pLast; p += 2 * stride )
+        {
+            __m128 a = _mm_loadu_ps( ( const FLOAT* )p );
+            __m128 b = _mm_loadu_ps( ( const FLOAT* )( p + stride ) );
+            lo0 = _mm_min_ps( lo0, a ); hi0 = _mm_max_ps( hi0, a );
+            lo1 = _mm_min_ps( lo1, b ); hi1 = _mm_max_ps( hi1, b );
+        }
+        if( p < pLast )
+        {
+            __m128 a = _mm_loadu_ps( ( const FLOAT* )p );
+            lo0 = _mm_min_ps( lo0, a ); hi0 = _mm_max_ps( hi0, a );
+        }
+        __m128 lo = _mm_min_ps( lo0, lo1 );
+        __m128 hi = _mm_max_ps( hi0, hi1 );
+        __m128 half = _mm_set1_ps( 0.5f );
+        __m128 center = _mm_mul_ps( _mm_add_ps( lo, hi ), half );
+
+        // the sphere shares the box center, its radius is the farthest vertex
+        __m128 d = _mm_sub_ps( loadPosition( pLast ), center );
+        d = _mm_mul_ps( d, d );
+        __m128 r = _mm_add_ss( _mm_add_ss( d, _mm_shuffle_ps( d, d, 1 ) ), _mm_shuffle_ps( d, d, 2 ) );
+        for( p = pPositions; p < pLast; p += stride )
+        {
+            d = _mm_sub_ps( _mm_loadu_ps( ( const FLOAT* )p ), center );
+            d = _mm_mul_ps( d, d );
+            r = _mm_max_ss( r, _mm_add_ss( _mm_add_ss( d, _mm_shuffle_ps( d, d, 1 ) ), _mm_shuffle_ps( d, d, 2 ) ) );
+        }
+
+        FLOAT c[4], e[4];
+        _mm_storeu_ps( c, center );
+        _mm_storeu_ps( e, _mm_mul_ps( _mm_sub_ps( hi, lo ), half ) );
+        pBounds->Center = D3DXVECTOR3( c[0], c[1], c[2] );
+        pBounds->Extents = D3DXVECTOR3( e[0], e[1], e[2] );
+        pBounds->Radius = _mm_cvtss_f32( _mm_sqrt_ss( r ) );
+    }
+
+    template <typename INDEX>
+    void IndexRange( const INDEX* pIndices, size_t count, UINT* pMin, UINT* pMax )
+    {
+        UINT lo = UINT_MAX, hi = 0;
+        for( size_t i = 0; i < count; i++ )
+        {
+            UINT index = pIndices[i];
+            lo = index < lo ? index : lo;
+            hi = index > hi ? index : hi;
+        }
+        *pMin = lo;
+        *pMax = hi;
+    }
+
+    struct BoundsBuilder
+    {
+        SDKMESH_MESH* pMeshes;
+        SDKMESH_SUBSET* pSubsets;
+        SDKMESH_VERTEX_BUFFER_HEADER* pVertexBuffers;
+        SDKMESH_INDEX_BUFFER_HEADER* pIndexBuffers;
+        BYTE** ppVertices;
+        BYTE** ppIndices;
+        SDKMESH_BOUNDS* pSubsetBounds;
+        SDKMESH_BOUNDS* pMeshBounds;
+
+        void MeshRange( size_t begin, size_t end ) const
+        {
+            for( size_t i = begin; i < end; i++ )
+                ComputeMesh( ( UINT )i );
+        }
+
+        void ComputeMesh( UINT iMesh ) const
+        {
+            SDKMESH_MESH& mesh = pMeshes[iMesh];
+            SDKMESH_BOUNDS& meshBounds = pMeshBounds[iMesh];
+            ZeroMemory( &meshBounds, sizeof( SDKMESH_BOUNDS ) );
+
+            // the float3 or float4 position of the first stream
+            const SDKMESH_VERTEX_BUFFER_HEADER& vb = pVertexBuffers[ mesh.VertexBuffers[0] ];
+            UINT positionOffset = UINT_MAX;
+            for( UINT e = 0; e < MAX_VERTEX_ELEMENTS && mesh.NumVertexBuffers > 0 && vb.Decl[e].Stream != 0xFF; e++ )
+            {
+                if( vb.Decl[e].Usage == D3DDECLUSAGE_POSITION && vb.Decl[e].UsageIndex == 0 &&
+                    ( vb.Decl[e].Type == D3DDECLTYPE_FLOAT3 || vb.Decl[e].Type == D3DDECLTYPE_FLOAT4 ) )
+                {
+                    positionOffset = vb.Decl[e].Offset;
+                    break;
+                }
+            }
+
+            D3DXVECTOR3 lower( FLT_MAX, FLT_MAX, FLT_MAX );
+            D3DXVECTOR3 upper( -FLT_MAX, -FLT_MAX, -FLT_MAX );
+            for( UINT s = 0; s < mesh.NumSubsets; s++ )
+            {
+                const SDKMESH_SUBSET& subset = pSubsets[ mesh.pSubsets[s] ];
+                SDKMESH_BOUNDS& bounds = pSubsetBounds[ mesh.pSubsets[s] ];
+                if( positionOffset == UINT_MAX )
+                {
+                    ZeroMemory( &bounds, sizeof( SDKMESH_BOUNDS ) );
+                    continue;
+                }
+
+                // the vertices the subset draws, found from its indices when the file doesn't say
+                UINT64 first = subset.VertexStart;
+                UINT64 count = subset.VertexCount;
+                if( count == 0 && subset.IndexCount > 0 )
+                {
+                    const SDKMESH_INDEX_BUFFER_HEADER& ib = pIndexBuffers[ mesh.IndexBuffer ];
+                    UINT lo, hi;
+                    if( ib.IndexType == IT_16BIT )
+                        IndexRange( ( const USHORT* )ppIndices[ mesh.IndexBuffer ] + subset.IndexStart, ( size_t )subset.IndexCount, &lo, &hi );
+                    else
+                        IndexRange( ( const UINT* )ppIndices[ mesh.IndexBuffer ] + subset.IndexStart, ( size_t )subset.IndexCount, &lo, &hi );
+                    first += lo;
+                    count = hi - lo + 1;
+                }
+                first = first < vb.NumVertices ? first : vb.NumVertices;
+                count = count < vb.NumVertices - first ? count : vb.NumVertices - first;
+
+                ComputeVertexBounds( ppVertices[ mesh.VertexBuffers[0] ] + first * vb.StrideBytes + positionOffset,
+                                     ( size_t )count, ( size_t )vb.StrideBytes, &bounds );
+                if( count == 0 )
+                    continue;
+
+                D3DXVECTOR3 subsetLower = bounds.Center - bounds.Extents;
+                D3DXVECTOR3 subsetUpper = bounds.Center + bounds.Extents;
+                D3DXVec3Minimize( &lower, &lower, &subsetLower );
+                D3DXVec3Maximize( &upper, &upper, &subsetUpper );
+            }
+
+            if( lower.x > upper.x )
+            {
+                mesh.BoundingBoxCenter = meshBounds.Center;
+                mesh.BoundingBoxExtents = meshBounds.Extents;
+                return;
+            }
+
+            // the mesh sphere encloses the subset spheres
+            meshBounds.Center = ( lower + upper ) * 0.5f;
+            meshBounds.Extents = ( upper - lower ) * 0.5f;
+            for( UINT s = 0; s < mesh.NumSubsets; s++ )
+            {
+                const SDKMESH_BOUNDS& bounds = pSubsetBounds[ mesh.pSubsets[s] ];
+                D3DXVECTOR3 offset = bounds.Center - meshBounds.Center;
+                FLOAT radius = D3DXVec3Length( &offset ) + bounds.Radius;
+                meshBounds.Radius = radius > meshBounds.Radius ? radius : meshBounds.Radius;
+            }
+            mesh.BoundingBoxCenter = meshBounds.Center;
+            mesh.BoundingBoxExtents = meshBounds.Extents;
+        }
+    };
+}
+
+//--------------------------------------------------------------------------------------
+void CDXUTSDKMesh::ComputeBounds()
+{
+    BoundsBuilder builder;
+    builder.pMeshes = m_pMeshArray;
+    builder.pSubsets = m_pSubsetArray;
+    builder.pVertexBuffers = m_pVertexBufferArray;
+    builder.pIndexBuffers = m_pIndexBufferArray;
+    builder.ppVertices = m_ppVertices;
+    builder.ppIndices = m_ppIndices;
+    builder.pSubsetBounds = m_pSubsetBounds;
+    builder.pMeshBounds = m_pMeshBounds;
+
+    // the subsets of a mesh are all handled by the task of the mesh
+    ci::dx11::parallelFor( m_pMeshHeader->NumMeshes, 1, boost::bind( &BoundsBuilder::MeshRange, &builder, _1, _2 ) );
+}
+
 //--------------------------------------------------------------------------------------
 HRESULT CDXUTSDKMesh::CreateFromFile( ID3D11Device* pDev,
                                       LPCTSTR szFileName,
                                       bool bCreateAdjacencyIndices,
-                                      SDKMESH_CALLBACKS* pLoaderCallbacks)
+                                      SDKMESH_CALLBACKS* pLoaderCallbacks,
+                                      bool bCreateBuffers)
 {
     HRESULT hr = S_OK;
 
@@ -211,7 +403,8 @@ HRESULT CDXUTSDKMesh::CreateFromFile( ID3D11Device* pDev,
                                cBytes,
                                bCreateAdjacencyIndices,
                                false,
-                               pLoaderCallbacks );
+                               pLoaderCallbacks,
+                               bCreateBuffers );
         if( FAILED( hr ) )
             delete []m_pStaticMeshData;
     }
@@ -224,13 +417,15 @@ HRESULT CDXUTSDKMesh::CreateFromMemory( ID3D11Device* pDev11,
                                         UINT DataBytes,
                                         bool bCreateAdjacencyIndices,
                                         bool bCopyStatic,
-                                        SDKMESH_CALLBACKS* pLoaderCallbacks11 )
+                                        SDKMESH_CALLBACKS* pLoaderCallbacks11,
+                                        bool bCreateBuffers,
+                                        bool bOwnsData )
 {
     HRESULT hr = E_FAIL;
-    D3DXVECTOR3 lower; 
-    D3DXVECTOR3 upper; 
     
 	m_pDev = pDev11;
+	m_bCreateBuffers = bCreateBuffers;
+	m_bOwnsData = bCopyStatic || bOwnsData;
 
     // Set outstanding resources to zero
     m_NumOutstandingResources = 0;
@@ -292,7 +487,9 @@ HRESULT CDXUTSDKMesh::CreateFromMemory( ID3D11Device* pDev11,
         BYTE* pVertices = NULL;
         pVertices = ( BYTE* )( pBufferData + ( m_pVertexBufferArray[i].DataOffset - BufferDataStart ) );
 
-        if( pDev11 )
+        if( !bCreateBuffers )
+            m_pVertexBufferArray[i].pVB = NULL;
+        else if( pDev11 )
             CreateVertexBuffer( pDev11, &m_pVertexBufferArray[i], pVertices, pLoaderCallbacks11 );
 
         m_ppVertices[i] = pVertices;
@@ -305,7 +502,9 @@ HRESULT CDXUTSDKMesh::CreateFromMemory( ID3D11Device* pDev11,
         BYTE* pIndices = NULL;
         pIndices = ( BYTE* )( pBufferData + ( m_pIndexBufferArray[i].DataOffset - BufferDataStart ) );
 
-        if( pDev11 )
+        if( !bCreateBuffers )
+            m_pIndexBufferArray[i].pIB = NULL;
+        else if( pDev11 )
             CreateIndexBuffer( pDev11, &m_pIndexBufferArray[i], pIndices, pLoaderCallbacks11 );
 
         m_ppIndices[i] = pIndices;
@@ -327,97 +526,19 @@ HRESULT CDXUTSDKMesh::CreateFromMemory( ID3D11Device* pDev11,
     m_pWorldPoseFrameMatrices = new D3DXMATRIX[ m_pMeshHeader->NumFrames ];
     if( !m_pWorldPoseFrameMatrices )
         goto Error;
+    m_pInvBindPoseFrameMatrices = new D3DXMATRIX[ m_pMeshHeader->NumFrames ];
+    if( !m_pInvBindPoseFrameMatrices )
+        goto Error;
 
-    SDKMESH_SUBSET* pSubset = NULL;
-    D3D11_PRIMITIVE_TOPOLOGY PrimType;
-
-    // update bounding volume 
-    SDKMESH_MESH* currentMesh = &m_pMeshArray[0];
-    int tris = 0;
-    for (UINT meshi=0; meshi < m_pMeshHeader->NumMeshes; ++meshi) {
-        lower.x = FLT_MAX; lower.y = FLT_MAX; lower.z = FLT_MAX;
-        upper.x = -FLT_MAX; upper.y = -FLT_MAX; upper.z = -FLT_MAX;
-        currentMesh = GetMesh( meshi );
-        INT indsize;
-        if (m_pIndexBufferArray[currentMesh->IndexBuffer].IndexType == IT_16BIT ) {
-            indsize = 2;
-        }else {
-            indsize = 4;        
-        }
-
-        for( UINT subset = 0; subset < currentMesh->NumSubsets; subset++ )
-        {
-            pSubset = GetSubset( meshi, subset ); //&m_pSubsetArray[ currentMesh->pSubsets[subset] ];
-
-            PrimType = GetPrimitiveType( ( SDKMESH_PRIMITIVE_TYPE )pSubset->PrimitiveType );
-            assert( PrimType == D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST );// only triangle lists are handled.
-
-            UINT IndexCount = ( UINT )pSubset->IndexCount;
-            UINT IndexStart = ( UINT )pSubset->IndexStart;
-
-            /*if( bAdjacent )
-            {
-                IndexCount *= 2;
-                IndexStart *= 2;
-            }*/
-     
-        //BYTE* pIndices = NULL;
-            //m_ppIndices[i]
-            UINT *ind = ( UINT * )m_ppIndices[currentMesh->IndexBuffer];
-            FLOAT *verts =  ( FLOAT* )m_ppVertices[currentMesh->VertexBuffers[0]];
-            UINT stride = (UINT)m_pVertexBufferArray[currentMesh->VertexBuffers[0]].StrideBytes;
-            assert (stride % 4 == 0);
-            stride /=4;
-            for (UINT vertind = IndexStart; vertind < IndexStart + IndexCount; ++vertind) {
-                UINT current_ind=0;
-                if (indsize == 2) {
-                    UINT ind_div2 = vertind / 2;
-                    current_ind = ind[ind_div2];
-                    if (vertind %2 ==0) {
-                        current_ind = current_ind << 16;
-                        current_ind = current_ind >> 16;
-                    }else {
-                        current_ind = current_ind >> 16;
-                    }
-                }else {
-                    current_ind = ind[vertind];
-                }
-                tris++;
-                D3DXVECTOR3 *pt = (D3DXVECTOR3*)&(verts[stride * current_ind]);
-                if (pt->x < lower.x) {
-                    lower.x = pt->x;
-                }
-                if (pt->y < lower.y) {
-                    lower.y = pt->y;
-                }
-                if (pt->z < lower.z) {
-                    lower.z = pt->z;
-                }
-                if (pt->x > upper.x) {
-                    upper.x = pt->x;
-                }
-                if (pt->y > upper.y) {
-                    upper.y = pt->y;
-                }
-                if (pt->z > upper.z) {
-                    upper.z = pt->z;
-                }
-                //BYTE** m_ppVertices;
-                //BYTE** m_ppIndices;
-            }
-            //pd3dDeviceContext->DrawIndexed( IndexCount, IndexStart, VertexStart );
-        }
-
-        D3DXVECTOR3 half = upper - lower;
-        half *=0.5f;
-
-        currentMesh->BoundingBoxCenter = lower + half;
-        currentMesh->BoundingBoxExtents = half;
-
-    }
-    // Update 
-        
+    // Order the frames parents first, so transforming them is a linear pass
+    m_pFrameOrder = new UINT[ m_pMeshHeader->NumFrames ];
+    m_pFrameParents = new UINT[ m_pMeshHeader->NumFrames ];
+    FlattenFrames();
 
+    // update bounding volumes
+    m_pSubsetBounds = new SDKMESH_BOUNDS[ m_pMeshHeader->NumTotalSubsets ];
+    m_pMeshBounds = new SDKMESH_BOUNDS[ m_pMeshHeader->NumMeshes ];
+    ComputeBounds();
 
     hr = S_OK;
 Error:
@@ -431,76 +552,59 @@ Error:
 }
 
 //--------------------------------------------------------------------------------------
-// transform bind pose frame using a recursive traversal
+// order the frames reachable from frame 0 so every parent comes before its children
 //--------------------------------------------------------------------------------------
-void CDXUTSDKMesh::TransformBindPoseFrame( UINT iFrame, D3DXMATRIX* pParentWorld )
+void CDXUTSDKMesh::FlattenFrames()
 {
-    if( !m_pBindPoseFrameMatrices )
+    UINT numFrames = m_pMeshHeader->NumFrames;
+    m_NumOrderedFrames = 0;
+    for( UINT i = 0; i < numFrames; i++ )
+    {
+        m_pFrameParents[i] = INVALID_FRAME;
+        D3DXMatrixIdentity( &m_pInvBindPoseFrameMatrices[i] );
+    }
+    if( numFrames == 0 )
         return;
 
-    // Transform ourselves
-    D3DXMATRIX LocalWorld;
-    D3DXMatrixMultiply( &LocalWorld, &m_pFrameArray[iFrame].Matrix, pParentWorld );
-    m_pBindPoseFrameMatrices[iFrame] = LocalWorld;
-
-    // Transform our siblings
-    if( m_pFrameArray[iFrame].SiblingFrame != INVALID_FRAME )
-        TransformBindPoseFrame( m_pFrameArray[iFrame].SiblingFrame, pParentWorld );
-
-    // Transform our children
-    if( m_pFrameArray[iFrame].ChildFrame != INVALID_FRAME )
-        TransformBindPoseFrame( m_pFrameArray[iFrame].ChildFrame, &LocalWorld );
+    // depth first with an explicit stack, the pairs are (frame, parent)
+    std::vector<bool> visited( numFrames, false );
+    std::vector<std::pair<UINT, UINT> > stack;
+    stack.push_back( std::make_pair( 0u, INVALID_FRAME ) );
+    while( !stack.empty() )
+    {
+        UINT iFrame = stack.back().first;
+        UINT iParent = stack.back().second;
+        stack.pop_back();
+        if( iFrame >= numFrames || visited[iFrame] )
+            continue;
+        visited[iFrame] = true;
+
+        m_pFrameOrder[ m_NumOrderedFrames++ ] = iFrame;
+        m_pFrameParents[iFrame] = iParent;
+        if( m_pFrameArray[iFrame].SiblingFrame != INVALID_FRAME )
+            stack.push_back( std::make_pair( m_pFrameArray[iFrame].SiblingFrame, iParent ) );
+        if( m_pFrameArray[iFrame].ChildFrame != INVALID_FRAME )
+            stack.push_back( std::make_pair( m_pFrameArray[iFrame].ChildFrame, iFrame ) );
+    }
 }
 
 //--------------------------------------------------------------------------------------
-// transform frame using a recursive traversal
+// the local transform of an animation key, rotation then translation (scaling is ignored)
 //--------------------------------------------------------------------------------------
-void CDXUTSDKMesh::TransformFrame( UINT iFrame, D3DXMATRIX* pParentWorld, double fTime )
+static void KeyToMatrix( const SDKANIMATION_DATA& key, D3DXMATRIX* pOut )
 {
-    // Get the tick data
-    D3DXMATRIX LocalTransform;
-    UINT iTick = GetAnimationKeyFromTime( fTime );
-
-    if( INVALID_ANIMATION_DATA != m_pFrameArray[iFrame].AnimationDataIndex )
-    {
-        SDKANIMATION_FRAME_DATA* pFrameData = &m_pAnimationFrameData[ m_pFrameArray[iFrame].AnimationDataIndex ];
-        SDKANIMATION_DATA* pData = &pFrameData->pAnimationData[ iTick ];
-
-        // turn it into a matrix (Ignore scaling for now)
-        D3DXVECTOR3 parentPos = pData->Translation;
-        D3DXMATRIX mTranslate;
-        D3DXMatrixTranslation( &mTranslate, parentPos.x, parentPos.y, parentPos.z );
-
-        D3DXQUATERNION quat;
-        D3DXMATRIX mQuat;
-        quat.w = pData->Orientation.w;
-        quat.x = pData->Orientation.x;
-        quat.y = pData->Orientation.y;
-        quat.z = pData->Orientation.z;
-        if( quat.w == 0 && quat.x == 0 && quat.y == 0 && quat.z == 0 )
-            D3DXQuaternionIdentity( &quat );
-        D3DXQuaternionNormalize( &quat, &quat );
-        D3DXMatrixRotationQuaternion( &mQuat, &quat );
-        LocalTransform = ( mQuat * mTranslate );
-    }
-    else
-    {
-        LocalTransform = m_pFrameArray[iFrame].Matrix;
-    }
-
-    // Transform ourselves
-    D3DXMATRIX LocalWorld;
-    D3DXMatrixMultiply( &LocalWorld, &LocalTransform, pParentWorld );
-    m_pTransformedFrameMatrices[iFrame] = LocalWorld;
-    m_pWorldPoseFrameMatrices[iFrame] = LocalWorld;
-
-    // Transform our siblings
-    if( m_pFrameArray[iFrame].SiblingFrame != INVALID_FRAME )
-        TransformFrame( m_pFrameArray[iFrame].SiblingFrame, pParentWorld, fTime );
-
-    // Transform our children
-    if( m_pFrameArray[iFrame].ChildFrame != INVALID_FRAME )
-        TransformFrame( m_pFrameArray[iFrame].ChildFrame, &LocalWorld, fTime );
+    FLOAT x = key.Orientation.x, y = key.Orientation.y, z = key.Orientation.z, w = key.Orientation.w;
+    FLOAT lengthSq = x * x + y * y + z * z + w * w;
+    FLOAT s = lengthSq > 0 ? 2.0f / lengthSq : 0.0f;
+
+    FLOAT xx = x * x * s, yy = y * y * s, zz = z * z * s;
+    FLOAT xy = x * y * s, xz = x * z * s, yz = y * z * s;
+    FLOAT xw = x * w * s, yw = y * w * s, zw = z * w * s;
+
+    pOut->_11 = 1 - yy - zz; pOut->_12 = xy + zw;     pOut->_13 = xz - yw;     pOut->_14 = 0;
+    pOut->_21 = xy - zw;     pOut->_22 = 1 - xx - zz; pOut->_23 = yz + xw;     pOut->_24 = 0;
+    pOut->_31 = xz + yw;     pOut->_32 = yz - xw;     pOut->_33 = 1 - xx - yy; pOut->_34 = 0;
+    pOut->_41 = key.Translation.x; pOut->_42 = key.Translation.y; pOut->_43 = key.Translation.z; pOut->_44 = 1;
 }
 
 //--------------------------------------------------------------------------------------
@@ -697,12 +801,21 @@ CDXUTSDKMesh::CDXUTSDKMesh() : m_NumOutstandingResources( 0 ),
                                m_pAdjacencyIndexBufferArray( NULL ),
                                m_pAnimationData( NULL ),
                                m_pAnimationHeader( NULL ),
+                               m_pAnimationFrameData( NULL ),
                                m_ppVertices( NULL ),
                                m_ppIndices( NULL ),
                                m_pBindPoseFrameMatrices( NULL ),
                                m_pTransformedFrameMatrices( NULL ),
                                m_pWorldPoseFrameMatrices( NULL ),
-							   m_pDev( NULL )
+							   m_pDev( NULL ),
+							   m_bCreateBuffers( true ),
+							   m_bOwnsData( true ),
+							   m_pSubsetBounds( NULL ),
+							   m_pMeshBounds( NULL ),
+							   m_pInvBindPoseFrameMatrices( NULL ),
+							   m_pFrameOrder( NULL ),
+							   m_pFrameParents( NULL ),
+							   m_NumOrderedFrames( 0 )
 {
 }
 
@@ -715,18 +828,19 @@ CDXUTSDKMesh::~CDXUTSDKMesh()
 
 //--------------------------------------------------------------------------------------
 HRESULT CDXUTSDKMesh::Create( ID3D11Device* pDev11, LPCTSTR szFileName, bool bCreateAdjacencyIndices,
-                              SDKMESH_CALLBACKS* pLoaderCallbacks )
+                              SDKMESH_CALLBACKS* pLoaderCallbacks, bool bCreateBuffers )
 {
-    return CreateFromFile( pDev11, szFileName, bCreateAdjacencyIndices, pLoaderCallbacks );
+    return CreateFromFile( pDev11, szFileName, bCreateAdjacencyIndices, pLoaderCallbacks, bCreateBuffers );
 }
 
 
 //--------------------------------------------------------------------------------------
 HRESULT CDXUTSDKMesh::Create( ID3D11Device* pDev11, BYTE* pData, UINT DataBytes, bool bCreateAdjacencyIndices,
-                              bool bCopyStatic, SDKMESH_CALLBACKS* pLoaderCallbacks )
+                              bool bCopyStatic, SDKMESH_CALLBACKS* pLoaderCallbacks, bool bCreateBuffers,
+                              bool bOwnsData )
 {
     return CreateFromMemory( pDev11, pData, DataBytes, bCreateAdjacencyIndices, bCopyStatic,
-                             pLoaderCallbacks );
+                             pLoaderCallbacks, bCreateBuffers, bOwnsData );
 }
 
 //--------------------------------------------------------------------------------------
@@ -854,15 +968,23 @@ void CDXUTSDKMesh::Destroy()
     }
     SAFE_DELETE_ARRAY( m_pAdjacencyIndexBufferArray );
 
-    SAFE_DELETE_ARRAY( m_pHeapData );
+    if( m_bOwnsData )
+        SAFE_DELETE_ARRAY( m_pHeapData );
+    m_pHeapData = NULL;
     m_pStaticMeshData = NULL;
     SAFE_DELETE_ARRAY( m_pAnimationData );
     SAFE_DELETE_ARRAY( m_pBindPoseFrameMatrices );
     SAFE_DELETE_ARRAY( m_pTransformedFrameMatrices );
     SAFE_DELETE_ARRAY( m_pWorldPoseFrameMatrices );
+    SAFE_DELETE_ARRAY( m_pInvBindPoseFrameMatrices );
+    SAFE_DELETE_ARRAY( m_pFrameOrder );
+    SAFE_DELETE_ARRAY( m_pFrameParents );
+    m_NumOrderedFrames = 0;
 
     SAFE_DELETE_ARRAY( m_ppVertices );
     SAFE_DELETE_ARRAY( m_ppIndices );
+    SAFE_DELETE_ARRAY( m_pSubsetBounds );
+    SAFE_DELETE_ARRAY( m_pMeshBounds );
 
     m_pMeshHeader = NULL;
     m_pVertexBufferArray = NULL;
@@ -882,7 +1004,19 @@ void CDXUTSDKMesh::Destroy()
 //--------------------------------------------------------------------------------------
 void CDXUTSDKMesh::TransformBindPose( D3DXMATRIX* pWorld )
 {
-    TransformBindPoseFrame( 0, pWorld );
+    if( !m_pBindPoseFrameMatrices )
+        return;
+
+    for( UINT i = 0; i < m_NumOrderedFrames; i++ )
+    {
+        UINT iFrame = m_pFrameOrder[i];
+        UINT iParent = m_pFrameParents[iFrame];
+        const D3DXMATRIX* pParentWorld = iParent == INVALID_FRAME ? pWorld : &m_pBindPoseFrameMatrices[iParent];
+        D3DXMatrixMultiply( &m_pBindPoseFrameMatrices[iFrame], &m_pFrameArray[iFrame].Matrix, pParentWorld );
+
+        // TransformMesh() needs the inverse every time, it only changes here
+        D3DXMatrixInverse( &m_pInvBindPoseFrameMatrices[iFrame], NULL, &m_pBindPoseFrameMatrices[iFrame] );
+    }
 }
 
 //--------------------------------------------------------------------------------------
@@ -892,17 +1026,25 @@ void CDXUTSDKMesh::TransformMesh( D3DXMATRIX* pWorld, double fTime )
 {
     if( m_pAnimationHeader == NULL || FTT_RELATIVE == m_pAnimationHeader->FrameTransformType )
     {
-        TransformFrame( 0, pWorld, fTime );
+        UINT iTick = GetAnimationKeyFromTime( fTime );
 
-        // For each frame, move the transform to the bind pose, then
-        // move it to the final position
-        D3DXMATRIX mInvBindPose;
-        D3DXMATRIX mFinal;
-        for( UINT i = 0; i < m_pMeshHeader->NumFrames; i++ )
+        // parents come first, so their world pose is ready when the children need it
+        for( UINT i = 0; i < m_NumOrderedFrames; i++ )
         {
-            D3DXMatrixInverse( &mInvBindPose, NULL, &m_pBindPoseFrameMatrices[i] );
-            mFinal = mInvBindPose * m_pTransformedFrameMatrices[i];
-            m_pTransformedFrameMatrices[i] = mFinal;
+            UINT iFrame = m_pFrameOrder[i];
+            UINT iParent = m_pFrameParents[iFrame];
+            const D3DXMATRIX* pParentWorld = iParent == INVALID_FRAME ? pWorld : &m_pWorldPoseFrameMatrices[iParent];
+
+            D3DXMATRIX LocalTransform;
+            if( m_pAnimationFrameData && INVALID_ANIMATION_DATA != m_pFrameArray[iFrame].AnimationDataIndex )
+                KeyToMatrix( m_pAnimationFrameData[ m_pFrameArray[iFrame].AnimationDataIndex ].pAnimationData[ iTick ], &LocalTransform );
+            else
+                LocalTransform = m_pFrameArray[iFrame].Matrix;
+            D3DXMatrixMultiply( &m_pWorldPoseFrameMatrices[iFrame], &LocalTransform, pParentWorld );
+
+            // move the transform to the bind pose, then to the final position
+            D3DXMatrixMultiply( &m_pTransformedFrameMatrices[iFrame], &m_pInvBindPoseFrameMatrices[iFrame],
+                                &m_pWorldPoseFrameMatrices[iFrame] );
         }
     }
     else if( FTT_ABSOLUTE == m_pAnimationHeader->FrameTransformType )
@@ -1155,6 +1297,18 @@ D3DXVECTOR3 CDXUTSDKMesh::GetMeshBBoxExtents( UINT iMesh )
     return m_pMeshArray[iMesh].BoundingBoxExtents;
 }
 
+//--------------------------------------------------------------------------------------
+const SDKMESH_BOUNDS* CDXUTSDKMesh::GetMeshBounds( UINT iMesh )
+{
+    return &m_pMeshBounds[iMesh];
+}
+
+//--------------------------------------------------------------------------------------
+const SDKMESH_BOUNDS* CDXUTSDKMesh::GetSubsetBounds( UINT iMesh, UINT iSubset )
+{
+    return &m_pSubsetBounds[ m_pMeshArray[ iMesh ].pSubsets[iSubset] ];
+}
+
 //--------------------------------------------------------------------------------------
 UINT CDXUTSDKMesh::GetOutstandingResources()
 {
@@ -1221,6 +1375,8 @@ UINT CDXUTSDKMesh::GetOutstandingBufferResources()
     UINT outstandingResources = 0;
     if( !m_pMeshHeader )
         return 1;
+    if( !m_bCreateBuffers )
+        return 0;
 
     for( UINT i = 0; i < m_pMeshHeader->NumVertexBuffers; i++ )
     {
@@ -1306,6 +1462,38 @@ const D3DXMATRIX* CDXUTSDKMesh::GetMeshInfluenceMatrix( UINT iMesh, UINT iInflue
     return &m_pTransformedFrameMatrices[iFrame];
 }
 
+UINT CDXUTSDKMesh::GetNumOrderedFrames()
+{
+    return m_NumOrderedFrames;
+}
+
+//--------------------------------------------------------------------------------------
+const UINT* CDXUTSDKMesh::GetFrameOrder()
+{
+    return m_pFrameOrder;
+}
+
+//--------------------------------------------------------------------------------------
+UINT CDXUTSDKMesh::GetFrameParent( UINT iFrame )
+{
+    return m_pFrameParents[iFrame];
+}
+
+//--------------------------------------------------------------------------------------
+const SDKANIMATION_FILE_HEADER* CDXUTSDKMesh::GetAnimationHeader()
+{
+    return m_pAnimationHeader;
+}
+
+//--------------------------------------------------------------------------------------
+const SDKANIMATION_DATA* CDXUTSDKMesh::GetAnimationKeys( UINT iFrame )
+{
+    if( !m_pAnimationFrameData || INVALID_ANIMATION_DATA == m_pFrameArray[iFrame].AnimationDataIndex )
+        return NULL;
+    return m_pAnimationFrameData[ m_pFrameArray[iFrame].AnimationDataIndex ].pAnimationData;
+}
+
+//--------------------------------------------------------------------------------------
 const D3DXMATRIX* CDXUTSDKMesh::GetWorldMatrix( UINT iFrameIndex )
 {
     return &m_pWorldPoseFrameMatrices[iFrameIndex];
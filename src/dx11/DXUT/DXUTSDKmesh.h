@@ -253,6 +253,14 @@ struct SDKANIMATION_FRAME_DATA
     };
 };
 
+//added by vinjn: bounds computed at load time, not part of the file
+struct SDKMESH_BOUNDS
+{
+    D3DXVECTOR3 Center;
+    D3DXVECTOR3 Extents;        //half the box size
+    FLOAT Radius;               //of the sphere around Center
+};
+
 //--------------------------------------------------------------------------------------
 // AsyncLoading callbacks
 //--------------------------------------------------------------------------------------
@@ -285,6 +293,10 @@ private:
     //CGrowableArray <BYTE*> m_MappedPointers;
     ID3D11Device* m_pDev;
     //ID3D11DeviceContext* m_pDevContext;
+    bool m_bCreateBuffers;
+    bool m_bOwnsData;                  //false when the caller keeps the memory passed to CreateFromMemory alive
+    SDKMESH_BOUNDS* m_pSubsetBounds;   //indexed like m_pSubsetArray
+    SDKMESH_BOUNDS* m_pMeshBounds;
 
 protected:
     //These are the pointers to the two chunks of data loaded in from the mesh file
@@ -316,6 +328,12 @@ protected:
     D3DXMATRIX* m_pBindPoseFrameMatrices;
     D3DXMATRIX* m_pTransformedFrameMatrices;
     D3DXMATRIX* m_pWorldPoseFrameMatrices;
+    D3DXMATRIX* m_pInvBindPoseFrameMatrices;
+
+    //Frames reachable from frame 0, parents before children
+    UINT* m_pFrameOrder;
+    UINT* m_pFrameParents;              //indexed by frame, INVALID_FRAME for roots
+    UINT m_NumOrderedFrames;
 
 protected:
     void                            LoadMaterials( ID3D11Device* pd3dDevice, SDKMESH_MATERIAL* pMaterials,
@@ -331,18 +349,23 @@ protected:
     HRESULT                 CreateFromFile( ID3D11Device* pDev11,
                                                     LPCTSTR szFileName,
                                                     bool bCreateAdjacencyIndices,
-                                                    SDKMESH_CALLBACKS* pLoaderCallbacks11 = NULL);
+                                                    SDKMESH_CALLBACKS* pLoaderCallbacks11 = NULL,
+                                                    bool bCreateBuffers = true);
 
     HRESULT                 CreateFromMemory( ID3D11Device* pDev11,
                                                       BYTE* pData,
                                                       UINT DataBytes,
                                                       bool bCreateAdjacencyIndices,
                                                       bool bCopyStatic,
-                                                      SDKMESH_CALLBACKS* pLoaderCallbacks11 = NULL);
+                                                      SDKMESH_CALLBACKS* pLoaderCallbacks11 = NULL,
+                                                      bool bCreateBuffers = true,
+                                                      bool bOwnsData = true);
+
+    //SIMD min/max over the vertices each subset draws, in parallel across meshes
+    void                            ComputeBounds();
 
     //frame manipulation
-    void                            TransformBindPoseFrame( UINT iFrame, D3DXMATRIX* pParentWorld );
-    void                            TransformFrame( UINT iFrame, D3DXMATRIX* pParentWorld, double fTime );
+    void                            FlattenFrames();
     void                            TransformFrameAbsolute( UINT iFrame, double fTime );
 
     //Direct3D 11 rendering helpers
@@ -363,11 +386,14 @@ public:
                                     CDXUTSDKMesh();
                             ~CDXUTSDKMesh();
 
+    //added by vinjn: bCreateBuffers=false leaves the vertex and index data to the caller, e.g. to pool it,
+    //GetVB()/GetIB() return NULL then and Render() can't be used
     HRESULT                 Create( ID3D11Device* pDev11, LPCTSTR szFileName, bool bCreateAdjacencyIndices=
-                                            false, SDKMESH_CALLBACKS* pLoaderCallbacks=NULL );
+                                            false, SDKMESH_CALLBACKS* pLoaderCallbacks=NULL, bool bCreateBuffers=true );
     HRESULT                 Create( ID3D11Device* pDev11, BYTE* pData, UINT DataBytes,
                                             bool bCreateAdjacencyIndices=false, bool bCopyStatic=false,
-                                            SDKMESH_CALLBACKS* pLoaderCallbacks=NULL );
+                                            SDKMESH_CALLBACKS* pLoaderCallbacks=NULL, bool bCreateBuffers=true,
+                                            bool bOwnsData=true );
     HRESULT                 LoadAnimation( WCHAR* szFileName );
     void                    Destroy();
 
@@ -422,6 +448,9 @@ public:
     UINT64                          GetNumIndices( UINT iMesh );
     D3DXVECTOR3                     GetMeshBBoxCenter( UINT iMesh );
     D3DXVECTOR3                     GetMeshBBoxExtents( UINT iMesh );
+    //The mesh box encloses the subset boxes and the mesh sphere the subset spheres
+    const SDKMESH_BOUNDS*           GetMeshBounds( UINT iMesh );
+    const SDKMESH_BOUNDS*           GetSubsetBounds( UINT iMesh, UINT iSubset );
     UINT                            GetOutstandingResources();
     UINT                            GetOutstandingBufferResources();
     bool                            CheckLoadDone();
@@ -437,6 +466,14 @@ public:
     const D3DXMATRIX*               GetWorldMatrix( UINT iFrameIndex );
     const D3DXMATRIX*               GetInfluenceMatrix( UINT iFrameIndex );
     bool                            GetAnimationProperties( UINT* pNumKeys, FLOAT* pFrameTime );
+
+    //Flattened hierarchy, GetFrameOrder() lists GetNumOrderedFrames() frames with parents first
+    UINT                            GetNumOrderedFrames();
+    const UINT*                     GetFrameOrder();
+    UINT                            GetFrameParent( UINT iFrame );
+    const SDKANIMATION_FILE_HEADER* GetAnimationHeader();
+    //NumAnimationKeys keys, NULL when the frame isn't animated
+    const SDKANIMATION_DATA*        GetAnimationKeys( UINT iFrame );
 };
 
 #endif
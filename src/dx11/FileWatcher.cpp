@@ -0,0 +1,254 @@
+#include "dx11/FileWatcher.h"
+#include "cinder/Thread.h"
+
+#include <string>
+
+#if defined( _WIN32 )
+#include <windows.h>
+#else
+#include <sys/inotify.h>
+#include <poll.h>
+#include <unistd.h>
+#include <map>
+#endif
+
+namespace cinder { namespace dx11 {
+
+namespace
+{
+    // directories are compared as spelled after normalizing the separators
+    std::string directoryKey(const fs::path& directory)
+    {
+        fs::path path = directory;
+        path.make_preferred();
+        std::string key = path.string();
+        while (key.size() > 1 && (key[key.size() - 1] == '/' || key[key.size() - 1] == '\\'))
+            key.erase(key.size() - 1);
+        return key;
+    }
+}
+
+#if defined( _WIN32 )
+
+// One overlapped ReadDirectoryChangesW per directory, all waited on together
+class Win32FileWatcher : public FileWatcher
+{
+public:
+    Win32FileWatcher():mWakeup(CreateEventA(NULL, FALSE, FALSE, NULL)){}
+
+    ~Win32FileWatcher()
+    {
+        for (size_t i=0;i<mDirectories.size();i++)
+        {
+            Directory& dir = *mDirectories[i];
+            CancelIo(dir.handle);
+            // the kernel may still write into the buffer until the cancelled read completes
+            DWORD bytes = 0;
+            GetOverlappedResult(dir.handle, &dir.overlapped, &bytes, TRUE);
+            CloseHandle(dir.handle);
+            CloseHandle(dir.overlapped.hEvent);
+        }
+        CloseHandle(mWakeup);
+    }
+
+    bool addDirectory( const fs::path& directory )
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        std::string key = directoryKey(directory);
+        for (size_t i=0;i<mDirectories.size();i++)
+        {
+            if (mDirectories[i]->key == key)
+                return true;
+        }
+        for (size_t i=0;i<mAdded.size();i++)
+        {
+            if (mAdded[i] == key)
+                return true;
+        }
+        // WaitForMultipleObjects takes at most 64 handles, one of them is the wakeup event
+        if (mDirectories.size() + mAdded.size() >= MAXIMUM_WAIT_OBJECTS - 1)
+            return false;
+
+        // overlapped reads have to be issued by the waiting thread, it picks the directory up when woken
+        mAdded.push_back(key);
+        SetEvent(mWakeup);
+        return true;
+    }
+
+    bool wait( uint32_t timeoutMs, std::vector<fs::path>* changed )
+    {
+        openAdded();
+
+        std::vector<HANDLE> events;
+        events.push_back(mWakeup);
+        for (size_t i=0;i<mDirectories.size();i++)
+            events.push_back(mDirectories[i]->overlapped.hEvent);
+
+        DWORD result = WaitForMultipleObjects((DWORD)events.size(), &events[0], FALSE, timeoutMs);
+        if (result < WAIT_OBJECT_0 + 1 || result >= WAIT_OBJECT_0 + events.size())
+            return false;
+
+        // the signalled one and every other that completed meanwhile
+        size_t numChanged = changed->size();
+        for (size_t i=result - WAIT_OBJECT_0 - 1;i<mDirectories.size();i++)
+        {
+            Directory& dir = *mDirectories[i];
+            DWORD bytes = 0;
+            if (!GetOverlappedResult(dir.handle, &dir.overlapped, &bytes, FALSE))
+                continue;
+            collect(dir, bytes, changed);
+            issueRead(dir);
+        }
+        return changed->size() > numChanged;
+    }
+
+private:
+    struct Directory
+    {
+        std::string key;
+        HANDLE      handle;
+        OVERLAPPED  overlapped;
+        DWORD       buffer[16 * 1024];
+    };
+
+    void openAdded()
+    {
+        std::vector<std::string> added;
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            added.swap(mAdded);
+        }
+
+        for (size_t i=0;i<added.size();i++)
+        {
+            std::shared_ptr<Directory> dir(new Directory);
+            dir->key = added[i];
+            dir->handle = CreateFileA(added[i].c_str(), FILE_LIST_DIRECTORY, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                NULL, OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED, NULL);
+            if (dir->handle == INVALID_HANDLE_VALUE)
+                continue;
+            ZeroMemory(&dir->overlapped, sizeof(dir->overlapped));
+            dir->overlapped.hEvent = CreateEventA(NULL, TRUE, FALSE, NULL);
+            if (!issueRead(*dir))
+            {
+                CloseHandle(dir->handle);
+                CloseHandle(dir->overlapped.hEvent);
+                continue;
+            }
+
+            std::lock_guard<std::mutex> lock(mMutex);
+            mDirectories.push_back(dir);
+        }
+    }
+
+    static bool issueRead(Directory& dir)
+    {
+        ResetEvent(dir.overlapped.hEvent);
+        return ReadDirectoryChangesW(dir.handle, dir.buffer, sizeof(dir.buffer), FALSE,
+            FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_SIZE,
+            NULL, &dir.overlapped, NULL) != 0;
+    }
+
+    static void collect(const Directory& dir, DWORD bytes, std::vector<fs::path>* changed)
+    {
+        // zero bytes means the buffer overflowed and the names of this batch are lost
+        if (bytes == 0)
+            return;
+
+        const uint8_t* entry = reinterpret_cast<const uint8_t*>(dir.buffer);
+        for (;;)
+        {
+            const FILE_NOTIFY_INFORMATION* info = reinterpret_cast<const FILE_NOTIFY_INFORMATION*>(entry);
+            if (info->Action != FILE_ACTION_REMOVED && info->Action != FILE_ACTION_RENAMED_OLD_NAME)
+            {
+                std::wstring name(info->FileName, info->FileNameLength / sizeof(WCHAR));
+                changed->push_back(fs::path(dir.key) / fs::path(name));
+            }
+            if (info->NextEntryOffset == 0)
+                break;
+            entry += info->NextEntryOffset;
+        }
+    }
+
+    HANDLE      mWakeup;
+    std::mutex  mMutex;
+    std::vector<std::string>    mAdded;
+    std::vector<std::shared_ptr<Directory> >    mDirectories;
+};
+
+FileWatcherRef FileWatcher::create()
+{
+    return FileWatcherRef(new Win32FileWatcher);
+}
+
+#else
+
+// One inotify instance with a watch per directory
+class InotifyFileWatcher : public FileWatcher
+{
+public:
+    explicit InotifyFileWatcher(int fd):mFd(fd){}
+
+    ~InotifyFileWatcher()
+    {
+        close(mFd);
+    }
+
+    bool addDirectory( const fs::path& directory )
+    {
+        std::string key = directoryKey(directory);
+        int wd = inotify_add_watch(mFd, key.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | IN_MODIFY);
+        if (wd < 0)
+            return false;
+
+        // adding a watched directory again returns its old descriptor
+        std::lock_guard<std::mutex> lock(mMutex);
+        mDirectories[wd] = key;
+        return true;
+    }
+
+    bool wait( uint32_t timeoutMs, std::vector<fs::path>* changed )
+    {
+        pollfd fd;
+        fd.fd = mFd;
+        fd.events = POLLIN;
+        fd.revents = 0;
+        if (poll(&fd, 1, (int)timeoutMs) <= 0)
+            return false;
+
+        size_t numChanged = changed->size();
+        char buffer[16 * 1024] __attribute__((aligned(__alignof__(inotify_event))));
+        ssize_t length;
+        while ((length = read(mFd, buffer, sizeof(buffer))) > 0)
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            for (ssize_t offset = 0; offset < length; )
+            {
+                const inotify_event* event = reinterpret_cast<const inotify_event*>(buffer + offset);
+                std::map<int, std::string>::const_iterator dir = mDirectories.find(event->wd);
+                if (dir != mDirectories.end() && event->len > 0)
+                    changed->push_back(fs::path(dir->second) / event->name);
+                offset += sizeof(inotify_event) + event->len;
+            }
+        }
+        return changed->size() > numChanged;
+    }
+
+private:
+    int         mFd;
+    std::mutex  mMutex;
+    std::map<int, std::string>  mDirectories;
+};
+
+FileWatcherRef FileWatcher::create()
+{
+    // non-blocking, so wait() can drain every queued event after poll() says there are some
+    int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (fd < 0)
+        return FileWatcherRef();
+    return FileWatcherRef(new InotifyFileWatcher(fd));
+}
+
+#endif
+
+} } // namespace cinder::dx11
@@ -0,0 +1,250 @@
+#include "dx11/FrameHierarchy.h"
+#include "dx11/WorkerPool.h"
+#include "DXUT/DXUTSDKmesh.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <xmmintrin.h>
+#include <boost/bind.hpp>
+
+namespace cinder { namespace dx11 {
+
+namespace
+{
+    // Matrices are 16 floats in the D3DX layout: rows, with row vectors. Read as a column-major Matrix44f
+    // the same floats are the same transform, so Matrix44f goes in and out without conversion.
+
+    // out = a * b, applying a first. out must not alias a or b.
+    inline void multiply( const float* a, const float* b, float* out )
+    {
+        __m128 b0 = _mm_loadu_ps(b), b1 = _mm_loadu_ps(b + 4), b2 = _mm_loadu_ps(b + 8), b3 = _mm_loadu_ps(b + 12);
+        for (int i=0;i<4;i++)
+        {
+            const float* row = a + i * 4;
+            __m128 r = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(row[0]), b0), _mm_mul_ps(_mm_set1_ps(row[1]), b1));
+            r = _mm_add_ps(r, _mm_add_ps(_mm_mul_ps(_mm_set1_ps(row[2]), b2), _mm_mul_ps(_mm_set1_ps(row[3]), b3)));
+            _mm_storeu_ps(out + i * 4, r);
+        }
+    }
+
+    // rotation by the unit quaternion q, then translation by t
+    void keyToMatrix( const float* t, const float* q, float* out )
+    {
+        float x = q[0], y = q[1], z = q[2], w = q[3];
+        float xx = 2 * x * x, yy = 2 * y * y, zz = 2 * z * z;
+        float xy = 2 * x * y, xz = 2 * x * z, yz = 2 * y * z;
+        float xw = 2 * x * w, yw = 2 * y * w, zw = 2 * z * w;
+
+        out[0] = 1 - yy - zz;   out[1] = xy + zw;       out[2] = xz - yw;       out[3] = 0;
+        out[4] = xy - zw;       out[5] = 1 - xx - zz;   out[6] = yz + xw;       out[7] = 0;
+        out[8] = xz + yw;       out[9] = yz - xw;       out[10] = 1 - xx - yy;  out[11] = 0;
+        out[12] = t[0];         out[13] = t[1];         out[14] = t[2];         out[15] = 1;
+    }
+
+    void invert( const float* m, float* out )
+    {
+        Matrix44f matrix;
+        memcpy(matrix.m, m, sizeof(matrix.m));
+        memcpy(out, matrix.inverted().m, sizeof(matrix.m));
+    }
+
+    const float kIdentity[16] = {1, 0, 0, 0,  0, 1, 0, 0,  0, 0, 1, 0,  0, 0, 0, 1};
+}
+
+// Each task poses a range of instances with a scratch pose of its own
+struct FrameHierarchy::Batch
+{
+    const FrameHierarchy*   hierarchy;
+    const Instance*         instances;
+    Matrix44f*              skin;
+
+    void evaluateRange( size_t begin, size_t end ) const
+    {
+        std::vector<float> scratch(hierarchy->mFrames.size() * 16 + 16);
+        for (size_t i=begin;i<end;i++)
+        {
+            hierarchy->evaluate(instances[i].time, instances[i].world, skin + i * hierarchy->mNumFrames, NULL,
+                &scratch[0]);
+        }
+    }
+};
+
+void FrameHierarchy::create( CDXUTSDKMesh& sdkMesh, const AnimationClip::Options& options )
+{
+    mNumFrames = sdkMesh.GetNumFrames();
+    size_t numSlots = sdkMesh.GetNumOrderedFrames();
+    const UINT* order = sdkMesh.GetFrameOrder();
+    mHasUnreachable = numSlots < mNumFrames;
+
+    const SDKANIMATION_FILE_HEADER* animation = sdkMesh.GetAnimationHeader();
+    mNumKeys = animation ? animation->NumAnimationKeys : 0;
+    mFps = animation ? (float)animation->AnimationFPS : 0.0f;
+    mAbsolute = animation && animation->FrameTransformType == FTT_ABSOLUTE;
+
+    std::vector<int32_t> slots(mNumFrames, -1);
+    mFrames.assign(order, order + numSlots);
+    mParents.resize(numSlots);
+    mTracks.assign(numSlots, -1);
+    mLocal.resize(numSlots * 16);
+    mInvBind.resize(numSlots * 16);
+    mInvFirstKeys.clear();
+
+    // per track, mNumKeys keys of translation xyz, unit quaternion xyzw and one float of padding
+    std::vector<float> packedKeys;
+    size_t numTracks = 0;
+
+    std::vector<float> bindWorld(numSlots * 16);
+    for (size_t slot=0;slot<numSlots;slot++)
+    {
+        UINT frame = mFrames[slot];
+        slots[frame] = (int32_t)slot;
+        UINT parent = sdkMesh.GetFrameParent(frame);
+        mParents[slot] = parent == INVALID_FRAME ? -1 : slots[parent];
+
+        // the bind pose with an identity world, like TransformBindPose() is usually called
+        memcpy(&mLocal[slot * 16], &sdkMesh.GetFrame(frame)->Matrix, 16 * sizeof(float));
+        if (mParents[slot] < 0)
+            memcpy(&bindWorld[slot * 16], &mLocal[slot * 16], 16 * sizeof(float));
+        else
+            multiply(&mLocal[slot * 16], &bindWorld[mParents[slot] * 16], &bindWorld[slot * 16]);
+        invert(&bindWorld[slot * 16], &mInvBind[slot * 16]);
+
+        const SDKANIMATION_DATA* keys = mNumKeys > 0 ? sdkMesh.GetAnimationKeys(frame) : NULL;
+        if (keys == NULL)
+            continue;
+
+        // normalized once here instead of every time a key is used
+        int32_t track = (int32_t)numTracks++;
+        mTracks[slot] = track;
+        for (size_t k=0;k<mNumKeys;k++)
+        {
+            const SDKANIMATION_DATA& key = keys[k];
+            float q[4] = {key.Orientation.x, key.Orientation.y, key.Orientation.z, key.Orientation.w};
+            float length = std::sqrt(q[0] * q[0] + q[1] * q[1] + q[2] * q[2] + q[3] * q[3]);
+            if (length > 0)
+            {
+                for (int c=0;c<4;c++)
+                    q[c] /= length;
+            }
+            else
+            {
+                q[0] = q[1] = q[2] = 0;
+                q[3] = 1;
+            }
+
+            float packed[8] = {key.Translation.x, key.Translation.y, key.Translation.z, q[0], q[1], q[2], q[3], 0};
+            packedKeys.insert(packedKeys.end(), packed, packed + 8);
+        }
+
+        if (mAbsolute)
+        {
+            float first[16];
+            mInvFirstKeys.resize(mInvFirstKeys.size() + 16);
+            keyToMatrix(&packedKeys[track * mNumKeys * 8], &packedKeys[track * mNumKeys * 8 + 3], first);
+            invert(first, &mInvFirstKeys[track * 16]);
+        }
+    }
+
+    mClip.create(numTracks > 0 ? &packedKeys[0] : NULL, numTracks, mNumKeys, options);
+}
+
+size_t FrameHierarchy::getKey( double time ) const
+{
+    if (mNumKeys < 2)
+        return 0;
+    return (size_t)getPosition(time);
+}
+
+double FrameHierarchy::getPosition( double time ) const
+{
+    // fmod() keeps the sign of a negative time, and a tiny negative remainder can round up to a whole loop
+    double loop = (double)(mNumKeys - 1);
+    double position = std::fmod(mFps * time, loop);
+    if (position < 0)
+        position += loop;
+    if (!(position < loop))
+        position = 0;
+    return position + 1.0;
+}
+
+void FrameHierarchy::computeLocal( size_t slot, float position, float* local ) const
+{
+    float translation[3], rotation[4];
+    size_t last = mNumKeys - 1;
+    mClip.sample(mTracks[slot], std::min(position, (float)last), translation, rotation);
+    if (position > last)
+    {
+        // past the last key the loop heads back to key 1
+        float wrapTranslation[3], wrapRotation[4];
+        mClip.sample(mTracks[slot], 1.0f, wrapTranslation, wrapRotation);
+        AnimationClip::interpolate(translation, rotation, wrapTranslation, wrapRotation, position - last,
+            translation, rotation);
+    }
+    keyToMatrix(translation, rotation, local);
+}
+
+void FrameHierarchy::evaluate( double time, const Matrix44f& world, Matrix44f* skin, Matrix44f* worldPose ) const
+{
+    std::vector<float> scratch(mFrames.size() * 16 + 16);
+    evaluate(time, world, skin, worldPose, &scratch[0]);
+}
+
+void FrameHierarchy::evaluate( double time, const Matrix44f& world, Matrix44f* skin, Matrix44f* worldPose, float* scratch ) const
+{
+    if (mHasUnreachable)
+    {
+        for (size_t i=0;i<mNumFrames;i++)
+        {
+            memcpy(skin[i].m, kIdentity, sizeof(kIdentity));
+            if (worldPose)
+                memcpy(worldPose[i].m, kIdentity, sizeof(kIdentity));
+        }
+    }
+
+    float position = 0;
+    if (mNumKeys >= 2)
+        position = (float)getPosition(time);
+    float* local = scratch + mFrames.size() * 16;
+    for (size_t slot=0;slot<mFrames.size();slot++)
+    {
+        float* frameWorld = scratch + slot * 16;
+        Matrix44f& frameSkin = skin[mFrames[slot]];
+
+        if (mAbsolute)
+        {
+            // no hierarchy, every animated frame moves from its first key to the current one
+            if (mTracks[slot] < 0)
+            {
+                memcpy(frameSkin.m, kIdentity, sizeof(kIdentity));
+                continue;
+            }
+            computeLocal(slot, position, local);
+            multiply(&mInvFirstKeys[mTracks[slot] * 16], local, frameSkin.m);
+            continue;
+        }
+
+        const float* parentWorld = mParents[slot] < 0 ? world.m : scratch + mParents[slot] * 16;
+        if (mTracks[slot] < 0)
+            multiply(&mLocal[slot * 16], parentWorld, frameWorld);
+        else
+        {
+            computeLocal(slot, position, local);
+            multiply(local, parentWorld, frameWorld);
+        }
+        multiply(&mInvBind[slot * 16], frameWorld, frameSkin.m);
+        if (worldPose)
+            memcpy(worldPose[mFrames[slot]].m, frameWorld, 16 * sizeof(float));
+    }
+}
+
+void FrameHierarchy::evaluate( const Instance* instances, size_t count, Matrix44f* skin ) const
+{
+    Batch batch;
+    batch.hierarchy = this;
+    batch.instances = instances;
+    batch.skin = skin;
+    parallelFor(count, 8, boost::bind(&Batch::evaluateRange, &batch, _1, _2));
+}
+
+} } // namespace cinder::dx11
@@ -0,0 +1,133 @@
+#include "dx11/IncludeCache.h"
+
+#include <fstream>
+
+#if defined( _WIN32 )
+#include <windows.h>
+#else
+#include <sys/stat.h>
+#endif
+
+namespace cinder { namespace dx11 {
+
+IncludeCache::IncludeCache( const Resolver& resolve )
+:mResolve(resolve)
+{
+}
+
+ShaderIncludes::Contents IncludeCache::open( const std::string& name )
+{
+    Entry entry;
+    bool known = false;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        boost::unordered_map<std::string, Entry>::const_iterator it = mEntries.find(name);
+        if (it != mEntries.end())
+        {
+            entry = it->second;
+            known = true;
+        }
+    }
+
+    // the file is looked at outside the lock, other compiles keep going meanwhile
+    if (known)
+    {
+        Stamp stamp;
+        if (getStamp(entry.path, &stamp) && stamp == entry.stamp)
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mStats.hits++;
+            return entry.contents;
+        }
+    }
+
+    // new or changed, or moved away, so it's resolved again too
+    Entry loaded;
+    loaded.path = mResolve(name);
+    if (loaded.path.empty())
+        return Contents();
+    std::shared_ptr<std::string> contents(new std::string);
+    if (!getStamp(loaded.path, &loaded.stamp) || !readFile(loaded.path, contents.get()) || contents->empty())
+        return Contents();
+    loaded.contents = contents;
+
+    std::lock_guard<std::mutex> lock(mMutex);
+    // when two compiles read a new include at once, the first one in wins and both share its contents
+    boost::unordered_map<std::string, Entry>::iterator it = mEntries.find(name);
+    if (it != mEntries.end() && it->second.path == loaded.path && it->second.stamp == loaded.stamp)
+    {
+        mStats.hits++;
+        return it->second.contents;
+    }
+    if (known)
+        mStats.reloads++;
+    else
+        mStats.loads++;
+    mEntries[name] = loaded;
+    return loaded.contents;
+}
+
+void IncludeCache::invalidate( const fs::path& path )
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    for (boost::unordered_map<std::string, Entry>::iterator it = mEntries.begin(); it != mEntries.end();)
+    {
+        // the watcher and the resolver may spell the same file differently
+        boost::system::error_code ec;
+        if (it->second.path == path || (it->second.path.filename() == path.filename() && fs::equivalent(it->second.path, path, ec)))
+            it = mEntries.erase(it);
+        else
+            ++it;
+    }
+}
+
+void IncludeCache::clear()
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    mEntries.clear();
+}
+
+IncludeCache::Stats IncludeCache::getStats() const
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mStats;
+}
+
+bool IncludeCache::getStamp( const fs::path& path, Stamp* stamp )
+{
+#if defined( _WIN32 )
+    WIN32_FILE_ATTRIBUTE_DATA data;
+    if (!::GetFileAttributesExW(path.wstring().c_str(), GetFileExInfoStandard, &data))
+        return false;
+    stamp->size = (uint64_t(data.nFileSizeHigh) << 32) | data.nFileSizeLow;
+    stamp->modified = (uint64_t(data.ftLastWriteTime.dwHighDateTime) << 32) | data.ftLastWriteTime.dwLowDateTime;
+#else
+    struct stat info;
+    if (::stat(path.string().c_str(), &info) != 0)
+        return false;
+    stamp->size = uint64_t(info.st_size);
+#if defined( __APPLE__ )
+    stamp->modified = uint64_t(info.st_mtimespec.tv_sec) * 1000000000u + info.st_mtimespec.tv_nsec;
+#else
+    stamp->modified = uint64_t(info.st_mtim.tv_sec) * 1000000000u + info.st_mtim.tv_nsec;
+#endif
+#endif
+    return true;
+}
+
+bool IncludeCache::readFile( const fs::path& path, std::string* contents )
+{
+    std::ifstream file(path.string().c_str(), std::ios::binary);
+    if (!file)
+        return false;
+
+    file.seekg(0, std::ios::end);
+    std::streamoff size = file.tellg();
+    if (size < 0)
+        return false;
+    file.seekg(0, std::ios::beg);
+    contents->resize((size_t)size);
+    return size == 0 || file.read(&(*contents)[0], size).good();
+}
+
+} } // namespace cinder::dx11
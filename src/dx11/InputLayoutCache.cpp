@@ -0,0 +1,181 @@
+#include "dx11/InputLayoutCache.h"
+#include "dx11/dx11.h"
+#include "CacheUtils.h"
+
+#include <cstring>
+
+namespace cinder { namespace dx11 {
+
+namespace
+{
+    using detail::kFnvOffset;
+    using detail::hashBytes;
+
+    uint64_t hashValue(uint64_t hash, UINT value)
+    {
+        return hashBytes(hash, &value, sizeof(value));
+    }
+
+    uint32_t readUint(const uint8_t* p)
+    {
+        uint32_t value;
+        memcpy(&value, p, sizeof(value));
+        return value;
+    }
+}
+
+bool InputLayoutCache::Element::operator==( const Element& rhs ) const
+{
+    return semanticName == rhs.semanticName && semanticIndex == rhs.semanticIndex && format == rhs.format
+        && inputSlot == rhs.inputSlot && alignedByteOffset == rhs.alignedByteOffset
+        && inputSlotClass == rhs.inputSlotClass && instanceDataStepRate == rhs.instanceDataStepRate;
+}
+
+InputLayoutCache& InputLayoutCache::get()
+{
+    static InputLayoutCache sCache;
+    return sCache;
+}
+
+// A DXBC container is a header followed by chunks. Only the ISGN chunk matters for input layouts,
+// so shaders that differ elsewhere share a layout. Unknown containers fall back to the whole bytecode.
+void InputLayoutCache::getSignature( const void* pShaderBytecode, SIZE_T BytecodeLength, const uint8_t** ppSignature, size_t* pSize )
+{
+    const uint8_t* bytes = static_cast<const uint8_t*>(pShaderBytecode);
+    *ppSignature = bytes;
+    *pSize = BytecodeLength;
+
+    const size_t kHeaderSize = 32;
+    if (BytecodeLength < kHeaderSize || memcmp(bytes, "DXBC", 4) != 0)
+        return;
+
+    uint32_t numChunks = readUint(bytes + 28);
+    if (numChunks > (BytecodeLength - kHeaderSize) / 4)
+        return;
+
+    for (uint32_t i=0;i<numChunks;i++)
+    {
+        uint32_t offset = readUint(bytes + kHeaderSize + i*4);
+        if (offset > BytecodeLength - 8)
+            return;
+
+        uint32_t size = readUint(bytes + offset + 4);
+        if (memcmp(bytes + offset, "ISGN", 4) == 0 && size <= BytecodeLength - offset - 8)
+        {
+            *ppSignature = bytes + offset;
+            *pSize = size + 8;
+            return;
+        }
+    }
+}
+
+ID3D11InputLayout* InputLayoutCache::find( uint64_t hash, const std::vector<Element>& elements, const uint8_t* signature, size_t signatureSize ) const
+{
+    std::pair<LayoutMap::const_iterator, LayoutMap::const_iterator> range = mLayouts.equal_range(hash);
+    for (LayoutMap::const_iterator it=range.first;it!=range.second;++it)
+    {
+        const Entry& entry = it->second;
+        if (entry.elements == elements && entry.signature.size() == signatureSize
+            && (signatureSize == 0 || memcmp(&entry.signature[0], signature, signatureSize) == 0))
+            return entry.layout;
+    }
+    return NULL;
+}
+
+HRESULT InputLayoutCache::getInputLayout( const D3D11_INPUT_ELEMENT_DESC* pElementDescs, UINT NumElements,
+    const void* pShaderBytecode, SIZE_T BytecodeLength, ID3D11InputLayout** ppInputLayout )
+{
+    if (ppInputLayout == NULL || pElementDescs == NULL || NumElements == 0)
+        return E_INVALIDARG;
+
+    const uint8_t* signature;
+    size_t signatureSize;
+    getSignature(pShaderBytecode, BytecodeLength, &signature, &signatureSize);
+
+    std::vector<Element> elements(NumElements);
+    uint64_t hash = hashBytes(kFnvOffset, signature, signatureSize);
+    for (UINT i=0;i<NumElements;i++)
+    {
+        const D3D11_INPUT_ELEMENT_DESC& desc = pElementDescs[i];
+        Element& element = elements[i];
+        element.semanticName = desc.SemanticName;
+        element.semanticIndex = desc.SemanticIndex;
+        element.format = desc.Format;
+        element.inputSlot = desc.InputSlot;
+        element.alignedByteOffset = desc.AlignedByteOffset;
+        element.inputSlotClass = desc.InputSlotClass;
+        element.instanceDataStepRate = desc.InstanceDataStepRate;
+
+        hash = hashBytes(hash, element.semanticName.c_str(), element.semanticName.size() + 1);
+        hash = hashValue(hash, element.semanticIndex);
+        hash = hashValue(hash, element.format);
+        hash = hashValue(hash, element.inputSlot);
+        hash = hashValue(hash, element.alignedByteOffset);
+        hash = hashValue(hash, element.inputSlotClass);
+        hash = hashValue(hash, element.instanceDataStepRate);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        ID3D11InputLayout* layout = find(hash, elements, signature, signatureSize);
+        if (layout != NULL)
+        {
+            mHits++;
+            layout->AddRef();
+            *ppInputLayout = layout;
+            return S_OK;
+        }
+        mMisses++;
+    }
+
+    // the device is free threaded, so creating outside the lock is fine
+    CComPtr<ID3D11InputLayout> layout;
+    HRESULT hr = getDevice()->CreateInputLayout(pElementDescs, NumElements, pShaderBytecode, BytecodeLength, &layout);
+    if (FAILED(hr))
+        return hr;
+
+    std::lock_guard<std::mutex> lock(mMutex);
+    // another thread may have created the same layout meanwhile, keep the first one
+    ID3D11InputLayout* existing = find(hash, elements, signature, signatureSize);
+    if (existing == NULL)
+    {
+        Entry entry;
+        entry.elements.swap(elements);
+        entry.signature.assign(signature, signature + signatureSize);
+        entry.layout = layout;
+        mLayouts.insert(std::make_pair(hash, entry));
+        existing = layout;
+    }
+
+    existing->AddRef();
+    *ppInputLayout = existing;
+    return S_OK;
+}
+
+void InputLayoutCache::clear()
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    mLayouts.clear();
+    mHits = 0;
+    mMisses = 0;
+}
+
+size_t InputLayoutCache::getNumLayouts() const
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mLayouts.size();
+}
+
+size_t InputLayoutCache::getHits() const
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mHits;
+}
+
+size_t InputLayoutCache::getMisses() const
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mMisses;
+}
+
+} } // namespace cinder::dx11
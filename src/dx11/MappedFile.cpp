@@ -0,0 +1,142 @@
+#include "dx11/MappedFile.h"
+
+#if !defined( _WIN32 )
+#include <cerrno>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace cinder { namespace dx11 {
+
+#if defined( _WIN32 )
+
+MappedFile::MappedFile()
+:mFile(INVALID_HANDLE_VALUE), mMapping(NULL), mData(NULL), mSize(0), mCopyOnWrite(false), mError(0)
+{
+}
+
+bool MappedFile::open( const std::string& path, bool copyOnWrite )
+{
+    close();
+
+    mFile = CreateFileA( path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL );
+    if (mFile == INVALID_HANDLE_VALUE)
+    {
+        mError = GetLastError();
+        return false;
+    }
+
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx( mFile, &fileSize ))
+    {
+        mError = GetLastError();
+        close();
+        return false;
+    }
+    if (fileSize.QuadPart == 0)
+    {
+        mError = ERROR_HANDLE_EOF;
+        close();
+        return false;
+    }
+
+    mMapping = CreateFileMappingA( mFile, NULL, copyOnWrite ? PAGE_WRITECOPY : PAGE_READONLY, 0, 0, NULL );
+    if (mMapping == NULL)
+    {
+        mError = GetLastError();
+        close();
+        return false;
+    }
+
+    mData = MapViewOfFile( mMapping, copyOnWrite ? FILE_MAP_COPY : FILE_MAP_READ, 0, 0, 0 );
+    if (mData == NULL)
+    {
+        mError = GetLastError();
+        close();
+        return false;
+    }
+
+    mSize = static_cast<size_t>(fileSize.QuadPart);
+    mCopyOnWrite = copyOnWrite;
+    mError = 0;
+    return true;
+}
+
+void MappedFile::close()
+{
+    if (mData != NULL)
+        UnmapViewOfFile( mData );
+    if (mMapping != NULL)
+        CloseHandle( mMapping );
+    if (mFile != INVALID_HANDLE_VALUE)
+        CloseHandle( mFile );
+
+    mFile = INVALID_HANDLE_VALUE;
+    mMapping = NULL;
+    mData = NULL;
+    mSize = 0;
+    mCopyOnWrite = false;
+}
+
+#else
+
+MappedFile::MappedFile()
+:mData(NULL), mSize(0), mCopyOnWrite(false), mError(0)
+{
+}
+
+bool MappedFile::open( const std::string& path, bool copyOnWrite )
+{
+    close();
+
+    int fd = ::open( path.c_str(), O_RDONLY | O_CLOEXEC );
+    if (fd < 0)
+    {
+        mError = errno;
+        return false;
+    }
+
+    struct stat info;
+    if (fstat( fd, &info ) != 0)
+    {
+        mError = errno;
+        ::close( fd );
+        return false;
+    }
+    if (info.st_size == 0)
+    {
+        mError = EINVAL;
+        ::close( fd );
+        return false;
+    }
+
+    // a private mapping is copy-on-write already, it only needs to be writable
+    size_t size = static_cast<size_t>(info.st_size);
+    void* data = mmap( NULL, size, copyOnWrite ? PROT_READ | PROT_WRITE : PROT_READ, MAP_PRIVATE, fd, 0 );
+    mError = data == MAP_FAILED ? errno : 0;
+    // the mapping keeps the file alive
+    ::close( fd );
+    if (data == MAP_FAILED)
+        return false;
+
+    mData = data;
+    mSize = size;
+    mCopyOnWrite = copyOnWrite;
+    return true;
+}
+
+void MappedFile::close()
+{
+    if (mData != NULL)
+        munmap( mData, mSize );
+
+    mData = NULL;
+    mSize = 0;
+    mCopyOnWrite = false;
+}
+
+#endif
+
+} } // namespace cinder::dx11
@@ -0,0 +1,320 @@
+#include "dx11/MeshAdjacency.h"
+#include "dx11/WorkerPool.h"
+
+#include <cstring>
+#include <algorithm>
+#include <boost/bind.hpp>
+
+namespace cinder { namespace dx11 {
+
+namespace
+{
+    const uint32_t kNone = ~0u;
+
+    // items are bucketed by the top bits of their hash, every bucket gets its own table and worker
+    const size_t kPartitionBits = 8;
+    const size_t kNumPartitions = 1 << kPartitionBits;
+    const size_t kChunkSize = 16384;
+
+    uint32_t mixHash(uint32_t h)
+    {
+        h ^= h >> 16;
+        h *= 0x85ebca6b;
+        h ^= h >> 13;
+        h *= 0xc2b2ae35;
+        h ^= h >> 16;
+        return h;
+    }
+
+    uint32_t getPartition(uint32_t hash)
+    {
+        return hash >> (32 - kPartitionBits);
+    }
+
+    size_t getTableSize(size_t count)
+    {
+        size_t size = 16;
+        while (size < count * 2)
+            size *= 2;
+        return size;
+    }
+
+    // Stable counting sort of item ids by partition, histograms and scatter run per chunk in parallel.
+    // Partition p ends up in order[starts[p], starts[p + 1]) with its ids ascending.
+    struct Partitioner
+    {
+        const std::vector<uint32_t>*    hashes;
+        std::vector<uint32_t>           counts;     // numChunks x kNumPartitions, turned into offsets
+        std::vector<uint32_t>*          order;
+
+        void countChunk(size_t begin, size_t end)
+        {
+            for (size_t c=begin;c<end;c++)
+            {
+                uint32_t* chunkCounts = &counts[c * kNumPartitions];
+                size_t last = std::min(hashes->size(), (c + 1) * kChunkSize);
+                for (size_t i=c*kChunkSize;i<last;i++)
+                    chunkCounts[getPartition((*hashes)[i])]++;
+            }
+        }
+
+        void scatterChunk(size_t begin, size_t end)
+        {
+            for (size_t c=begin;c<end;c++)
+            {
+                uint32_t* offsets = &counts[c * kNumPartitions];
+                size_t last = std::min(hashes->size(), (c + 1) * kChunkSize);
+                for (size_t i=c*kChunkSize;i<last;i++)
+                    (*order)[offsets[getPartition((*hashes)[i])]++] = static_cast<uint32_t>(i);
+            }
+        }
+    };
+
+    void partitionItems(const std::vector<uint32_t>& hashes, std::vector<uint32_t>& order, std::vector<uint32_t>& starts)
+    {
+        size_t numChunks = (hashes.size() + kChunkSize - 1) / kChunkSize;
+
+        Partitioner partitioner;
+        partitioner.hashes = &hashes;
+        partitioner.counts.assign(numChunks * kNumPartitions, 0);
+        partitioner.order = &order;
+        order.resize(hashes.size());
+
+        parallelFor(numChunks, 1, boost::bind(&Partitioner::countChunk, &partitioner, _1, _2));
+
+        // partition major, chunk minor, which keeps the ids ascending inside a partition
+        starts.resize(kNumPartitions + 1);
+        uint32_t offset = 0;
+        for (size_t p=0;p<kNumPartitions;p++)
+        {
+            starts[p] = offset;
+            for (size_t c=0;c<numChunks;c++)
+            {
+                uint32_t count = partitioner.counts[c * kNumPartitions + p];
+                partitioner.counts[c * kNumPartitions + p] = offset;
+                offset += count;
+            }
+        }
+        starts[kNumPartitions] = offset;
+
+        parallelFor(numChunks, 1, boost::bind(&Partitioner::scatterChunk, &partitioner, _1, _2));
+    }
+
+    // items with equal keys map to the first of them, the ids in a partition are ascending
+    struct KeyWelder
+    {
+        const uint32_t*         keys;
+        size_t                  keyWords;
+        std::vector<uint32_t>   hashes;
+        std::vector<uint32_t>   order;
+        std::vector<uint32_t>   starts;
+        std::vector<uint32_t>*  remap;
+
+        bool equal(uint32_t a, uint32_t b) const
+        {
+            return memcmp(keys + a * keyWords, keys + b * keyWords, keyWords * sizeof(uint32_t)) == 0;
+        }
+
+        void hashRange(size_t begin, size_t end)
+        {
+            for (size_t i=begin;i<end;i++)
+            {
+                const uint32_t* key = keys + i * keyWords;
+                uint32_t hash = 0;
+                for (size_t w=0;w<keyWords;w++)
+                    hash = mixHash(hash ^ key[w]) + 0x9e3779b9u;
+                hashes[i] = hash;
+            }
+        }
+
+        void weldPartitions(size_t begin, size_t end)
+        {
+            std::vector<uint32_t> table;
+            for (size_t p=begin;p<end;p++)
+            {
+                size_t count = starts[p + 1] - starts[p];
+                if (count == 0)
+                    continue;
+
+                size_t mask = getTableSize(count) - 1;
+                table.assign(mask + 1, kNone);
+
+                for (size_t i=starts[p];i<starts[p + 1];i++)
+                {
+                    uint32_t item = order[i];
+                    size_t slot = hashes[item] & mask;
+                    for (;;)
+                    {
+                        uint32_t other = table[slot];
+                        if (other == kNone)
+                        {
+                            table[slot] = item;
+                            (*remap)[item] = item;
+                            break;
+                        }
+                        if (hashes[other] == hashes[item] && equal(item, other))
+                        {
+                            (*remap)[item] = other;
+                            break;
+                        }
+                        slot = (slot + 1) & mask;
+                    }
+                }
+            }
+        }
+    };
+
+    // +0.0f turns -0 into 0, so both weld
+    struct PositionKeys
+    {
+        const uint8_t*  positions;
+        size_t          stride;
+        uint32_t*       keys;
+
+        void keyRange(size_t begin, size_t end)
+        {
+            for (size_t i=begin;i<end;i++)
+            {
+                const float* p = reinterpret_cast<const float*>(positions + i * stride);
+                for (int c=0;c<3;c++)
+                {
+                    float value = p[c] + 0.0f;
+                    memcpy(&keys[i * 3 + c], &value, sizeof(value));
+                }
+            }
+        }
+    };
+
+    // Half-edge h of triangle h / 3 runs from corner h % 3 to the next corner, in welded vertices.
+    // The neighbour across it owns the half-edge running the other way.
+    struct EdgeMatcher
+    {
+        const uint32_t*         indices;
+        const uint32_t*         remap;
+        std::vector<uint32_t>   hashes;
+        std::vector<uint32_t>   order;
+        std::vector<uint32_t>   starts;
+        uint32_t*               adjacency;
+
+        uint32_t getFrom(uint32_t h) const { return remap[indices[h]]; }
+        uint32_t getTo(uint32_t h) const { return remap[indices[h - h % 3 + (h % 3 + 1) % 3]]; }
+        uint32_t getOpposite(uint32_t h) const { return indices[h - h % 3 + (h % 3 + 2) % 3]; }
+
+        static uint32_t hashEdge(uint32_t a, uint32_t b)
+        {
+            return mixHash(a * 0x9e3779b1u + b);
+        }
+
+        // both directions of an edge hash alike, so they share a partition
+        void hashRange(size_t begin, size_t end)
+        {
+            for (size_t h=begin;h<end;h++)
+            {
+                uint32_t a = getFrom(static_cast<uint32_t>(h));
+                uint32_t b = getTo(static_cast<uint32_t>(h));
+                hashes[h] = a < b ? hashEdge(a, b) : hashEdge(b, a);
+            }
+        }
+
+        void matchPartitions(size_t begin, size_t end)
+        {
+            std::vector<uint32_t> table;
+            for (size_t p=begin;p<end;p++)
+            {
+                size_t count = starts[p + 1] - starts[p];
+                if (count == 0)
+                    continue;
+
+                size_t mask = getTableSize(count) - 1;
+                table.assign(mask + 1, kNone);
+
+                // the first half-edge of every direction wins, later duplicates make the edge non-manifold
+                for (size_t i=starts[p];i<starts[p + 1];i++)
+                {
+                    uint32_t h = order[i];
+                    uint32_t a = getFrom(h), b = getTo(h);
+                    if (a == b)
+                        continue;
+
+                    size_t slot = hashEdge(a, b) & mask;
+                    while (table[slot] != kNone && (getFrom(table[slot]) != a || getTo(table[slot]) != b))
+                        slot = (slot + 1) & mask;
+                    if (table[slot] == kNone)
+                        table[slot] = h;
+                }
+
+                for (size_t i=starts[p];i<starts[p + 1];i++)
+                {
+                    uint32_t h = order[i];
+                    uint32_t a = getFrom(h), b = getTo(h);
+                    uint32_t neighbour = kNone;
+                    if (a != b)
+                    {
+                        size_t slot = hashEdge(b, a) & mask;
+                        while (table[slot] != kNone && (getFrom(table[slot]) != b || getTo(table[slot]) != a))
+                            slot = (slot + 1) & mask;
+                        neighbour = table[slot];
+                    }
+
+                    adjacency[h * 2] = indices[h];
+                    adjacency[h * 2 + 1] = getOpposite(neighbour != kNone ? neighbour : h);
+                }
+            }
+        }
+    };
+}
+
+void buildKeyRemap( std::vector<uint32_t>& remap, const uint32_t* keys, size_t count, size_t keyWords )
+{
+    remap.resize(count);
+    if (count == 0)
+        return;
+
+    KeyWelder welder;
+    welder.keys = keys;
+    welder.keyWords = keyWords;
+    welder.hashes.resize(count);
+    welder.remap = &remap;
+
+    parallelFor(count, kChunkSize, boost::bind(&KeyWelder::hashRange, &welder, _1, _2));
+    partitionItems(welder.hashes, welder.order, welder.starts);
+    parallelFor(kNumPartitions, 1, boost::bind(&KeyWelder::weldPartitions, &welder, _1, _2));
+}
+
+void buildPositionRemap( std::vector<uint32_t>& remap, const void* positions, size_t numVertices, size_t stride )
+{
+    std::vector<uint32_t> keys(numVertices * 3);
+    if (numVertices == 0)
+    {
+        remap.clear();
+        return;
+    }
+
+    PositionKeys positionKeys = { static_cast<const uint8_t*>(positions), stride, &keys[0] };
+    parallelFor(numVertices, kChunkSize, boost::bind(&PositionKeys::keyRange, &positionKeys, _1, _2));
+    buildKeyRemap(remap, &keys[0], numVertices, 3);
+}
+
+void buildAdjacencyIndices( std::vector<uint32_t>& adjacency, const uint32_t* indices, size_t numIndices,
+    const void* positions, size_t numVertices, size_t stride )
+{
+    size_t numHalfEdges = numIndices - numIndices % 3;
+    adjacency.resize(numHalfEdges * 2);
+    if (numHalfEdges == 0)
+        return;
+
+    std::vector<uint32_t> remap;
+    buildPositionRemap(remap, positions, numVertices, stride);
+
+    EdgeMatcher matcher;
+    matcher.indices = indices;
+    matcher.remap = &remap[0];
+    matcher.hashes.resize(numHalfEdges);
+    matcher.adjacency = &adjacency[0];
+
+    parallelFor(numHalfEdges, kChunkSize, boost::bind(&EdgeMatcher::hashRange, &matcher, _1, _2));
+    partitionItems(matcher.hashes, matcher.order, matcher.starts);
+    parallelFor(kNumPartitions, 1, boost::bind(&EdgeMatcher::matchPartitions, &matcher, _1, _2));
+}
+
+} } // namespace cinder::dx11
@@ -0,0 +1,371 @@
+#include "dx11/MeshCache.h"
+#include "dx11/MeshCodec.h"
+
+#include <set>
+#include <fstream>
+#include <cstring>
+
+#include "cinder/Thread.h"
+
+namespace cinder { namespace dx11 {
+
+namespace
+{
+    const uint32_t kMagic = 0x434d5844; // "DXMC"
+    const size_t kAlignment = 16;
+
+    struct FileHeader
+    {
+        uint32_t    magic;
+        uint32_t    version;
+        uint32_t    fileSize;
+        uint32_t    numVertices;
+        uint32_t    numIndices;
+        uint32_t    indexFormat;
+        uint32_t    numElements;
+        uint32_t    numStreams;
+        uint32_t    numLods;
+        uint32_t    numClusters;
+        float       boundsMin[3];
+        float       boundsMax[3];
+        uint32_t    elementsOffset;
+        uint32_t    streamsOffset;
+        uint32_t    indexOffset;
+        uint32_t    indexSize;
+        uint32_t    lodsOffset;
+        uint32_t    clustersOffset;
+        uint32_t    indexEncodedSize;   // 0 when the indices are stored raw
+    };
+
+    struct FileElement
+    {
+        char        semanticName[32];
+        uint32_t    semanticIndex;
+        uint32_t    format;
+        uint32_t    inputSlot;
+        uint32_t    alignedByteOffset;
+    };
+
+    struct FileStream
+    {
+        uint32_t    offset;
+        uint32_t    size;
+        uint32_t    stride;
+        uint32_t    encodedSize;        // 0 when the stream is stored raw
+    };
+
+    struct FileLod
+    {
+        uint32_t    startIndex;
+        uint32_t    indexCount;
+        float       error;
+        uint32_t    reserved;
+    };
+
+    struct FileCluster
+    {
+        uint32_t    startIndex;
+        uint32_t    indexCount;
+        float       center[3];
+        float       radius;
+        float       coneApex[3];
+        float       coneAxis[3];
+        float       coneCutoff;
+        uint32_t    reserved;
+    };
+
+    size_t align(size_t offset)
+    {
+        return (offset + kAlignment - 1) & ~(kAlignment - 1);
+    }
+
+    // input element descs keep bare pointers to their names, so names read from files live as long as the process
+    const char* internSemanticName(const char* name)
+    {
+        static std::mutex sMutex;
+        static std::set<std::string> sNames;
+
+        std::lock_guard<std::mutex> lock(sMutex);
+        return sNames.insert(name).first->c_str();
+    }
+
+    bool isInside(size_t offset, size_t size, size_t fileSize)
+    {
+        return offset <= fileSize && size <= fileSize - offset;
+    }
+
+    size_t getIndexWidth(DXGI_FORMAT format)
+    {
+        return format == DXGI_FORMAT_R16_UINT ? 2 : format == DXGI_FORMAT_R32_UINT ? 4 : 0;
+    }
+
+    // the index data holds whole triangle lists (the mesh, LODs, clusters), anything else stays raw
+    bool encodeIndices(std::vector<uint8_t>& out, const MeshCacheData& data)
+    {
+        size_t width = getIndexWidth(data.indexFormat);
+        if (width == 0 || data.indexDataSize % (width * 3) != 0)
+            return false;
+
+        std::vector<uint32_t> indices(data.indexDataSize / width);
+        for (size_t i=0;i<indices.size();i++)
+        {
+            if (width == 2)
+                indices[i] = static_cast<const uint16_t*>(data.indexData)[i];
+            else
+                indices[i] = static_cast<const uint32_t*>(data.indexData)[i];
+        }
+        encodeIndexBuffer(out, indices.empty() ? NULL : &indices[0], indices.size());
+        return true;
+    }
+}
+
+HRESULT MeshCacheFile::write( const std::string& path, const MeshCacheData& data, bool compress )
+{
+    if (data.streams.empty() || data.elements.empty())
+        return E_INVALIDARG;
+
+    FileHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = kMagic;
+    header.version = kVersion;
+    header.numVertices = data.numVertices;
+    header.numIndices = data.numIndices;
+    header.indexFormat = data.indexFormat;
+    header.numElements = data.elements.size();
+    header.numStreams = data.streams.size();
+    header.numLods = data.lods.size();
+    header.numClusters = data.clusters.size();
+    for (int i=0;i<3;i++)
+    {
+        header.boundsMin[i] = data.bounds.getMin()[i];
+        header.boundsMax[i] = data.bounds.getMax()[i];
+    }
+
+    // section table first, then the bulk data
+    size_t offset = align(sizeof(FileHeader));
+    header.elementsOffset = offset;
+    offset = align(offset + sizeof(FileElement) * data.elements.size());
+    header.streamsOffset = offset;
+    offset = align(offset + sizeof(FileStream) * data.streams.size());
+    header.lodsOffset = offset;
+    offset = align(offset + sizeof(FileLod) * data.lods.size());
+    header.clustersOffset = offset;
+    offset = align(offset + sizeof(FileCluster) * data.clusters.size());
+
+    std::vector<FileStream> streams(data.streams.size());
+    std::vector<std::vector<uint8_t> > encodedStreams(data.streams.size());
+    for (size_t i=0;i<streams.size();i++)
+    {
+        streams[i].offset = offset;
+        streams[i].size = data.streams[i].stride * data.numVertices;
+        streams[i].stride = data.streams[i].stride;
+        streams[i].encodedSize = 0;
+        if (compress && streams[i].stride <= 256)
+        {
+            encodeVertexBuffer(encodedStreams[i], data.streams[i].data, data.numVertices, data.streams[i].stride);
+            streams[i].encodedSize = static_cast<uint32_t>(encodedStreams[i].size());
+        }
+        offset = align(offset + (streams[i].encodedSize > 0 ? streams[i].encodedSize : streams[i].size));
+    }
+
+    std::vector<uint8_t> encodedIndices;
+    if (compress && data.indexDataSize > 0 && encodeIndices(encodedIndices, data))
+        header.indexEncodedSize = static_cast<uint32_t>(encodedIndices.size());
+    header.indexOffset = offset;
+    header.indexSize = data.indexDataSize;
+    offset = align(offset + (header.indexEncodedSize > 0 ? header.indexEncodedSize : data.indexDataSize));
+    header.fileSize = offset;
+
+    std::vector<uint8_t> blob(offset, 0);
+    memcpy(&blob[0], &header, sizeof(header));
+
+    for (size_t i=0;i<data.elements.size();i++)
+    {
+        const D3D11_INPUT_ELEMENT_DESC& desc = data.elements[i];
+        FileElement element;
+        memset(&element, 0, sizeof(element));
+        strncpy(element.semanticName, desc.SemanticName, sizeof(element.semanticName) - 1);
+        element.semanticIndex = desc.SemanticIndex;
+        element.format = desc.Format;
+        element.inputSlot = desc.InputSlot;
+        element.alignedByteOffset = desc.AlignedByteOffset;
+        memcpy(&blob[header.elementsOffset + i * sizeof(FileElement)], &element, sizeof(element));
+    }
+
+    for (size_t i=0;i<streams.size();i++)
+    {
+        memcpy(&blob[header.streamsOffset + i * sizeof(FileStream)], &streams[i], sizeof(FileStream));
+        if (streams[i].encodedSize > 0)
+            memcpy(&blob[streams[i].offset], &encodedStreams[i][0], streams[i].encodedSize);
+        else if (streams[i].size > 0)
+            memcpy(&blob[streams[i].offset], data.streams[i].data, streams[i].size);
+    }
+
+    for (size_t i=0;i<data.lods.size();i++)
+    {
+        FileLod lod = { static_cast<uint32_t>(data.lods[i].startIndex), static_cast<uint32_t>(data.lods[i].indexCount), data.lods[i].error, 0 };
+        memcpy(&blob[header.lodsOffset + i * sizeof(FileLod)], &lod, sizeof(lod));
+    }
+
+    for (size_t i=0;i<data.clusters.size();i++)
+    {
+        const MeshCluster& c = data.clusters[i];
+        FileCluster cluster =
+        {
+            static_cast<uint32_t>(c.startIndex), static_cast<uint32_t>(c.indexCount),
+            { c.center.x, c.center.y, c.center.z }, c.radius,
+            { c.coneApex.x, c.coneApex.y, c.coneApex.z },
+            { c.coneAxis.x, c.coneAxis.y, c.coneAxis.z }, c.coneCutoff, 0
+        };
+        memcpy(&blob[header.clustersOffset + i * sizeof(FileCluster)], &cluster, sizeof(cluster));
+    }
+
+    if (header.indexEncodedSize > 0)
+        memcpy(&blob[header.indexOffset], &encodedIndices[0], header.indexEncodedSize);
+    else if (data.indexDataSize > 0)
+        memcpy(&blob[header.indexOffset], data.indexData, data.indexDataSize);
+
+    std::ofstream file(path.c_str(), std::ios::binary | std::ios::trunc);
+    if (!file)
+        return E_FAIL;
+    file.write(reinterpret_cast<const char*>(&blob[0]), blob.size());
+    return file ? S_OK : E_FAIL;
+}
+
+HRESULT MeshCacheFile::open( const std::string& path )
+{
+    close();
+
+    if (!mFile.open(path))
+        return mFile.getResult();
+
+    const uint8_t* base = static_cast<const uint8_t*>(mFile.getData());
+    size_t fileSize = mFile.getSize();
+
+    FileHeader header;
+    if (fileSize < sizeof(header))
+    {
+        close();
+        return E_FAIL;
+    }
+    memcpy(&header, base, sizeof(header));
+
+    if (header.magic != kMagic || header.version != kVersion || header.fileSize != fileSize
+        || !isInside(header.elementsOffset, sizeof(FileElement) * header.numElements, fileSize)
+        || !isInside(header.streamsOffset, sizeof(FileStream) * header.numStreams, fileSize)
+        || !isInside(header.lodsOffset, sizeof(FileLod) * header.numLods, fileSize)
+        || !isInside(header.clustersOffset, sizeof(FileCluster) * header.numClusters, fileSize)
+        || !isInside(header.indexOffset, header.indexEncodedSize > 0 ? header.indexEncodedSize : header.indexSize, fileSize))
+    {
+        close();
+        return E_FAIL;
+    }
+
+    mData.numVertices = header.numVertices;
+    mData.numIndices = header.numIndices;
+    mData.indexFormat = static_cast<DXGI_FORMAT>(header.indexFormat);
+    mData.indexData = base + header.indexOffset;
+    mData.indexDataSize = header.indexSize;
+
+    // decoded buffers are referenced by mData, so they must never move
+    mDecoded.reserve(header.numStreams + 1);
+    if (header.indexEncodedSize > 0)
+    {
+        size_t width = getIndexWidth(mData.indexFormat);
+        if (width == 0 || header.indexSize % width != 0)
+        {
+            close();
+            return E_FAIL;
+        }
+
+        mDecoded.push_back(std::vector<uint8_t>(header.indexSize));
+        std::vector<uint8_t>& decoded = mDecoded.back();
+        if (!decodeIndexBuffer(decoded.empty() ? NULL : &decoded[0], header.indexSize / width, width, base + header.indexOffset, header.indexEncodedSize))
+        {
+            close();
+            return E_FAIL;
+        }
+        mData.indexData = decoded.empty() ? NULL : &decoded[0];
+    }
+    mData.bounds = AxisAlignedBox3f(Vec3f(header.boundsMin[0], header.boundsMin[1], header.boundsMin[2]),
+        Vec3f(header.boundsMax[0], header.boundsMax[1], header.boundsMax[2]));
+
+    const FileElement* elements = reinterpret_cast<const FileElement*>(base + header.elementsOffset);
+    mData.elements.resize(header.numElements);
+    for (size_t i=0;i<header.numElements;i++)
+    {
+        char name[sizeof(elements[i].semanticName) + 1] = {0};
+        memcpy(name, elements[i].semanticName, sizeof(elements[i].semanticName));
+
+        D3D11_INPUT_ELEMENT_DESC& desc = mData.elements[i];
+        desc.SemanticName = internSemanticName(name);
+        desc.SemanticIndex = elements[i].semanticIndex;
+        desc.Format = static_cast<DXGI_FORMAT>(elements[i].format);
+        desc.InputSlot = elements[i].inputSlot;
+        desc.AlignedByteOffset = elements[i].alignedByteOffset;
+        desc.InputSlotClass = D3D11_INPUT_PER_VERTEX_DATA;
+        desc.InstanceDataStepRate = 0;
+    }
+
+    const FileStream* streams = reinterpret_cast<const FileStream*>(base + header.streamsOffset);
+    mData.streams.resize(header.numStreams);
+    for (size_t i=0;i<header.numStreams;i++)
+    {
+        const FileStream& stream = streams[i];
+        size_t storedSize = stream.encodedSize > 0 ? stream.encodedSize : stream.size;
+        if (!isInside(stream.offset, storedSize, fileSize) || stream.size != stream.stride * header.numVertices)
+        {
+            close();
+            return E_FAIL;
+        }
+        mData.streams[i].data = base + stream.offset;
+        mData.streams[i].stride = stream.stride;
+
+        if (stream.encodedSize > 0)
+        {
+            mDecoded.push_back(std::vector<uint8_t>(stream.size));
+            std::vector<uint8_t>& decoded = mDecoded.back();
+            if (!decodeVertexBuffer(decoded.empty() ? NULL : &decoded[0], header.numVertices, stream.stride, base + stream.offset, stream.encodedSize))
+            {
+                close();
+                return E_FAIL;
+            }
+            mData.streams[i].data = decoded.empty() ? NULL : &decoded[0];
+        }
+    }
+
+    const FileLod* lods = reinterpret_cast<const FileLod*>(base + header.lodsOffset);
+    mData.lods.resize(header.numLods);
+    for (size_t i=0;i<header.numLods;i++)
+    {
+        mData.lods[i].startIndex = lods[i].startIndex;
+        mData.lods[i].indexCount = lods[i].indexCount;
+        mData.lods[i].error = lods[i].error;
+    }
+
+    const FileCluster* clusters = reinterpret_cast<const FileCluster*>(base + header.clustersOffset);
+    mData.clusters.resize(header.numClusters);
+    for (size_t i=0;i<header.numClusters;i++)
+    {
+        const FileCluster& c = clusters[i];
+        MeshCluster& cluster = mData.clusters[i];
+        cluster.startIndex = c.startIndex;
+        cluster.indexCount = c.indexCount;
+        cluster.center = Vec3f(c.center[0], c.center[1], c.center[2]);
+        cluster.radius = c.radius;
+        cluster.coneApex = Vec3f(c.coneApex[0], c.coneApex[1], c.coneApex[2]);
+        cluster.coneAxis = Vec3f(c.coneAxis[0], c.coneAxis[1], c.coneAxis[2]);
+        cluster.coneCutoff = c.coneCutoff;
+    }
+
+    return S_OK;
+}
+
+void MeshCacheFile::close()
+{
+    mFile.close();
+    mData = MeshCacheData();
+    mDecoded.clear();
+}
+
+} } // namespace cinder::dx11
@@ -0,0 +1,422 @@
+#include "cinder/TriMesh.h"
+
+#include "dx11/MeshCluster.h"
+#include "dx11/WorkerPool.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <xmmintrin.h>
+#include <boost/bind.hpp>
+
+namespace cinder { namespace dx11 {
+
+namespace
+{
+    const uint32_t kNone = ~0u;
+
+    // normal cones wider than this (cos of the half angle) are useless for culling
+    const float kMinConeDot = 0.1f;
+
+    // spreads the low 10 bits of x over every third bit
+    uint32_t spreadBits(uint32_t x)
+    {
+        x &= 0x3ff;
+        x = (x | (x << 16)) & 0x030000ff;
+        x = (x | (x <<  8)) & 0x0300f00f;
+        x = (x | (x <<  4)) & 0x030c30c3;
+        x = (x | (x <<  2)) & 0x09249249;
+        return x;
+    }
+
+    struct MortonLess
+    {
+        explicit MortonLess(const std::vector<uint32_t>& codes):mCodes(codes){}
+        bool operator()(uint32_t a, uint32_t b) const { return mCodes[a] < mCodes[b]; }
+        const std::vector<uint32_t>& mCodes;
+    };
+
+    Vec3f triangleNormal(const Vec3f* positions, const uint32_t* tri, bool clockwise)
+    {
+        const Vec3f& p0 = positions[tri[0]];
+        Vec3f n = (positions[tri[1]] - p0).cross(positions[tri[2]] - p0);
+        return clockwise ? -n : n;
+    }
+
+    void computeRange(const Vec3f* positions, const uint32_t* indices, bool clockwise, std::vector<MeshCluster>* clusters, size_t begin, size_t end)
+    {
+        for (size_t i=begin;i<end;i++)
+        {
+            MeshCluster& cluster = (*clusters)[i];
+            cluster = Clusterizer::computeBounds(positions, indices, cluster.startIndex, cluster.indexCount, clockwise);
+        }
+    }
+}
+
+MeshCluster Clusterizer::computeBounds( const Vec3f* positions, const uint32_t* indices, size_t startIndex, size_t indexCount, bool clockwise )
+{
+    MeshCluster cluster;
+    cluster.startIndex = startIndex;
+    cluster.indexCount = indexCount;
+    cluster.center = Vec3f::zero();
+    cluster.radius = 0;
+    cluster.coneApex = Vec3f::zero();
+    cluster.coneAxis = Vec3f::zAxis();
+    cluster.coneCutoff = 2.0f;
+
+    if (indexCount == 0)
+        return cluster;
+
+    const uint32_t* tris = indices + startIndex;
+
+    Vec3f minP(FLT_MAX, FLT_MAX, FLT_MAX);
+    Vec3f maxP(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+    for (size_t i=0;i<indexCount;i++)
+    {
+        const Vec3f& p = positions[tris[i]];
+        minP.set(std::min(minP.x, p.x), std::min(minP.y, p.y), std::min(minP.z, p.z));
+        maxP.set(std::max(maxP.x, p.x), std::max(maxP.y, p.y), std::max(maxP.z, p.z));
+    }
+
+    cluster.center = (minP + maxP) * 0.5f;
+    float radiusSq = 0;
+    for (size_t i=0;i<indexCount;i++)
+        radiusSq = std::max(radiusSq, positions[tris[i]].distanceSquared(cluster.center));
+    cluster.radius = math<float>::sqrt(radiusSq);
+
+    // the cone axis is the average facing, its width the triangle that deviates the most
+    Vec3f axis = Vec3f::zero();
+    for (size_t i=0;i<indexCount;i+=3)
+    {
+        Vec3f n = triangleNormal(positions, tris + i, clockwise);
+        float length = n.length();
+        if (length > 0)
+            axis += n / length;
+    }
+
+    float axisLength = axis.length();
+    if (axisLength == 0)
+        return cluster;
+    axis /= axisLength;
+
+    float minDot = 1.0f;
+    for (size_t i=0;i<indexCount;i+=3)
+    {
+        Vec3f n = triangleNormal(positions, tris + i, clockwise);
+        float length = n.length();
+        if (length > 0)
+            minDot = std::min(minDot, axis.dot(n / length));
+    }
+
+    cluster.coneAxis = axis;
+    if (minDot <= kMinConeDot)
+        return cluster;
+
+    // move the apex back along the axis until it is behind every triangle plane
+    float maxT = 0;
+    for (size_t i=0;i<indexCount;i+=3)
+    {
+        Vec3f n = triangleNormal(positions, tris + i, clockwise);
+        float length = n.length();
+        if (length == 0)
+            continue;
+        n /= length;
+
+        float t = (cluster.center - positions[tris[i]]).dot(n) / axis.dot(n);
+        maxT = std::max(maxT, t);
+    }
+
+    cluster.coneApex = cluster.center - axis * maxT;
+    // the cone of view directions that see only back faces is the normal cone widened by 90 degrees and flipped
+    cluster.coneCutoff = math<float>::sqrt(1 - minDot * minDot);
+    return cluster;
+}
+
+ClusterMesh Clusterizer::build( const Vec3f* positions, size_t numVertices, const uint32_t* indices, size_t numIndices,
+    const Options& options )
+{
+    ClusterMesh result;
+    size_t numTriangles = numIndices / 3;
+    if (numTriangles == 0)
+        return result;
+
+    size_t maxVertices = std::max<size_t>(options.maxVertices, 3);
+    size_t maxTriangles = std::max<size_t>(options.maxTriangles, 1);
+
+    // triangles around each vertex
+    std::vector<uint32_t> offsets(numVertices + 1, 0);
+    for (size_t i=0;i<numTriangles*3;i++)
+        offsets[indices[i] + 1]++;
+    for (size_t i=0;i<numVertices;i++)
+        offsets[i + 1] += offsets[i];
+
+    std::vector<uint32_t> adjacency(numTriangles * 3);
+    {
+        std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+        for (size_t i=0;i<numTriangles*3;i++)
+            adjacency[fill[indices[i]]++] = static_cast<uint32_t>(i / 3);
+    }
+
+    // centroids and unit normals, and a Morton order to pick seeds in so neighbouring clusters stay close
+    std::vector<Vec3f> centroids(numTriangles);
+    std::vector<Vec3f> normals(numTriangles);
+    Vec3f minP(FLT_MAX, FLT_MAX, FLT_MAX);
+    Vec3f maxP(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+    for (size_t i=0;i<numTriangles;i++)
+    {
+        const uint32_t* tri = indices + i * 3;
+        centroids[i] = (positions[tri[0]] + positions[tri[1]] + positions[tri[2]]) / 3.0f;
+        normals[i] = triangleNormal(positions, tri, options.clockwise).safeNormalized();
+
+        const Vec3f& c = centroids[i];
+        minP.set(std::min(minP.x, c.x), std::min(minP.y, c.y), std::min(minP.z, c.z));
+        maxP.set(std::max(maxP.x, c.x), std::max(maxP.y, c.y), std::max(maxP.z, c.z));
+    }
+
+    Vec3f extent = maxP - minP;
+    float scale = std::max(extent.x, std::max(extent.y, extent.z));
+    scale = scale > 0 ? 1023.0f / scale : 0;
+
+    std::vector<uint32_t> codes(numTriangles);
+    std::vector<uint32_t> order(numTriangles);
+    for (size_t i=0;i<numTriangles;i++)
+    {
+        Vec3f q = (centroids[i] - minP) * scale;
+        codes[i] = spreadBits(static_cast<uint32_t>(q.x)) | (spreadBits(static_cast<uint32_t>(q.y)) << 1) | (spreadBits(static_cast<uint32_t>(q.z)) << 2);
+        order[i] = static_cast<uint32_t>(i);
+    }
+    std::sort(order.begin(), order.end(), MortonLess(codes));
+
+    std::vector<uint8_t>  emitted(numTriangles, 0);
+    std::vector<uint32_t> vertexTag(numVertices, kNone);    // last cluster that used the vertex
+    std::vector<uint32_t> candidateTag(numTriangles, kNone);
+    std::vector<uint32_t> candidates;
+
+    result.indices.reserve(numTriangles * 3);
+
+    for (size_t seed=0;seed<numTriangles;seed++)
+    {
+        uint32_t next = order[seed];
+        if (emitted[next])
+            continue;
+
+        uint32_t clusterId = static_cast<uint32_t>(result.clusters.size());
+        MeshCluster cluster;
+        cluster.startIndex = result.indices.size();
+
+        size_t clusterVertices = 0;
+        size_t clusterTriangles = 0;
+        Vec3f centroidSum = Vec3f::zero();
+        Vec3f normalSum = Vec3f::zero();
+        float radius = 0;
+        candidates.clear();
+
+        while (next != kNone)
+        {
+            const uint32_t* tri = indices + next * 3;
+            emitted[next] = 1;
+            clusterTriangles++;
+            centroidSum += centroids[next];
+            normalSum += normals[next];
+            result.indices.insert(result.indices.end(), tri, tri + 3);
+
+            for (int k=0;k<3;k++)
+            {
+                uint32_t v = tri[k];
+                if (vertexTag[v] == clusterId)
+                    continue;
+                vertexTag[v] = clusterId;
+                clusterVertices++;
+
+                for (uint32_t j=offsets[v];j<offsets[v + 1];j++)
+                {
+                    uint32_t t = adjacency[j];
+                    if (!emitted[t] && candidateTag[t] != clusterId)
+                    {
+                        candidateTag[t] = clusterId;
+                        candidates.push_back(t);
+                    }
+                }
+            }
+
+            if (clusterTriangles == maxTriangles)
+                break;
+
+            Vec3f center = centroidSum / static_cast<float>(clusterTriangles);
+            radius = std::max(radius, centroids[next].distance(center));
+            Vec3f facing = normalSum.safeNormalized();
+
+            // prefer triangles that add the fewest vertices, then the closest ones, then the ones facing along
+            next = kNone;
+            float bestScore = FLT_MAX;
+            for (size_t i=0;i<candidates.size();)
+            {
+                uint32_t t = candidates[i];
+                if (emitted[t])
+                {
+                    candidates[i] = candidates.back();
+                    candidates.pop_back();
+                    continue;
+                }
+
+                const uint32_t* c = indices + t * 3;
+                size_t extra = (vertexTag[c[0]] != clusterId) + (vertexTag[c[1]] != clusterId) + (vertexTag[c[2]] != clusterId);
+                if (clusterVertices + extra <= maxVertices)
+                {
+                    float distance = centroids[t].distance(center) / (radius + FLT_EPSILON);
+                    float score = static_cast<float>(extra) + 0.5f * std::min(distance, 2.0f)
+                        + options.coneWeight * (1 - facing.dot(normals[t]));
+                    if (score < bestScore)
+                    {
+                        bestScore = score;
+                        next = t;
+                    }
+                }
+                i++;
+            }
+        }
+
+        cluster.indexCount = result.indices.size() - cluster.startIndex;
+        result.clusters.push_back(cluster);
+    }
+
+    parallelFor(result.clusters.size(), 64,
+        boost::bind(&computeRange, positions, &result.indices[0], options.clockwise, &result.clusters, _1, _2));
+
+    return result;
+}
+
+ClusterMesh buildClusters( const TriMesh& triMesh, const Clusterizer::Options& options, bool flipOrder )
+{
+    if (triMesh.getNumIndices() == 0)
+        return ClusterMesh();
+
+    // match the winding VboMesh uploads
+    std::vector<uint32_t> indices = triMesh.getIndices();
+    if (flipOrder)
+    {
+        for (size_t i=0;i<indices.size();i+=3)
+            std::swap(indices[i+1], indices[i+2]);
+    }
+
+    Clusterizer::Options flipped = options;
+    flipped.clockwise = options.clockwise != flipOrder;
+    return Clusterizer::build(&triMesh.getVertices()[0], triMesh.getNumVertices(), &indices[0], indices.size(), flipped);
+}
+
+ClusterCuller::ClusterCuller( const std::vector<MeshCluster>& clusters )
+:mNumClusters(clusters.size()), mBackfaceCulling(true)
+{
+    size_t padded = (mNumClusters + 3) & ~size_t(3);
+
+    // padding lanes are masked out in cull()
+    mCenterX.resize(padded, 0); mCenterY.resize(padded, 0); mCenterZ.resize(padded, 0); mRadius.resize(padded, 0);
+    mApexX.resize(padded, 0); mApexY.resize(padded, 0); mApexZ.resize(padded, 0);
+    mAxisX.resize(padded, 0); mAxisY.resize(padded, 0); mAxisZ.resize(padded, 0); mCutoff.resize(padded, 2.0f);
+    mRanges.resize(mNumClusters);
+
+    for (size_t i=0;i<mNumClusters;i++)
+    {
+        const MeshCluster& c = clusters[i];
+        mCenterX[i] = c.center.x; mCenterY[i] = c.center.y; mCenterZ[i] = c.center.z; mRadius[i] = c.radius;
+        mApexX[i] = c.coneApex.x; mApexY[i] = c.coneApex.y; mApexZ[i] = c.coneApex.z;
+        mAxisX[i] = c.coneAxis.x; mAxisY[i] = c.coneAxis.y; mAxisZ[i] = c.coneAxis.z; mCutoff[i] = c.coneCutoff;
+        mRanges[i] = DrawRange(c.startIndex, c.indexCount);
+    }
+
+    // everything passes until a frustum is set
+    for (int i=0;i<6;i++)
+        mPlanes[i] = Vec4f(0, 0, 0, FLT_MAX);
+}
+
+void ClusterCuller::setFrustum( const Matrix44f& worldViewProj )
+{
+    const Matrix44f& m = worldViewProj;
+    Vec4f row[4];
+    for (int r=0;r<4;r++)
+        row[r] = Vec4f(m.at(r, 0), m.at(r, 1), m.at(r, 2), m.at(r, 3));
+
+    mPlanes[0] = row[3] + row[0];   // left
+    mPlanes[1] = row[3] - row[0];   // right
+    mPlanes[2] = row[3] + row[1];   // bottom
+    mPlanes[3] = row[3] - row[1];   // top
+    mPlanes[4] = row[2];            // near, D3D clip space starts at z = 0
+    mPlanes[5] = row[3] - row[2];   // far
+
+    for (int i=0;i<6;i++)
+    {
+        float length = Vec3f(mPlanes[i].x, mPlanes[i].y, mPlanes[i].z).length();
+        if (length > 0)
+            mPlanes[i] /= length;
+    }
+}
+
+size_t ClusterCuller::cull( std::vector<DrawRange>& ranges ) const
+{
+    size_t firstNew = ranges.size();
+    size_t numVisible = 0;
+
+    __m128 px[6], py[6], pz[6], pw[6];
+    for (int i=0;i<6;i++)
+    {
+        px[i] = _mm_set1_ps(mPlanes[i].x);
+        py[i] = _mm_set1_ps(mPlanes[i].y);
+        pz[i] = _mm_set1_ps(mPlanes[i].z);
+        pw[i] = _mm_set1_ps(mPlanes[i].w);
+    }
+    const __m128 ex = _mm_set1_ps(mEye.x);
+    const __m128 ey = _mm_set1_ps(mEye.y);
+    const __m128 ez = _mm_set1_ps(mEye.z);
+
+    for (size_t i=0;i<mCenterX.size();i+=4)
+    {
+        __m128 cx = _mm_loadu_ps(&mCenterX[i]);
+        __m128 cy = _mm_loadu_ps(&mCenterY[i]);
+        __m128 cz = _mm_loadu_ps(&mCenterZ[i]);
+        __m128 negRadius = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(&mRadius[i]));
+
+        // a sphere is out when it is entirely behind one plane
+        __m128 visible = _mm_cmpeq_ps(negRadius, negRadius);
+        for (int p=0;p<6;p++)
+        {
+            __m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(px[p], cx), _mm_mul_ps(py[p], cy)), _mm_add_ps(_mm_mul_ps(pz[p], cz), pw[p]));
+            visible = _mm_and_ps(visible, _mm_cmpge_ps(d, negRadius));
+        }
+
+        if (mBackfaceCulling)
+        {
+            __m128 dx = _mm_sub_ps(_mm_loadu_ps(&mApexX[i]), ex);
+            __m128 dy = _mm_sub_ps(_mm_loadu_ps(&mApexY[i]), ey);
+            __m128 dz = _mm_sub_ps(_mm_loadu_ps(&mApexZ[i]), ez);
+            __m128 length = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz)));
+            __m128 facing = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, _mm_loadu_ps(&mAxisX[i])), _mm_mul_ps(dy, _mm_loadu_ps(&mAxisY[i]))),
+                _mm_mul_ps(dz, _mm_loadu_ps(&mAxisZ[i])));
+            __m128 backfacing = _mm_cmpge_ps(facing, _mm_mul_ps(_mm_loadu_ps(&mCutoff[i]), length));
+            visible = _mm_andnot_ps(backfacing, visible);
+        }
+
+        int mask = _mm_movemask_ps(visible);
+        if (i + 4 > mNumClusters)
+            mask &= (1 << (mNumClusters - i)) - 1;
+
+        while (mask)
+        {
+            int lane = 0;
+            while (!(mask & (1 << lane)))
+                lane++;
+            mask &= ~(1 << lane);
+
+            const DrawRange& range = mRanges[i + lane];
+            numVisible++;
+
+            if (ranges.size() > firstNew && ranges.back().startIndex + ranges.back().indexCount == range.startIndex)
+                ranges.back().indexCount += range.indexCount;
+            else
+                ranges.push_back(range);
+        }
+    }
+
+    return numVisible;
+}
+
+} } // namespace cinder::dx11
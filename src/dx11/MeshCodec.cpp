@@ -0,0 +1,480 @@
+#include "dx11/MeshCodec.h"
+
+#include <cassert>
+#include <cstring>
+#include <algorithm>
+#include <emmintrin.h>
+
+namespace cinder { namespace dx11 {
+
+namespace
+{
+    const uint8_t kVertexHeader = 0xa1;
+    const uint8_t kIndexHeader = 0xe1;
+
+    const size_t kBlockVertices = 256;
+    const size_t kGroupSize = 16;
+    const size_t kMaxStride = 256;
+
+    // group widths selectable by the 2-bit group header
+    const int kGroupBits[4] = { 0, 2, 4, 8 };
+
+    uint8_t zigzag8(uint8_t delta)
+    {
+        return static_cast<uint8_t>((delta << 1) ^ (static_cast<int8_t>(delta) >> 7));
+    }
+
+    int groupBitsIndex(const uint8_t* values)
+    {
+        uint8_t all = 0;
+        for (size_t i=0;i<kGroupSize;i++)
+            all |= values[i];
+        return all == 0 ? 0 : all < 4 ? 1 : all < 16 ? 2 : 3;
+    }
+
+    void encodePlane(std::vector<uint8_t>& out, const uint8_t* plane, size_t numGroups)
+    {
+        size_t headerStart = out.size();
+        out.resize(headerStart + (numGroups + 3) / 4, 0);
+
+        for (size_t g=0;g<numGroups;g++)
+        {
+            const uint8_t* values = plane + g * kGroupSize;
+            int index = groupBitsIndex(values);
+            out[headerStart + g / 4] |= static_cast<uint8_t>(index << ((g % 4) * 2));
+
+            int bits = kGroupBits[index];
+            if (bits == 8)
+            {
+                out.insert(out.end(), values, values + kGroupSize);
+            }
+            else if (bits > 0)
+            {
+                int perByte = 8 / bits;
+                for (size_t i=0;i<kGroupSize;i+=perByte)
+                {
+                    uint8_t packed = 0;
+                    for (int j=0;j<perByte;j++)
+                        packed |= static_cast<uint8_t>(values[i + j] << (j * bits));
+                    out.push_back(packed);
+                }
+            }
+        }
+    }
+
+    // unpacks one group of 16 values, low bits first
+    __m128i unpackGroup(const uint8_t* data, int bits)
+    {
+        if (bits == 8)
+            return _mm_loadu_si128(reinterpret_cast<const __m128i*>(data));
+
+        if (bits == 4)
+        {
+            __m128i packed = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(data));
+            __m128i mask = _mm_set1_epi8(0x0f);
+            __m128i lo = _mm_and_si128(packed, mask);
+            __m128i hi = _mm_and_si128(_mm_srli_epi16(packed, 4), mask);
+            return _mm_unpacklo_epi8(lo, hi);
+        }
+
+        if (bits == 2)
+        {
+            int word;
+            memcpy(&word, data, sizeof(word));
+            __m128i packed = _mm_cvtsi32_si128(word);
+            __m128i mask = _mm_set1_epi8(0x03);
+            __m128i v0 = _mm_and_si128(packed, mask);
+            __m128i v1 = _mm_and_si128(_mm_srli_epi16(packed, 2), mask);
+            __m128i v2 = _mm_and_si128(_mm_srli_epi16(packed, 4), mask);
+            __m128i v3 = _mm_and_si128(_mm_srli_epi16(packed, 6), mask);
+            return _mm_unpacklo_epi16(_mm_unpacklo_epi8(v0, v1), _mm_unpacklo_epi8(v2, v3));
+        }
+
+        return _mm_setzero_si128();
+    }
+
+    // undoes the zigzag mapping and the deltas, \a last carries the running value between groups in all 16 bytes,
+    // which keeps the chain from one group to the next in registers
+    __m128i decodeGroup(__m128i zz, __m128i* last)
+    {
+        __m128i one = _mm_set1_epi8(1);
+        __m128i half = _mm_and_si128(_mm_srli_epi16(zz, 1), _mm_set1_epi8(0x7f));
+        __m128i sign = _mm_sub_epi8(_mm_setzero_si128(), _mm_and_si128(zz, one));
+        __m128i delta = _mm_xor_si128(half, sign);
+
+        // inclusive prefix sum over the 16 bytes
+        delta = _mm_add_epi8(delta, _mm_slli_si128(delta, 1));
+        delta = _mm_add_epi8(delta, _mm_slli_si128(delta, 2));
+        delta = _mm_add_epi8(delta, _mm_slli_si128(delta, 4));
+        delta = _mm_add_epi8(delta, _mm_slli_si128(delta, 8));
+        __m128i result = _mm_add_epi8(delta, *last);
+
+        __m128i top = _mm_unpackhi_epi8(result, result);
+        *last = _mm_shuffle_epi32(_mm_unpackhi_epi16(top, top), _MM_SHUFFLE(3, 3, 3, 3));
+        return result;
+    }
+
+    // decodes one byte plane into \a destination, which has room for whole groups
+    const uint8_t* decodePlane(const uint8_t* data, const uint8_t* end, size_t numVertices, uint8_t* destination,
+        uint8_t* last)
+    {
+        size_t numGroups = (numVertices + kGroupSize - 1) / kGroupSize;
+        const uint8_t* headers = data;
+        if (static_cast<size_t>(end - data) < (numGroups + 3) / 4)
+            return NULL;
+        data += (numGroups + 3) / 4;
+
+        // groups read up to 16 bytes, the tail of the stream goes through a padded copy
+        uint8_t padded[kGroupSize];
+        __m128i running = _mm_set1_epi8(static_cast<char>(*last));
+
+        for (size_t g=0;g<numGroups;g++)
+        {
+            int bits = kGroupBits[(headers[g / 4] >> ((g % 4) * 2)) & 3];
+            size_t size = bits * 2;
+
+            // one comparison while a whole group of input is left, the checks only matter near the end
+            const uint8_t* source = data;
+            if (static_cast<size_t>(end - data) < kGroupSize)
+            {
+                if (static_cast<size_t>(end - data) < size)
+                    return NULL;
+                memset(padded, 0, sizeof(padded));
+                memcpy(padded, data, size);
+                source = padded;
+            }
+            data += size;
+
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(destination + g * kGroupSize), decodeGroup(unpackGroup(source, bits), &running));
+        }
+        *last = static_cast<uint8_t>(_mm_cvtsi128_si32(running));
+        return data;
+    }
+
+    // interleaves the byte planes of a block back into vertices. Four planes at a time become one 32-bit store per
+    // vertex instead of four scattered byte stores, which is where most of the decode time went.
+    void interleavePlanes(const uint8_t* planes, size_t numVertices, size_t stride, uint8_t* destination)
+    {
+        size_t k = 0;
+        for (;k+4<=stride;k+=4)
+        {
+            const uint8_t* p = planes + k * kBlockVertices;
+            for (size_t i=0;i<numVertices;i+=kGroupSize)
+            {
+                __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i));
+                __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + kBlockVertices + i));
+                __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 2 * kBlockVertices + i));
+                __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 3 * kBlockVertices + i));
+                __m128i ab0 = _mm_unpacklo_epi8(a, b), ab1 = _mm_unpackhi_epi8(a, b);
+                __m128i cd0 = _mm_unpacklo_epi8(c, d), cd1 = _mm_unpackhi_epi8(c, d);
+
+                uint32_t words[kGroupSize];
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(words), _mm_unpacklo_epi16(ab0, cd0));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(words + 4), _mm_unpackhi_epi16(ab0, cd0));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(words + 8), _mm_unpacklo_epi16(ab1, cd1));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(words + 12), _mm_unpackhi_epi16(ab1, cd1));
+
+                size_t count = std::min(kGroupSize, numVertices - i);
+                uint8_t* target = destination + i * stride + k;
+                for (size_t j=0;j<count;j++)
+                    memcpy(target + j * stride, &words[j], sizeof(uint32_t));
+            }
+        }
+        for (;k<stride;k++)
+        {
+            const uint8_t* p = planes + k * kBlockVertices;
+            for (size_t i=0;i<numVertices;i++)
+                destination[i * stride + k] = p[i];
+        }
+    }
+
+    // Triangle coding. A triangle sharing an edge with one of the last kEdgeFifo edges stores the rotation that
+    // brings the shared edge first, the FIFO slot and the code of its third vertex. Vertex codes are: the next
+    // unseen index, one of the last kVertexFifo new vertices, or an explicit delta following the code bytes.
+    const size_t kEdgeFifo = 8;
+    const size_t kVertexFifo = 6;
+    const uint8_t kCodeNext = 0;
+    const uint8_t kCodeExplicit = 7;
+    const uint8_t kNoEdge = 3;
+
+    struct IndexState
+    {
+        IndexState():edgeCount(0), vertexCount(0), next(0){}
+
+        uint32_t    edges[kEdgeFifo][2];
+        size_t      edgeCount;
+        uint32_t    vertices[kVertexFifo];
+        size_t      vertexCount;
+        uint32_t    next;
+
+        // slot 0 is the most recent entry
+        const uint32_t* edge(size_t slot) const { return edges[(edgeCount - 1 - slot) % kEdgeFifo]; }
+        uint32_t vertex(size_t slot) const { return vertices[(vertexCount - 1 - slot) % kVertexFifo]; }
+
+        size_t numEdges() const { return std::min(edgeCount, kEdgeFifo); }
+        size_t numVertices() const { return std::min(vertexCount, kVertexFifo); }
+
+        void pushEdge(uint32_t a, uint32_t b)
+        {
+            edges[edgeCount % kEdgeFifo][0] = a;
+            edges[edgeCount % kEdgeFifo][1] = b;
+            edgeCount++;
+        }
+
+        // neighbours run along a shared edge in the opposite direction
+        void pushTriangle(uint32_t a, uint32_t b, uint32_t c)
+        {
+            pushEdge(b, a);
+            pushEdge(c, b);
+            pushEdge(a, c);
+        }
+
+        void update(uint8_t code, uint32_t v)
+        {
+            if (code == kCodeNext || code == kCodeExplicit)
+            {
+                vertices[vertexCount % kVertexFifo] = v;
+                vertexCount++;
+            }
+            if (v >= next)
+                next = v + 1;
+        }
+
+        uint8_t encodeVertex(uint32_t v) const
+        {
+            if (v == next)
+                return kCodeNext;
+            for (size_t i=0;i<numVertices();i++)
+                if (vertex(i) == v)
+                    return static_cast<uint8_t>(i + 1);
+            return kCodeExplicit;
+        }
+    };
+
+    void writeVarint(std::vector<uint8_t>& out, uint32_t value)
+    {
+        while (value >= 0x80)
+        {
+            out.push_back(static_cast<uint8_t>(value | 0x80));
+            value >>= 7;
+        }
+        out.push_back(static_cast<uint8_t>(value));
+    }
+
+    bool readVarint(const uint8_t*& data, const uint8_t* end, uint32_t* value)
+    {
+        *value = 0;
+        for (int shift=0;shift<35;shift+=7)
+        {
+            if (data == end)
+                return false;
+            uint8_t byte = *data++;
+            *value |= static_cast<uint32_t>(byte & 0x7f) << shift;
+            if ((byte & 0x80) == 0)
+                return true;
+        }
+        return false;
+    }
+
+    void writeExplicit(std::vector<uint8_t>& out, const IndexState& state, uint32_t v)
+    {
+        int32_t delta = static_cast<int32_t>(v - state.next);
+        // zigzag in unsigned arithmetic, shifting a negative delta left is undefined
+        writeVarint(out, (static_cast<uint32_t>(delta) << 1) ^ static_cast<uint32_t>(delta >> 31));
+    }
+
+    bool decodeVertex(const uint8_t*& data, const uint8_t* end, IndexState& state, uint8_t code, uint32_t* v)
+    {
+        if (code == kCodeNext)
+        {
+            *v = state.next;
+        }
+        else if (code == kCodeExplicit)
+        {
+            uint32_t zz;
+            if (!readVarint(data, end, &zz))
+                return false;
+            *v = state.next + ((zz >> 1) ^ (0u - (zz & 1)));
+        }
+        else
+        {
+            if (code > state.numVertices())
+                return false;
+            *v = state.vertex(code - 1);
+        }
+        state.update(code, *v);
+        return true;
+    }
+}
+
+void encodeVertexBuffer( std::vector<uint8_t>& out, const void* vertices, size_t count, size_t stride )
+{
+    assert(stride > 0 && stride <= kMaxStride);
+
+    const uint8_t* source = static_cast<const uint8_t*>(vertices);
+    uint8_t last[kMaxStride] = {0};
+    uint8_t plane[kBlockVertices];
+
+    out.push_back(kVertexHeader);
+    for (size_t begin=0;begin<count;begin+=kBlockVertices)
+    {
+        size_t n = std::min(kBlockVertices, count - begin);
+        size_t numGroups = (n + kGroupSize - 1) / kGroupSize;
+
+        for (size_t k=0;k<stride;k++)
+        {
+            uint8_t previous = last[k];
+            for (size_t i=0;i<n;i++)
+            {
+                uint8_t value = source[(begin + i) * stride + k];
+                plane[i] = zigzag8(static_cast<uint8_t>(value - previous));
+                previous = value;
+            }
+            memset(plane + n, 0, numGroups * kGroupSize - n);
+            last[k] = previous;
+
+            encodePlane(out, plane, numGroups);
+        }
+    }
+}
+
+bool decodeVertexBuffer( void* destination, size_t count, size_t stride, const uint8_t* data, size_t size )
+{
+    if (stride == 0 || stride > kMaxStride || size == 0 || data[0] != kVertexHeader)
+        return false;
+
+    uint8_t* target = static_cast<uint8_t*>(destination);
+    const uint8_t* end = data + size;
+    uint8_t last[kMaxStride] = {0};
+    data++;
+
+    // one block of planes, 64KB at the largest stride
+    std::vector<uint8_t> planes(stride * kBlockVertices);
+    for (size_t begin=0;begin<count;begin+=kBlockVertices)
+    {
+        size_t n = std::min(kBlockVertices, count - begin);
+        for (size_t k=0;k<stride;k++)
+        {
+            data = decodePlane(data, end, n, &planes[k * kBlockVertices], &last[k]);
+            if (data == NULL)
+                return false;
+        }
+        interleavePlanes(&planes[0], n, stride, target + begin * stride);
+    }
+    return data == end;
+}
+
+void encodeIndexBuffer( std::vector<uint8_t>& out, const uint32_t* indices, size_t count )
+{
+    assert(count % 3 == 0);
+
+    IndexState state;
+    out.push_back(kIndexHeader);
+
+    for (size_t t=0;t+2<count;t+=3)
+    {
+        const uint32_t tri[3] = { indices[t], indices[t + 1], indices[t + 2] };
+
+        // look for a known edge in any of the three rotations
+        int rotation = kNoEdge;
+        size_t slot = 0;
+        for (size_t i=0;i<state.numEdges() && rotation == kNoEdge;i++)
+        {
+            const uint32_t* e = state.edge(i);
+            for (int r=0;r<3;r++)
+            {
+                if (tri[r] == e[0] && tri[(r + 1) % 3] == e[1])
+                {
+                    rotation = r;
+                    slot = i;
+                    break;
+                }
+            }
+        }
+
+        if (rotation != kNoEdge)
+        {
+            uint32_t c = tri[(rotation + 2) % 3];
+            uint8_t code = state.encodeVertex(c);
+            out.push_back(static_cast<uint8_t>((rotation << 6) | (slot << 3) | code));
+            if (code == kCodeExplicit)
+                writeExplicit(out, state, c);
+            state.update(code, c);
+        }
+        else
+        {
+            uint8_t codes[3];
+            std::vector<uint8_t> explicitValues;
+            for (int i=0;i<3;i++)
+            {
+                codes[i] = state.encodeVertex(tri[i]);
+                if (codes[i] == kCodeExplicit)
+                    writeExplicit(explicitValues, state, tri[i]);
+                state.update(codes[i], tri[i]);
+            }
+            out.push_back(static_cast<uint8_t>((kNoEdge << 6) | (codes[0] << 3) | codes[1]));
+            out.push_back(codes[2]);
+            out.insert(out.end(), explicitValues.begin(), explicitValues.end());
+        }
+
+        state.pushTriangle(tri[0], tri[1], tri[2]);
+    }
+}
+
+bool decodeIndexBuffer( void* destination, size_t count, size_t indexSize, const uint8_t* data, size_t size )
+{
+    if (count % 3 != 0 || (indexSize != 2 && indexSize != 4) || size == 0 || data[0] != kIndexHeader)
+        return false;
+
+    const uint8_t* end = data + size;
+    IndexState state;
+    data++;
+
+    for (size_t t=0;t<count;t+=3)
+    {
+        if (data == end)
+            return false;
+        uint8_t code = *data++;
+        int rotation = code >> 6;
+
+        uint32_t tri[3];
+        if (rotation != kNoEdge)
+        {
+            size_t slot = (code >> 3) & 7;
+            if (slot >= state.numEdges())
+                return false;
+            const uint32_t* e = state.edge(slot);
+            tri[rotation] = e[0];
+            tri[(rotation + 1) % 3] = e[1];
+            if (!decodeVertex(data, end, state, code & 7, &tri[(rotation + 2) % 3]))
+                return false;
+        }
+        else
+        {
+            if (data == end || *data > kCodeExplicit)
+                return false;
+            uint8_t codes[3] = { static_cast<uint8_t>((code >> 3) & 7), static_cast<uint8_t>(code & 7), *data++ };
+            for (int i=0;i<3;i++)
+                if (!decodeVertex(data, end, state, codes[i], &tri[i]))
+                    return false;
+        }
+
+        state.pushTriangle(tri[0], tri[1], tri[2]);
+
+        if (indexSize == 2)
+        {
+            if (tri[0] > 0xffff || tri[1] > 0xffff || tri[2] > 0xffff)
+                return false;
+            uint16_t* target = static_cast<uint16_t*>(destination) + t;
+            for (int i=0;i<3;i++)
+                target[i] = static_cast<uint16_t>(tri[i]);
+        }
+        else
+        {
+            memcpy(static_cast<uint32_t*>(destination) + t, tri, sizeof(tri));
+        }
+    }
+    return data == end;
+}
+
+} } // namespace cinder::dx11
@@ -0,0 +1,319 @@
+#include "cinder/TriMesh.h"
+
+#include "dx11/MeshNormals.h"
+#include "dx11/MeshAdjacency.h"
+#include "dx11/WorkerPool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <xmmintrin.h>
+#include <boost/bind.hpp>
+
+namespace cinder { namespace dx11 {
+
+namespace
+{
+    const uint32_t kNone = ~0u;
+    const float kPi = 3.14159265f;
+
+    __m128 select(__m128 mask, __m128 a, __m128 b)
+    {
+        return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+    }
+
+    __m128 dot(__m128 ax, __m128 ay, __m128 az, __m128 bx, __m128 by, __m128 bz)
+    {
+        return _mm_add_ps(_mm_add_ps(_mm_mul_ps(ax, bx), _mm_mul_ps(ay, by)), _mm_mul_ps(az, bz));
+    }
+
+    // 1 / x, or 0 where x is 0
+    __m128 safeReciprocal(__m128 x)
+    {
+        return _mm_and_ps(_mm_cmpgt_ps(x, _mm_setzero_ps()), _mm_div_ps(_mm_set1_ps(1.0f), x));
+    }
+
+    // acos to within 7e-5 radians (Abramowitz and Stegun 4.4.45), for x in [-1, 1]
+    __m128 acosApprox(__m128 x)
+    {
+        __m128 a = _mm_andnot_ps(_mm_set1_ps(-0.0f), x);
+        __m128 poly = _mm_set1_ps(-0.0187293f);
+        poly = _mm_add_ps(_mm_mul_ps(poly, a), _mm_set1_ps(0.0742610f));
+        poly = _mm_sub_ps(_mm_mul_ps(poly, a), _mm_set1_ps(0.2121144f));
+        poly = _mm_add_ps(_mm_mul_ps(poly, a), _mm_set1_ps(1.5707288f));
+        __m128 result = _mm_mul_ps(_mm_sqrt_ps(_mm_sub_ps(_mm_set1_ps(1.0f), a)), poly);
+        return select(_mm_cmplt_ps(x, _mm_setzero_ps()), _mm_sub_ps(_mm_set1_ps(kPi), result), result);
+    }
+
+    Vec3f normalizeOrZero(const Vec3f& v)
+    {
+        float length = v.length();
+        return length > 0 ? v / length : Vec3f::zero();
+    }
+
+    // Unit face normals and the weight every corner adds to its vertex, four triangles per iteration
+    struct FaceBuilder
+    {
+        const Vec3f*    positions;
+        const uint32_t* indices;
+        bool            angleWeighted;
+        bool            clockwise;
+        Vec3f*          faceNormals;
+        float*          cornerWeights;
+
+        void buildRange(size_t begin, size_t end)
+        {
+            float p[9][4];
+            float out[6][4];
+
+            for (size_t t=begin;t<end;t+=4)
+            {
+                size_t n = std::min<size_t>(4, end - t);
+                for (size_t k=0;k<4;k++)
+                {
+                    // the tail repeats its last triangle
+                    size_t triangle = t + std::min(k, n - 1);
+                    for (int c=0;c<3;c++)
+                    {
+                        const Vec3f& v = positions[indices[triangle * 3 + c]];
+                        p[c * 3 + 0][k] = v.x;
+                        p[c * 3 + 1][k] = v.y;
+                        p[c * 3 + 2][k] = v.z;
+                    }
+                }
+
+                __m128 ax = _mm_loadu_ps(p[0]), ay = _mm_loadu_ps(p[1]), az = _mm_loadu_ps(p[2]);
+                __m128 bx = _mm_loadu_ps(p[3]), by = _mm_loadu_ps(p[4]), bz = _mm_loadu_ps(p[5]);
+                __m128 cx = _mm_loadu_ps(p[6]), cy = _mm_loadu_ps(p[7]), cz = _mm_loadu_ps(p[8]);
+
+                __m128 e1x = _mm_sub_ps(bx, ax), e1y = _mm_sub_ps(by, ay), e1z = _mm_sub_ps(bz, az);
+                __m128 e2x = _mm_sub_ps(cx, ax), e2y = _mm_sub_ps(cy, ay), e2z = _mm_sub_ps(cz, az);
+                __m128 e3x = _mm_sub_ps(cx, bx), e3y = _mm_sub_ps(cy, by), e3z = _mm_sub_ps(cz, bz);
+
+                __m128 nx = _mm_sub_ps(_mm_mul_ps(e1y, e2z), _mm_mul_ps(e1z, e2y));
+                __m128 ny = _mm_sub_ps(_mm_mul_ps(e1z, e2x), _mm_mul_ps(e1x, e2z));
+                __m128 nz = _mm_sub_ps(_mm_mul_ps(e1x, e2y), _mm_mul_ps(e1y, e2x));
+
+                // twice the area, degenerate triangles get no direction and no weight
+                __m128 length = _mm_sqrt_ps(dot(nx, ny, nz, nx, ny, nz));
+                __m128 scale = safeReciprocal(length);
+                if (clockwise)
+                    scale = _mm_sub_ps(_mm_setzero_ps(), scale);
+
+                _mm_storeu_ps(out[0], _mm_mul_ps(nx, scale));
+                _mm_storeu_ps(out[1], _mm_mul_ps(ny, scale));
+                _mm_storeu_ps(out[2], _mm_mul_ps(nz, scale));
+
+                if (angleWeighted)
+                {
+                    __m128 l1 = _mm_sqrt_ps(dot(e1x, e1y, e1z, e1x, e1y, e1z));
+                    __m128 l2 = _mm_sqrt_ps(dot(e2x, e2y, e2z, e2x, e2y, e2z));
+                    __m128 l3 = _mm_sqrt_ps(dot(e3x, e3y, e3z, e3x, e3y, e3z));
+                    __m128 one = _mm_set1_ps(1.0f);
+                    __m128 minusOne = _mm_set1_ps(-1.0f);
+                    __m128 valid = _mm_cmpgt_ps(length, _mm_setzero_ps());
+
+                    // at a between e1 and e2, at b between -e1 and e3, at c between -e2 and -e3
+                    __m128 cosines[3] =
+                    {
+                        _mm_mul_ps(dot(e1x, e1y, e1z, e2x, e2y, e2z), safeReciprocal(_mm_mul_ps(l1, l2))),
+                        _mm_mul_ps(_mm_sub_ps(_mm_setzero_ps(), dot(e1x, e1y, e1z, e3x, e3y, e3z)), safeReciprocal(_mm_mul_ps(l1, l3))),
+                        _mm_mul_ps(dot(e2x, e2y, e2z, e3x, e3y, e3z), safeReciprocal(_mm_mul_ps(l2, l3)))
+                    };
+                    for (int c=0;c<3;c++)
+                    {
+                        __m128 cosine = _mm_max_ps(minusOne, _mm_min_ps(one, cosines[c]));
+                        _mm_storeu_ps(out[3 + c], _mm_and_ps(valid, acosApprox(cosine)));
+                    }
+                }
+                else
+                {
+                    for (int c=0;c<3;c++)
+                        _mm_storeu_ps(out[3 + c], length);
+                }
+
+                for (size_t k=0;k<n;k++)
+                {
+                    faceNormals[t + k] = Vec3f(out[0][k], out[1][k], out[2][k]);
+                    for (int c=0;c<3;c++)
+                        cornerWeights[(t + k) * 3 + c] = out[3 + c][k];
+                }
+            }
+        }
+    };
+
+    // Every vertex sums the faces in its own corner list, so no two workers touch the same output
+    struct NormalGatherer
+    {
+        const Vec3f*            faceNormals;
+        const float*            cornerWeights;
+        const uint32_t*         cornerStarts;
+        const uint32_t*         corners;
+        float                   creaseCosine;
+        Vec3f*                  vertexNormals;  // smooth, per welded vertex
+        Vec3f*                  cornerNormals;  // creased, per corner
+
+        void smoothRange(size_t begin, size_t end)
+        {
+            for (size_t v=begin;v<end;v++)
+            {
+                Vec3f sum = Vec3f::zero();
+                for (uint32_t i=cornerStarts[v];i<cornerStarts[v + 1];i++)
+                    sum += faceNormals[corners[i] / 3] * cornerWeights[corners[i]];
+                vertexNormals[v] = normalizeOrZero(sum);
+            }
+        }
+
+        void creaseRange(size_t begin, size_t end)
+        {
+            for (size_t v=begin;v<end;v++)
+            {
+                for (uint32_t i=cornerStarts[v];i<cornerStarts[v + 1];i++)
+                {
+                    const Vec3f& face = faceNormals[corners[i] / 3];
+                    Vec3f sum = Vec3f::zero();
+                    for (uint32_t j=cornerStarts[v];j<cornerStarts[v + 1];j++)
+                    {
+                        const Vec3f& other = faceNormals[corners[j] / 3];
+                        if (i == j || face.dot(other) >= creaseCosine)
+                            sum += other * cornerWeights[corners[j]];
+                    }
+                    cornerNormals[corners[i]] = normalizeOrZero(sum);
+                }
+            }
+        }
+    };
+}
+
+NormalGenerator::Result NormalGenerator::build( const Vec3f* positions, size_t numVertices, const uint32_t* indices, size_t numIndices,
+    const Options& options )
+{
+    Result result;
+    size_t numTriangles = numIndices / 3;
+    size_t numCorners = numTriangles * 3;
+
+    result.normals.assign(numVertices, Vec3f::zero());
+    result.vertexSources.resize(numVertices);
+    for (size_t v=0;v<numVertices;v++)
+        result.vertexSources[v] = static_cast<uint32_t>(v);
+    result.indices.assign(indices, indices + numCorners);
+    if (numTriangles == 0)
+        return result;
+
+    std::vector<Vec3f> faceNormals(numTriangles);
+    std::vector<float> cornerWeights(numCorners);
+    FaceBuilder builder = { positions, indices, options.angleWeighted, options.clockwise, &faceNormals[0], &cornerWeights[0] };
+    parallelFor(numTriangles, 4096, boost::bind(&FaceBuilder::buildRange, &builder, _1, _2));
+
+    // vertices sharing a position gather from one corner list
+    std::vector<uint32_t> groups;
+    if (options.weldPositions)
+    {
+        buildPositionRemap(groups, positions, numVertices, sizeof(Vec3f));
+    }
+    else
+    {
+        groups.resize(numVertices);
+        for (size_t v=0;v<numVertices;v++)
+            groups[v] = static_cast<uint32_t>(v);
+    }
+
+    std::vector<uint32_t> cornerStarts(numVertices + 1, 0);
+    for (size_t c=0;c<numCorners;c++)
+        cornerStarts[groups[indices[c]] + 1]++;
+    for (size_t v=0;v<numVertices;v++)
+        cornerStarts[v + 1] += cornerStarts[v];
+
+    std::vector<uint32_t> corners(numCorners);
+    std::vector<uint32_t> cursors(cornerStarts.begin(), cornerStarts.end() - 1);
+    for (size_t c=0;c<numCorners;c++)
+        corners[cursors[groups[indices[c]]]++] = static_cast<uint32_t>(c);
+
+    NormalGatherer gatherer = { &faceNormals[0], &cornerWeights[0], &cornerStarts[0], &corners[0],
+        cosf(options.creaseAngle * kPi / 180.0f), &result.normals[0], NULL };
+
+    if (options.creaseAngle >= 180.0f)
+    {
+        std::vector<Vec3f> groupNormals(numVertices);
+        gatherer.vertexNormals = &groupNormals[0];
+        parallelFor(numVertices, 4096, boost::bind(&NormalGatherer::smoothRange, &gatherer, _1, _2));
+
+        for (size_t v=0;v<numVertices;v++)
+            result.normals[v] = groupNormals[groups[v]];
+        return result;
+    }
+
+    std::vector<Vec3f> cornerNormals(numCorners);
+    gatherer.cornerNormals = &cornerNormals[0];
+    parallelFor(numVertices, 1024, boost::bind(&NormalGatherer::creaseRange, &gatherer, _1, _2));
+
+    // corners of one vertex that ended up with the same normal share it, the others become new vertices
+    std::vector<uint32_t> keys(numCorners * 4);
+    for (size_t c=0;c<numCorners;c++)
+    {
+        keys[c * 4] = indices[c];
+        memcpy(&keys[c * 4 + 1], &cornerNormals[c].x, sizeof(float));
+        memcpy(&keys[c * 4 + 2], &cornerNormals[c].y, sizeof(float));
+        memcpy(&keys[c * 4 + 3], &cornerNormals[c].z, sizeof(float));
+    }
+    std::vector<uint32_t> remap;
+    buildKeyRemap(remap, &keys[0], numCorners, 4);
+
+    std::vector<uint32_t> cornerVertices(numCorners, kNone);
+    std::vector<bool> used(numVertices, false);
+    for (size_t c=0;c<numCorners;c++)
+    {
+        uint32_t corner = remap[c];
+        if (cornerVertices[corner] == kNone)
+        {
+            uint32_t source = indices[c];
+            if (!used[source])
+            {
+                used[source] = true;
+                cornerVertices[corner] = source;
+            }
+            else
+            {
+                cornerVertices[corner] = static_cast<uint32_t>(result.normals.size());
+                result.normals.push_back(Vec3f::zero());
+                result.vertexSources.push_back(source);
+            }
+            result.normals[cornerVertices[corner]] = cornerNormals[corner];
+        }
+        result.indices[c] = cornerVertices[corner];
+    }
+    return result;
+}
+
+namespace
+{
+    template <typename T>
+    void appendSources(std::vector<T>& values, const std::vector<uint32_t>& sources)
+    {
+        if (values.empty())
+            return;
+
+        size_t first = values.size();
+        values.reserve(sources.size());
+        for (size_t v=first;v<sources.size();v++)
+            values.push_back(values[sources[v]]);
+    }
+}
+
+void generateNormals( TriMesh* triMesh, const NormalGenerator::Options& options )
+{
+    if (triMesh->getNumVertices() == 0)
+        return;
+
+    NormalGenerator::Result result = NormalGenerator::build(&triMesh->getVertices()[0], triMesh->getNumVertices(),
+        triMesh->getIndices().empty() ? NULL : &triMesh->getIndices()[0], triMesh->getNumIndices(), options);
+
+    appendSources(triMesh->getVertices(), result.vertexSources);
+    appendSources(triMesh->getTexCoords(), result.vertexSources);
+    appendSources(triMesh->getColorsRGB(), result.vertexSources);
+    appendSources(triMesh->getColorsRGBA(), result.vertexSources);
+    triMesh->getNormals().swap(result.normals);
+    triMesh->getIndices().swap(result.indices);
+}
+
+} } // namespace cinder::dx11
@@ -0,0 +1,637 @@
+#include "cinder/TriMesh.h"
+
+#include "dx11/MeshSimplifier.h"
+#include "dx11/WorkerPool.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cstring>
+#include <boost/bind.hpp>
+
+namespace cinder { namespace dx11 {
+
+namespace
+{
+    const uint32_t kNone = ~0u;
+    const uint32_t kMulti = ~1u;
+
+    // boundary planes are weighted up so that open borders keep their silhouette
+    const float kBoundaryWeight = 10.0f;
+
+    // Manifold, Border, Seam, Locked
+    const bool kCanCollapse[4][4] =
+    {
+        { true,  true,  true,  true  },
+        { false, true,  false, false },
+        { false, false, true,  false },
+        { false, false, false, false },
+    };
+
+    // whether an edge between the two kinds is shared by two triangles, in which case it is picked only once
+    const bool kHasOpposite[4][4] =
+    {
+        { true,  true,  true,  true  },
+        { true,  false, true,  false },
+        { true,  true,  true,  true  },
+        { true,  false, true,  false },
+    };
+
+    uint32_t hashPosition(const Vec3f& p)
+    {
+        uint32_t h[3];
+        memcpy(h, &p.x, sizeof(h));
+        return (h[0] * 73856093) ^ (h[1] * 19349663) ^ (h[2] * 83492791);
+    }
+
+    struct CollapseOrder
+    {
+        CollapseOrder(const std::vector<float>& costs):mCosts(costs){}
+        bool operator()(uint32_t a, uint32_t b) const { return mCosts[a] < mCosts[b]; }
+        const std::vector<float>& mCosts;
+    };
+}
+
+MeshSimplifier::MeshSimplifier( const Vec3f* positions, size_t numVertices, const uint32_t* indices, size_t numIndices,
+                                const Vec3f* normals, const Vec2f* texCoords, const Options& options )
+:mOptions(options), mNormals(normals), mTexCoords(texCoords), mNumVertices(numVertices), mRadius(1.0f), mError(0.0f),
+mIndices(indices, indices + numIndices)
+{
+    assert(numIndices % 3 == 0);
+
+    // bring the mesh into the unit sphere so that errors are relative to its size
+    Vec3f lower(FLT_MAX, FLT_MAX, FLT_MAX);
+    Vec3f upper(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+    for (size_t i=0;i<numVertices;i++)
+    {
+        for (int k=0;k<3;k++)
+        {
+            lower[k] = std::min(lower[k], positions[i][k]);
+            upper[k] = std::max(upper[k], positions[i][k]);
+        }
+    }
+    Vec3f center = (lower + upper) * 0.5f;
+    mRadius = numVertices > 0 ? (upper - lower).length() * 0.5f : 0.0f;
+    float invRadius = mRadius > 0 ? 1.0f / mRadius : 1.0f;
+
+    mPositions.resize(numVertices);
+    for (size_t i=0;i<numVertices;i++)
+        mPositions[i] = (positions[i] - center) * invRadius;
+
+    buildPositionRemap();
+    classifyVertices();
+    computeQuadrics();
+}
+
+void MeshSimplifier::buildPositionRemap()
+{
+    mRemap.resize(mNumVertices);
+    mWedge.resize(mNumVertices);
+
+    size_t tableSize = 16;
+    while (tableSize < mNumVertices * 2)
+        tableSize *= 2;
+    size_t mask = tableSize - 1;
+
+    std::vector<uint32_t> table(tableSize, kNone);
+    for (size_t i=0;i<mNumVertices;i++)
+    {
+        size_t bucket = hashPosition(mPositions[i]) & mask;
+        for (;;)
+        {
+            uint32_t entry = table[bucket];
+            if (entry == kNone)
+            {
+                table[bucket] = i;
+                mRemap[i] = i;
+                break;
+            }
+            if (memcmp(&mPositions[entry], &mPositions[i], sizeof(Vec3f)) == 0)
+            {
+                mRemap[i] = entry;
+                break;
+            }
+            bucket = (bucket + 1) & mask;
+        }
+    }
+
+    // link the vertices sharing a position into a ring
+    for (size_t i=0;i<mNumVertices;i++)
+        mWedge[i] = i;
+    for (size_t i=0;i<mNumVertices;i++)
+    {
+        uint32_t r = mRemap[i];
+        if (r != i)
+        {
+            mWedge[i] = mWedge[r];
+            mWedge[r] = i;
+        }
+    }
+}
+
+void MeshSimplifier::buildAdjacency( Adjacency& adjacency, bool welded ) const
+{
+    const uint32_t* remap = welded ? &mRemap[0] : NULL;
+    size_t numIndices = mIndices.size();
+
+    adjacency.counts.assign(mNumVertices, 0);
+    adjacency.offsets.resize(mNumVertices);
+    adjacency.data.resize(numIndices * 2);
+
+    for (size_t i=0;i<numIndices;i++)
+    {
+        uint32_t v = remap ? remap[mIndices[i]] : mIndices[i];
+        adjacency.counts[v]++;
+    }
+
+    uint32_t offset = 0;
+    for (size_t i=0;i<mNumVertices;i++)
+    {
+        adjacency.offsets[i] = offset;
+        offset += adjacency.counts[i];
+    }
+
+    std::vector<uint32_t> fill(adjacency.offsets);
+    for (size_t i=0;i<numIndices;i+=3)
+    {
+        uint32_t v[3];
+        for (int k=0;k<3;k++)
+            v[k] = remap ? remap[mIndices[i+k]] : mIndices[i+k];
+
+        for (int k=0;k<3;k++)
+        {
+            uint32_t& pos = fill[v[k]];
+            adjacency.data[pos*2+0] = v[(k+1)%3];
+            adjacency.data[pos*2+1] = v[(k+2)%3];
+            pos++;
+        }
+    }
+}
+
+const uint32_t* MeshSimplifier::getCorners( const Adjacency& adjacency, uint32_t v )
+{
+    // vertices that no triangle references sit past the end of the data
+    return adjacency.data.empty() ? NULL : &adjacency.data[0] + adjacency.offsets[v] * 2;
+}
+
+bool MeshSimplifier::hasEdge( const Adjacency& adjacency, uint32_t a, uint32_t b ) const
+{
+    const uint32_t* corners = getCorners(adjacency, a);
+    for (uint32_t i=0;i<adjacency.counts[a];i++)
+    {
+        if (corners[i*2] == b)
+            return true;
+    }
+    return false;
+}
+
+void MeshSimplifier::classifyVertices()
+{
+    Adjacency adjacency;
+    buildAdjacency(adjacency, false);
+    Adjacency welded;
+    buildAdjacency(welded, true);
+
+    // the single open edge leaving / entering each vertex, kMulti if there are several
+    std::vector<uint32_t> openOut(mNumVertices, kNone);
+    std::vector<uint32_t> openIn(mNumVertices, kNone);
+    std::vector<uint8_t> weldedOpen(mNumVertices, 0);
+
+    for (size_t i=0;i<mNumVertices;i++)
+    {
+        const uint32_t* corners = getCorners(adjacency, i);
+        for (uint32_t k=0;k<adjacency.counts[i];k++)
+        {
+            uint32_t next = corners[k*2+0];
+            uint32_t prev = corners[k*2+1];
+            if (!hasEdge(adjacency, next, i))
+                openOut[i] = (openOut[i] == kNone) ? next : kMulti;
+            if (!hasEdge(adjacency, i, prev))
+                openIn[i] = (openIn[i] == kNone) ? prev : kMulti;
+        }
+
+        if (mRemap[i] == i)
+        {
+            const uint32_t* weldedCorners = getCorners(welded, i);
+            uint32_t outCount = 0, inCount = 0;
+            for (uint32_t k=0;k<welded.counts[i];k++)
+            {
+                if (!hasEdge(welded, weldedCorners[k*2+0], i))
+                    outCount++;
+                if (!hasEdge(welded, i, weldedCorners[k*2+1]))
+                    inCount++;
+            }
+            if (outCount == 0 && inCount == 0)
+                weldedOpen[i] = 0;
+            else if (outCount == 1 && inCount == 1)
+                weldedOpen[i] = 1;
+            else
+                weldedOpen[i] = 2;
+        }
+    }
+
+    mKind.resize(mNumVertices);
+    for (size_t i=0;i<mNumVertices;i++)
+    {
+        if (mRemap[i] != i)
+            continue;
+
+        uint8_t kind = Kind_Locked;
+        uint32_t w = mWedge[i];
+        if (w == i)
+        {
+            if (weldedOpen[i] == 0)
+                kind = Kind_Manifold;
+            else if (weldedOpen[i] == 1 && openOut[i] < kMulti && openIn[i] < kMulti)
+                kind = mOptions.lockBorder ? Kind_Locked : Kind_Border;
+        }
+        else if (mWedge[w] == i && weldedOpen[i] == 0)
+        {
+            // a seam: each wedge has one open edge in and out, and the two sides run along the same positions
+            uint32_t iv = openIn[i], ov = openOut[i];
+            uint32_t iw = openIn[w], ow = openOut[w];
+            if (iv < kMulti && ov < kMulti && iw < kMulti && ow < kMulti &&
+                mRemap[iv] == mRemap[ow] && mRemap[ov] == mRemap[iw] && mRemap[iv] != mRemap[ov])
+                kind = Kind_Seam;
+        }
+        mKind[i] = kind;
+    }
+    for (size_t i=0;i<mNumVertices;i++)
+        mKind[i] = mKind[mRemap[i]];
+
+    mLoop.resize(mNumVertices);
+    for (size_t i=0;i<mNumVertices;i++)
+        mLoop[i] = openOut[i] < kMulti ? openOut[i] : kNone;
+
+    // computeQuadrics() needs the welded topology of the input
+    mAdjacency.offsets.swap(welded.offsets);
+    mAdjacency.counts.swap(welded.counts);
+    mAdjacency.data.swap(welded.data);
+}
+
+void MeshSimplifier::addQuadric( Quadric& q, const Quadric& r )
+{
+    q.a00 += r.a00; q.a11 += r.a11; q.a22 += r.a22;
+    q.a10 += r.a10; q.a20 += r.a20; q.a21 += r.a21;
+    q.b0 += r.b0; q.b1 += r.b1; q.b2 += r.b2;
+    q.c += r.c;
+    q.w += r.w;
+}
+
+void MeshSimplifier::planeQuadric( Quadric& q, const Vec3f& n, float d, float w )
+{
+    q.a00 = w * n.x * n.x; q.a11 = w * n.y * n.y; q.a22 = w * n.z * n.z;
+    q.a10 = w * n.y * n.x; q.a20 = w * n.z * n.x; q.a21 = w * n.z * n.y;
+    q.b0 = w * n.x * d; q.b1 = w * n.y * d; q.b2 = w * n.z * d;
+    q.c = w * d * d;
+    q.w = w;
+}
+
+float MeshSimplifier::evalQuadric( const Quadric& q, const Vec3f& p )
+{
+    // p^T A p + 2 b.p + c
+    float rx = q.a00 * p.x + q.a10 * p.y + q.a20 * p.z;
+    float ry = q.a10 * p.x + q.a11 * p.y + q.a21 * p.z;
+    float rz = q.a20 * p.x + q.a21 * p.y + q.a22 * p.z;
+    return rx * p.x + ry * p.y + rz * p.z + 2 * (q.b0 * p.x + q.b1 * p.y + q.b2 * p.z) + q.c;
+}
+
+void MeshSimplifier::computeQuadrics()
+{
+    mQuadrics.resize(mNumVertices);
+    parallelFor(mNumVertices, 1024, boost::bind(&MeshSimplifier::gatherQuadrics, this, _1, _2));
+
+    // from now on mAdjacency holds the per pass topology
+    mAdjacency = Adjacency();
+}
+
+// sums the face and border quadrics around each welded vertex, every vertex only writes its own entry
+void MeshSimplifier::gatherQuadrics( size_t begin, size_t end )
+{
+    for (size_t i=begin;i<end;i++)
+    {
+        Quadric& q = mQuadrics[i];
+        memset(&q, 0, sizeof(Quadric));
+        if (mRemap[i] != i)
+            continue;
+
+        const Vec3f& p0 = mPositions[i];
+        const uint32_t* corners = getCorners(mAdjacency, i);
+        for (uint32_t k=0;k<mAdjacency.counts[i];k++)
+        {
+            uint32_t next = corners[k*2+0];
+            uint32_t prev = corners[k*2+1];
+            const Vec3f& p1 = mPositions[next];
+            const Vec3f& p2 = mPositions[prev];
+
+            Vec3f normal = (p1 - p0).cross(p2 - p0);
+            float area = normal.length();
+            if (area > 0)
+            {
+                normal /= area;
+                Quadric face;
+                planeQuadric(face, normal, -normal.dot(p0), area * 0.5f);
+                addQuadric(q, face);
+            }
+
+            // open edges get a plane perpendicular to the face through the edge
+            for (int e=0;e<2;e++)
+            {
+                uint32_t other = (e == 0) ? next : prev;
+                bool open = (e == 0) ? !hasEdge(mAdjacency, next, i) : !hasEdge(mAdjacency, i, prev);
+                if (!open)
+                    continue;
+
+                Vec3f edge = mPositions[other] - p0;
+                float length = edge.length();
+                Vec3f edgeNormal = edge.cross(normal);
+                float edgeNormalLength = edgeNormal.length();
+                if (edgeNormalLength > 0)
+                {
+                    edgeNormal /= edgeNormalLength;
+                    Quadric border;
+                    planeQuadric(border, edgeNormal, -edgeNormal.dot(p0), length * length * kBoundaryWeight);
+                    addQuadric(q, border);
+                }
+            }
+        }
+    }
+}
+
+float MeshSimplifier::collapseError( uint32_t i0, uint32_t i1 ) const
+{
+    const Quadric& q = mQuadrics[mRemap[i0]];
+    if (q.w <= 0)
+        return 0;
+    float error = evalQuadric(q, mPositions[i1]) / q.w;
+    return sqrtf(std::max(error, 0.0f));
+}
+
+float MeshSimplifier::attributeCost( uint32_t i0, uint32_t i1 ) const
+{
+    float cost = 0;
+    if (mNormals)
+        cost += (mNormals[i0] - mNormals[i1]).lengthSquared() * 0.25f;
+    if (mTexCoords)
+        cost += (mTexCoords[i0] - mTexCoords[i1]).lengthSquared();
+    return cost * mOptions.attributeWeight;
+}
+
+void MeshSimplifier::pickCollapses( std::vector<Collapse>& collapses ) const
+{
+    collapses.clear();
+    for (size_t i=0;i<mIndices.size();i+=3)
+    {
+        for (int e=0;e<3;e++)
+        {
+            uint32_t i0 = mIndices[i+e];
+            uint32_t i1 = mIndices[i+(e+1)%3];
+
+            // zero length edge, leave it alone
+            if (mRemap[i0] == mRemap[i1])
+                continue;
+
+            uint8_t k0 = mKind[i0];
+            uint8_t k1 = mKind[i1];
+            bool can01 = kCanCollapse[k0][k1];
+            bool can10 = kCanCollapse[k1][k0];
+            if (!can01 && !can10)
+                continue;
+
+            // edges shared by two triangles are seen twice
+            if (kHasOpposite[k0][k1] && mRemap[i1] > mRemap[i0])
+                continue;
+
+            // two border / seam vertices without an open edge between them belong to different loops
+            if (k0 == k1 && (k0 == Kind_Border || k0 == Kind_Seam) && mLoop[i0] != i1)
+                continue;
+
+            Collapse c;
+            c.v0 = can01 ? i0 : i1;
+            c.v1 = can01 ? i1 : i0;
+            c.bidirectional = can01 && can10;
+            c.error = 0;
+            c.cost = 0;
+            collapses.push_back(c);
+        }
+    }
+}
+
+void MeshSimplifier::rankCollapses( std::vector<Collapse>& collapses ) const
+{
+    parallelFor(collapses.size(), 4096, boost::bind(&MeshSimplifier::rankRange, this, &collapses, _1, _2));
+}
+
+void MeshSimplifier::rankRange( std::vector<Collapse>* collapses, size_t begin, size_t end ) const
+{
+    for (size_t i=begin;i<end;i++)
+    {
+        Collapse& c = (*collapses)[i];
+        c.error = collapseError(c.v0, c.v1);
+        c.cost = c.error + attributeCost(c.v0, c.v1);
+        if (mKind[c.v0] == Kind_Seam)
+            c.cost += attributeCost(mWedge[c.v0], mWedge[c.v1]);
+
+        if (c.bidirectional)
+        {
+            float error = collapseError(c.v1, c.v0);
+            float cost = error + attributeCost(c.v1, c.v0);
+            if (mKind[c.v1] == Kind_Seam)
+                cost += attributeCost(mWedge[c.v1], mWedge[c.v0]);
+            if (cost < c.cost)
+            {
+                std::swap(c.v0, c.v1);
+                c.error = error;
+                c.cost = cost;
+            }
+        }
+    }
+}
+
+bool MeshSimplifier::hasTriangleFlips( uint32_t i0, uint32_t i1 ) const
+{
+    const Vec3f& v0 = mPositions[i0];
+    const Vec3f& v1 = mPositions[i1];
+
+    const uint32_t* corners = getCorners(mAdjacency, i0);
+    for (uint32_t k=0;k<mAdjacency.counts[i0];k++)
+    {
+        uint32_t a = mCollapseRemap[corners[k*2+0]];
+        uint32_t b = mCollapseRemap[corners[k*2+1]];
+
+        // this triangle collapses away
+        if (mRemap[a] == mRemap[i1] || mRemap[b] == mRemap[i1])
+            continue;
+
+        const Vec3f& va = mPositions[a];
+        const Vec3f& vb = mPositions[b];
+        Vec3f before = (va - v0).cross(vb - v0);
+        Vec3f after = (va - v1).cross(vb - v1);
+        if (before.dot(after) <= 0)
+            return true;
+    }
+    return false;
+}
+
+size_t MeshSimplifier::performCollapses( const std::vector<Collapse>& collapses, size_t triangleGoal, float errorLimit )
+{
+    std::vector<float> costs(collapses.size());
+    std::vector<uint32_t> order(collapses.size());
+    for (size_t i=0;i<collapses.size();i++)
+    {
+        costs[i] = collapses[i].cost;
+        order[i] = i;
+    }
+    std::sort(order.begin(), order.end(), CollapseOrder(costs));
+
+    mCollapseRemap.resize(mNumVertices);
+    for (size_t i=0;i<mNumVertices;i++)
+        mCollapseRemap[i] = i;
+    mCollapseLocked.assign(mNumVertices, 0);
+
+    size_t edgeCollapses = 0;
+    size_t triangleCollapses = 0;
+    for (size_t i=0;i<order.size() && triangleCollapses < triangleGoal;i++)
+    {
+        const Collapse& c = collapses[order[i]];
+        if (c.error > errorLimit)
+            continue;
+
+        uint32_t i0 = c.v0;
+        uint32_t i1 = c.v1;
+        uint32_t r0 = mRemap[i0];
+        uint32_t r1 = mRemap[i1];
+
+        // one collapse per neighbourhood and pass
+        if (mCollapseLocked[r0] || mCollapseLocked[r1])
+            continue;
+
+        uint8_t kind = mKind[i0];
+        if (hasTriangleFlips(i0, i1))
+            continue;
+
+        if (kind == Kind_Seam)
+        {
+            // the twin on the other side of the seam moves along with us
+            uint32_t s0 = mWedge[i0];
+            uint32_t s1 = mWedge[i1];
+            if (hasTriangleFlips(s0, s1))
+                continue;
+
+            mCollapseRemap[i0] = i1;
+            mCollapseRemap[s0] = s1;
+        }
+        else
+        {
+            mCollapseRemap[i0] = i1;
+        }
+
+        addQuadric(mQuadrics[r1], mQuadrics[r0]);
+        mCollapseLocked[r0] = 1;
+        mCollapseLocked[r1] = 1;
+
+        triangleCollapses += (kind == Kind_Border) ? 1 : 2;
+        edgeCollapses++;
+        mError = std::max(mError, c.error);
+    }
+
+    return edgeCollapses;
+}
+
+float MeshSimplifier::simplify( size_t targetIndexCount, float maxError )
+{
+    std::vector<Collapse> collapses;
+
+    while (mIndices.size() > targetIndexCount)
+    {
+        buildAdjacency(mAdjacency, false);
+
+        pickCollapses(collapses);
+        if (collapses.empty())
+            break;
+        rankCollapses(collapses);
+
+        size_t triangleGoal = (mIndices.size() - targetIndexCount) / 3;
+        if (performCollapses(collapses, triangleGoal, maxError) == 0)
+            break;
+
+        // drop the triangles that became degenerate
+        size_t write = 0;
+        for (size_t i=0;i<mIndices.size();i+=3)
+        {
+            uint32_t a = mCollapseRemap[mIndices[i+0]];
+            uint32_t b = mCollapseRemap[mIndices[i+1]];
+            uint32_t c = mCollapseRemap[mIndices[i+2]];
+            if (a != b && b != c && c != a)
+            {
+                mIndices[write+0] = a;
+                mIndices[write+1] = b;
+                mIndices[write+2] = c;
+                write += 3;
+            }
+        }
+        mIndices.resize(write);
+
+        for (size_t i=0;i<mNumVertices;i++)
+        {
+            uint32_t l = mLoop[i];
+            if (l != kNone)
+            {
+                // a collapse against the direction of the loop leaves us pointing at ourselves
+                uint32_t r = mCollapseRemap[l];
+                mLoop[i] = (r == i) ? mLoop[l] : r;
+            }
+        }
+    }
+
+    return mError;
+}
+
+LodChain MeshSimplifier::buildLodChain()
+{
+    LodChain chain;
+
+    LodLevel level;
+    level.indexCount = mIndices.size();
+    chain.levels.push_back(level);
+    chain.indices = mIndices;
+
+    for (size_t lod=1;lod<mOptions.numLods;lod++)
+    {
+        size_t previous = chain.levels.back().indexCount;
+        size_t target = static_cast<size_t>(previous * mOptions.reduction) / 3 * 3;
+
+        simplify(target, mOptions.maxError);
+        if (mIndices.empty() || mIndices.size() == previous)
+            break;
+
+        level.startIndex = chain.indices.size();
+        level.indexCount = mIndices.size();
+        level.error = mError;
+        chain.levels.push_back(level);
+        chain.indices.insert(chain.indices.end(), mIndices.begin(), mIndices.end());
+    }
+
+    return chain;
+}
+
+LodChain buildLodChain( const TriMesh& triMesh, const MeshSimplifier::Options& options, bool flipOrder )
+{
+    if (triMesh.getNumIndices() == 0)
+        return LodChain();
+
+    // match the winding VboMesh uploads
+    std::vector<uint32_t> indices = triMesh.getIndices();
+    if (flipOrder)
+    {
+        for (size_t i=0;i<indices.size();i+=3)
+            std::swap(indices[i+1], indices[i+2]);
+    }
+
+    MeshSimplifier simplifier(&triMesh.getVertices()[0], triMesh.getNumVertices(), &indices[0], indices.size(),
+        triMesh.hasNormals() ? &triMesh.getNormals()[0] : NULL,
+        triMesh.hasTexCoords() ? &triMesh.getTexCoords()[0] : NULL,
+        options);
+    return simplifier.buildLodChain();
+}
+
+} } // namespace cinder::dx11
@@ -0,0 +1,251 @@
+#include "dx11/MorphTargets.h"
+#include "dx11/WorkerPool.h"
+#include "dx11/dx11.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <emmintrin.h>
+#include <boost/bind.hpp>
+
+namespace cinder { namespace dx11 {
+
+namespace
+{
+    const size_t kGrainSize = 4096;
+
+    inline __m128 load3( const uint8_t* p )
+    {
+        const float* f = reinterpret_cast<const float*>(p);
+        return _mm_setr_ps(f[0], f[1], f[2], 0);
+    }
+
+    inline void store3( __m128 v, uint8_t* p )
+    {
+        float* f = reinterpret_cast<float*>(p);
+        _mm_storel_pi(reinterpret_cast<__m64*>(f), v);
+        _mm_store_ss(f + 2, _mm_movehl_ps(v, v));
+    }
+
+    inline __m128 normalize3( __m128 v )
+    {
+        __m128 sq = _mm_mul_ps(v, v);
+        __m128 lengthSq = _mm_add_ss(_mm_add_ss(sq, _mm_shuffle_ps(sq, sq, _MM_SHUFFLE(1, 1, 1, 1))),
+            _mm_movehl_ps(sq, sq));
+        if (_mm_cvtss_f32(lengthSq) <= 0)
+            return v;
+        __m128 length = _mm_sqrt_ss(lengthSq);
+        return _mm_div_ps(v, _mm_shuffle_ps(length, length, _MM_SHUFFLE(0, 0, 0, 0)));
+    }
+
+    // the first four 16-bit values of v, sign extended and converted
+    inline __m128 shortsToFloats( __m128i v )
+    {
+        return _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16));
+    }
+
+    inline bool isZero( __m128 v )
+    {
+        return _mm_movemask_ps(_mm_cmpneq_ps(v, _mm_setzero_ps())) == 0;
+    }
+
+    int16_t quantize( float value, float scale )
+    {
+        return scale > 0 ? (int16_t)floor(value / scale + 0.5f) : 0;
+    }
+}
+
+// Splits one character over vertex chunks, or many characters over the pool
+struct MorphTargets::Job
+{
+    const MorphTargets* targets;
+    const float*        weights;
+    const Instance*     instances;
+    const uint8_t*      base;
+    uint8_t*            dest;
+    const Format*       format;
+    size_t              numVertices;
+
+    void vertexRange( size_t begin, size_t end ) const
+    {
+        targets->applyRange(weights, base, dest, *format, begin, end);
+    }
+
+    void instanceRange( size_t begin, size_t end ) const
+    {
+        for (size_t i=begin;i<end;i++)
+        {
+            targets->applyRange(instances[i].weights, base, static_cast<uint8_t*>(instances[i].dest), *format,
+                0, numVertices);
+        }
+    }
+};
+
+HRESULT MorphTargets::Format::fromElements( const D3D11_INPUT_ELEMENT_DESC* elements, size_t numElements, UINT stride,
+    Format* format, UINT slot )
+{
+    *format = Format();
+    format->stride = stride;
+    for (size_t i=0;i<numElements;i++)
+    {
+        const D3D11_INPUT_ELEMENT_DESC& element = elements[i];
+        if (element.InputSlot != slot || element.SemanticIndex != 0 || element.Format != DXGI_FORMAT_R32G32B32_FLOAT)
+            continue;
+        if (strcmp(element.SemanticName, "POSITION") == 0)
+            format->position = (int)element.AlignedByteOffset;
+        else if (strcmp(element.SemanticName, "NORMAL") == 0)
+            format->normal = (int)element.AlignedByteOffset;
+    }
+    return format->position < 0 ? E_INVALIDARG : S_OK;
+}
+
+size_t MorphTargets::addTarget( const std::string& name, size_t count, const Vec3f* positionDeltas, const Vec3f* normalDeltas,
+    const uint32_t* indices, float threshold )
+{
+    Target target;
+    target.name = name;
+    target.first = mDeltas.size();
+
+    // the largest component of each channel sets its 16-bit step
+    float maxPosition = 0, maxNormal = 0;
+    std::vector<std::pair<uint32_t, size_t> > kept;
+    for (size_t i=0;i<count;i++)
+    {
+        const Vec3f& p = positionDeltas[i];
+        float position = std::max(std::abs(p.x), std::max(std::abs(p.y), std::abs(p.z)));
+        float normal = 0;
+        if (normalDeltas)
+        {
+            const Vec3f& n = normalDeltas[i];
+            normal = std::max(std::abs(n.x), std::max(std::abs(n.y), std::abs(n.z)));
+        }
+        if (position <= threshold && normal <= threshold)
+            continue;
+        maxPosition = std::max(maxPosition, position);
+        maxNormal = std::max(maxNormal, normal);
+        kept.push_back(std::make_pair(indices ? indices[i] : (uint32_t)i, i));
+    }
+    std::sort(kept.begin(), kept.end());
+
+    target.count = kept.size();
+    target.positionScale = maxPosition / 32767.0f;
+    target.normalScale = maxNormal / 32767.0f;
+    for (size_t i=0;i<kept.size();i++)
+    {
+        Delta delta;
+        delta.index = kept[i].first;
+        const Vec3f& p = positionDeltas[kept[i].second];
+        delta.position[0] = quantize(p.x, target.positionScale);
+        delta.position[1] = quantize(p.y, target.positionScale);
+        delta.position[2] = quantize(p.z, target.positionScale);
+        Vec3f n = normalDeltas ? normalDeltas[kept[i].second] : Vec3f(0, 0, 0);
+        delta.normal[0] = quantize(n.x, target.normalScale);
+        delta.normal[1] = quantize(n.y, target.normalScale);
+        delta.normal[2] = quantize(n.z, target.normalScale);
+        mDeltas.push_back(delta);
+    }
+
+    mTargets.push_back(target);
+    return mTargets.size() - 1;
+}
+
+void MorphTargets::applyRange( const float* weights, const uint8_t* base, uint8_t* dest, const Format& format,
+    size_t begin, size_t end ) const
+{
+    size_t stride = format.stride;
+    memcpy(dest + begin * stride, base + begin * stride, (end - begin) * stride);
+
+    // position and normal offsets of the vertices in the range, 8 floats each
+    std::vector<float> offsets;
+    for (size_t t=0;t<mTargets.size();t++)
+    {
+        if (weights[t] == 0 || mTargets[t].count == 0)
+            continue;
+        if (offsets.empty())
+            offsets.resize((end - begin) * 8);
+
+        const Target& target = mTargets[t];
+        const Delta* first = &mDeltas[target.first];
+        const Delta* last = first + target.count;
+        // the first delta of the range
+        size_t lo = 0, hi = target.count;
+        while (lo < hi)
+        {
+            size_t mid = (lo + hi) / 2;
+            if (first[mid].index < begin)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+
+        float positionScale = weights[t] * target.positionScale;
+        float normalScale = weights[t] * target.normalScale;
+        __m128 ps = _mm_setr_ps(positionScale, positionScale, positionScale, 0);
+        __m128 ns = _mm_setr_ps(normalScale, normalScale, normalScale, 0);
+        for (const Delta* d=first + lo;d!=last && d->index<end;++d)
+        {
+            __m128i raw = _mm_loadu_si128(reinterpret_cast<const __m128i*>(d));
+            float* offset = &offsets[(d->index - begin) * 8];
+            __m128 position = _mm_mul_ps(shortsToFloats(_mm_srli_si128(raw, 4)), ps);
+            __m128 normal = _mm_mul_ps(shortsToFloats(_mm_srli_si128(raw, 10)), ns);
+            _mm_storeu_ps(offset, _mm_add_ps(_mm_loadu_ps(offset), position));
+            _mm_storeu_ps(offset + 4, _mm_add_ps(_mm_loadu_ps(offset + 4), normal));
+        }
+    }
+    if (offsets.empty())
+        return;
+
+    // only written to, dest may be a mapped dynamic buffer
+    for (size_t v=begin;v<end;v++)
+    {
+        const float* offset = &offsets[(v - begin) * 8];
+        const uint8_t* in = base + v * stride;
+        uint8_t* out = dest + v * stride;
+
+        __m128 position = _mm_loadu_ps(offset);
+        if (!isZero(position))
+            store3(_mm_add_ps(load3(in + format.position), position), out + format.position);
+        __m128 normal = _mm_loadu_ps(offset + 4);
+        if (format.normal >= 0 && !isZero(normal))
+            store3(normalize3(_mm_add_ps(load3(in + format.normal), normal)), out + format.normal);
+    }
+}
+
+void MorphTargets::apply( const float* weights, const void* base, void* dest, const Format& format, size_t numVertices ) const
+{
+    Job job;
+    job.targets = this;
+    job.weights = weights;
+    job.instances = NULL;
+    job.base = static_cast<const uint8_t*>(base);
+    job.dest = static_cast<uint8_t*>(dest);
+    job.format = &format;
+    job.numVertices = numVertices;
+    parallelFor(numVertices, kGrainSize, boost::bind(&Job::vertexRange, &job, _1, _2));
+}
+
+void MorphTargets::apply( const Instance* instances, size_t count, const void* base, const Format& format, size_t numVertices ) const
+{
+    Job job;
+    job.targets = this;
+    job.weights = NULL;
+    job.instances = instances;
+    job.base = static_cast<const uint8_t*>(base);
+    job.dest = NULL;
+    job.format = &format;
+    job.numVertices = numVertices;
+    parallelFor(count, 1, boost::bind(&Job::instanceRange, &job, _1, _2));
+}
+
+HRESULT MorphTargets::apply( const float* weights, const void* base, ID3D11Buffer* buffer, const Format& format, size_t numVertices ) const
+{
+    HRESULT hr = S_OK;
+    ID3D11DeviceContext* context = getImmediateContext();
+    D3D11_MAPPED_SUBRESOURCE mapped;
+    V_RETURN(context->Map(buffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped));
+    apply(weights, base, mapped.pData, format, numVertices);
+    context->Unmap(buffer, 0);
+    return S_OK;
+}
+
+} } // namespace cinder::dx11
@@ -0,0 +1,693 @@
+#include "dx11/ObjMesh.h"
+#include "dx11/Vbo.h"
+#include "dx11/MappedFile.h"
+#include "dx11/MeshAdjacency.h"
+#include "dx11/WorkerPool.h"
+
+#include <climits>
+#include <cstring>
+#include <algorithm>
+#include <boost/bind.hpp>
+#include <boost/unordered_map.hpp>
+
+namespace cinder { namespace dx11 {
+
+namespace
+{
+    const uint32_t kNone = ~0u;
+    // a face corner without texcoord or normal, while parsing
+    const int32_t kMissing = INT_MIN;
+    const size_t kChunkSize = 1 << 20;
+
+    const double kPowersOf10[] =
+    {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+
+    bool isSpace(char c)
+    {
+        return c == ' ' || c == '\t' || c == '\r';
+    }
+
+    bool isDigit(char c)
+    {
+        return c >= '0' && c <= '9';
+    }
+
+    void skipSpaces(const char*& p, const char* end)
+    {
+        while (p != end && isSpace(*p))
+            p++;
+    }
+
+    void skipToken(const char*& p, const char* end)
+    {
+        while (p != end && !isSpace(*p) && *p != '\n')
+            p++;
+    }
+
+    void skipLine(const char*& p, const char* end)
+    {
+        while (p != end && *p != '\n')
+            p++;
+        if (p != end)
+            p++;
+    }
+
+    bool startsWith(const char* p, const char* end, const char* keyword)
+    {
+        size_t length = strlen(keyword);
+        return static_cast<size_t>(end - p) > length && memcmp(p, keyword, length) == 0 && isSpace(p[length]);
+    }
+
+    // Decimal floats without locale lookups or copies. Up to 19 significant digits are kept, which is plenty for floats.
+    float parseFloat(const char*& p, const char* end)
+    {
+        skipSpaces(p, end);
+
+        bool negative = false;
+        if (p != end && (*p == '-' || *p == '+'))
+            negative = *p++ == '-';
+
+        uint64_t mantissa = 0;
+        int digits = 0;
+        int exponent = 0;
+        for (;p != end && isDigit(*p);p++)
+        {
+            if (digits < 19)
+            {
+                mantissa = mantissa * 10 + (*p - '0');
+                digits += mantissa > 0;
+            }
+            else
+            {
+                exponent++;
+            }
+        }
+
+        if (p != end && *p == '.')
+        {
+            for (p++;p != end && isDigit(*p);p++)
+            {
+                if (digits < 19)
+                {
+                    mantissa = mantissa * 10 + (*p - '0');
+                    digits += mantissa > 0;
+                    exponent--;
+                }
+            }
+        }
+
+        if (p != end && (*p == 'e' || *p == 'E'))
+        {
+            p++;
+            bool negativeExponent = false;
+            if (p != end && (*p == '-' || *p == '+'))
+                negativeExponent = *p++ == '-';
+
+            int value = 0;
+            for (;p != end && isDigit(*p);p++)
+                value = std::min(value * 10 + (*p - '0'), 1000);
+            exponent += negativeExponent ? -value : value;
+        }
+
+        // nan, inf and garbage end up as zero
+        skipToken(p, end);
+
+        double result = static_cast<double>(mantissa);
+        for (;exponent > 22;exponent -= 22)
+            result *= kPowersOf10[22];
+        for (;exponent < -22;exponent += 22)
+            result /= kPowersOf10[22];
+        result = exponent >= 0 ? result * kPowersOf10[exponent] : result / kPowersOf10[-exponent];
+
+        return static_cast<float>(negative ? -result : result);
+    }
+
+    int32_t parseInt(const char*& p, const char* end)
+    {
+        bool negative = false;
+        if (p != end && (*p == '-' || *p == '+'))
+            negative = *p++ == '-';
+
+        if (p == end || !isDigit(*p))
+            return kMissing;
+
+        // clamped, an index that long is out of range anyway
+        int64_t value = 0;
+        for (;p != end && isDigit(*p);p++)
+            value = std::min<int64_t>(value * 10 + (*p - '0'), INT_MAX);
+        return static_cast<int32_t>(negative ? -value : value);
+    }
+
+    std::string parseName(const char*& p, const char* end)
+    {
+        skipSpaces(p, end);
+        const char* first = p;
+        while (p != end && *p != '\n')
+            p++;
+
+        const char* last = p;
+        while (last != first && isSpace(last[-1]))
+            last--;
+        return std::string(first, last);
+    }
+
+    struct Corner
+    {
+        int32_t     index[3];   // position, texcoord, normal
+        uint32_t    relative;   // bit e set when index[e] still lacks the offset of its chunk
+    };
+
+    struct Chunk
+    {
+        Chunk():begin(NULL), end(NULL), error(false){}
+
+        const char*                 begin;
+        const char*                 end;
+        std::vector<Vec3f>          positions;
+        std::vector<Vec2f>          texCoords;
+        std::vector<Vec3f>          normals;
+        //! Three per triangle
+        std::vector<Corner>         corners;
+        //! usemtl switches, as the first triangle they apply to
+        std::vector<std::pair<size_t, std::string> > materials;
+        std::vector<std::string>    libraries;
+        bool                        error;
+    };
+
+    bool parseFace(const char*& p, const char* end, Chunk& chunk, std::vector<Corner>& face)
+    {
+        face.clear();
+        size_t counts[3] = { chunk.positions.size(), chunk.texCoords.size(), chunk.normals.size() };
+
+        for (;;)
+        {
+            skipSpaces(p, end);
+            if (p == end || *p == '\n')
+                break;
+
+            Corner corner = {{ kMissing, kMissing, kMissing }, 0};
+            for (int e=0;e<3;e++)
+            {
+                corner.index[e] = parseInt(p, end);
+                if (p == end || *p != '/')
+                    break;
+                p++;
+            }
+            if (p != end && !isSpace(*p) && *p != '\n')
+                return false;
+
+            // 1-based, negative counts back from the last element read so far
+            for (int e=0;e<3;e++)
+            {
+                int32_t& index = corner.index[e];
+                if (index == 0 || (e == 0 && index == kMissing))
+                    return false;
+                if (index == kMissing)
+                    continue;
+                if (index > 0)
+                {
+                    index--;
+                }
+                else
+                {
+                    index += static_cast<int32_t>(counts[e]);
+                    corner.relative |= 1 << e;
+                }
+            }
+            face.push_back(corner);
+        }
+
+        if (face.size() < 3)
+            return false;
+
+        for (size_t k=1;k+1<face.size();k++)
+        {
+            chunk.corners.push_back(face[0]);
+            chunk.corners.push_back(face[k]);
+            chunk.corners.push_back(face[k + 1]);
+        }
+        return true;
+    }
+
+    void parseLine(const char*& p, const char* end, Chunk& chunk, std::vector<Corner>& face)
+    {
+        skipSpaces(p, end);
+        if (p == end)
+            return;
+
+        if (startsWith(p, end, "v"))
+        {
+            p += 1;
+            float x = parseFloat(p, end);
+            float y = parseFloat(p, end);
+            float z = parseFloat(p, end);
+            chunk.positions.push_back(Vec3f(x, y, z));
+        }
+        else if (startsWith(p, end, "vt"))
+        {
+            p += 2;
+            float u = parseFloat(p, end);
+            float v = parseFloat(p, end);
+            chunk.texCoords.push_back(Vec2f(u, v));
+        }
+        else if (startsWith(p, end, "vn"))
+        {
+            p += 2;
+            float x = parseFloat(p, end);
+            float y = parseFloat(p, end);
+            float z = parseFloat(p, end);
+            chunk.normals.push_back(Vec3f(x, y, z));
+        }
+        else if (startsWith(p, end, "f"))
+        {
+            p += 1;
+            if (!parseFace(p, end, chunk, face))
+                chunk.error = true;
+        }
+        else if (startsWith(p, end, "usemtl"))
+        {
+            p += 6;
+            chunk.materials.push_back(std::make_pair(chunk.corners.size() / 3, parseName(p, end)));
+        }
+        else if (startsWith(p, end, "mtllib"))
+        {
+            p += 6;
+            for (;;)
+            {
+                skipSpaces(p, end);
+                const char* first = p;
+                skipToken(p, end);
+                if (first == p)
+                    break;
+                chunk.libraries.push_back(std::string(first, p));
+            }
+        }
+        // comments, groups, smoothing groups, lines and points are skipped
+        skipLine(p, end);
+    }
+
+    void parseChunks(std::vector<Chunk>* chunks, size_t begin, size_t end)
+    {
+        std::vector<Corner> face;
+        for (size_t i=begin;i<end;i++)
+        {
+            Chunk& chunk = (*chunks)[i];
+            const char* p = chunk.begin;
+            while (p != chunk.end && !chunk.error)
+                parseLine(p, chunk.end, chunk, face);
+        }
+    }
+
+    // Concatenates the chunks into one set of arrays and resolves their relative references
+    struct ChunkMerger
+    {
+        std::vector<Chunk>*     chunks;
+        std::vector<size_t>     offsets[4];     // per chunk: positions, texcoords, normals, corners
+        std::vector<Vec3f>*     positions;
+        std::vector<Vec2f>*     texCoords;
+        std::vector<Vec3f>*     normals;
+        std::vector<Corner>*    corners;
+
+        template <typename T>
+        static void append(std::vector<T>* target, size_t offset, const std::vector<T>& source)
+        {
+            if (!source.empty())
+                std::copy(source.begin(), source.end(), target->begin() + offset);
+        }
+
+        void mergeRange(size_t begin, size_t end)
+        {
+            const size_t sizes[3] = { positions->size(), texCoords->size(), normals->size() };
+            for (size_t c=begin;c<end;c++)
+            {
+                Chunk& chunk = (*chunks)[c];
+                append(positions, offsets[0][c], chunk.positions);
+                append(texCoords, offsets[1][c], chunk.texCoords);
+                append(normals, offsets[2][c], chunk.normals);
+
+                for (size_t i=0;i<chunk.corners.size();i++)
+                {
+                    Corner corner = chunk.corners[i];
+                    for (int e=0;e<3;e++)
+                    {
+                        int64_t index = corner.index[e];
+                        if (index == kMissing)
+                        {
+                            corner.index[e] = -1;
+                            continue;
+                        }
+                        if (corner.relative & (1 << e))
+                            index += offsets[e][c];
+                        if (index < 0 || index >= static_cast<int64_t>(sizes[e]))
+                            chunk.error = true;
+                        corner.index[e] = static_cast<int32_t>(index);
+                    }
+                    corner.relative = 0;
+                    (*corners)[offsets[3][c] + i] = corner;
+                }
+
+                // release the chunk's memory early, big files hold a lot of it
+                std::vector<Vec3f>().swap(chunk.positions);
+                std::vector<Vec2f>().swap(chunk.texCoords);
+                std::vector<Vec3f>().swap(chunk.normals);
+                std::vector<Corner>().swap(chunk.corners);
+            }
+        }
+    };
+
+    struct VertexEmitter
+    {
+        const std::vector<Vec3f>*   positions;
+        const std::vector<Vec2f>*   texCoords;
+        const std::vector<Vec3f>*   normals;
+        const std::vector<Corner>*  corners;
+        const std::vector<uint32_t>* vertexCorners;
+        std::vector<VertexPNT>*     vertices;
+
+        void emitRange(size_t begin, size_t end)
+        {
+            for (size_t v=begin;v<end;v++)
+            {
+                const Corner& corner = (*corners)[(*vertexCorners)[v]];
+                VertexPNT& vertex = (*vertices)[v];
+                vertex.position = (*positions)[corner.index[0]];
+                vertex.texCoord = corner.index[1] >= 0 ? (*texCoords)[corner.index[1]] : Vec2f::zero();
+                vertex.normal = corner.index[2] >= 0 ? (*normals)[corner.index[2]] : Vec3f::zero();
+            }
+        }
+    };
+
+    size_t getMaterialId(const std::string& name, boost::unordered_map<std::string, size_t>& ids, std::vector<ObjMaterial>& materials)
+    {
+        boost::unordered_map<std::string, size_t>::const_iterator it = ids.find(name);
+        if (it != ids.end())
+            return it->second;
+
+        materials.push_back(ObjMaterial());
+        materials.back().name = name;
+        ids.insert(std::make_pair(name, materials.size() - 1));
+        return materials.size() - 1;
+    }
+
+    std::string getDirectory(const std::string& path)
+    {
+        size_t slash = path.find_last_of("/\\");
+        return slash == std::string::npos ? std::string() : path.substr(0, slash + 1);
+    }
+
+    Color parseColor(const char*& p, const char* end)
+    {
+        float r = parseFloat(p, end);
+        float g = parseFloat(p, end);
+        float b = parseFloat(p, end);
+        return Color(r, g, b);
+    }
+
+    // texture statements may carry options like -bm 0.02 ahead of the file name, which comes last
+    std::string parseMap(const char*& p, const char* end, float* bumpScale)
+    {
+        std::string name;
+        for (;;)
+        {
+            skipSpaces(p, end);
+            if (p == end || *p == '\n')
+                break;
+
+            const char* first = p;
+            skipToken(p, end);
+            std::string token(first, p);
+            if (token == "-bm" && bumpScale != NULL)
+                *bumpScale = parseFloat(p, end);
+            else if (token[0] != '-' || token.size() == 1)
+                name = token;
+        }
+        return name;
+    }
+}
+
+HRESULT ObjMesh::loadMaterials( const std::string& path, std::vector<ObjMaterial>* materials )
+{
+    MappedFile file;
+    if (!file.open(path))
+        return file.getResult();
+
+    const char* p = static_cast<const char*>(file.getData());
+    const char* end = p + file.getSize();
+    ObjMaterial* material = NULL;
+
+    while (p != end)
+    {
+        skipSpaces(p, end);
+        if (startsWith(p, end, "newmtl"))
+        {
+            p += 6;
+            materials->push_back(ObjMaterial());
+            material = &materials->back();
+            material->name = parseName(p, end);
+        }
+        else if (material == NULL)
+        {
+            // properties ahead of the first newmtl have nothing to go to
+        }
+        else if (startsWith(p, end, "Ka"))
+        {
+            p += 2;
+            material->ambient = parseColor(p, end);
+        }
+        else if (startsWith(p, end, "Kd"))
+        {
+            p += 2;
+            material->diffuse = parseColor(p, end);
+        }
+        else if (startsWith(p, end, "Ks"))
+        {
+            p += 2;
+            material->specular = parseColor(p, end);
+        }
+        else if (startsWith(p, end, "Ns"))
+        {
+            p += 2;
+            material->shininess = parseFloat(p, end);
+        }
+        else if (startsWith(p, end, "d"))
+        {
+            p += 1;
+            material->opacity = parseFloat(p, end);
+        }
+        else if (startsWith(p, end, "Tr"))
+        {
+            p += 2;
+            material->opacity = 1 - parseFloat(p, end);
+        }
+        else if (startsWith(p, end, "illum"))
+        {
+            p += 5;
+            skipSpaces(p, end);
+            int32_t illum = parseInt(p, end);
+            material->illum = illum == kMissing ? 0 : illum;
+        }
+        else if (startsWith(p, end, "map_Kd"))
+        {
+            p += 6;
+            material->diffuseMap = parseMap(p, end, NULL);
+        }
+        else if (startsWith(p, end, "map_Ks"))
+        {
+            p += 6;
+            material->specularMap = parseMap(p, end, NULL);
+        }
+        else if (startsWith(p, end, "map_d"))
+        {
+            p += 5;
+            material->opacityMap = parseMap(p, end, NULL);
+        }
+        else if (startsWith(p, end, "bump") || startsWith(p, end, "map_Bump") || startsWith(p, end, "map_bump"))
+        {
+            skipToken(p, end);
+            material->normalMap = parseMap(p, end, &material->bumpScale);
+        }
+        skipLine(p, end);
+    }
+    return S_OK;
+}
+
+HRESULT ObjMesh::load( const std::string& path )
+{
+    mVertices.clear();
+    mIndices.clear();
+    mRanges.clear();
+    mMaterials.clear();
+    mHasNormals = false;
+    mHasTexCoords = false;
+
+    MappedFile file;
+    if (!file.open(path))
+        return file.getResult();
+
+    // chunks end after a line break, so no line is split
+    const char* data = static_cast<const char*>(file.getData());
+    const char* dataEnd = data + file.getSize();
+    std::vector<Chunk> chunks;
+    for (const char* begin=data;begin!=dataEnd;)
+    {
+        const char* end = begin + std::min(kChunkSize, static_cast<size_t>(dataEnd - begin));
+        while (end != dataEnd && end[-1] != '\n')
+            end++;
+
+        chunks.push_back(Chunk());
+        chunks.back().begin = begin;
+        chunks.back().end = end;
+        begin = end;
+    }
+
+    parallelFor(chunks.size(), 1, boost::bind(&parseChunks, &chunks, _1, _2));
+
+    std::vector<Vec3f> positions;
+    std::vector<Vec2f> texCoords;
+    std::vector<Vec3f> normals;
+    std::vector<Corner> corners;
+
+    ChunkMerger merger;
+    merger.chunks = &chunks;
+    merger.positions = &positions;
+    merger.texCoords = &texCoords;
+    merger.normals = &normals;
+    merger.corners = &corners;
+
+    size_t totals[4] = {0};
+    for (size_t c=0;c<chunks.size();c++)
+    {
+        const Chunk& chunk = chunks[c];
+        if (chunk.error)
+            return E_FAIL;
+
+        const size_t sizes[4] = { chunk.positions.size(), chunk.texCoords.size(), chunk.normals.size(), chunk.corners.size() };
+        for (int e=0;e<4;e++)
+        {
+            merger.offsets[e].push_back(totals[e]);
+            totals[e] += sizes[e];
+        }
+    }
+    // corner ids, and kNone past them, have to fit 32 bits
+    if (totals[3] == 0 || totals[3] > kNone)
+        return E_FAIL;
+
+    positions.resize(totals[0]);
+    texCoords.resize(totals[1]);
+    normals.resize(totals[2]);
+    corners.resize(totals[3]);
+    parallelFor(chunks.size(), 1, boost::bind(&ChunkMerger::mergeRange, &merger, _1, _2));
+
+    // materials of every library, then the ones only known from usemtl
+    boost::unordered_map<std::string, size_t> materialIds;
+    for (size_t c=0;c<chunks.size();c++)
+    {
+        if (chunks[c].error)
+            return E_FAIL;
+
+        for (size_t i=0;i<chunks[c].libraries.size();i++)
+        {
+            size_t first = mMaterials.size();
+            // a missing library leaves the materials at their defaults
+            if (FAILED(loadMaterials(getDirectory(path) + chunks[c].libraries[i], &mMaterials)))
+                continue;
+            for (size_t m=first;m<mMaterials.size();m++)
+                materialIds.insert(std::make_pair(mMaterials[m].name, m));
+        }
+    }
+
+    // every triangle takes the material of the last usemtl before it, the ones before any usemtl get an unnamed default
+    size_t numTriangles = corners.size() / 3;
+    std::vector<uint32_t> triangleMaterials(numTriangles);
+    uint32_t current = kNone;
+    for (size_t c=0;c<chunks.size();c++)
+    {
+        const std::vector<std::pair<size_t, std::string> >& switches = chunks[c].materials;
+        size_t first = merger.offsets[3][c] / 3;
+        size_t last = c + 1 < chunks.size() ? merger.offsets[3][c + 1] / 3 : numTriangles;
+
+        for (size_t s=0;s<=switches.size();s++)
+        {
+            size_t until = s < switches.size() ? merger.offsets[3][c] / 3 + switches[s].first : last;
+            if (until > first && current == kNone)
+                current = static_cast<uint32_t>(getMaterialId("", materialIds, mMaterials));
+            std::fill(triangleMaterials.begin() + first, triangleMaterials.begin() + until, current);
+            first = until;
+
+            if (s < switches.size())
+                current = static_cast<uint32_t>(getMaterialId(switches[s].second, materialIds, mMaterials));
+        }
+    }
+
+    // counting sort of the triangles by material, stable so the file order survives inside a material
+    std::vector<size_t> materialStarts(mMaterials.size() + 1, 0);
+    for (size_t t=0;t<numTriangles;t++)
+        materialStarts[triangleMaterials[t] + 1]++;
+    for (size_t m=0;m<mMaterials.size();m++)
+        materialStarts[m + 1] += materialStarts[m];
+
+    std::vector<uint32_t> order(numTriangles);
+    std::vector<size_t> cursors(materialStarts.begin(), materialStarts.end() - 1);
+    for (size_t t=0;t<numTriangles;t++)
+        order[cursors[triangleMaterials[t]]++] = static_cast<uint32_t>(t);
+
+    std::vector<uint32_t> remap;
+    buildKeyRemap(remap, reinterpret_cast<const uint32_t*>(&corners[0]), corners.size(), sizeof(Corner) / sizeof(uint32_t));
+
+    // vertices are numbered in order of first use, which keeps the vertex fetch local
+    std::vector<uint32_t> vertexIds(corners.size(), kNone);
+    std::vector<uint32_t> vertexCorners;
+    mIndices.resize(corners.size());
+    for (size_t i=0;i<numTriangles;i++)
+    {
+        for (size_t k=0;k<3;k++)
+        {
+            uint32_t corner = remap[order[i] * 3 + k];
+            if (vertexIds[corner] == kNone)
+            {
+                vertexIds[corner] = static_cast<uint32_t>(vertexCorners.size());
+                vertexCorners.push_back(corner);
+                mHasTexCoords = mHasTexCoords || corners[corner].index[1] >= 0;
+                mHasNormals = mHasNormals || corners[corner].index[2] >= 0;
+            }
+            mIndices[i * 3 + k] = vertexIds[corner];
+        }
+    }
+
+    for (size_t m=0;m<mMaterials.size();m++)
+    {
+        if (materialStarts[m + 1] > materialStarts[m])
+        {
+            Range range = { m, materialStarts[m] * 3, (materialStarts[m + 1] - materialStarts[m]) * 3 };
+            mRanges.push_back(range);
+        }
+    }
+
+    VertexEmitter emitter = { &positions, &texCoords, &normals, &corners, &vertexCorners, &mVertices };
+    mVertices.resize(vertexCorners.size());
+    parallelFor(mVertices.size(), 4096, boost::bind(&VertexEmitter::emitRange, &emitter, _1, _2));
+
+    return S_OK;
+}
+
+HRESULT ObjMesh::createVboMesh( VboMesh* vbo ) const
+{
+    if (mVertices.empty() || mIndices.empty())
+        return E_INVALIDARG;
+
+    HRESULT hr = vbo->createVertexBuffer(&mVertices[0], mVertices.size());
+    if (FAILED(hr))
+        return hr;
+
+    if (mVertices.size() <= 0xFFFF)
+    {
+        std::vector<uint16_t> indices(mIndices.begin(), mIndices.end());
+        return vbo->createIndexBuffer(&indices[0], indices.size());
+    }
+    return vbo->createIndexBuffer(&mIndices[0], mIndices.size());
+}
+
+} } // namespace cinder::dx11
@@ -26,6 +26,8 @@
 #include "cinder/app/AppImplMsw.h"
 #include "dx11/RendererDx11.h"
 #include "dx11/dx11.h"
+#include "dx11/InputLayoutCache.h"
+#include "dx11/ShaderReloader.h"
 
 //#include "cinder/ip/Flip.h"
 
@@ -201,6 +203,9 @@ void RendererDX11::setup( App *aApp, HWND wnd, HDC dc )
 
 void RendererDX11::kill()
 {
+    // no recompiles against a device that is going away
+    ShaderReloader::get().stop();
+
 	SAFE_RELEASE(mRenderTargetView);
 	SAFE_RELEASE(mDepthStencilView);
     SAFE_RELEASE(mDepthStencilBuffer);
@@ -214,6 +219,8 @@ void RendererDX11::kill()
 		md3dImmediateContext->Flush();
 	}
 
+	dx11::InputLayoutCache::get().clear();
+
 	SAFE_RELEASE(md3dImmediateContext);
     SAFE_RELEASE(md3dDevice);
 }
@@ -265,6 +272,8 @@ void RendererDX11::finishToggleFullScreen()
 
 void RendererDX11::startDraw()
 {
+    // frame boundary, shaders recompiled meanwhile are swapped in before anything binds them
+    ShaderReloader::get().update();
 }
 
 void RendererDX11::finishDraw()
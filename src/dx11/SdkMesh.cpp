@@ -2,8 +2,16 @@
 #include "dx11/dx11.h"
 #include "dx11/SdkMesh.h"
 #include "dx11/Vbo.h"
+#include "dx11/Shader.h"
+#include "dx11/InputLayoutCache.h"
+#include "dx11/MappedFile.h"
+#include "dx11/WorkerPool.h"
 #include "cinder/app/App.h"
 
+#include <map>
+#include <boost/bind.hpp>
+#include <boost/unordered_map.hpp>
+
 namespace{
 	HRESULT hr = S_OK;
 }
@@ -61,7 +69,6 @@ DXGI_FORMAT	ConvertType( const D3DDECLTYPE& d3d9Form )
 
 HRESULT ConvertDeclaration( const D3DVERTEXELEMENT9 original[ MAX_VERTEX_ELEMENTS ], std::vector<D3D11_INPUT_ELEMENT_DESC>& output)
 {
-	app::console() << std::endl;
 	for( UINT i = 0; i < MAX_VERTEX_ELEMENTS; ++i )
 	{
 		if( original[i].Stream == 0xFF )
@@ -75,8 +82,6 @@ HRESULT ConvertDeclaration( const D3DVERTEXELEMENT9 original[ MAX_VERTEX_ELEMENT
 		item.InputSlotClass		= D3D11_INPUT_PER_VERTEX_DATA;
 		item.InstanceDataStepRate	= 0;
 		item.Format				= ConvertType( static_cast< D3DDECLTYPE >( original[i].Type ) );
-		
-		app::console() << item.SemanticName << std::endl;
 
 		output.push_back(item);
 	}
@@ -84,22 +89,184 @@ HRESULT ConvertDeclaration( const D3DVERTEXELEMENT9 original[ MAX_VERTEX_ELEMENT
 	return S_OK;
 }
 
+// Collects the textures CDXUTSDKMesh::LoadMaterials() asks for, each file once however many materials use it,
+// then loads the pooled buffers and all the files as parallel items
+struct SdkMesh::Loader
+{
+	SdkMesh*						mesh;
+	ID3D11Device*					device;
+	std::string						directory;
+	std::vector<std::string>		files;
+	std::vector<std::vector<ID3D11ShaderResourceView**> >	targets;	// per file, the material slots it goes to
+	boost::unordered_map<std::string, size_t>	fileIds;
+	HRESULT							result;
+
+	static void CALLBACK requestTexture( ID3D11Device* device, char* fileName, ID3D11ShaderResourceView** view, void* context )
+	{
+		Loader* loader = static_cast<Loader*>(context);
+		*view = NULL;
+		std::string file = loader->directory + fileName;
+		boost::unordered_map<std::string, size_t>::const_iterator it = loader->fileIds.find(file);
+		if (it == loader->fileIds.end())
+		{
+			it = loader->fileIds.insert(std::make_pair(file, loader->files.size())).first;
+			loader->files.push_back(file);
+			loader->targets.resize(loader->files.size());
+		}
+		loader->targets[it->second].push_back(view);
+	}
+
+	// item 0 builds the pooled buffers and the frame hierarchy, the others are textures
+	void loadRange( size_t begin, size_t end )
+	{
+		for (size_t i=begin;i<end;i++)
+		{
+			if (i == 0)
+			{
+				result = mesh->createPooledBuffers();
+				if (SUCCEEDED(result))
+					mesh->mFrameHierarchy.create(*mesh->mSdkMesh);
+				continue;
+			}
+
+			ID3D11ShaderResourceView* view = NULL;
+			if (FAILED(D3DX11CreateShaderResourceViewFromFileA(device, files[i - 1].c_str(), NULL, NULL, &view, NULL)))
+				view = (ID3D11ShaderResourceView*)ERROR_RESOURCE_VALUE;
+			// every slot holds a reference, CDXUTSDKMesh::Destroy() releases them one by one
+			const std::vector<ID3D11ShaderResourceView**>& slots = targets[i - 1];
+			for (size_t j=0;j<slots.size();j++)
+			{
+				if (j > 0 && !IsErrorResource(view))
+					view->AddRef();
+				*slots[j] = view;
+			}
+		}
+	}
+};
+
+SdkMesh::SdkMesh()
+:mSdkMesh(std::shared_ptr<CDXUTSDKMesh>(new CDXUTSDKMesh)), mIBFormat(DXGI_FORMAT_UNKNOWN)
+{
+}
+
 SdkMesh::SdkMesh( DataSourceRef dataSource, bool includeUVs /*= true */ )
-:mSdkMesh(std::shared_ptr<CDXUTSDKMesh>(new CDXUTSDKMesh))
+:mSdkMesh(std::shared_ptr<CDXUTSDKMesh>(new CDXUTSDKMesh)), mIBFormat(DXGI_FORMAT_UNKNOWN)
 {
-	app::console() << dataSource->getFilePath() << std::endl;
-	mSdkMesh->Create(getDevice(), dataSource->getFilePath().c_str());
+	HR(loadFile(dataSource->getFilePath().string()));
+}
+
+HRESULT SdkMesh::loadFile( const std::string& path )
+{
+	HRESULT hr = S_OK;
+
+	// the headers are patched in place, only the pages they are on get copied, vertices and indices are read
+	// straight from the file
+	mFile.reset(new MappedFile);
+	if (!mFile->open(path, true))
+		return mFile->getResult();
+
+	Loader loader;
+	loader.mesh = this;
+	loader.device = getDevice();
+	loader.directory = path.substr(0, path.find_last_of("\\/") + 1);
+	loader.result = S_OK;
+	SDKMESH_CALLBACKS callbacks = {&Loader::requestTexture, NULL, NULL, &loader};
+
+	// the buffers of the file are created once, pooled, instead of one by one
+	V_RETURN(mSdkMesh->Create(getDevice(), static_cast<BYTE*>(mFile->getWritableData()), (UINT)mFile->getSize(),
+		false, false, &callbacks, false, false));
+
+	parallelFor(loader.files.size() + 1, 1, boost::bind(&Loader::loadRange, &loader, _1, _2));
+	V_RETURN(loader.result);
+
+	for (size_t i=0;i<mMaterials.size();i++)
+	{
+		const SDKMESH_MATERIAL* src = mSdkMesh->GetMaterial((UINT)i);
+		Material& material = mMaterials[i];
+		if (!IsErrorResource(src->pDiffuseRV))
+			material.diffuseView = src->pDiffuseRV;
+		if (!IsErrorResource(src->pNormalRV))
+			material.normalView = src->pNormalRV;
+		if (!IsErrorResource(src->pSpecularRV))
+			material.specularView = src->pSpecularRV;
+	}
+	return S_OK;
+}
+
+SdkMesh::AsyncLoadRef SdkMesh::loadAsync( DataSourceRef dataSource, const LoadCallback& callback )
+{
+	AsyncLoadRef load(new AsyncLoad);
+	WorkerPool::get().submit(boost::bind(&SdkMesh::runAsyncLoad, dataSource->getFilePath().string(), load, callback));
+	return load;
+}
+
+void SdkMesh::runAsyncLoad( const std::string& path, AsyncLoadRef load, LoadCallback callback )
+{
+	SdkMeshRef mesh(new SdkMesh);
+	HRESULT result = mesh->loadFile(path);
+	if (FAILED(result))
+		mesh.reset();
+
+	load->finish(mesh, result);
+	if (callback)
+		callback(mesh, result);
+}
+
+bool SdkMesh::AsyncLoad::isReady() const
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	return mReady;
+}
+
+void SdkMesh::AsyncLoad::wait() const
+{
+	std::unique_lock<std::mutex> lock(mMutex);
+	while (!mReady)
+		mCondition.wait(lock);
+}
+
+HRESULT SdkMesh::AsyncLoad::getResult() const
+{
+	wait();
+	return mResult;
+}
+
+SdkMeshRef SdkMesh::AsyncLoad::getMesh() const
+{
+	wait();
+	return mMesh;
+}
+
+void SdkMesh::AsyncLoad::finish( SdkMeshRef mesh, HRESULT result )
+{
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mMesh = mesh;
+		mResult = result;
+		mReady = true;
+	}
+	mCondition.notify_all();
+}
+
+HRESULT SdkMesh::loadAnimation( DataSourceRef dataSource, const AnimationClip::Options& options )
+{
+	HRESULT hr = S_OK;
+	std::wstring path = dataSource->getFilePath().wstring();
+	V_RETURN(mSdkMesh->LoadAnimation(&path[0]));
+	mFrameHierarchy.create(*mSdkMesh, options);
+	return S_OK;
 }
 
 void SdkMesh::load( uint32_t iMesh, VboMesh* target ) const
 {
 	// create VB
-	uint32_t iVB = 0;//TODO: more general
+	uint32_t iVB = 0;
 	std::vector<D3D11_INPUT_ELEMENT_DESC> dx11_elements;
 	D3DVERTEXELEMENT9* dx9_elements = mSdkMesh->GetVertexElements(iMesh, iVB);
 	HR(ConvertDeclaration(dx9_elements, dx11_elements));
 
-	void* pVertices = static_cast<void*>(mSdkMesh->GetRawVerticesAt(iVB));
+	const SDKMESH_MESH* mesh = mSdkMesh->GetMesh(iMesh);
+	void* pVertices = static_cast<void*>(mSdkMesh->GetRawVerticesAt(mesh->VertexBuffers[iVB]));
 	size_t nVertices = mSdkMesh->GetNumVertices(iMesh, iVB);
 	size_t VertexSize = mSdkMesh->GetVertexStride(iMesh, iVB);
 
@@ -107,12 +274,11 @@ void SdkMesh::load( uint32_t iMesh, VboMesh* target ) const
 		&dx11_elements[0], dx11_elements.size(),VertexSize);
 
 	// create IB
-	uint32_t iIB = 0;//TODO: more general
+	uint32_t iIB = mesh->IndexBuffer;
 	SDKMESH_INDEX_TYPE idxType = mSdkMesh->GetIndexType(iMesh);
 	size_t nIndices = mSdkMesh->GetNumIndices(iMesh);
 	if (idxType == IT_16BIT)
 	{
-		//TODO: potential bug here?
 		uint16_t* indices = (uint16_t*)mSdkMesh->GetRawIndicesAt(iIB);
 		target->createIndexBuffer(indices, nIndices);
 	}
@@ -127,4 +293,283 @@ void SdkMesh::load( uint32_t iMesh, VboMesh* target ) const
 	}
 }
 
+const void* SdkMesh::getVertexData( size_t mesh, size_t stream ) const
+{
+	return mSdkMesh->GetRawVerticesAt(mSdkMesh->GetMesh((UINT)mesh)->VertexBuffers[stream]);
+}
+
+size_t SdkMesh::getNumVertices( size_t mesh ) const
+{
+	return (size_t)mSdkMesh->GetNumVertices((UINT)mesh, 0);
+}
+
+size_t SdkMesh::getNumInfluences( size_t mesh ) const
+{
+	return mSdkMesh->GetNumInfluences((UINT)mesh);
+}
+
+void SdkMesh::getInfluences( size_t mesh, const Matrix44f* frameMatrices, Matrix44f* palette ) const
+{
+	const SDKMESH_MESH* src = mSdkMesh->GetMesh((UINT)mesh);
+	for (UINT i=0;i<src->NumFrameInfluences;i++)
+		palette[i] = frameMatrices[src->pFrameInfluences[i]];
+}
+
+static size_t alignUp( size_t offset )
+{
+	return (offset + 15) & ~size_t(15);
+}
+
+HRESULT SdkMesh::createPooledBuffers()
+{
+	HRESULT hr = S_OK;
+	CDXUTSDKMesh& sdk = *mSdkMesh;
+	UINT numMeshes = sdk.GetNumMeshes();
+
+	mMaterials.resize(sdk.GetNumMaterials());
+	for (size_t i=0;i<mMaterials.size();i++)
+	{
+		const SDKMESH_MATERIAL* src = sdk.GetMaterial((UINT)i);
+		Material& material = mMaterials[i];
+		material.name = src->Name;
+		material.diffuseTexture = src->DiffuseTexture;
+		material.normalTexture = src->NormalTexture;
+		material.specularTexture = src->SpecularTexture;
+		material.diffuse = ColorA(src->Diffuse.x, src->Diffuse.y, src->Diffuse.z, src->Diffuse.w);
+		material.ambient = ColorA(src->Ambient.x, src->Ambient.y, src->Ambient.z, src->Ambient.w);
+		material.specular = ColorA(src->Specular.x, src->Specular.y, src->Specular.z, src->Specular.w);
+		material.emissive = ColorA(src->Emissive.x, src->Emissive.y, src->Emissive.z, src->Emissive.w);
+		material.power = src->Power;
+	}
+
+	// meshes whose streams have the same declarations and strides share a layout
+	std::map<std::vector<UINT>, size_t> layoutIds;
+	// within a layout, meshes reading the same vertex buffers share their place in the pool
+	std::vector<std::map<std::vector<UINT>, size_t> > placements;
+	std::vector<std::vector<UINT> > representatives;	// a mesh per placement, in pool order
+	std::vector<size_t> meshBaseVertex(numMeshes);
+	mMeshes.resize(numMeshes);
+	for (UINT m=0;m<numMeshes;m++)
+	{
+		const SDKMESH_MESH* mesh = sdk.GetMesh(m);
+		if (mesh->NumVertexBuffers == 0 || mesh->NumVertexBuffers > MAX_VERTEX_STREAMS)
+			return E_FAIL;
+
+		std::vector<UINT> key;
+		for (UINT s=0;s<mesh->NumVertexBuffers;s++)
+		{
+			key.push_back(sdk.GetVertexStride(m, s));
+			const D3DVERTEXELEMENT9* decl = sdk.GetVertexElements(m, s);
+			for (UINT e=0;e<MAX_VERTEX_ELEMENTS && decl[e].Stream != 0xFF;e++)
+			{
+				key.push_back(decl[e].Offset | (decl[e].Type << 16) | (decl[e].Usage << 24));
+				key.push_back(decl[e].UsageIndex);
+			}
+			key.push_back(~0u);
+		}
+
+		std::map<std::vector<UINT>, size_t>::iterator it = layoutIds.find(key);
+		if (it == layoutIds.end())
+		{
+			it = layoutIds.insert(std::make_pair(key, mLayouts.size())).first;
+			mLayouts.push_back(Layout());
+			placements.push_back(std::map<std::vector<UINT>, size_t>());
+			representatives.push_back(std::vector<UINT>());
+
+			Layout& layout = mLayouts.back();
+			for (UINT s=0;s<mesh->NumVertexBuffers;s++)
+			{
+				std::vector<D3D11_INPUT_ELEMENT_DESC> elements;
+				V_RETURN(ConvertDeclaration(sdk.GetVertexElements(m, s), elements));
+				for (size_t e=0;e<elements.size();e++)
+				{
+					elements[e].InputSlot = s;
+					layout.elements.push_back(elements[e]);
+				}
+				layout.strides.push_back(sdk.GetVertexStride(m, s));
+			}
+		}
+
+		size_t layoutId = it->second;
+		Layout& layout = mLayouts[layoutId];
+		std::vector<UINT> buffers(mesh->VertexBuffers, mesh->VertexBuffers + mesh->NumVertexBuffers);
+		std::map<std::vector<UINT>, size_t>::iterator placement = placements[layoutId].find(buffers);
+		if (placement == placements[layoutId].end())
+		{
+			placement = placements[layoutId].insert(std::make_pair(buffers, layout.numVertices)).first;
+			representatives[layoutId].push_back(m);
+			layout.numVertices += (size_t)sdk.GetNumVertices(m, 0);
+		}
+
+		mMeshes[m].name = mesh->Name;
+		mMeshes[m].layout = layoutId;
+		meshBaseVertex[m] = placement->second;
+	}
+
+	// every stream of every layout gets a region of the pooled vertex buffer
+	size_t vertexBytes = 0;
+	for (size_t l=0;l<mLayouts.size();l++)
+	{
+		Layout& layout = mLayouts[l];
+		for (size_t s=0;s<layout.strides.size();s++)
+		{
+			vertexBytes = alignUp(vertexBytes);
+			layout.offsets.push_back((UINT)vertexBytes);
+			vertexBytes += layout.numVertices * layout.strides[s];
+		}
+	}
+
+	std::vector<uint8_t> vertices(vertexBytes);
+	for (size_t l=0;l<mLayouts.size();l++)
+	{
+		const Layout& layout = mLayouts[l];
+		size_t baseVertex = 0;
+		for (size_t p=0;p<representatives[l].size();p++)
+		{
+			UINT m = representatives[l][p];
+			size_t numVertices = (size_t)sdk.GetNumVertices(m, 0);
+			for (UINT s=0;s<layout.strides.size();s++)
+			{
+				// streams shorter than the first one leave zeros
+				size_t count = std::min(numVertices, (size_t)sdk.GetNumVertices(m, s));
+				memcpy(&vertices[layout.offsets[s] + baseVertex * layout.strides[s]],
+					sdk.GetRawVerticesAt(sdk.GetMesh(m)->VertexBuffers[s]), count * layout.strides[s]);
+			}
+			baseVertex += numVertices;
+		}
+	}
+
+	// the index buffers the meshes use, widened to 32 bits if any of them needs it
+	std::vector<size_t> ibBase(sdk.GetNumIBs(), ~size_t(0));
+	std::vector<UINT> ibOrder;
+	size_t numIndices = 0;
+	bool wide = false;
+	for (UINT m=0;m<numMeshes;m++)
+	{
+		UINT ib = sdk.GetMesh(m)->IndexBuffer;
+		if (ibBase[ib] != ~size_t(0))
+			continue;
+		ibBase[ib] = numIndices;
+		ibOrder.push_back(m);
+		numIndices += (size_t)sdk.GetNumIndices(m);
+		wide = wide || sdk.GetIndexType(m) == IT_32BIT;
+	}
+
+	mIBFormat = wide ? DXGI_FORMAT_R32_UINT : DXGI_FORMAT_R16_UINT;
+	size_t indexSize = wide ? 4 : 2;
+	std::vector<uint8_t> indices(numIndices * indexSize);
+	for (size_t i=0;i<ibOrder.size();i++)
+	{
+		UINT m = ibOrder[i];
+		const BYTE* src = sdk.GetRawIndicesAt(sdk.GetMesh(m)->IndexBuffer);
+		size_t count = (size_t)sdk.GetNumIndices(m);
+		uint8_t* dst = &indices[ibBase[sdk.GetMesh(m)->IndexBuffer] * indexSize];
+		if (wide && sdk.GetIndexType(m) == IT_16BIT)
+		{
+			const uint16_t* src16 = reinterpret_cast<const uint16_t*>(src);
+			uint32_t* dst32 = reinterpret_cast<uint32_t*>(dst);
+			for (size_t k=0;k<count;k++)
+				dst32[k] = src16[k];
+		}
+		else
+			memcpy(dst, src, count * indexSize);
+	}
+
+	// subsets grouped by layout, each mesh's subsets staying together
+	for (size_t l=0;l<mLayouts.size();l++)
+	{
+		for (UINT m=0;m<numMeshes;m++)
+		{
+			if (mMeshes[m].layout != l)
+				continue;
+			const SDKMESH_MESH* mesh = sdk.GetMesh(m);
+			mMeshes[m].firstSubset = mSubsets.size();
+			mMeshes[m].numSubsets = mesh->NumSubsets;
+			for (UINT i=0;i<mesh->NumSubsets;i++)
+			{
+				const SDKMESH_SUBSET* src = sdk.GetSubset(m, i);
+				Subset subset;
+				subset.mesh = m;
+				subset.material = src->MaterialID;
+				subset.topology = CDXUTSDKMesh::GetPrimitiveType((SDKMESH_PRIMITIVE_TYPE)src->PrimitiveType);
+				subset.startIndex = ibBase[mesh->IndexBuffer] + (size_t)src->IndexStart;
+				subset.indexCount = (size_t)src->IndexCount;
+				subset.baseVertex = (int)(meshBaseVertex[m] + src->VertexStart);
+				const SDKMESH_BOUNDS* bounds = sdk.GetSubsetBounds(m, i);
+				Vec3f center(bounds->Center.x, bounds->Center.y, bounds->Center.z);
+				Vec3f extents(bounds->Extents.x, bounds->Extents.y, bounds->Extents.z);
+				subset.bounds = AxisAlignedBox3f(center - extents, center + extents);
+				subset.sphere = Sphere(center, bounds->Radius);
+				mSubsets.push_back(subset);
+			}
+		}
+	}
+
+	// one upload per pool
+	if (!vertices.empty())
+	{
+		CD3D11_BUFFER_DESC bd(vertices.size(), D3D11_BIND_VERTEX_BUFFER);
+		D3D11_SUBRESOURCE_DATA InitData = {0};
+		InitData.pSysMem = &vertices[0];
+		V_RETURN(getDevice()->CreateBuffer( &bd, &InitData, &mVertexBuffer ));
+	}
+	if (!indices.empty())
+	{
+		CD3D11_BUFFER_DESC bd(indices.size(), D3D11_BIND_INDEX_BUFFER);
+		D3D11_SUBRESOURCE_DATA InitData = {0};
+		InitData.pSysMem = &indices[0];
+		V_RETURN(getDevice()->CreateBuffer( &bd, &InitData, &mIndexBuffer ));
+	}
+	return S_OK;
+}
+
+HRESULT SdkMesh::createInputLayout( size_t layout, Shader* shader )
+{
+	dx11::VertexShader* vertexShader = dynamic_cast<dx11::VertexShader*>(shader);
+	assert(vertexShader && "The input shader should be a vertex shader");
+
+	Layout& target = mLayouts[layout];
+	target.inputLayout.Release();
+	return InputLayoutCache::get().getInputLayout(&target.elements[0], target.elements.size(),
+		vertexShader->getBytecode(), vertexShader->getBytecodeLength(),
+		&target.inputLayout);
+}
+
+void SdkMesh::bind( size_t layout ) const
+{
+	const Layout& source = mLayouts[layout];
+	UINT numStreams = (UINT)source.strides.size();
+	ID3D11Buffer* buffers[MAX_VERTEX_STREAMS];
+	for (UINT s=0;s<numStreams;s++)
+		buffers[s] = mVertexBuffer;
+
+	ID3D11DeviceContext* context = getImmediateContext();
+	context->IASetInputLayout(source.inputLayout);
+	context->IASetVertexBuffers(0, numStreams, buffers, &source.strides[0], &source.offsets[0]);
+	context->IASetIndexBuffer(mIndexBuffer, mIBFormat, 0);
+}
+
+void SdkMesh::drawSubset( size_t subset ) const
+{
+	const Subset& range = mSubsets[subset];
+	ID3D11DeviceContext* context = getImmediateContext();
+	context->IASetPrimitiveTopology(range.topology);
+	context->DrawIndexed(range.indexCount, range.startIndex, range.baseVertex);
+}
+
+void SdkMesh::draw() const
+{
+	size_t bound = ~size_t(0);
+	for (size_t i=0;i<mSubsets.size();i++)
+	{
+		size_t layout = mMeshes[mSubsets[i].mesh].layout;
+		if (layout != bound)
+		{
+			bind(layout);
+			bound = layout;
+		}
+		drawSubset(i);
+	}
+}
+
 }}
\ No newline at end of file
@@ -22,32 +22,270 @@
 
 #include "dx11/dx11.h"
 #include "dx11/Shader.h"
+#include "dx11/WorkerPool.h"
+#include "dx11/ShaderReloader.h"
 #include "cinder/app/App.h"
 
+#include <boost/bind.hpp>
+
 using namespace std;
 
-namespace
+namespace cinder { namespace dx11 {
+
+//////////////////////////////////////////////////////////////////////////
+Shader::Shader():mArchiveBytecode(NULL), mArchiveBytecodeLength(0), mReady(true), mResult(S_OK), mPending(false), mGeneration(0)
 {
-    HRESULT hr = S_OK;
 }
 
-namespace cinder { namespace dx11 {
+HRESULT Shader::build(const Buffer& source, const std::string& entryName, const std::vector<ShaderMacro>& macros,
+    ID3D11DeviceChild** pHandle, ID3DBlob** ppBytecode, ShaderDependencies* dependencies, ShaderConstants* constants)
+{
+    HRESULT hr = S_OK;
+    CComPtr<ID3DBlob> shaderBytecode;
+    V_RETURN( dx11::compileShader(source, entryName, getProfileName(), &shaderBytecode, dependencies, &macros) );
+    V_RETURN( constants->setup(shaderBytecode->GetBufferPointer(), shaderBytecode->GetBufferSize()) );
+    V_RETURN( doCreateShader(shaderBytecode->GetBufferPointer(), shaderBytecode->GetBufferSize(), pHandle) );
+    *ppBytecode = shaderBytecode.Detach();
+    return hr;
+}
 
-//////////////////////////////////////////////////////////////////////////
 HRESULT Shader::setup(DataSourceRef dataSrc, const std::string& entryName)
 {
+    return setup(dataSrc, entryName, std::vector<ShaderMacro>());
+}
+
+HRESULT Shader::setup(DataSourceRef dataSrc, const std::string& entryName, const std::vector<ShaderMacro>& macros)
+{
+    // a local result, setup() runs on several workers at once
+    HRESULT hr = S_OK;
+    CComPtr<ID3D11DeviceChild> handle;
+    CComPtr<ID3DBlob> bytecode;
+    ShaderDependencies dependencies;
+    ShaderConstants constants;
     if (dataSrc && dataSrc->getBuffer().getDataSize() > 0)
+        hr = build(dataSrc->getBuffer(), entryName, macros, &handle, &bytecode, &dependencies, &constants);
+
+    std::lock_guard<std::mutex> lock(mMutex);
+    mResult = hr;
+    mSourcePath = dataSrc && dataSrc->isFilePath() ? dataSrc->getFilePath() : fs::path();
+    mEntryName = entryName;
+    mMacros = macros;
+    if (handle)
     {
-        CComPtr<ID3DBlob> shaderBytecode;
-        HR( dx11::compileShader(dataSrc->getBuffer(), entryName, getProfileName(), &shaderBytecode) );
-        HR( doCreateShader(shaderBytecode, &mHandle) );
-    }
+        mHandle = handle;
+        mBytecode = bytecode;
+        mArchive.reset();
+        mDependencies = dependencies;
+        constants.copyVariables(mConstants);
+        mConstants = constants;
+        mGeneration++;
+    }
+    return hr;
+}
+
+HRESULT Shader::setup(ShaderArchiveRef archive, const std::string& name, const std::string& entryName,
+    const std::vector<ShaderMacro>& macros)
+{
+    HRESULT hr = S_OK;
+    const void* bytecode = NULL;
+    size_t bytecodeLength = 0;
+    CComPtr<ID3D11DeviceChild> handle;
+    ShaderConstants constants;
+    if (!archive || !archive->find(name, entryName, getProfileName(), macros, &bytecode, &bytecodeLength))
+        hr = E_FAIL;
+    else if (SUCCEEDED(hr = constants.setup(bytecode, bytecodeLength)))
+        hr = doCreateShader(bytecode, bytecodeLength, &handle);
+
+    std::lock_guard<std::mutex> lock(mMutex);
+    mResult = hr;
+    // nothing to reload, the source isn't around
+    mSourcePath = fs::path();
+    mEntryName = entryName;
+    mMacros = macros;
+    if (handle)
+    {
+        mHandle = handle;
+        mBytecode.Release();
+        mArchive = archive;
+        mArchiveBytecode = bytecode;
+        mArchiveBytecodeLength = bytecodeLength;
+        mDependencies.clear();
+        constants.copyVariables(mConstants);
+        mConstants = constants;
+        mGeneration++;
+    }
     return hr;
+}
+
+HRESULT Shader::recompile()
+{
+    fs::path sourcePath;
+    std::string entryName;
+    std::vector<ShaderMacro> macros;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        sourcePath = mSourcePath;
+        entryName = mEntryName;
+        macros = mMacros;
+    }
+    if (sourcePath.empty())
+        return E_FAIL;
+
+    // a fresh data source, the one setup() had keeps the old contents
+    DataSourceRef dataSrc;
+    try
+    {
+        dataSrc = loadFile(sourcePath);
+        if (dataSrc->getBuffer().getDataSize() == 0)
+            return E_FAIL;
+    }
+    catch (...)
+    {
+        return E_FAIL;
+    }
+
+    HRESULT hr = S_OK;
+    CComPtr<ID3D11DeviceChild> handle;
+    CComPtr<ID3DBlob> bytecode;
+    ShaderDependencies dependencies;
+    ShaderConstants constants;
+    V_RETURN( build(dataSrc->getBuffer(), entryName, macros, &handle, &bytecode, &dependencies, &constants) );
+
+    std::lock_guard<std::mutex> lock(mMutex);
+    mReloadedHandle = handle;
+    mReloadedBytecode = bytecode;
+    mReloadedDependencies = dependencies;
+    mReloadedConstants = constants;
+    return hr;
+}
+
+bool Shader::swapPending()
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    if (!mReloadedHandle)
+        return false;
+
+    mHandle = mReloadedHandle;
+    mBytecode = mReloadedBytecode;
+    mDependencies = mReloadedDependencies;
+    // the values are copied here rather than in recompile(), the app may have set some since
+    mReloadedConstants.copyVariables(mConstants);
+    mConstants = mReloadedConstants;
+    mReloadedHandle.Release();
+    mReloadedBytecode.Release();
+    mReloadedDependencies.clear();
+    mReloadedConstants.clear();
+    mGeneration++;
+    return true;
+}
+
+uint32_t Shader::getGeneration() const
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mGeneration;
+}
+
+fs::path Shader::getSourcePath() const
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mSourcePath;
+}
+
+ShaderDependencies Shader::getDependencies() const
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mDependencies;
+}
+
+void Shader::runAsync(ShaderDesc desc)
+{
+    setup(desc.dataSrc, desc.entryName, desc.macros);
+
+    std::lock_guard<std::mutex> lock(mMutex);
+    mReady = true;
+    mReadyCond.notify_all();
+}
+
+bool Shader::isReady() const
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mReady;
+}
+
+void Shader::wait() const
+{
+    // Called from a pool task, blocking could hold up every worker while the compile is still queued, so queued
+    // tasks run here until the shader is ready. Once the queue is empty the compile is running somewhere.
+    for (;;)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            if (mReady)
+                return;
+        }
+        if (!WorkerPool::get().runQueuedTask())
+            break;
+    }
+
+    std::unique_lock<std::mutex> lock(mMutex);
+    while (!mReady)
+        mReadyCond.wait(lock);
+}
+
+HRESULT Shader::getResult() const
+{
+    wait();
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mResult;
 }
 
 void Shader::bind()
 {
+    if (mPending)
+    {
+        if (!isReady())
+        {
+            if (mFallback)
+                mFallback->bind();
+            else
+                doBind(NULL);
+            return;
+        }
+        mPending = false;
+        mFallback.reset();
+    }
     doBind(mHandle);
+    commitConstants();
+}
+
+bool Shader::setConstant(const std::string& name, const void* data, size_t size)
+{
+    // no lock, once the shader is ready mConstants only changes on this thread, in setup() and swapPending()
+    wait();
+    return mConstants.set(name, data, size);
+}
+
+ConstantBufferRef Shader::getConstantBuffer(const std::string& name) const
+{
+    wait();
+    return mConstants.getBuffer(name);
+}
+
+void Shader::commitConstants()
+{
+    HRESULT hr = S_OK;
+    if (mPending && !isReady())
+        return;
+
+    ID3D11DeviceContext* context = getImmediateContext();
+    const std::vector<ConstantBufferRef>& buffers = mConstants.getBuffers();
+    for (size_t i = 0; i < buffers.size(); ++i)
+    {
+        if (!buffers[i]->isUsed())
+            continue;
+        HR( buffers[i]->flush(context) );
+        doSetConstBuffer(buffers[i]->getDesc().slot, buffers[i]->getBuffer());
+    }
 }
 
 void Shader::unbind()
@@ -55,26 +293,29 @@ void Shader::unbind()
     doBind(NULL);
 }
 
+void Shader::setConstBuffer(uint32_t slot, ID3D11Buffer* buffer)
+{
+    doSetConstBuffer(slot, buffer);
+}
+
 void* VertexShader::getBytecode() const
 {
-    assert(mShaderBytecode);
-    return mShaderBytecode->GetBufferPointer();
+    wait();
+    assert(mBytecode || mArchive);
+    return mBytecode ? mBytecode->GetBufferPointer() : const_cast<void*>(mArchiveBytecode);
 }
 
 size_t VertexShader::getBytecodeLength() const
 {
-    assert(mShaderBytecode);
-    return mShaderBytecode->GetBufferSize();
+    wait();
+    assert(mBytecode || mArchive);
+    return mBytecode ? mBytecode->GetBufferSize() : mArchiveBytecodeLength;
 }
 
-HRESULT VertexShader::doCreateShader(ID3DBlob* blob, ID3D11DeviceChild** pHandle)
+HRESULT VertexShader::doCreateShader(const void* pBytecode, size_t bytecodeLength, ID3D11DeviceChild** pHandle)
 {
-    HR( getDevice()->CreateVertexShader(blob->GetBufferPointer(), blob->GetBufferSize(), NULL, 
-        reinterpret_cast<ID3D11VertexShader**>(pHandle)) );
-
-    mShaderBytecode = blob; // make a local copy
-
-    return hr;
+    return getDevice()->CreateVertexShader(pBytecode, bytecodeLength, NULL, 
+        reinterpret_cast<ID3D11VertexShader**>(pHandle));
 }
 
 void VertexShader::doBind(ID3D11DeviceChild* handle)
@@ -92,9 +333,9 @@ const char* VertexShader::getProfileName() const {return "vs_4_0"; }
 class PixelShader : public Shader
 {
 protected:
-    HRESULT doCreateShader(ID3DBlob* blob, ID3D11DeviceChild** pHandle)
+    HRESULT doCreateShader(const void* pBytecode, size_t bytecodeLength, ID3D11DeviceChild** pHandle)
     {
-        return getDevice()->CreatePixelShader(blob->GetBufferPointer(), blob->GetBufferSize(), NULL, 
+        return getDevice()->CreatePixelShader(pBytecode, bytecodeLength, NULL, 
             reinterpret_cast<ID3D11PixelShader**>(pHandle));
     }
 
@@ -114,9 +355,9 @@ protected:
 class GeometryShader : public Shader
 {
 protected:
-    HRESULT doCreateShader(ID3DBlob* blob, ID3D11DeviceChild** pHandle)
+    HRESULT doCreateShader(const void* pBytecode, size_t bytecodeLength, ID3D11DeviceChild** pHandle)
     {
-        return getDevice()->CreateGeometryShader(blob->GetBufferPointer(), blob->GetBufferSize(), NULL, 
+        return getDevice()->CreateGeometryShader(pBytecode, bytecodeLength, NULL, 
             reinterpret_cast<ID3D11GeometryShader**>(pHandle));
     }
 
@@ -133,22 +374,93 @@ protected:
     const char* getProfileName() const {return "gs_4_0"; }
 };
 
+namespace
+{
+    ShaderRef createEmpty(ShaderType type)
+    {
+        switch (type)
+        {
+        case Shader_VS: return ShaderRef(new VertexShader);
+        case Shader_PS: return ShaderRef(new PixelShader);
+        case Shader_GS: return ShaderRef(new GeometryShader);
+        default: throw std::runtime_error("unexpected shader type");
+        }
+    }
+
+    struct BatchSetup
+    {
+        const std::vector<ShaderDesc>*  descs;
+        std::vector<ShaderRef>*         shaders;
+
+        void run(size_t begin, size_t end)
+        {
+            for (size_t i = begin; i < end; ++i)
+                (*shaders)[i]->setup((*descs)[i].dataSrc, (*descs)[i].entryName, (*descs)[i].macros);
+        }
+    };
+}
 
 ShaderRef Shader::create(ShaderType type, DataSourceRef dataSrc, const std::string& entryName)
 {
-    ShaderRef shader;
+    return create(ShaderDesc(type, dataSrc, entryName));
+}
 
-    switch (type)
-    {
-    case Shader_VS: shader = ShaderRef(new VertexShader);   break;
-    case Shader_PS: shader = ShaderRef(new PixelShader);    break;
-    case Shader_GS: shader = ShaderRef(new GeometryShader); break;
-    default: throw std::runtime_error("unexpected shader type");
-    }
+ShaderRef Shader::create(const ShaderDesc& desc)
+{
+    HRESULT hr = S_OK;
+    ShaderRef shader = createEmpty(desc.type);
+
+    HR( shader->setup(desc.dataSrc, desc.entryName, desc.macros) );
+    ShaderReloader::get().add(shader);
+
+    return shader;
+}
+
+ShaderRef Shader::create(ShaderArchiveRef archive, ShaderType type, const std::string& name, const std::string& entryName,
+    const std::vector<ShaderMacro>& macros)
+{
+    HRESULT hr = S_OK;
+    ShaderRef shader = createEmpty(type);
 
-    HR( shader->setup(dataSrc, entryName) );
+    HR( shader->setup(archive, name, entryName, macros) );
 
     return shader;
 }
 
+ShaderRef Shader::createAsync(ShaderType type, DataSourceRef dataSrc, const std::string& entryName, ShaderRef fallback)
+{
+    return createAsync(ShaderDesc(type, dataSrc, entryName), fallback);
+}
+
+ShaderRef Shader::createAsync(const ShaderDesc& desc, ShaderRef fallback)
+{
+    ShaderRef shader = createEmpty(desc.type);
+    shader->mReady = false;
+    shader->mPending = true;
+    shader->mFallback = fallback;
+
+    // the task holds a reference, so dropping the shader early doesn't pull it from under the worker
+    WorkerPool::get().submit(boost::bind(&Shader::runAsync, shader, desc));
+    ShaderReloader::get().add(shader);
+
+    return shader;
+}
+
+std::vector<ShaderRef> Shader::createBatch(const std::vector<ShaderDesc>& descs)
+{
+    std::vector<ShaderRef> shaders(descs.size());
+    for (size_t i = 0; i < descs.size(); ++i)
+        shaders[i] = createEmpty(descs[i].type);
+
+    // one shader per grain, compile times vary too much for larger ones
+    BatchSetup batch;
+    batch.descs = &descs;
+    batch.shaders = &shaders;
+    parallelFor(descs.size(), 1, boost::bind(&BatchSetup::run, &batch, _1, _2));
+    for (size_t i = 0; i < shaders.size(); ++i)
+        ShaderReloader::get().add(shaders[i]);
+
+    return shaders;
+}
+
 } } // namespace cinder::dx11
@@ -0,0 +1,300 @@
+#include "dx11/ShaderArchive.h"
+#include "dx11/MappedFile.h"
+#include "CacheUtils.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <sstream>
+
+namespace cinder { namespace dx11 {
+
+namespace
+{
+    using detail::kFnvOffset;
+    using detail::hashBytes;
+    using detail::hashString;
+
+    bool macroLess(const ShaderMacro& a, const ShaderMacro& b)
+    {
+        return a.name < b.name || (a.name == b.name && a.definition < b.definition);
+    }
+
+    // the order of the index: name, entry point, profile, variant hash
+    int compareKey(const char* nameA, const char* entryA, const char* profileA, uint64_t hashA,
+        const char* nameB, const char* entryB, const char* profileB, uint64_t hashB)
+    {
+        int order = strcmp(nameA, nameB);
+        if (order == 0)
+            order = strcmp(entryA, entryB);
+        if (order == 0)
+            order = strcmp(profileA, profileB);
+        if (order == 0 && hashA != hashB)
+            order = hashA < hashB ? -1 : 1;
+        return order;
+    }
+}
+
+ShaderArchive::ShaderArchive()
+:mData(NULL), mSize(0), mHeader(NULL), mEntries(NULL), mStrings(NULL)
+{
+}
+
+ShaderArchive::~ShaderArchive()
+{
+}
+
+ShaderArchiveRef ShaderArchive::create(const std::string& path)
+{
+    std::shared_ptr<MappedFile> file(new MappedFile);
+    if (!file->open(path) || file->getSize() < sizeof(Header))
+        return ShaderArchiveRef();
+
+    const uint8_t* data = static_cast<const uint8_t*>(file->getData());
+    size_t size = file->getSize();
+    const Header* header = reinterpret_cast<const Header*>(data);
+    if (header->magic != kMagic || header->version != kVersion || header->fileSize != size)
+        return ShaderArchiveRef();
+
+    // what find() relies on, verify() checks the rest
+    uint64_t indexEnd = sizeof(Header) + (uint64_t)header->numEntries * sizeof(Entry);
+    if (indexEnd > header->stringsOffset || (uint64_t)header->stringsOffset + header->stringsSize > size ||
+        header->stringsSize == 0 || data[header->stringsOffset + header->stringsSize - 1] != 0)
+        return ShaderArchiveRef();
+
+    ShaderArchiveRef archive(new ShaderArchive);
+    archive->mFile = file;
+    archive->mData = data;
+    archive->mSize = size;
+    archive->mHeader = header;
+    archive->mEntries = reinterpret_cast<const Entry*>(data + sizeof(Header));
+    archive->mStrings = reinterpret_cast<const char*>(data + header->stringsOffset);
+    return archive;
+}
+
+bool ShaderArchive::find(const std::string& name, const std::string& entry, const std::string& profile, uint64_t variantHash,
+    const void** ppBytecode, size_t* pSize) const
+{
+    size_t first = 0, count = mHeader->numEntries;
+    while (count > 0)
+    {
+        size_t half = count / 2;
+        const Entry& middle = mEntries[first + half];
+        if (middle.name >= mHeader->stringsSize || middle.entry >= mHeader->stringsSize || middle.profile >= mHeader->stringsSize)
+            return false;
+        int order = compareKey(getString(middle.name), getString(middle.entry), getString(middle.profile), middle.variantHash,
+            name.c_str(), entry.c_str(), profile.c_str(), variantHash);
+        if (order == 0)
+        {
+            if (middle.offset > mSize || middle.size > mSize - middle.offset)
+                return false;
+            *ppBytecode = getBlob(middle);
+            *pSize = middle.size;
+            return true;
+        }
+        if (order < 0)
+        {
+            first += half + 1;
+            count -= half + 1;
+        }
+        else
+            count = half;
+    }
+    return false;
+}
+
+bool ShaderArchive::find(const std::string& name, const std::string& entry, const std::string& profile,
+    const std::vector<ShaderMacro>& macros, const void** ppBytecode, size_t* pSize) const
+{
+    return find(name, entry, profile, hashMacros(macros), ppBytecode, pSize);
+}
+
+bool ShaderArchive::verify(std::string* error) const
+{
+    std::ostringstream message;
+    uint64_t blobsStart = (uint64_t)mHeader->stringsOffset + mHeader->stringsSize;
+    for (uint32_t i=0;i<mHeader->numEntries;i++)
+    {
+        const Entry& entry = mEntries[i];
+        message << "entry " << i << ": ";
+        if (entry.name >= mHeader->stringsSize || entry.entry >= mHeader->stringsSize || entry.profile >= mHeader->stringsSize)
+            message << "string offset outside the string table";
+        else if (i > 0 && compareKey(getString(mEntries[i - 1].name), getString(mEntries[i - 1].entry),
+            getString(mEntries[i - 1].profile), mEntries[i - 1].variantHash,
+            getString(entry.name), getString(entry.entry), getString(entry.profile), entry.variantHash) >= 0)
+            message << "index not sorted or key repeated";
+        else if (entry.offset % kBlobAlignment != 0)
+            message << "blob not " << (int)kBlobAlignment << "-byte aligned";
+        else if (entry.offset < blobsStart || entry.offset > mSize || entry.size > mSize - entry.offset)
+            message << "blob outside the blob area";
+        else if (checksum(getBlob(entry), entry.size) != entry.checksum)
+            message << "checksum mismatch";
+        else if (entry.size < 4 || memcmp(getBlob(entry), "DXBC", 4) != 0)
+            message << "blob isn't DXBC bytecode";
+        else
+        {
+            message.str("");
+            continue;
+        }
+
+        if (error)
+            *error = message.str();
+        return false;
+    }
+    return true;
+}
+
+uint64_t ShaderArchive::hashMacros(const std::vector<ShaderMacro>& macros)
+{
+    std::vector<ShaderMacro> sorted(macros);
+    std::sort(sorted.begin(), sorted.end(), macroLess);
+
+    uint64_t hash = kFnvOffset;
+    for (size_t i=0;i<sorted.size();i++)
+    {
+        // with terminators, so "A" "BC" and "AB" "C" differ
+        hash = hashString(hash, sorted[i].name);
+        hash = hashString(hash, sorted[i].definition);
+    }
+    return hash;
+}
+
+uint64_t ShaderArchive::checksum(const void* data, size_t size)
+{
+    return hashBytes(kFnvOffset, data, size);
+}
+
+//////////////////////////////////////////////////////////////////////////
+void ShaderArchiveWriter::add(const std::string& name, const std::string& entry, const std::string& profile,
+    const std::vector<ShaderMacro>& macros, const void* bytecode, size_t size)
+{
+    Item item;
+    item.name = name;
+    item.entry = entry;
+    item.profile = profile;
+    item.variantHash = ShaderArchive::hashMacros(macros);
+    item.bytecode.assign(static_cast<const uint8_t*>(bytecode), static_cast<const uint8_t*>(bytecode) + size);
+
+    for (size_t i=0;i<mEntries.size();i++)
+    {
+        if (mEntries[i].name == name && mEntries[i].entry == entry && mEntries[i].profile == profile &&
+            mEntries[i].variantHash == item.variantHash)
+        {
+            mEntries[i] = item;
+            return;
+        }
+    }
+    mEntries.push_back(item);
+}
+
+namespace
+{
+    struct ItemLess
+    {
+        template <typename T>
+        bool operator()(const T* a, const T* b) const
+        {
+            return compareKey(a->name.c_str(), a->entry.c_str(), a->profile.c_str(), a->variantHash,
+                b->name.c_str(), b->entry.c_str(), b->profile.c_str(), b->variantHash) < 0;
+        }
+    };
+
+    uint32_t addString(std::vector<char>* strings, const std::string& value)
+    {
+        uint32_t offset = (uint32_t)strings->size();
+        strings->insert(strings->end(), value.c_str(), value.c_str() + value.size() + 1);
+        return offset;
+    }
+
+    uint64_t alignUp(uint64_t value, uint64_t alignment)
+    {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+}
+
+bool ShaderArchiveWriter::write(const std::string& path) const
+{
+    std::vector<const Item*> sorted(mEntries.size());
+    for (size_t i=0;i<mEntries.size();i++)
+        sorted[i] = &mEntries[i];
+    std::sort(sorted.begin(), sorted.end(), ItemLess());
+
+    // names repeat for every variant of a shader, so every string goes in once
+    std::vector<char> strings;
+    std::map<std::string, uint32_t> stringOffsets;
+    std::vector<ShaderArchive::Entry> entries(sorted.size());
+    for (size_t i=0;i<sorted.size();i++)
+    {
+        const std::string* values[3] = { &sorted[i]->name, &sorted[i]->entry, &sorted[i]->profile };
+        uint32_t* offsets[3] = { &entries[i].name, &entries[i].entry, &entries[i].profile };
+        for (int j=0;j<3;j++)
+        {
+            std::map<std::string, uint32_t>::const_iterator it = stringOffsets.find(*values[j]);
+            if (it == stringOffsets.end())
+                it = stringOffsets.insert(std::make_pair(*values[j], addString(&strings, *values[j]))).first;
+            *offsets[j] = it->second;
+        }
+    }
+    if (strings.empty())
+        strings.push_back(0);
+
+    ShaderArchive::Header header;
+    header.magic = ShaderArchive::kMagic;
+    header.version = ShaderArchive::kVersion;
+    header.numEntries = (uint32_t)entries.size();
+    header.stringsOffset = (uint32_t)(sizeof(ShaderArchive::Header) + entries.size() * sizeof(ShaderArchive::Entry));
+    header.stringsSize = (uint32_t)strings.size();
+    header.reserved = 0;
+
+    uint64_t offset = (uint64_t)header.stringsOffset + header.stringsSize;
+    for (size_t i=0;i<sorted.size();i++)
+    {
+        const std::vector<uint8_t>& bytecode = sorted[i]->bytecode;
+        offset = alignUp(offset, ShaderArchive::kBlobAlignment);
+        entries[i].size = (uint32_t)bytecode.size();
+        entries[i].variantHash = sorted[i]->variantHash;
+        entries[i].offset = offset;
+        entries[i].checksum = ShaderArchive::checksum(bytecode.empty() ? NULL : &bytecode[0], bytecode.size());
+        offset += bytecode.size();
+    }
+    header.fileSize = offset;
+
+    std::string temp = path + ".tmp";
+    {
+        std::ofstream file(temp.c_str(), std::ios::binary | std::ios::trunc);
+        if (!file)
+            return false;
+
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        if (!entries.empty())
+            file.write(reinterpret_cast<const char*>(&entries[0]), entries.size() * sizeof(ShaderArchive::Entry));
+        file.write(&strings[0], strings.size());
+
+        static const char padding[16] = { 0 };
+        uint64_t written = (uint64_t)header.stringsOffset + header.stringsSize;
+        for (size_t i=0;i<sorted.size();i++)
+        {
+            file.write(padding, (std::streamsize)(entries[i].offset - written));
+            if (!sorted[i]->bytecode.empty())
+                file.write(reinterpret_cast<const char*>(&sorted[i]->bytecode[0]), sorted[i]->bytecode.size());
+            written = entries[i].offset + entries[i].size;
+        }
+        if (!file.flush())
+        {
+            file.close();
+            std::remove(temp.c_str());
+            return false;
+        }
+    }
+
+    if (!detail::renameFile(temp, path))
+    {
+        std::remove(temp.c_str());
+        return false;
+    }
+    return true;
+}
+
+} } // namespace cinder::dx11
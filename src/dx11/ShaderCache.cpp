@@ -0,0 +1,319 @@
+#include "dx11/ShaderCache.h"
+#include "CacheUtils.h"
+
+#include <cstdio>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+
+#if defined( _WIN32 )
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace cinder { namespace dx11 {
+
+namespace
+{
+    const uint32_t kMagic = 0x43535844; // "DXSC"
+    const uint32_t kVersion = 2;
+
+    using detail::kFnvOffset;
+    using detail::hashBytes;
+    using detail::hashString;
+
+    template <typename T>
+    void writeValue(std::ofstream& file, const T& value)
+    {
+        file.write(reinterpret_cast<const char*>(&value), sizeof(value));
+    }
+
+    template <typename T>
+    bool readValue(std::ifstream& file, T* value)
+    {
+        return file.read(reinterpret_cast<char*>(value), sizeof(*value)).good();
+    }
+
+    void writeString(std::ofstream& file, const std::string& value)
+    {
+        writeValue(file, (uint32_t)value.size());
+        file.write(value.data(), value.size());
+    }
+
+    // lengths come from the file, a corrupted one mustn't get to allocate gigabytes
+    bool fits(std::ifstream& file, uint64_t fileSize, uint64_t length)
+    {
+        std::streamoff position = file.tellg();
+        return position >= 0 && length <= fileSize - (uint64_t)position;
+    }
+
+    bool readString(std::ifstream& file, uint64_t fileSize, std::string* value)
+    {
+        uint32_t length = 0;
+        if (!readValue(file, &length) || !fits(file, fileSize, length))
+            return false;
+        value->resize(length);
+        return length == 0 || file.read(&(*value)[0], length).good();
+    }
+
+    unsigned long getProcessId()
+    {
+#if defined( _WIN32 )
+        return GetCurrentProcessId();
+#else
+        return (unsigned long)getpid();
+#endif
+    }
+}
+
+std::vector<std::string> ShaderDependencies::getFiles() const
+{
+    std::vector<std::string> files;
+    for (size_t i=0;i<edges.size();i++)
+    {
+        if (std::find(files.begin(), files.end(), edges[i].included) == files.end())
+            files.push_back(edges[i].included);
+    }
+    return files;
+}
+
+std::vector<std::string> ShaderDependencies::getIncludes( const std::string& includer ) const
+{
+    std::vector<std::string> includes;
+    for (size_t i=0;i<edges.size();i++)
+    {
+        if (edges[i].includer == includer &&
+            std::find(includes.begin(), includes.end(), edges[i].included) == includes.end())
+            includes.push_back(edges[i].included);
+    }
+    return includes;
+}
+
+bool ShaderDependencies::dependsOn( const std::string& name ) const
+{
+    // every included file was read by this compile, however deep it sits
+    for (size_t i=0;i<edges.size();i++)
+    {
+        if (edges[i].included == name)
+            return true;
+    }
+    return false;
+}
+
+// Forwards to the real include reader and keeps what the compiler read, which is what the entry has to match
+class ShaderCache::RecordingIncludes : public ShaderIncludes
+{
+public:
+    explicit RecordingIncludes(ShaderIncludes* includes):mIncludes(includes){}
+
+    Contents open( const std::string& name )
+    {
+        Contents contents = mIncludes->open(name);
+        if (contents && mRead.find(name) == mRead.end())
+        {
+            mRead[name] = contents;
+            mOrder.push_back(name);
+        }
+        return contents;
+    }
+
+    Contents getRead( const std::string& name ) const
+    {
+        boost::unordered_map<std::string, Contents>::const_iterator it = mRead.find(name);
+        return it == mRead.end() ? Contents() : it->second;
+    }
+
+    const std::vector<std::string>& getOrder() const { return mOrder; }
+
+private:
+    ShaderIncludes*     mIncludes;
+    boost::unordered_map<std::string, Contents> mRead;
+    std::vector<std::string>    mOrder;
+};
+
+ShaderCache::ShaderCache( const std::string& directory, ShaderCompiler* compiler, ShaderIncludes* includes )
+:mDirectory(directory), mCompiler(compiler), mIncludes(includes), mNextTemp(0)
+{
+    if (!mDirectory.empty() && mDirectory[mDirectory.size() - 1] != '/' && mDirectory[mDirectory.size() - 1] != '\\')
+        mDirectory += '/';
+}
+
+std::string ShaderCache::getPath( const ShaderRequest& request ) const
+{
+    uint64_t key = hashBytes(kFnvOffset, &kVersion, sizeof(kVersion));
+    uint32_t compilerVersion = mCompiler->getVersion();
+    key = hashBytes(key, &compilerVersion, sizeof(compilerVersion));
+    key = hashBytes(key, &request.flags, sizeof(request.flags));
+    key = hashString(key, request.entry);
+    key = hashString(key, request.profile);
+    for (size_t i=0;i<request.macros.size();i++)
+    {
+        key = hashString(key, request.macros[i].name);
+        key = hashString(key, request.macros[i].definition);
+    }
+    key = hashBytes(key, request.source, request.sourceSize);
+
+    char name[32];
+    sprintf(name, "%08x%08x.cso", (uint32_t)(key >> 32), (uint32_t)key);
+    return mDirectory + name;
+}
+
+bool ShaderCache::get( const ShaderRequest& request, std::vector<uint8_t>* bytecode, std::string* errors,
+    ShaderDependencies* dependencies )
+{
+    std::string path = getPath(request);
+    ShaderDependencies graph;
+    if (load(path, bytecode, &graph))
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mStats.hits++;
+        if (dependencies)
+            *dependencies = graph;
+        return true;
+    }
+
+    RecordingIncludes includes(mIncludes);
+    bytecode->clear();
+    graph.clear();
+    bool compiled = mCompiler->compile(request, &includes, bytecode, errors, &graph);
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mStats.misses++;
+    }
+
+    // a compiler that doesn't report the graph still gets every include it read checked
+    for (size_t i=0;i<includes.getOrder().size();i++)
+    {
+        if (!graph.dependsOn(includes.getOrder()[i]))
+        {
+            ShaderDependencies::Edge edge;
+            edge.included = includes.getOrder()[i];
+            graph.edges.push_back(edge);
+        }
+    }
+    if (dependencies)
+        *dependencies = graph;
+
+    if (compiled && !store(path, graph, includes, *bytecode))
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mStats.writeFailures++;
+    }
+    return compiled;
+}
+
+ShaderCache::Stats ShaderCache::getStats() const
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mStats;
+}
+
+uint64_t ShaderCache::hashInclude( const std::string& name, const ShaderIncludes::Contents& contents )
+{
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        boost::unordered_map<std::string, HashedInclude>::const_iterator it = mHashes.find(name);
+        if (it != mHashes.end() && it->second.contents == contents)
+            return it->second.hash;
+    }
+
+    HashedInclude hashed;
+    hashed.contents = contents;
+    hashed.hash = hashBytes(kFnvOffset, contents->data(), contents->size());
+
+    std::lock_guard<std::mutex> lock(mMutex);
+    mHashes[name] = hashed;
+    return hashed.hash;
+}
+
+bool ShaderCache::load( const std::string& path, std::vector<uint8_t>* bytecode, ShaderDependencies* dependencies )
+{
+    std::ifstream file(path.c_str(), std::ios::binary | std::ios::ate);
+    if (!file)
+        return false;
+    uint64_t fileSize = (uint64_t)file.tellg();
+    file.seekg(0);
+
+    uint32_t magic = 0, version = 0, numEdges = 0;
+    if (!readValue(file, &magic) || !readValue(file, &version) || !readValue(file, &numEdges) ||
+        magic != kMagic || version != kVersion)
+        return false;
+    // an edge takes two string lengths and a hash at least
+    if (!fits(file, fileSize, (uint64_t)numEdges * 16))
+        return false;
+
+    // a stale include makes the entry stale, the compile that follows overwrites it
+    dependencies->edges.resize(numEdges);
+    for (uint32_t i=0;i<numEdges;i++)
+    {
+        ShaderDependencies::Edge& edge = dependencies->edges[i];
+        uint64_t hash = 0;
+        if (!readString(file, fileSize, &edge.includer) || !readString(file, fileSize, &edge.included) || !readValue(file, &hash))
+            return false;
+        ShaderIncludes::Contents contents = mIncludes->open(edge.included);
+        if (!contents || hashInclude(edge.included, contents) != hash)
+            return false;
+    }
+
+    uint32_t size = 0;
+    if (!readValue(file, &size) || size == 0 || !fits(file, fileSize, size))
+        return false;
+    bytecode->resize(size);
+    return file.read(reinterpret_cast<char*>(&(*bytecode)[0]), size).good();
+}
+
+bool ShaderCache::store( const std::string& path, const ShaderDependencies& dependencies, const RecordingIncludes& includes,
+    const std::vector<uint8_t>& bytecode )
+{
+    if (bytecode.empty())
+        return false;
+
+    std::ostringstream temp;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        temp << path << "." << getProcessId() << "." << mNextTemp++ << ".tmp";
+    }
+
+    {
+        std::ofstream file(temp.str().c_str(), std::ios::binary | std::ios::trunc);
+        if (!file)
+            return false;
+
+        writeValue(file, kMagic);
+        writeValue(file, kVersion);
+        writeValue(file, (uint32_t)dependencies.edges.size());
+        for (size_t i=0;i<dependencies.edges.size();i++)
+        {
+            const ShaderDependencies::Edge& edge = dependencies.edges[i];
+            ShaderIncludes::Contents contents = includes.getRead(edge.included);
+            if (!contents)
+            {
+                // the compiler reported a file it never read through the cache's reader, so it can't be checked
+                file.close();
+                std::remove(temp.str().c_str());
+                return false;
+            }
+            writeString(file, edge.includer);
+            writeString(file, edge.included);
+            writeValue(file, hashInclude(edge.included, contents));
+        }
+        writeValue(file, (uint32_t)bytecode.size());
+        file.write(reinterpret_cast<const char*>(&bytecode[0]), bytecode.size());
+        if (!file.flush())
+        {
+            file.close();
+            std::remove(temp.str().c_str());
+            return false;
+        }
+    }
+
+    if (!detail::renameFile(temp.str(), path))
+    {
+        std::remove(temp.str().c_str());
+        return false;
+    }
+    return true;
+}
+
+} } // namespace cinder::dx11
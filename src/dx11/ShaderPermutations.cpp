@@ -0,0 +1,110 @@
+#include "dx11/ShaderPermutations.h"
+
+#include <stdexcept>
+
+namespace cinder { namespace dx11 {
+
+ShaderPermutationsRef ShaderPermutations::create(ShaderType type, DataSourceRef dataSrc, const std::string& entryName,
+    const std::vector<std::string>& keywords)
+{
+    if (keywords.size() > 32)
+        throw std::runtime_error("more than 32 shader keywords");
+
+    return ShaderPermutationsRef(new ShaderPermutations(type, dataSrc, entryName, keywords));
+}
+
+ShaderPermutations::ShaderPermutations(ShaderType type, DataSourceRef dataSrc, const std::string& entryName,
+    const std::vector<std::string>& keywords)
+:mType(type), mDataSrc(dataSrc), mEntryName(entryName), mKeywords(keywords)
+{
+    for (size_t i=0;i<keywords.size();i++)
+    {
+        size_t equals = keywords[i].find('=');
+        if (equals == std::string::npos)
+            mKeywordMacros.push_back(ShaderMacro(keywords[i]));
+        else
+            mKeywordMacros.push_back(ShaderMacro(keywords[i].substr(0, equals), keywords[i].substr(equals + 1)));
+    }
+
+    // loaded here, the variants read the buffer from several workers at once
+    if (mDataSrc)
+        mDataSrc->getBuffer();
+}
+
+uint32_t ShaderPermutations::getMask(const std::string& keyword) const
+{
+    for (size_t i=0;i<mKeywords.size();i++)
+    {
+        if (mKeywords[i] == keyword)
+            return 1u << i;
+    }
+    return 0;
+}
+
+uint32_t ShaderPermutations::getValidMask(uint32_t mask) const
+{
+    return mKeywords.size() < 32 ? mask & ((1u << mKeywords.size()) - 1) : mask;
+}
+
+std::vector<ShaderMacro> ShaderPermutations::getMacros(uint32_t mask) const
+{
+    mask = getValidMask(mask);
+
+    std::vector<ShaderMacro> macros;
+    for (size_t i=0;i<mKeywordMacros.size();i++)
+    {
+        if (mask & (1u << i))
+            macros.push_back(mKeywordMacros[i]);
+    }
+    return macros;
+}
+
+ShaderRef ShaderPermutations::get(uint32_t mask)
+{
+    mask = getValidMask(mask);
+
+    ShaderRef shader;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        boost::unordered_map<uint32_t, ShaderRef>::const_iterator it = mVariants.find(mask);
+        if (it != mVariants.end())
+            shader = it->second;
+    }
+    if (shader)
+    {
+        shader->wait();
+        return shader;
+    }
+
+    // compiled outside the lock so other variants don't wait for this one
+    shader = Shader::create(ShaderDesc(mType, mDataSrc, mEntryName, getMacros(mask)));
+
+    // when two threads compiled the same variant, the first one in wins
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        std::pair<boost::unordered_map<uint32_t, ShaderRef>::iterator, bool> inserted = mVariants.insert(std::make_pair(mask, shader));
+        shader = inserted.first->second;
+    }
+    shader->wait();
+    return shader;
+}
+
+void ShaderPermutations::prewarm(const std::vector<uint32_t>& masks)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    for (size_t i=0;i<masks.size();i++)
+    {
+        uint32_t mask = getValidMask(masks[i]);
+        if (mVariants.find(mask) != mVariants.end())
+            continue;
+        mVariants[mask] = Shader::createAsync(ShaderDesc(mType, mDataSrc, mEntryName, getMacros(mask)));
+    }
+}
+
+size_t ShaderPermutations::getNumVariants() const
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mVariants.size();
+}
+
+} } // namespace cinder::dx11
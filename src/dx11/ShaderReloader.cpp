@@ -0,0 +1,272 @@
+#include "dx11/ShaderReloader.h"
+#include "dx11/WorkerPool.h"
+#include "dx11/IncludeCache.h"
+#include "cinder/app/App.h"
+
+#include <boost/bind.hpp>
+#include <boost/algorithm/string/predicate.hpp>
+
+namespace cinder { namespace dx11 {
+
+namespace
+{
+    // how long the watcher sleeps between checks for new shaders and for stop()
+    const uint32_t kPollMs = 100;
+    // editors save in several writes, a change is only compiled once the files stayed quiet this long
+    const uint32_t kSettleMs = 30;
+
+    bool samePath(const fs::path& a, const fs::path& b)
+    {
+        // the cheap test first, equivalent() has to look at both files
+        if (!boost::algorithm::iequals(a.filename().string(), b.filename().string()))
+            return false;
+        boost::system::error_code ec;
+        return fs::equivalent(a, b, ec) && !ec;
+    }
+}
+
+ShaderReloader& ShaderReloader::get()
+{
+    static ShaderReloader reloader;
+    return reloader;
+}
+
+ShaderReloader::ShaderReloader()
+:mTimer(true), mQuit(false)
+{
+    // constructed first, so the pool outlives the reloader thread that compiles on it
+    WorkerPool::get();
+}
+
+ShaderReloader::~ShaderReloader()
+{
+    stop();
+}
+
+bool ShaderReloader::start()
+{
+    if (mThread)
+        return true;
+
+    mWatcher = FileWatcher::create();
+    if (!mWatcher)
+        return false;
+
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mQuit = false;
+        // watched again from scratch by the new watcher
+        for (size_t i=0;i<mTracked.size();i++)
+        {
+            mTracked[i]->generation = ~0u;
+            mTracked[i]->files.clear();
+        }
+    }
+    mThread.reset(new std::thread(boost::bind(&ShaderReloader::threadLoop, this)));
+    return true;
+}
+
+void ShaderReloader::stop()
+{
+    if (!mThread)
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mQuit = true;
+    }
+    mThread->join();
+    mThread.reset();
+    mWatcher.reset();
+}
+
+bool ShaderReloader::isRunning() const
+{
+    return mThread.get() != NULL;
+}
+
+bool ShaderReloader::shouldQuit() const
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mQuit;
+}
+
+void ShaderReloader::add(const ShaderRef& shader)
+{
+    if (!shader)
+        return;
+
+    TrackedRef tracked(new Tracked);
+    tracked->shader = shader;
+    tracked->generation = ~0u;
+
+    std::lock_guard<std::mutex> lock(mMutex);
+    pruneReleased();
+    mTracked.push_back(tracked);
+}
+
+void ShaderReloader::pruneReleased()
+{
+    for (size_t i=0;i<mTracked.size();)
+    {
+        if (mTracked[i]->shader.expired())
+        {
+            mTracked[i] = mTracked.back();
+            mTracked.pop_back();
+        }
+        else
+            i++;
+    }
+}
+
+void ShaderReloader::refreshWatches(const std::vector<TrackedRef>& tracked)
+{
+    for (size_t i=0;i<tracked.size();i++)
+    {
+        Tracked& entry = *tracked[i];
+        ShaderRef shader = entry.shader.lock();
+        // an async shader that is still compiling doesn't know its includes yet
+        if (!shader || !shader->isReady())
+            continue;
+        uint32_t generation = shader->getGeneration();
+        if (generation == entry.generation)
+            continue;
+
+        entry.generation = generation;
+        entry.files.clear();
+        fs::path sourcePath = shader->getSourcePath();
+        if (sourcePath.empty())
+            continue;
+        entry.files.push_back(sourcePath);
+
+        // the graph holds every file the compile read, so this is the whole closure of the shader
+        std::vector<std::string> includes = shader->getDependencies().getFiles();
+        for (size_t j=0;j<includes.size();j++)
+        {
+            fs::path path = app::getAssetPath(includes[j]);
+            if (!path.empty())
+                entry.files.push_back(path);
+        }
+
+        for (size_t j=0;j<entry.files.size();j++)
+            mWatcher->addDirectory(entry.files[j].parent_path());
+    }
+}
+
+void ShaderReloader::recompile(const std::vector<ShaderRef>* affected, std::vector<HRESULT>* results, size_t begin, size_t end)
+{
+    for (size_t i=begin;i<end;i++)
+        (*results)[i] = (*affected)[i]->recompile();
+}
+
+void ShaderReloader::threadLoop()
+{
+    std::vector<TrackedRef> tracked;
+    std::vector<fs::path> changed;
+    while (!shouldQuit())
+    {
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            pruneReleased();
+            tracked = mTracked;
+        }
+        refreshWatches(tracked);
+
+        changed.clear();
+        if (!mWatcher->wait(kPollMs, &changed))
+            continue;
+        double noticed = mTimer.getSeconds();
+        while (mWatcher->wait(kSettleMs, &changed))
+            ;
+
+        // held only while they compile, a shader released meanwhile goes away once its compile is done
+        std::vector<ShaderRef> affected;
+        for (size_t i=0;i<tracked.size();i++)
+        {
+            const std::vector<fs::path>& files = tracked[i]->files;
+            bool hit = false;
+            for (size_t j=0;j<files.size() && !hit;j++)
+            {
+                for (size_t k=0;k<changed.size() && !hit;k++)
+                    hit = samePath(files[j], changed[k]);
+            }
+            ShaderRef shader = hit ? tracked[i]->shader.lock() : ShaderRef();
+            if (shader)
+                affected.push_back(shader);
+        }
+        if (affected.empty())
+            continue;
+
+        // the include cache would otherwise decide from the file stamps, which an editor can keep unchanged
+        for (size_t i=0;i<changed.size();i++)
+            getIncludeCache()->invalidate(changed[i]);
+
+        // one shader per grain, like Shader::createBatch
+        std::vector<HRESULT> results(affected.size(), S_OK);
+        parallelFor(affected.size(), 1, boost::bind(&ShaderReloader::recompile, this, &affected, &results, _1, _2));
+
+        std::lock_guard<std::mutex> lock(mMutex);
+        for (size_t i=0;i<affected.size();i++)
+        {
+            if (SUCCEEDED(results[i]))
+            {
+                Reloaded reloaded;
+                reloaded.shader = affected[i];
+                reloaded.noticed = noticed;
+                mReloaded.push_back(reloaded);
+            }
+            else
+            {
+                mFailed.push_back(affected[i]->getSourcePath());
+                mStats.failures++;
+            }
+        }
+    }
+}
+
+size_t ShaderReloader::update()
+{
+    std::vector<Reloaded> reloaded;
+    std::vector<fs::path> failed;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        pruneReleased();
+        if (mReloaded.empty() && mFailed.empty())
+            return 0;
+        reloaded.swap(mReloaded);
+        failed.swap(mFailed);
+    }
+
+    for (size_t i=0;i<failed.size();i++)
+        app::console() << "ShaderReloader: " << failed[i] << " failed to compile, keeping the previous version" << std::endl;
+
+    size_t numSwapped = 0;
+    double now = mTimer.getSeconds();
+    for (size_t i=0;i<reloaded.size();i++)
+    {
+        ShaderRef shader = reloaded[i].shader.lock();
+        if (!shader || !shader->swapPending())
+            continue;
+
+        double latency = now - reloaded[i].noticed;
+        numSwapped++;
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mStats.averageLatency = (mStats.averageLatency * mStats.reloads + latency) / (mStats.reloads + 1);
+            mStats.reloads++;
+            mStats.lastLatency = latency;
+            mStats.maxLatency = std::max(mStats.maxLatency, latency);
+        }
+        app::console() << "ShaderReloader: reloaded " << shader->getSourcePath() << " in "
+            << (int)(latency * 1000) << " ms" << std::endl;
+    }
+    return numSwapped;
+}
+
+ShaderReloader::Stats ShaderReloader::getStats() const
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mStats;
+}
+
+} } // namespace cinder::dx11
@@ -0,0 +1,185 @@
+#include "dx11/Skinning.h"
+#include "dx11/WorkerPool.h"
+#include "dx11/dx11.h"
+
+#include <cstring>
+#include <xmmintrin.h>
+#include <boost/bind.hpp>
+
+namespace cinder { namespace dx11 {
+
+namespace
+{
+    const size_t kGrainSize = 1024;
+
+    inline __m128 load3( const uint8_t* p )
+    {
+        const float* f = reinterpret_cast<const float*>(p);
+        return _mm_setr_ps(f[0], f[1], f[2], 0);
+    }
+
+    inline void store3( __m128 v, uint8_t* p )
+    {
+        float* f = reinterpret_cast<float*>(p);
+        _mm_storel_pi(reinterpret_cast<__m64*>(f), v);
+        _mm_store_ss(f + 2, _mm_movehl_ps(v, v));
+    }
+
+    // v.x * r0 + v.y * r1 + v.z * r2, a row vector times the upper 3x3 of a D3DX-layout matrix
+    inline __m128 transform3( __m128 v, __m128 r0, __m128 r1, __m128 r2 )
+    {
+        __m128 x = _mm_shuffle_ps(v, v, _MM_SHUFFLE(0, 0, 0, 0));
+        __m128 y = _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 1, 1, 1));
+        __m128 z = _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 2, 2, 2));
+        return _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, r0), _mm_mul_ps(y, r1)), _mm_mul_ps(z, r2));
+    }
+
+    inline __m128 normalize3( __m128 v )
+    {
+        __m128 sq = _mm_mul_ps(v, v);
+        __m128 lengthSq = _mm_add_ss(_mm_add_ss(sq, _mm_shuffle_ps(sq, sq, _MM_SHUFFLE(1, 1, 1, 1))),
+            _mm_movehl_ps(sq, sq));
+        if (_mm_cvtss_f32(lengthSq) <= 0)
+            return v;
+        __m128 length = _mm_sqrt_ss(lengthSq);
+        return _mm_div_ps(v, _mm_shuffle_ps(length, length, _MM_SHUFFLE(0, 0, 0, 0)));
+    }
+
+    void readWeights( const uint8_t* p, DXGI_FORMAT format, float* weights )
+    {
+        if (format == DXGI_FORMAT_R8G8B8A8_UNORM)
+        {
+            for (int i=0;i<4;i++)
+                weights[i] = p[i] * (1.0f / 255.0f);
+        }
+        else
+        {
+            const float* f = reinterpret_cast<const float*>(p);
+            weights[0] = f[0];
+            weights[1] = f[1];
+            weights[2] = f[2];
+            weights[3] = format == DXGI_FORMAT_R32G32B32_FLOAT ? 1.0f - f[0] - f[1] - f[2] : f[3];
+        }
+    }
+
+    // Skins a range of vertices with a blended matrix per vertex, SSE across the four matrix columns
+    struct SkinJob
+    {
+        const Skinner::Format*  format;
+        const uint8_t*          source;
+        uint8_t*                dest;
+        const float*            palette;
+        size_t                  paletteSize;
+
+        void skinRange( size_t begin, size_t end ) const
+        {
+            size_t stride = format->stride;
+            if (dest != source)
+                memcpy(dest + begin * stride, source + begin * stride, (end - begin) * stride);
+
+            for (size_t v=begin;v<end;v++)
+            {
+                const uint8_t* in = source + v * stride;
+                uint8_t* out = dest + v * stride;
+
+                float weights[4];
+                readWeights(in + format->weights, format->weightFormat, weights);
+                const uint8_t* indices = in + format->indices;
+
+                __m128 r0 = _mm_setzero_ps(), r1 = r0, r2 = r0, r3 = r0;
+                for (int i=0;i<4;i++)
+                {
+                    if (weights[i] == 0)
+                        continue;
+                    // out of range indices fall back to the first matrix instead of reading past the palette
+                    size_t index = indices[i] < paletteSize ? indices[i] : 0;
+                    const float* m = palette + index * 16;
+                    __m128 w = _mm_set1_ps(weights[i]);
+                    r0 = _mm_add_ps(r0, _mm_mul_ps(w, _mm_loadu_ps(m)));
+                    r1 = _mm_add_ps(r1, _mm_mul_ps(w, _mm_loadu_ps(m + 4)));
+                    r2 = _mm_add_ps(r2, _mm_mul_ps(w, _mm_loadu_ps(m + 8)));
+                    r3 = _mm_add_ps(r3, _mm_mul_ps(w, _mm_loadu_ps(m + 12)));
+                }
+
+                store3(_mm_add_ps(transform3(load3(in + format->position), r0, r1, r2), r3), out + format->position);
+                if (format->normal >= 0)
+                    store3(normalize3(transform3(load3(in + format->normal), r0, r1, r2)), out + format->normal);
+                if (format->tangent >= 0)
+                    store3(normalize3(transform3(load3(in + format->tangent), r0, r1, r2)), out + format->tangent);
+            }
+        }
+    };
+}
+
+HRESULT Skinner::Format::fromElements( const D3D11_INPUT_ELEMENT_DESC* elements, size_t numElements, UINT stride,
+    Format* format, UINT slot )
+{
+    *format = Format();
+    format->stride = stride;
+    for (size_t i=0;i<numElements;i++)
+    {
+        const D3D11_INPUT_ELEMENT_DESC& element = elements[i];
+        if (element.InputSlot != slot || element.SemanticIndex != 0)
+            continue;
+
+        int offset = (int)element.AlignedByteOffset;
+        bool isFloat3 = element.Format == DXGI_FORMAT_R32G32B32_FLOAT;
+        if (strcmp(element.SemanticName, "POSITION") == 0 && isFloat3)
+            format->position = offset;
+        else if (strcmp(element.SemanticName, "NORMAL") == 0 && isFloat3)
+            format->normal = offset;
+        else if (strcmp(element.SemanticName, "TANGENT") == 0 && isFloat3)
+            format->tangent = offset;
+        else if (strcmp(element.SemanticName, "BLENDWEIGHT") == 0 && (isFloat3 ||
+            element.Format == DXGI_FORMAT_R32G32B32A32_FLOAT || element.Format == DXGI_FORMAT_R8G8B8A8_UNORM))
+        {
+            format->weights = offset;
+            format->weightFormat = element.Format;
+        }
+        else if (strcmp(element.SemanticName, "BLENDINDICES") == 0 && (element.Format == DXGI_FORMAT_R8G8B8A8_UINT ||
+            element.Format == DXGI_FORMAT_R8G8B8A8_UNORM))
+            format->indices = offset;
+        else if (strcmp(element.SemanticName, "POSITION") == 0 || strcmp(element.SemanticName, "NORMAL") == 0 ||
+            strcmp(element.SemanticName, "TANGENT") == 0 || strcmp(element.SemanticName, "BLENDWEIGHT") == 0 ||
+            strcmp(element.SemanticName, "BLENDINDICES") == 0)
+            return E_INVALIDARG;
+    }
+
+    if (format->position < 0 || format->weights < 0 || format->indices < 0)
+        return E_INVALIDARG;
+    return S_OK;
+}
+
+void Skinner::skin( const Format& format, const void* source, void* dest, size_t numVertices,
+    const Matrix44f* palette, size_t paletteSize )
+{
+    // without a palette there's nothing to move, but dest may be a freshly discarded buffer that gets drawn
+    if (paletteSize == 0)
+    {
+        if (dest != source)
+            memcpy(dest, source, numVertices * format.stride);
+        return;
+    }
+
+    SkinJob job;
+    job.format = &format;
+    job.source = static_cast<const uint8_t*>(source);
+    job.dest = static_cast<uint8_t*>(dest);
+    job.palette = palette[0].m;
+    job.paletteSize = paletteSize;
+    parallelFor(numVertices, kGrainSize, boost::bind(&SkinJob::skinRange, &job, _1, _2));
+}
+
+HRESULT Skinner::skin( const Format& format, const void* source, ID3D11Buffer* buffer, size_t numVertices,
+    const Matrix44f* palette, size_t paletteSize )
+{
+    HRESULT hr = S_OK;
+    ID3D11DeviceContext* context = getImmediateContext();
+    D3D11_MAPPED_SUBRESOURCE mapped;
+    V_RETURN(context->Map(buffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped));
+    skin(format, source, mapped.pData, numVertices, palette, paletteSize);
+    context->Unmap(buffer, 0);
+    return S_OK;
+}
+
+} } // namespace cinder::dx11
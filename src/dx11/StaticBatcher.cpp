@@ -0,0 +1,331 @@
+#include "dx11/StaticBatcher.h"
+#include "dx11/Vbo.h"
+#include "dx11/VertexTypes.h"
+#include "dx11/WorkerPool.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <xmmintrin.h>
+#include <boost/bind.hpp>
+
+namespace cinder { namespace dx11 {
+
+namespace
+{
+    bool isFloatVector(DXGI_FORMAT format)
+    {
+        return format == DXGI_FORMAT_R32G32B32_FLOAT || format == DXGI_FORMAT_R32G32B32A32_FLOAT;
+    }
+
+    void store3(float* p, __m128 v)
+    {
+        _mm_storel_pi(reinterpret_cast<__m64*>(p), v);
+        _mm_store_ss(p + 2, _mm_movehl_ps(v, v));
+    }
+
+    // columns[0..2] * xyz, plus columns[3] when given
+    __m128 transform3(const float* p, const __m128* columns, bool point)
+    {
+        __m128 r = _mm_add_ps(_mm_mul_ps(columns[0], _mm_set1_ps(p[0])), _mm_mul_ps(columns[1], _mm_set1_ps(p[1])));
+        r = _mm_add_ps(r, _mm_mul_ps(columns[2], _mm_set1_ps(p[2])));
+        return point ? _mm_add_ps(r, columns[3]) : r;
+    }
+
+    void storeNormalized3(float* p, __m128 v)
+    {
+        float lengths[4];
+        _mm_storeu_ps(lengths, _mm_mul_ps(v, v));
+        float length = std::sqrt(lengths[0] + lengths[1] + lengths[2]);
+        store3(p, length > 0 ? _mm_div_ps(v, _mm_set1_ps(length)) : v);
+    }
+}
+
+bool StaticBatcher::InstanceLess::operator()( const Instance& a, const Instance& b ) const
+{
+    if (a.materialKey != b.materialKey)
+        return a.materialKey < b.materialKey;
+    for (int i=0;i<3;i++)
+    {
+        if (a.cell[i] != b.cell[i])
+            return a.cell[i] < b.cell[i];
+    }
+    return a.source < b.source;
+}
+
+StaticBatcher::StaticBatcher( const D3D11_INPUT_ELEMENT_DESC* pElementDescs, UINT NumElements, UINT VertexStride )
+:mVertexStride(VertexStride)
+{
+    UINT offset = 0;
+    for (UINT i=0;i<NumElements;i++)
+    {
+        D3D11_INPUT_ELEMENT_DESC desc = pElementDescs[i];
+        if (desc.AlignedByteOffset == D3D11_APPEND_ALIGNED_ELEMENT)
+            desc.AlignedByteOffset = offset;
+        offset = desc.AlignedByteOffset + getFormatSize(desc.Format);
+        mElements.push_back(desc);
+
+        if (!isFloatVector(desc.Format))
+            continue;
+
+        if (strcmp(desc.SemanticName, "POSITION") == 0)
+            mPointOffsets.push_back(desc.AlignedByteOffset);
+        else if (strcmp(desc.SemanticName, "NORMAL") == 0)
+            mNormalOffsets.push_back(desc.AlignedByteOffset);
+        else if (strcmp(desc.SemanticName, "TANGENT") == 0 || strcmp(desc.SemanticName, "BINORMAL") == 0)
+        {
+            mVectorOffsets.push_back(desc.AlignedByteOffset);
+            mVectorHasW.push_back(desc.Format == DXGI_FORMAT_R32G32B32A32_FLOAT);
+        }
+    }
+}
+
+size_t StaticBatcher::addSource( const void* pVertices, size_t numVertices, const uint32_t* pIndices, size_t numIndices )
+{
+    std::shared_ptr<Source> source(new Source);
+    const uint8_t* bytes = static_cast<const uint8_t*>(pVertices);
+    source->vertices.assign(bytes, bytes + numVertices * mVertexStride);
+    source->indices.assign(pIndices, pIndices + numIndices);
+    source->numVertices = numVertices;
+
+    Vec3f minP(FLT_MAX, FLT_MAX, FLT_MAX);
+    Vec3f maxP(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+    if (!mPointOffsets.empty())
+    {
+        for (size_t i=0;i<numVertices;i++)
+        {
+            const float* p = reinterpret_cast<const float*>(bytes + i * mVertexStride + mPointOffsets[0]);
+            minP.set(std::min(minP.x, p[0]), std::min(minP.y, p[1]), std::min(minP.z, p[2]));
+            maxP.set(std::max(maxP.x, p[0]), std::max(maxP.y, p[1]), std::max(maxP.z, p[2]));
+        }
+    }
+    if (minP.x > maxP.x)
+        minP = maxP = Vec3f::zero();
+    source->bounds = AxisAlignedBox3f(minP, maxP);
+
+    mSources.push_back(source);
+    return mSources.size() - 1;
+}
+
+HRESULT StaticBatcher::addSource( const VboMesh& vbo, size_t* pSourceId )
+{
+    // only the per-vertex elements have to match, instance streams are not baked
+    std::vector<D3D11_INPUT_ELEMENT_DESC> elements;
+    for (size_t i=0;i<vbo.getInputElementDescs().size();i++)
+    {
+        if (vbo.getInputElementDescs()[i].InputSlotClass == D3D11_INPUT_PER_VERTEX_DATA)
+            elements.push_back(vbo.getInputElementDescs()[i]);
+    }
+
+    if (vbo.getVertexStride() != mVertexStride || elements.size() != mElements.size())
+        return E_INVALIDARG;
+    for (size_t i=0;i<elements.size();i++)
+    {
+        if (strcmp(elements[i].SemanticName, mElements[i].SemanticName) != 0 || elements[i].SemanticIndex != mElements[i].SemanticIndex
+            || elements[i].Format != mElements[i].Format || elements[i].AlignedByteOffset != mElements[i].AlignedByteOffset)
+            return E_INVALIDARG;
+    }
+
+    std::vector<uint8_t> vertices;
+    std::vector<uint32_t> indices;
+    HRESULT hr = vbo.readBack(&vertices, &indices);
+    if (FAILED(hr))
+        return hr;
+
+    // non-indexed meshes get a trivial index list
+    if (indices.empty())
+    {
+        indices.resize(vbo.getNumVertices());
+        for (size_t i=0;i<indices.size();i++)
+            indices[i] = static_cast<uint32_t>(i);
+    }
+
+    *pSourceId = addSource(&vertices[0], vbo.getNumVertices(), &indices[0], indices.size());
+    return S_OK;
+}
+
+void StaticBatcher::addInstance( size_t sourceId, const Matrix44f& world, uint32_t materialKey )
+{
+    assert(sourceId < mSources.size());
+
+    Instance instance;
+    instance.source = sourceId;
+    instance.world = world;
+    instance.materialKey = materialKey;
+    instance.baseVertex = 0;
+    instance.baseIndex = 0;
+
+    // world bounds from the transformed center and the absolute extents
+    const AxisAlignedBox3f& bounds = mSources[sourceId]->bounds;
+    Vec3f center = (bounds.getMin() + bounds.getMax()) * 0.5f;
+    Vec3f extent = (bounds.getMax() - bounds.getMin()) * 0.5f;
+    Vec3f worldCenter, worldExtent;
+    for (int r=0;r<3;r++)
+    {
+        worldCenter[r] = world.at(r, 0) * center.x + world.at(r, 1) * center.y + world.at(r, 2) * center.z + world.at(r, 3);
+        worldExtent[r] = std::abs(world.at(r, 0)) * extent.x + std::abs(world.at(r, 1)) * extent.y + std::abs(world.at(r, 2)) * extent.z;
+    }
+    instance.boundsMin = worldCenter - worldExtent;
+    instance.boundsMax = worldCenter + worldExtent;
+
+    mInstances.push_back(instance);
+}
+
+StaticBatcher::Result StaticBatcher::build( float cellSize ) const
+{
+    Result result;
+    if (mInstances.empty())
+        return result;
+
+    std::vector<Instance> instances(mInstances);
+    for (size_t i=0;i<instances.size();i++)
+    {
+        Instance& instance = instances[i];
+        Vec3f center = (instance.boundsMin + instance.boundsMax) * 0.5f;
+        for (int k=0;k<3;k++)
+            instance.cell[k] = cellSize > 0 ? static_cast<int>(std::floor(center[k] / cellSize)) : 0;
+    }
+    std::sort(instances.begin(), instances.end(), InstanceLess());
+
+    size_t numVertices = 0;
+    size_t numIndices = 0;
+    for (size_t i=0;i<instances.size();i++)
+    {
+        Instance& instance = instances[i];
+        const Source& source = *mSources[instance.source];
+        instance.baseVertex = numVertices;
+        instance.baseIndex = numIndices;
+        numVertices += source.numVertices;
+        numIndices += source.indices.size();
+    }
+
+    result.numVertices = numVertices;
+    result.vertices.resize(numVertices * mVertexStride);
+    result.indices.resize(numIndices);
+    parallelFor(instances.size(), 16, boost::bind(&StaticBatcher::bakeRange, this, &result, &instances, _1, _2));
+
+    // instances are sorted, so every material / cell group is one contiguous range
+    for (size_t i=0;i<instances.size();)
+    {
+        const Instance& first = instances[i];
+        Range range;
+        range.materialKey = first.materialKey;
+        range.startIndex = first.baseIndex;
+        range.indexCount = 0;
+        range.numInstances = 0;
+
+        Vec3f minP = first.boundsMin;
+        Vec3f maxP = first.boundsMax;
+        for (;i<instances.size();i++)
+        {
+            const Instance& instance = instances[i];
+            if (instance.materialKey != first.materialKey || instance.cell[0] != first.cell[0]
+                || instance.cell[1] != first.cell[1] || instance.cell[2] != first.cell[2])
+                break;
+
+            range.indexCount += mSources[instance.source]->indices.size();
+            range.numInstances++;
+            minP.set(std::min(minP.x, instance.boundsMin.x), std::min(minP.y, instance.boundsMin.y), std::min(minP.z, instance.boundsMin.z));
+            maxP.set(std::max(maxP.x, instance.boundsMax.x), std::max(maxP.y, instance.boundsMax.y), std::max(maxP.z, instance.boundsMax.z));
+        }
+        range.bounds = AxisAlignedBox3f(minP, maxP);
+        result.ranges.push_back(range);
+    }
+
+    return result;
+}
+
+void StaticBatcher::bakeRange( Result* result, const std::vector<Instance>* instances, size_t begin, size_t end ) const
+{
+    for (size_t i=begin;i<end;i++)
+        bakeInstance(result, (*instances)[i]);
+}
+
+void StaticBatcher::bakeInstance( Result* result, const Instance& instance ) const
+{
+    const Source& source = *mSources[instance.source];
+    const Matrix44f& world = instance.world;
+
+    __m128 columns[4];
+    for (int c=0;c<4;c++)
+        columns[c] = _mm_setr_ps(world.at(0, c), world.at(1, c), world.at(2, c), 0);
+
+    // normals take the inverse transpose of the upper 3x3, the cofactor matrix up to a scale that normalizing removes
+    float a[3][3];
+    for (int r=0;r<3;r++)
+        for (int c=0;c<3;c++)
+            a[r][c] = world.at(r, c);
+
+    float cofactor[3][3];
+    for (int r=0;r<3;r++)
+    {
+        for (int c=0;c<3;c++)
+        {
+            int r0 = (r + 1) % 3, r1 = (r + 2) % 3;
+            int c0 = (c + 1) % 3, c1 = (c + 2) % 3;
+            cofactor[r][c] = a[r0][c0] * a[r1][c1] - a[r0][c1] * a[r1][c0];
+        }
+    }
+    float det = a[0][0] * cofactor[0][0] + a[0][1] * cofactor[0][1] + a[0][2] * cofactor[0][2];
+    float sign = det < 0 ? -1.0f : 1.0f;
+
+    __m128 normalColumns[3];
+    for (int c=0;c<3;c++)
+        normalColumns[c] = _mm_mul_ps(_mm_setr_ps(cofactor[0][c], cofactor[1][c], cofactor[2][c], 0), _mm_set1_ps(sign));
+
+    uint8_t* vertices = &result->vertices[instance.baseVertex * mVertexStride];
+    if (source.numVertices > 0)
+        memcpy(vertices, &source.vertices[0], source.numVertices * mVertexStride);
+
+    for (size_t v=0;v<source.numVertices;v++)
+    {
+        uint8_t* vertex = vertices + v * mVertexStride;
+        for (size_t k=0;k<mPointOffsets.size();k++)
+        {
+            float* p = reinterpret_cast<float*>(vertex + mPointOffsets[k]);
+            store3(p, transform3(p, columns, true));
+        }
+        for (size_t k=0;k<mNormalOffsets.size();k++)
+        {
+            float* n = reinterpret_cast<float*>(vertex + mNormalOffsets[k]);
+            storeNormalized3(n, transform3(n, normalColumns, false));
+        }
+        for (size_t k=0;k<mVectorOffsets.size();k++)
+        {
+            float* t = reinterpret_cast<float*>(vertex + mVectorOffsets[k]);
+            storeNormalized3(t, transform3(t, columns, false));
+            if (mVectorHasW[k])
+                t[3] *= sign;
+        }
+    }
+
+    // a mirroring transform turns the winding around
+    uint32_t* indices = &result->indices[instance.baseIndex];
+    uint32_t baseVertex = static_cast<uint32_t>(instance.baseVertex);
+    for (size_t i=0;i+2<source.indices.size();i+=3)
+    {
+        indices[i] = source.indices[i] + baseVertex;
+        indices[i + 1] = source.indices[det < 0 ? i + 2 : i + 1] + baseVertex;
+        indices[i + 2] = source.indices[det < 0 ? i + 1 : i + 2] + baseVertex;
+    }
+}
+
+HRESULT StaticBatcher::createVboMesh( const Result& result, VboMesh* vbo ) const
+{
+    if (result.numVertices == 0 || result.indices.empty())
+        return E_INVALIDARG;
+
+    HRESULT hr = vbo->createVertexBuffer(&result.vertices[0], result.numVertices, &mElements[0], mElements.size(), mVertexStride);
+    if (FAILED(hr))
+        return hr;
+
+    if (result.numVertices <= 0xFFFF)
+    {
+        std::vector<uint16_t> indices(result.indices.begin(), result.indices.end());
+        return vbo->createIndexBuffer(&indices[0], indices.size());
+    }
+    return vbo->createIndexBuffer(&result.indices[0], result.indices.size());
+}
+
+} } // namespace cinder::dx11
@@ -4,10 +4,51 @@
 #include "dx11/VertexTypes.h"
 #include "dx11/SdkMesh.h"
 #include "dx11/Shader.h"
+#include "dx11/MeshCache.h"
+#include "dx11/InputLayoutCache.h"
+#include "dx11/MeshAdjacency.h"
+#include "dx11/MeshNormals.h"
 
 namespace cinder { namespace dx11 {
 
-static std::vector<Vec4f> computeTangent(const TriMesh &triMesh)
+static HRESULT readBuffer(ID3D11Buffer* buffer, std::vector<uint8_t>& bytes)
+{
+    HRESULT hr = S_OK;
+
+    D3D11_BUFFER_DESC desc;
+    buffer->GetDesc(&desc);
+    CD3D11_BUFFER_DESC stagingDesc(desc.ByteWidth, 0, D3D11_USAGE_STAGING, D3D11_CPU_ACCESS_READ);
+    CComPtr<ID3D11Buffer> staging;
+    V_RETURN(dx11::getDevice()->CreateBuffer( &stagingDesc, NULL, &staging ));
+
+    dx11::getImmediateContext()->CopyResource(staging, buffer);
+    D3D11_MAPPED_SUBRESOURCE mapped;
+    V_RETURN(dx11::getImmediateContext()->Map(staging, 0, D3D11_MAP_READ, 0, &mapped));
+    bytes.assign(static_cast<const uint8_t*>(mapped.pData), static_cast<const uint8_t*>(mapped.pData) + desc.ByteWidth);
+    dx11::getImmediateContext()->Unmap(staging, 0);
+    return S_OK;
+}
+
+// widens the first \a count indices of an R16 or R32 index buffer
+static HRESULT readIndices(ID3D11Buffer* buffer, DXGI_FORMAT format, size_t count, std::vector<uint32_t>& indices)
+{
+    HRESULT hr = S_OK;
+
+    std::vector<uint8_t> bytes;
+    V_RETURN(readBuffer(buffer, bytes));
+
+    indices.resize(count);
+    for (size_t i=0;i<count;i++)
+    {
+        if (format == DXGI_FORMAT_R16_UINT)
+            indices[i] = reinterpret_cast<const uint16_t*>(&bytes[0])[i];
+        else
+            indices[i] = reinterpret_cast<const uint32_t*>(&bytes[0])[i];
+    }
+    return S_OK;
+}
+
+static std::vector<Vec4f> computeTangent(const TriMesh &triMesh, const std::vector<Vec3f>& normals)
 {
     size_t NumVertices = triMesh.getNumVertices();
     const std::vector<Vec3f>& positions = triMesh.getVertices();
@@ -57,7 +98,7 @@ static std::vector<Vec4f> computeTangent(const TriMesh &triMesh)
     std::vector<Vec4f> tangents(NumVertices);
     for (size_t a = 0; a < NumVertices; a++)
     {
-        const Vec3f& n = triMesh.getNormals()[a];
+        const Vec3f& n = normals[a];
         const Vec3f& t = TSum[a];
         // Gram-Schmidt orthogonalize.
         tangents[a] = (t - n * n.dot(t)).normalized();
@@ -67,10 +108,20 @@ static std::vector<Vec4f> computeTangent(const TriMesh &triMesh)
     return tangents;
 }
 
-VboMesh::VboMesh( const TriMesh &triMesh, bool normalMap, bool flipOrder ):
+VboMesh::VboMesh( const TriMesh &triMesh, bool normalMap, bool flipOrder, bool splitPositions ):
 mObj( std::shared_ptr<Obj>( new Obj ) )
 {
-    bool N = triMesh.hasNormals();
+    // normal maps need normals and bare positions have no layout of their own, those get smooth normals generated
+    bool needsNormals = normalMap || !(triMesh.hasColorsRGB() || triMesh.hasColorsRGBA() || triMesh.hasTexCoords());
+    std::vector<Vec3f> generatedNormals;
+    if (!triMesh.hasNormals() && needsNormals && triMesh.getNumIndices() > 0)
+    {
+        generatedNormals = NormalGenerator::build(&triMesh.getVertices()[0], triMesh.getNumVertices(),
+            &triMesh.getIndices()[0], triMesh.getNumIndices()).normals;
+    }
+    const std::vector<Vec3f>& normals = triMesh.hasNormals() ? triMesh.getNormals() : generatedNormals;
+
+    bool N = !normals.empty();
     bool C = triMesh.hasColorsRGB();
     bool Ca = triMesh.hasColorsRGBA();
     bool T = triMesh.hasTexCoords();
@@ -80,16 +131,16 @@ mObj( std::shared_ptr<Obj>( new Obj ) )
     if (normalMap)
     {//
         assert (N && T);
-        std::vector<Vec4f> tangents = computeTangent(triMesh);
+        std::vector<Vec4f> tangents = computeTangent(triMesh, normals);
         std::vector<VertexNMap> vertices(mObj->mNumVertices);
         for (size_t i=0;i<mObj->mNumVertices;i++)
         {
             vertices[i].position = triMesh.getVertices()[i];
-            vertices[i].normal = triMesh.getNormals()[i];
+            vertices[i].normal = normals[i];
             vertices[i].texCoord = triMesh.getTexCoords()[i];
             vertices[i].tangent = tangents[i].xyz();
         }
-        createVertexBuffer<VertexNMap>(&vertices[0], mObj->mNumVertices);
+        createVertexBuffer<VertexNMap>(&vertices[0], mObj->mNumVertices, splitPositions);
     }
     else
     {
@@ -104,7 +155,7 @@ mObj( std::shared_ptr<Obj>( new Obj ) )
                 else
                     vertices[i].color = triMesh.getColorsRGBA()[i];
             }
-            createVertexBuffer<VertexPC>(&vertices[0], mObj->mNumVertices);
+            createVertexBuffer<VertexPC>(&vertices[0], mObj->mNumVertices, splitPositions);
         }
 
         if (N && (C || Ca) && !T)
@@ -113,13 +164,13 @@ mObj( std::shared_ptr<Obj>( new Obj ) )
             for (size_t i=0;i<mObj->mNumVertices;i++)
             {
                 vertices[i].position = triMesh.getVertices()[i];
-                vertices[i].normal = triMesh.getNormals()[i];
+                vertices[i].normal = normals[i];
                 if (C)
                     vertices[i].color = triMesh.getColorsRGB()[i];
                 else
                     vertices[i].color = triMesh.getColorsRGBA()[i];
             }
-            createVertexBuffer<VertexPNC>(&vertices[0], mObj->mNumVertices);
+            createVertexBuffer<VertexPNC>(&vertices[0], mObj->mNumVertices, splitPositions);
         }
 
         if (N && !(C || Ca) && T)
@@ -128,10 +179,10 @@ mObj( std::shared_ptr<Obj>( new Obj ) )
             for (size_t i=0;i<mObj->mNumVertices;i++)
             {
                 vertices[i].position = triMesh.getVertices()[i];
-                vertices[i].normal = triMesh.getNormals()[i];
+                vertices[i].normal = normals[i];
                 vertices[i].texCoord = triMesh.getTexCoords()[i];
             }
-            createVertexBuffer<VertexPNT>(&vertices[0], mObj->mNumVertices);
+            createVertexBuffer<VertexPNT>(&vertices[0], mObj->mNumVertices, splitPositions);
         }
 
         if (N && (C || Ca) && T)
@@ -140,17 +191,28 @@ mObj( std::shared_ptr<Obj>( new Obj ) )
             for (size_t i=0;i<mObj->mNumVertices;i++)
             {
                 vertices[i].position = triMesh.getVertices()[i];
-                vertices[i].normal = triMesh.getNormals()[i];
+                vertices[i].normal = normals[i];
                 if (C)
                     vertices[i].color = triMesh.getColorsRGB()[i];
                 else
                     vertices[i].color = triMesh.getColorsRGBA()[i];
                 vertices[i].texCoord = triMesh.getTexCoords()[i];
             }
-            createVertexBuffer<VertexPNCT>(&vertices[0], mObj->mNumVertices);
+            createVertexBuffer<VertexPNCT>(&vertices[0], mObj->mNumVertices, splitPositions);
         }
 
-        if (N && !(C || Ca) && T)
+        if (N && !(C || Ca) && !T)
+        {//PN
+            std::vector<VertexPN> vertices(mObj->mNumVertices);
+            for (size_t i=0;i<mObj->mNumVertices;i++)
+            {
+                vertices[i].position = triMesh.getVertices()[i];
+                vertices[i].normal = normals[i];
+            }
+            createVertexBuffer<VertexPN>(&vertices[0], mObj->mNumVertices, splitPositions);
+        }
+
+        if (!N && !(C || Ca) && T)
         {//PT
             mObj->mNumVertices = triMesh.getNumVertices();
             std::vector<VertexPT> vertices(mObj->mNumVertices);
@@ -159,7 +221,7 @@ mObj( std::shared_ptr<Obj>( new Obj ) )
                 vertices[i].position = triMesh.getVertices()[i];
                 vertices[i].texCoord = triMesh.getTexCoords()[i];
             }
-            createVertexBuffer<VertexPT>(&vertices[0], mObj->mNumVertices);
+            createVertexBuffer<VertexPT>(&vertices[0], mObj->mNumVertices, splitPositions);
         }
     }
 
@@ -190,27 +252,386 @@ void VboMesh::bind( D3D_PRIMITIVE_TOPOLOGY Topology /*= D3D11_PRIMITIVE_TOPOLOGY
     dx11::getImmediateContext()->IASetInputLayout(mObj->mInputLayout);
     dx11::getImmediateContext()->IASetPrimitiveTopology( Topology );
 
-    UINT stride = mObj->mVertexStride;
+    // slot 0 positions (or whole vertices), slot 1 the other attributes if split, then the instances
+    UINT strides[] = {static_cast<UINT>(mObj->mVertexStride), static_cast<UINT>(mObj->mAttributeStride), static_cast<UINT>(mObj->mInstanceStride)};
+    UINT offsets[] = {0, 0, 0};
+    ID3D11Buffer* vextexBuffers[] = {mObj->mVertexBuffer, mObj->mAttributeBuffer, mObj->mInstanceBuffer};
+    UINT numBuffers = mObj->mInstanceBuffer ? mObj->mInstanceSlot + 1 : (mObj->mAttributeBuffer ? 2 : 1);
+    if (mObj->mInstanceBuffer && mObj->mInstanceSlot == 1)
+    {
+        vextexBuffers[1] = mObj->mInstanceBuffer;
+        strides[1] = static_cast<UINT>(mObj->mInstanceStride);
+    }
+    dx11::getImmediateContext()->IASetVertexBuffers( 0, numBuffers, vextexBuffers, strides, offsets );
+    dx11::getImmediateContext()->IASetIndexBuffer(mObj->mIndexBuffer, mObj->mIBFormat, 0 );
+}
+
+void VboMesh::bindDepthOnly( D3D_PRIMITIVE_TOPOLOGY Topology /*= D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST*/ ) const
+{
+    dx11::getImmediateContext()->IASetInputLayout(mObj->mDepthInputLayout);
+    dx11::getImmediateContext()->IASetPrimitiveTopology( Topology );
+
+    UINT stride = static_cast<UINT>(mObj->mVertexStride);
     UINT offset = 0;
     ID3D11Buffer* vextexBuffers[] = {mObj->mVertexBuffer};
-    dx11::getImmediateContext()->IASetVertexBuffers( 0, _countof(vextexBuffers), vextexBuffers, &stride, &offset );
+    dx11::getImmediateContext()->IASetVertexBuffers( 0, 1, vextexBuffers, &stride, &offset );
+    if (mObj->mInstanceBuffer)
+    {
+        UINT instanceStride = static_cast<UINT>(mObj->mInstanceStride);
+        ID3D11Buffer* instanceBuffers[] = {mObj->mInstanceBuffer};
+        dx11::getImmediateContext()->IASetVertexBuffers( mObj->mInstanceSlot, 1, instanceBuffers, &instanceStride, &offset );
+    }
     dx11::getImmediateContext()->IASetIndexBuffer(mObj->mIndexBuffer, mObj->mIBFormat, 0 );
 }
 
-HRESULT VboMesh::createVertexBuffer( const void* pVertices, UINT nVertices, const D3D11_INPUT_ELEMENT_DESC* pElementDescs, UINT NumInputElements, UINT VertexStride)
+void VboMesh::bindAdjacency() const
+{
+    bind(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST_ADJ);
+    dx11::getImmediateContext()->IASetIndexBuffer(mObj->mAdjacencyIndexBuffer, mObj->mAdjacencyIBFormat, 0 );
+}
+
+HRESULT VboMesh::createVertexBuffer( const void* pVertices, UINT nVertices, const D3D11_INPUT_ELEMENT_DESC* pElementDescs, UINT NumInputElements, UINT VertexStride, bool splitPositions)
 {
     mObj = std::shared_ptr<Obj>( new Obj );
 
     mObj->mNumVertices = nVertices;
+
+    // resolve D3D11_APPEND_ALIGNED_ELEMENT so the offsets can be moved to another slot
+    UINT offset = 0;
     for (size_t i=0;i<NumInputElements;i++)
-        mObj->InputElementDescs.push_back(pElementDescs[i]);
+    {
+        D3D11_INPUT_ELEMENT_DESC desc = pElementDescs[i];
+        if (desc.AlignedByteOffset == D3D11_APPEND_ALIGNED_ELEMENT)
+            desc.AlignedByteOffset = offset;
+        offset = desc.AlignedByteOffset + getFormatSize(desc.Format);
+        mObj->InputElementDescs.push_back(desc);
+    }
+
+    const D3D11_INPUT_ELEMENT_DESC& first = mObj->InputElementDescs[0];
+    UINT positionSize = getFormatSize(first.Format);
 
-    mObj->mVertexStride = VertexStride;
-    CD3D11_BUFFER_DESC bd(mObj->mVertexStride*nVertices, D3D11_BIND_VERTEX_BUFFER);
+    if (strcmp(first.SemanticName, "POSITION") == 0 && first.Format == DXGI_FORMAT_R32G32B32_FLOAT && nVertices > 0)
+    {
+        const uint8_t* src = static_cast<const uint8_t*>(pVertices) + first.AlignedByteOffset;
+        Vec3f minP = *reinterpret_cast<const Vec3f*>(src);
+        Vec3f maxP = minP;
+        for (size_t i=1;i<nVertices;i++)
+        {
+            const Vec3f& p = *reinterpret_cast<const Vec3f*>(src + i*VertexStride);
+            minP.set(math<float>::min(minP.x, p.x), math<float>::min(minP.y, p.y), math<float>::min(minP.z, p.z));
+            maxP.set(math<float>::max(maxP.x, p.x), math<float>::max(maxP.y, p.y), math<float>::max(maxP.z, p.z));
+        }
+        mObj->mBounds = AxisAlignedBox3f(minP, maxP);
+    }
+    splitPositions = splitPositions && NumInputElements > 1 && strcmp(first.SemanticName, "POSITION") == 0 && first.AlignedByteOffset == 0;
+    for (size_t i=1;i<NumInputElements && splitPositions;i++)
+        splitPositions = mObj->InputElementDescs[i].AlignedByteOffset >= positionSize;
+
+    if (!splitPositions)
+    {
+        mObj->mVertexStride = VertexStride;
+        CD3D11_BUFFER_DESC bd(mObj->mVertexStride*nVertices, D3D11_BIND_VERTEX_BUFFER);
+
+        D3D11_SUBRESOURCE_DATA InitData = {0};
+        InitData.pSysMem = pVertices;
+        return dx11::getDevice()->CreateBuffer( &bd, &InitData, &mObj->mVertexBuffer );
+    }
+
+    mObj->mVertexStride = positionSize;
+    mObj->mAttributeStride = VertexStride - positionSize;
+    for (size_t i=1;i<NumInputElements;i++)
+    {
+        mObj->InputElementDescs[i].InputSlot = 1;
+        mObj->InputElementDescs[i].AlignedByteOffset -= positionSize;
+    }
 
+    std::vector<uint8_t> positions(mObj->mVertexStride*nVertices);
+    std::vector<uint8_t> attributes(mObj->mAttributeStride*nVertices);
+    const uint8_t* src = static_cast<const uint8_t*>(pVertices);
+    for (size_t i=0;i<nVertices;i++)
+    {
+        memcpy(&positions[i*mObj->mVertexStride], src + i*VertexStride, mObj->mVertexStride);
+        memcpy(&attributes[i*mObj->mAttributeStride], src + i*VertexStride + positionSize, mObj->mAttributeStride);
+    }
+
+    HRESULT hr = S_OK;
+    CD3D11_BUFFER_DESC bd(positions.size(), D3D11_BIND_VERTEX_BUFFER);
     D3D11_SUBRESOURCE_DATA InitData = {0};
-    InitData.pSysMem = pVertices;
-    return dx11::getDevice()->CreateBuffer( &bd, &InitData, &mObj->mVertexBuffer );
+    InitData.pSysMem = &positions[0];
+    V_RETURN(dx11::getDevice()->CreateBuffer( &bd, &InitData, &mObj->mVertexBuffer ));
+
+    bd.ByteWidth = attributes.size();
+    InitData.pSysMem = &attributes[0];
+    return dx11::getDevice()->CreateBuffer( &bd, &InitData, &mObj->mAttributeBuffer );
+}
+
+HRESULT VboMesh::createInstanceBuffer( const D3D11_INPUT_ELEMENT_DESC* pElementDescs, UINT NumInputElements, UINT InstanceSize, UINT capacity )
+{
+    assert(mObj && "call createVertexBuffer() first");
+
+    mObj->mInstanceSlot = mObj->mAttributeBuffer ? 2 : 1;
+
+    // drop the elements of a previous instance buffer, the layout has to be created again anyway
+    std::vector<D3D11_INPUT_ELEMENT_DESC> descs;
+    for (size_t i=0;i<mObj->InputElementDescs.size();i++)
+    {
+        if (mObj->InputElementDescs[i].InputSlotClass == D3D11_INPUT_PER_VERTEX_DATA)
+            descs.push_back(mObj->InputElementDescs[i]);
+    }
+    for (size_t i=0;i<NumInputElements;i++)
+    {
+        D3D11_INPUT_ELEMENT_DESC desc = pElementDescs[i];
+        desc.InputSlot = mObj->mInstanceSlot;
+        desc.InputSlotClass = D3D11_INPUT_PER_INSTANCE_DATA;
+        desc.InstanceDataStepRate = std::max<UINT>(desc.InstanceDataStepRate, 1);
+        descs.push_back(desc);
+    }
+    mObj->InputElementDescs.swap(descs);
+    mObj->mInputLayout.Release();
+    mObj->mDepthInputLayout.Release();
+    mObj->mInstanceBuffer.Release();
+
+    mObj->mInstanceStride = InstanceSize;
+    mObj->mInstanceCapacity = capacity;
+    CD3D11_BUFFER_DESC bd(InstanceSize*capacity, D3D11_BIND_VERTEX_BUFFER, D3D11_USAGE_DYNAMIC, D3D11_CPU_ACCESS_WRITE);
+    return dx11::getDevice()->CreateBuffer( &bd, NULL, &mObj->mInstanceBuffer );
+}
+
+HRESULT VboMesh::updateInstanceBuffer( const void* pInstances, UINT nInstances ) const
+{
+    if (!mObj->mInstanceBuffer || nInstances > mObj->mInstanceCapacity)
+        return E_INVALIDARG;
+
+    D3D11_MAPPED_SUBRESOURCE mapped;
+    HRESULT hr = dx11::getImmediateContext()->Map(mObj->mInstanceBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped);
+    if (FAILED(hr))
+        return hr;
+
+    memcpy(mapped.pData, pInstances, mObj->mInstanceStride*nInstances);
+    dx11::getImmediateContext()->Unmap(mObj->mInstanceBuffer, 0);
+    return S_OK;
+}
+
+HRESULT VboMesh::writeCache( const std::string& path, bool compress ) const
+{
+    HRESULT hr = S_OK;
+
+    std::vector<uint8_t> streams[2];
+    std::vector<uint8_t> indices;
+    V_RETURN(readBuffer(mObj->mVertexBuffer, streams[0]));
+    if (mObj->mAttributeBuffer)
+        V_RETURN(readBuffer(mObj->mAttributeBuffer, streams[1]));
+    if (mObj->mIndexBuffer)
+        V_RETURN(readBuffer(mObj->mIndexBuffer, indices));
+
+    MeshCacheData data;
+    data.numVertices = mObj->mNumVertices;
+    data.numIndices = mObj->mNumIndices;
+    data.indexFormat = mObj->mIBFormat;
+    data.indexData = indices.empty() ? NULL : &indices[0];
+    data.indexDataSize = indices.size();
+    data.bounds = mObj->mBounds;
+    data.lods = mObj->mLods;
+    data.clusters = mObj->mClusters;
+
+    UINT strides[] = {static_cast<UINT>(mObj->mVertexStride), static_cast<UINT>(mObj->mAttributeStride)};
+    for (size_t i=0;i<_countof(streams) && !streams[i].empty();i++)
+    {
+        MeshCacheData::Stream stream = {&streams[i][0], strides[i]};
+        data.streams.push_back(stream);
+    }
+
+    // instance elements belong to whoever draws the mesh, not to the mesh
+    for (size_t i=0;i<mObj->InputElementDescs.size();i++)
+    {
+        if (mObj->InputElementDescs[i].InputSlotClass == D3D11_INPUT_PER_VERTEX_DATA)
+            data.elements.push_back(mObj->InputElementDescs[i]);
+    }
+
+    return MeshCacheFile::write(path, data, compress);
+}
+
+HRESULT VboMesh::loadCache( const std::string& path )
+{
+    HRESULT hr = S_OK;
+
+    MeshCacheFile file;
+    V_RETURN(file.open(path));
+    const MeshCacheData& data = file.getData();
+
+    mObj = std::shared_ptr<Obj>( new Obj );
+    mObj->mNumVertices = data.numVertices;
+    mObj->InputElementDescs = data.elements;
+    mObj->mBounds = data.bounds;
+    mObj->mLods = data.lods;
+    mObj->mClusters = data.clusters;
+
+    // the device copies the initial data, so the mapping can go away once the buffers exist
+    CComPtr<ID3D11Buffer>* buffers[] = {&mObj->mVertexBuffer, &mObj->mAttributeBuffer};
+    size_t* strides[] = {&mObj->mVertexStride, &mObj->mAttributeStride};
+    for (size_t i=0;i<data.streams.size() && i<_countof(buffers);i++)
+    {
+        *strides[i] = data.streams[i].stride;
+        CD3D11_BUFFER_DESC bd(data.streams[i].stride*data.numVertices, D3D11_BIND_VERTEX_BUFFER);
+        D3D11_SUBRESOURCE_DATA InitData = {0};
+        InitData.pSysMem = data.streams[i].data;
+        V_RETURN(dx11::getDevice()->CreateBuffer( &bd, &InitData, buffers[i] ));
+    }
+
+    if (data.indexDataSize > 0)
+    {
+        CD3D11_BUFFER_DESC bd(data.indexDataSize, D3D11_BIND_INDEX_BUFFER);
+        D3D11_SUBRESOURCE_DATA InitData = {0};
+        InitData.pSysMem = data.indexData;
+        V_RETURN(dx11::getDevice()->CreateBuffer( &bd, &InitData, &mObj->mIndexBuffer ));
+        mObj->mIBFormat = data.indexFormat;
+        mObj->mNumIndices = data.numIndices;
+    }
+
+    return S_OK;
+}
+
+HRESULT VboMesh::readBack( std::vector<uint8_t>* vertices, std::vector<uint32_t>* indices ) const
+{
+    if (mObj->mAttributeBuffer)
+        return E_INVALIDARG;
+
+    HRESULT hr = S_OK;
+    V_RETURN(readBuffer(mObj->mVertexBuffer, *vertices));
+
+    indices->clear();
+    if (mObj->mIndexBuffer)
+        V_RETURN(readIndices(mObj->mIndexBuffer, mObj->mIBFormat, mObj->mNumIndices, *indices));
+    return S_OK;
+}
+
+HRESULT VboMesh::setLodChain( const LodChain& chain )
+{
+    if (chain.levels.empty())
+        return E_INVALIDARG;
+
+    HRESULT hr = S_OK;
+    V_RETURN(uploadIndices(chain.indices));
+
+    mObj->mLods = chain.levels;
+    mObj->mClusters.clear();
+    mObj->mNumIndices = chain.levels[0].indexCount;
+    return hr;
+}
+
+HRESULT VboMesh::setClusters( const ClusterMesh& clusters )
+{
+    if (clusters.clusters.empty())
+        return E_INVALIDARG;
+
+    HRESULT hr = S_OK;
+    V_RETURN(uploadIndices(clusters.indices));
+
+    mObj->mClusters = clusters.clusters;
+    mObj->mLods.clear();
+    return hr;
+}
+
+HRESULT VboMesh::uploadIndices( const std::vector<uint32_t>& indices )
+{
+    if (indices.empty())
+        return E_INVALIDARG;
+
+    // the new buffer comes first, a failed upload leaves the mesh drawing what it drew before
+    HRESULT hr = S_OK;
+    std::vector<uint16_t> shortIndices;
+    D3D11_SUBRESOURCE_DATA InitData = {0};
+    UINT indexSize = sizeof(uint32_t);
+    if (mObj->mNumVertices <= 0xFFFF)
+    {
+        shortIndices.assign(indices.begin(), indices.end());
+        InitData.pSysMem = &shortIndices[0];
+        indexSize = sizeof(uint16_t);
+    }
+    else
+    {
+        InitData.pSysMem = &indices[0];
+    }
+
+    CComPtr<ID3D11Buffer> indexBuffer;
+    CD3D11_BUFFER_DESC bd(static_cast<UINT>(indexSize*indices.size()), D3D11_BIND_INDEX_BUFFER);
+    V_RETURN(dx11::getDevice()->CreateBuffer( &bd, &InitData, &indexBuffer ));
+
+    mObj->mIndexBuffer = indexBuffer;
+    mObj->mNumIndices = indices.size();
+    mObj->mIBFormat = shortIndices.empty() ? IndexBufferTraits<uint32_t>::getDXGIFormat() : IndexBufferTraits<uint16_t>::getDXGIFormat();
+    mObj->mAdjacencyIndexBuffer.Release();
+    mObj->mNumAdjacencyIndices = 0;
+    return hr;
+}
+
+HRESULT VboMesh::createAdjacency()
+{
+    // positions live in slot 0 whether the mesh is split or not
+    const D3D11_INPUT_ELEMENT_DESC* position = NULL;
+    for (size_t i=0;i<mObj->InputElementDescs.size() && position == NULL;i++)
+    {
+        const D3D11_INPUT_ELEMENT_DESC& desc = mObj->InputElementDescs[i];
+        if (strcmp(desc.SemanticName, "POSITION") == 0 && desc.InputSlot == 0
+            && (desc.Format == DXGI_FORMAT_R32G32B32_FLOAT || desc.Format == DXGI_FORMAT_R32G32B32A32_FLOAT))
+            position = &desc;
+    }
+    if (position == NULL || mObj->mNumVertices == 0)
+        return E_INVALIDARG;
+
+    HRESULT hr = S_OK;
+    std::vector<uint8_t> vertices;
+    V_RETURN(readBuffer(mObj->mVertexBuffer, vertices));
+
+    std::vector<uint32_t> indices;
+    if (mObj->mIndexBuffer)
+    {
+        V_RETURN(readIndices(mObj->mIndexBuffer, mObj->mIBFormat, mObj->mNumIndices, indices));
+    }
+    else
+    {
+        indices.resize(mObj->mNumVertices);
+        for (size_t i=0;i<indices.size();i++)
+            indices[i] = i;
+    }
+
+    std::vector<uint32_t> adjacency;
+    buildAdjacencyIndices(adjacency, &indices[0], indices.size(), &vertices[position->AlignedByteOffset], mObj->mNumVertices, mObj->mVertexStride);
+    if (adjacency.empty())
+        return E_INVALIDARG;
+
+    mObj->mAdjacencyIndexBuffer.Release();
+    D3D11_SUBRESOURCE_DATA InitData = {0};
+    std::vector<uint16_t> shortIndices;
+    if (mObj->mNumVertices <= 0xFFFF)
+    {
+        shortIndices.assign(adjacency.begin(), adjacency.end());
+        InitData.pSysMem = &shortIndices[0];
+        mObj->mAdjacencyIBFormat = DXGI_FORMAT_R16_UINT;
+    }
+    else
+    {
+        InitData.pSysMem = &adjacency[0];
+        mObj->mAdjacencyIBFormat = DXGI_FORMAT_R32_UINT;
+    }
+
+    UINT indexSize = mObj->mAdjacencyIBFormat == DXGI_FORMAT_R16_UINT ? sizeof(uint16_t) : sizeof(uint32_t);
+    CD3D11_BUFFER_DESC bd(indexSize*adjacency.size(), D3D11_BIND_INDEX_BUFFER);
+    V_RETURN(dx11::getDevice()->CreateBuffer( &bd, &InitData, &mObj->mAdjacencyIndexBuffer ));
+    mObj->mNumAdjacencyIndices = adjacency.size();
+    return S_OK;
+}
+
+size_t VboMesh::selectLod( float screenSize, float pixelError ) const
+{
+    // level errors are relative to the bounding radius, i.e. half of screenSize
+    size_t lod = 0;
+    for (size_t i=1;i<mObj->mLods.size();i++)
+    {
+        if (mObj->mLods[i].error * screenSize * 0.5f <= pixelError)
+            lod = i;
+    }
+    return lod;
 }
 
 HRESULT VboMesh::createInputLayout(dx11::Shader* shader)
@@ -219,11 +640,34 @@ HRESULT VboMesh::createInputLayout(dx11::Shader* shader)
     dx11::VertexShader* vertexShader = dynamic_cast<dx11::VertexShader*>(shader);
     assert(vertexShader && "The input shader should be a vertex shader");
 
-    return getDevice()->CreateInputLayout(&mObj->InputElementDescs[0], mObj->InputElementDescs.size(), 
+    mObj->mInputLayout.Release();
+    return InputLayoutCache::get().getInputLayout(&mObj->InputElementDescs[0], mObj->InputElementDescs.size(), 
         vertexShader->getBytecode(), vertexShader->getBytecodeLength(),
         &mObj->mInputLayout);
 }
 
+HRESULT VboMesh::createDepthInputLayout(dx11::Shader* shader)
+{
+    assert(!mObj->InputElementDescs.empty() && "call createBuffer() first");
+    dx11::VertexShader* vertexShader = dynamic_cast<dx11::VertexShader*>(shader);
+    assert(vertexShader && "The input shader should be a vertex shader");
+
+    std::vector<D3D11_INPUT_ELEMENT_DESC> descs;
+    for (size_t i=0;i<mObj->InputElementDescs.size();i++)
+    {
+        const D3D11_INPUT_ELEMENT_DESC& desc = mObj->InputElementDescs[i];
+        if (strcmp(desc.SemanticName, "POSITION") == 0 || desc.InputSlotClass == D3D11_INPUT_PER_INSTANCE_DATA)
+            descs.push_back(desc);
+    }
+    if (descs.empty())
+        return E_INVALIDARG;
+
+    mObj->mDepthInputLayout.Release();
+    return InputLayoutCache::get().getInputLayout(&descs[0], descs.size(), 
+        vertexShader->getBytecode(), vertexShader->getBytecodeLength(),
+        &mObj->mDepthInputLayout);
+}
+
 VboMesh::VboMesh( const SdkMesh &sdkMesh, bool normalMap /*= false*/, bool flipOrder /*= true */ )
 {
     sdkMesh.load(0, this);
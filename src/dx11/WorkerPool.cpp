@@ -0,0 +1,155 @@
+#include "dx11/WorkerPool.h"
+
+#include <algorithm>
+#include <boost/bind.hpp>
+
+namespace cinder { namespace dx11 {
+
+namespace
+{
+    // Shared by every chunk of one parallelFor() call
+    struct RangeJob
+    {
+        RangeJob(size_t count, size_t grainSize, size_t numChunks, const WorkerPool::RangeTask& fn)
+            :mCount(count), mGrainSize(grainSize), mNumChunks(numChunks), mNextChunk(0), mDoneChunks(0), mFn(fn){}
+
+        // Runs chunks until there is nothing left to hand out
+        void run()
+        {
+            for (;;)
+            {
+                size_t chunk;
+                {
+                    std::lock_guard<std::mutex> lock(mMutex);
+                    if (mNextChunk == mNumChunks)
+                        return;
+                    chunk = mNextChunk++;
+                }
+
+                size_t begin = chunk * mGrainSize;
+                size_t end = std::min(begin + mGrainSize, mCount);
+                mFn(begin, end);
+
+                std::lock_guard<std::mutex> lock(mMutex);
+                if (++mDoneChunks == mNumChunks)
+                    mFinished.notify_all();
+            }
+        }
+
+        void wait()
+        {
+            std::unique_lock<std::mutex> lock(mMutex);
+            while (mDoneChunks != mNumChunks)
+                mFinished.wait(lock);
+        }
+
+        size_t  mCount;
+        size_t  mGrainSize;
+        size_t  mNumChunks;
+        size_t  mNextChunk;
+        size_t  mDoneChunks;
+        WorkerPool::RangeTask   mFn;
+        std::mutex              mMutex;
+        std::condition_variable mFinished;
+    };
+
+    void runRangeJob(std::shared_ptr<RangeJob> job)
+    {
+        job->run();
+    }
+}
+
+WorkerPool& WorkerPool::get()
+{
+    static WorkerPool sPool;
+    return sPool;
+}
+
+WorkerPool::WorkerPool(size_t numThreads)
+:mQuit(false)
+{
+    if (numThreads == 0)
+        numThreads = std::max<size_t>(1, std::thread::hardware_concurrency());
+
+    for (size_t i=0;i<numThreads;i++)
+        mThreads.push_back(std::shared_ptr<std::thread>(new std::thread(boost::bind(&WorkerPool::workerLoop, this))));
+}
+
+WorkerPool::~WorkerPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mQuit = true;
+    }
+    mCondition.notify_all();
+
+    for (size_t i=0;i<mThreads.size();i++)
+        mThreads[i]->join();
+}
+
+void WorkerPool::submit(const Task& task)
+{
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mTasks.push_back(task);
+    }
+    mCondition.notify_one();
+}
+
+void WorkerPool::parallelFor(size_t count, size_t grainSize, const RangeTask& fn)
+{
+    if (count == 0)
+        return;
+
+    grainSize = std::max<size_t>(grainSize, 1);
+    size_t numChunks = (count + grainSize - 1) / grainSize;
+    if (numChunks == 1 || mThreads.empty())
+    {
+        fn(0, count);
+        return;
+    }
+
+    std::shared_ptr<RangeJob> job(new RangeJob(count, grainSize, numChunks, fn));
+
+    // the calling thread takes one share of the work itself
+    size_t numHelpers = std::min(numChunks - 1, mThreads.size());
+    for (size_t i=0;i<numHelpers;i++)
+        submit(boost::bind(&runRangeJob, job));
+
+    job->run();
+    job->wait();
+}
+
+bool WorkerPool::runQueuedTask()
+{
+    Task task;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        if (mTasks.empty())
+            return false;
+        task = mTasks.front();
+        mTasks.pop_front();
+    }
+    task();
+    return true;
+}
+
+void WorkerPool::workerLoop()
+{
+    for (;;)
+    {
+        Task task;
+        {
+            std::unique_lock<std::mutex> lock(mMutex);
+            while (!mQuit && mTasks.empty())
+                mCondition.wait(lock);
+            if (mQuit && mTasks.empty())
+                return;
+            task = mTasks.front();
+            mTasks.pop_front();
+        }
+        task();
+    }
+}
+
+} } // namespace cinder::dx11
@@ -16,8 +16,13 @@
 #include "cinder/Shape2d.h"
 #include "cinder/Triangulate.h"
 #include "cinder/app/App.h"
+#include "cinder/Thread.h"
 
 #include "dx11/Vbo.h"
+#include "dx11/ShaderCache.h"
+#include "dx11/IncludeCache.h"
+
+#include <map>
 
 namespace{
 HRESULT hr = S_OK;
@@ -31,6 +36,7 @@ ID3D11RenderTargetView* g_RenderTargetView;
 ID3D11DepthStencilView* g_DepthStencilView;
 ID3D11ShaderResourceView* g_DepthSRV;
 DXGI_FORMAT g_backBufferFormat;
+InstancingStats g_instancingStats;
 
 ID3D11Device* getDevice()
 {
@@ -79,50 +85,21 @@ void clear( const ColorA &color, bool clearDepthBuffer, float clearZ)
 
 
 //--------------------------------------------------------------------------------------
-// Use this until D3DX11 comes online and we get some compilation helpers
+// Hands D3DCompile the includes from a ShaderIncludes and notes which file included which
 //--------------------------------------------------------------------------------------
-static const unsigned int MAX_INCLUDES = 9;
-struct sInclude
-{
-	HANDLE         hFile;
-	HANDLE         hFileMap;
-	LARGE_INTEGER  FileSize;
-	void           *pMapData;
-};
-
 class CIncludeHandler : public ID3DInclude
 {
 private:
-	struct sInclude   m_includeFiles[MAX_INCLUDES];
-	unsigned int      m_nIncludes;
-	std::vector<DataSourceRef>	m_dataSourceRefs;
+	ShaderIncludes*		m_pIncludes;
+	ShaderDependencies*	m_pDependencies;
+	// name and contents by data pointer, pinned until the compiler is done
+	typedef std::map<LPCVOID, std::pair<std::string, ShaderIncludes::Contents> > OpenedMap;
+	OpenedMap			m_opened;
 
 public:
-	CIncludeHandler()
+	CIncludeHandler( ShaderIncludes* pIncludes, ShaderDependencies* pDependencies )
+	: m_pIncludes( pIncludes ), m_pDependencies( pDependencies )
 	{
-		// array initialization
-		for ( unsigned int i=0; i<MAX_INCLUDES; i++)
-		{
-			m_includeFiles[i].hFile = INVALID_HANDLE_VALUE;
-			m_includeFiles[i].hFileMap = INVALID_HANDLE_VALUE;
-			m_includeFiles[i].pMapData = NULL;
-		}
-		m_nIncludes = 0;
-	}
-	~CIncludeHandler()
-	{
-		for (unsigned int i=0; i<m_nIncludes; i++)
-		{
-			UnmapViewOfFile( m_includeFiles[i].pMapData );
-
-			if ( m_includeFiles[i].hFileMap != INVALID_HANDLE_VALUE)
-				CloseHandle( m_includeFiles[i].hFileMap );
-
-			if ( m_includeFiles[i].hFile != INVALID_HANDLE_VALUE)
-				CloseHandle( m_includeFiles[i].hFile );
-		}
-
-		m_nIncludes = 0;
 	}
 
 	STDMETHOD(Open(
@@ -133,52 +110,24 @@ public:
 		UINT *pBytes
 		))
 	{
-#if 1
-		DataSourceRef dataSource = app::loadAsset(pFileName);
-		if (dataSource->getBuffer().getDataSize() > 0)
-		{
-			*ppData = dataSource->getBuffer().getData();
-			*pBytes = dataSource->getBuffer().getDataSize();
-			m_dataSourceRefs.push_back(dataSource);
-		}
-		else
-		{
-			return E_FAIL;
-		}
-#else
-		unsigned int   incIndex = m_nIncludes+1;
-
-		// Make sure we have enough room for this include file
-		if ( incIndex >= MAX_INCLUDES )
+		ShaderIncludes::Contents contents = m_pIncludes->open(pFileName);
+		if (!contents)
 			return E_FAIL;
 
-		// try to open the file
-		m_includeFiles[incIndex].hFile  = CreateFileA( pFileName, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
-			FILE_FLAG_SEQUENTIAL_SCAN, NULL );
-		if( INVALID_HANDLE_VALUE == m_includeFiles[incIndex].hFile )
+		if (m_pDependencies)
 		{
-			return E_FAIL;
-		}
-
-		// Get the file size
-		GetFileSizeEx( m_includeFiles[incIndex].hFile, &m_includeFiles[incIndex].FileSize );
-
-		// Use Memory Mapped File I/O for the header data
-		m_includeFiles[incIndex].hFileMap = CreateFileMappingA( m_includeFiles[incIndex].hFile, NULL, PAGE_READONLY, m_includeFiles[incIndex].FileSize.HighPart, m_includeFiles[incIndex].FileSize.LowPart, pFileName);
-		if( m_includeFiles[incIndex].hFileMap == NULL  )
-		{
-			if (m_includeFiles[incIndex].hFile != INVALID_HANDLE_VALUE)
-				CloseHandle( m_includeFiles[incIndex].hFile );
-			return E_FAIL;
+			// the parent is an include opened earlier, or the source itself
+			ShaderDependencies::Edge edge;
+			OpenedMap::const_iterator parent = m_opened.find(pParentData);
+			if (parent != m_opened.end())
+				edge.includer = parent->second.first;
+			edge.included = pFileName;
+			m_pDependencies->edges.push_back(edge);
 		}
 
-		// Create Map view
-		*ppData = MapViewOfFile( m_includeFiles[incIndex].hFileMap, FILE_MAP_READ, 0, 0, 0 );
-		*pBytes = m_includeFiles[incIndex].FileSize.LowPart;
-
-		// Success - Increment the include file count
-		m_nIncludes= incIndex;
-#endif
+		*ppData = contents->data();
+		*pBytes = (UINT)contents->size();
+		m_opened[*ppData] = std::make_pair(std::string(pFileName), contents);
 		return S_OK;
 	}
 
@@ -189,7 +138,86 @@ public:
 	}
 };
 
-HRESULT compileShader( const Buffer& data, const std::string& entryName, const std::string& shaderModel, ID3DBlob** ppShaderBytecode )
+namespace
+{
+	// Looks includes up in the app assets, like the shaders themselves
+	fs::path resolveAsset( const std::string& name )
+	{
+		return app::getAssetPath(name);
+	}
+}
+
+class D3DShaderCompiler : public ShaderCompiler
+{
+public:
+	bool compile( const ShaderRequest& request, ShaderIncludes* includes, std::vector<uint8_t>* bytecode, std::string* errors,
+		ShaderDependencies* dependencies )
+	{
+		CComPtr<ID3DBlob> pBytecode;
+		CComPtr<ID3DBlob> pErrorBlob;
+		CIncludeHandler includeHandler(includes, dependencies);
+
+		// NULL terminated
+		std::vector<D3D_SHADER_MACRO> macros(request.macros.size() + 1);
+		for (size_t i=0; i<request.macros.size(); i++)
+		{
+			macros[i].Name = request.macros[i].name.c_str();
+			macros[i].Definition = request.macros[i].definition.c_str();
+		}
+		macros.back().Name = NULL;
+		macros.back().Definition = NULL;
+
+		HRESULT hr = D3DCompile( request.source, request.sourceSize, NULL,
+			&macros[0], &includeHandler,
+			request.entry.c_str(), request.profile.c_str(),
+			request.flags, 0,
+			&pBytecode, &pErrorBlob);
+		if( pErrorBlob != NULL )
+			errors->assign( (const char*)pErrorBlob->GetBufferPointer(), pErrorBlob->GetBufferSize() );
+		if( FAILED(hr) )
+			return false;
+
+		const uint8_t* data = static_cast<const uint8_t*>(pBytecode->GetBufferPointer());
+		bytecode->assign(data, data + pBytecode->GetBufferSize());
+		return true;
+	}
+
+	uint32_t getVersion() const { return D3D_COMPILER_VERSION; }
+};
+
+IncludeCache g_includeCache(&resolveAsset);
+D3DShaderCompiler g_shaderCompiler;
+// compile workers take their own reference under the lock, so switching caches never pulls one from under them
+std::shared_ptr<ShaderCache> g_shaderCache;
+std::mutex g_shaderCacheMutex;
+
+void setShaderCacheDirectory( const fs::path& directory )
+{
+	std::shared_ptr<ShaderCache> cache;
+	if (!directory.empty())
+	{
+		boost::system::error_code ec;
+		fs::create_directories(directory, ec);
+		cache.reset(new ShaderCache(directory.string(), &g_shaderCompiler, &g_includeCache));
+	}
+
+	std::lock_guard<std::mutex> lock(g_shaderCacheMutex);
+	g_shaderCache.swap(cache);
+}
+
+ShaderCache* getShaderCache()
+{
+	std::lock_guard<std::mutex> lock(g_shaderCacheMutex);
+	return g_shaderCache.get();
+}
+
+IncludeCache* getIncludeCache()
+{
+	return &g_includeCache;
+}
+
+HRESULT compileShader( const Buffer& data, const std::string& entryName, const std::string& shaderModel, ID3DBlob** ppShaderBytecode,
+	ShaderDependencies* dependencies, const std::vector<ShaderMacro>* macros )
 {
 	HRESULT hr = S_OK;
 
@@ -210,22 +238,36 @@ HRESULT compileShader( const Buffer& data, const std::string& entryName, const s
 	dwShaderFlags |= D3DCOMPILE_PREFER_FLOW_CONTROL;
 #endif
 
-	// compiling
-	CComPtr<ID3DBlob> pErrorBlob;
-
-	CIncludeHandler includeHandler;
-
-	hr = D3DCompile( data.getData(), data.getDataSize(), NULL,
-		NULL, &includeHandler,
-		entryName.c_str(), shaderModel.c_str(), 
-		dwShaderFlags, 0, 
-		ppShaderBytecode, &pErrorBlob);
-	if( FAILED(hr) )
+	ShaderRequest request;
+	request.source = data.getData();
+	request.sourceSize = data.getDataSize();
+	request.entry = entryName;
+	request.profile = shaderModel;
+	request.flags = dwShaderFlags;
+	if( macros )
+		request.macros = *macros;
+
+	// compiling, or loading what an earlier launch compiled
+	std::vector<uint8_t> bytecode;
+	std::string errors;
+	if( dependencies )
+		dependencies->clear();
+	std::shared_ptr<ShaderCache> cache;
 	{
-		if( pErrorBlob != NULL )
-			OutputDebugStringA( (char*)pErrorBlob->GetBufferPointer() );
+		std::lock_guard<std::mutex> lock(g_shaderCacheMutex);
+		cache = g_shaderCache;
+	}
+	bool compiled = cache ? cache->get(request, &bytecode, &errors, dependencies) :
+		g_shaderCompiler.compile(request, &g_includeCache, &bytecode, &errors, dependencies);
+	if( !compiled )
+	{
+		if( !errors.empty() )
+			OutputDebugStringA( errors.c_str() );
+		return E_FAIL;
 	}
 
+	V_RETURN( D3DCreateBlob( bytecode.size(), ppShaderBytecode ) );
+	memcpy( (*ppShaderBytecode)->GetBufferPointer(), &bytecode[0], bytecode.size() );
 	return hr;
 }
 
@@ -357,13 +399,90 @@ void CameraPerspDX::calcProjection()
 void draw( const VboMesh &vbo )
 {
 	vbo.bind();
-	//if (g_currentEffect != NULL)
-	//{
-	//	if (vbo.getNumIndices() > 0)
-	//		g_currentEffect->drawIndexed(vbo.getNumIndices());
-	//	else
-	//		g_currentEffect->draw(vbo.getNumVertices());
-	//}
+	if (vbo.getNumIndices() > 0)
+		g_immediateContex->DrawIndexed(vbo.getNumIndices(), 0, 0);
+	else
+		g_immediateContex->Draw(vbo.getNumVertices(), 0);
+}
+
+void drawDepth( const VboMesh &vbo )
+{
+	vbo.bindDepthOnly();
+	if (vbo.getNumIndices() > 0)
+		g_immediateContex->DrawIndexed(vbo.getNumIndices(), 0, 0);
+	else
+		g_immediateContex->Draw(vbo.getNumVertices(), 0);
+}
+
+void drawAdjacency( const VboMesh &vbo )
+{
+	if (vbo.getNumAdjacencyIndices() == 0)
+		return;
+
+	vbo.bindAdjacency();
+	g_immediateContex->DrawIndexed(vbo.getNumAdjacencyIndices(), 0, 0);
+}
+
+void drawRange( const VboMesh &vbo, size_t startIndex, size_t indexCount )
+{
+	vbo.bind();
+	g_immediateContex->DrawIndexed(indexCount, startIndex, 0);
+}
+
+void drawLod( const VboMesh &vbo, float screenSize, float pixelError )
+{
+	if (vbo.getNumLods() == 0)
+	{
+		draw(vbo);
+		return;
+	}
+
+	const LodLevel& level = vbo.getLod(vbo.selectLod(screenSize, pixelError));
+	drawRange(vbo, level.startIndex, level.indexCount);
+}
+
+void drawInstanced( const VboMesh &vbo, const void *instances, size_t numInstances )
+{
+	size_t capacity = vbo.getInstanceCapacity();
+	if (numInstances == 0 || capacity == 0)
+		return;
+
+	vbo.bind();
+	const uint8_t* data = static_cast<const uint8_t*>(instances);
+	for (size_t first=0;first<numInstances;first+=capacity)
+	{
+		UINT count = static_cast<UINT>(std::min(capacity, numInstances - first));
+		if (FAILED(vbo.updateInstanceBuffer(data + first*vbo.getInstanceStride(), count)))
+			return;
+
+		if (vbo.getNumIndices() > 0)
+			g_immediateContex->DrawIndexedInstanced(vbo.getNumIndices(), count, 0, 0, 0);
+		else
+			g_immediateContex->DrawInstanced(vbo.getNumVertices(), count, 0, 0);
+
+		g_instancingStats.instances += count;
+		g_instancingStats.drawCalls++;
+	}
+}
+
+const InstancingStats& getInstancingStats()
+{
+	return g_instancingStats;
+}
+
+void resetInstancingStats()
+{
+	g_instancingStats = InstancingStats();
+}
+
+void drawRanges( const VboMesh &vbo, const std::vector<DrawRange> &ranges )
+{
+	if (ranges.empty())
+		return;
+
+	vbo.bind();
+	for (size_t i=0;i<ranges.size();i++)
+		g_immediateContex->DrawIndexed(ranges[i].indexCount, ranges[i].startIndex, 0);
 }
 
 } } // namespace cinder::dx11
\ No newline at end of file
@@ -0,0 +1,203 @@
+// ConstantBufferDesc's text form and ConstantBufferShadow's dirty ranges, the parts of the constant buffer system
+// that don't need a device.
+
+#include "dx11/ConstantBufferLayout.h"
+#include "Test.h"
+
+#include <cstring>
+
+using namespace cinder::dx11;
+
+namespace
+{
+    const char* kLayout =
+        "cbuffer cbPerFrame 0 112\n"
+        "    gDirLight 0 64\n"
+        "    gEyePosW 64 12\n"
+        "    gFogStart 76 4\n"
+        "    gFogColor 80 16\n"
+        "    gLights 96 16\n"
+        "\n"
+        "cbuffer cbPerObject 1 208\n"
+        "    gWorld 0 64\n"
+        "    gWorldInvTranspose 64 64\n"
+        "    gWorldViewProj 128 64\n"
+        "    gMaterial 192 16\n";
+
+    ConstantBufferDesc perObject()
+    {
+        std::vector<ConstantBufferDesc> descs;
+        ConstantBufferDesc::parse(kLayout, &descs);
+        return descs[1];
+    }
+
+    bool hasRanges( const ConstantBufferShadow& shadow, const char* expected )
+    {
+        std::string ranges;
+        for (size_t i=0;i<shadow.getDirtyRanges().size();i++)
+        {
+            char range[32];
+            sprintf(range, "[%u,%u)", shadow.getDirtyRanges()[i].begin, shadow.getDirtyRanges()[i].end);
+            ranges += range;
+        }
+        if (ranges != expected)
+            printf("dirty ranges %s, expected %s\n", ranges.c_str(), expected);
+        return ranges == expected;
+    }
+
+    bool parseFails( const char* text, const char* message )
+    {
+        std::vector<ConstantBufferDesc> descs;
+        std::string error;
+        return !ConstantBufferDesc::parse(text, &descs, &error) && error.find(message) != std::string::npos;
+    }
+
+    void testParse()
+    {
+        std::vector<ConstantBufferDesc> descs;
+        std::string error;
+        CHECK(ConstantBufferDesc::parse(kLayout, &descs, &error));
+        CHECK(error.empty());
+        CHECK(descs.size() == 2);
+        CHECK(descs[0].name == "cbPerFrame" && descs[0].slot == 0 && descs[0].size == 112);
+        CHECK(descs[0].variables.size() == 5);
+        CHECK(descs[0].variables[1].name == "gEyePosW");
+        CHECK(descs[0].variables[1].offset == 64 && descs[0].variables[1].size == 12);
+        CHECK(descs[1].name == "cbPerObject" && descs[1].slot == 1 && descs[1].size == 208);
+        CHECK(descs[1].variables[3].name == "gMaterial" && descs[1].variables[3].offset == 192);
+
+        // serialize() writes what parse() reads back
+        std::string text = ConstantBufferDesc::serialize(descs);
+        CHECK(text.compare(0, 25, "cbuffer cbPerFrame 0 112\n") == 0);
+        std::vector<ConstantBufferDesc> again;
+        CHECK(ConstantBufferDesc::parse(text, &again));
+        CHECK(ConstantBufferDesc::serialize(again) == text);
+        CHECK(again.size() == 2 && again[1].variables.size() == 4);
+
+        CHECK(ConstantBufferDesc::parse("", &descs));
+        CHECK(descs.empty());
+    }
+
+    void testParseErrors()
+    {
+        CHECK(parseFails("cbuffer x 0\n", "line 1:"));
+        CHECK(parseFails("cbuffer x 0 32 extra\n", "line 1:"));
+        CHECK(parseFails("cbuffer x zero 32\n", "line 1:"));
+        CHECK(parseFails("a 0 4\n", "line 1:"));
+        CHECK(parseFails("cbuffer x 0 32\n    a 0\n", "line 2:"));
+        CHECK(parseFails("cbuffer x 0 32\n    a 0 four\n", "line 2:"));
+
+        // well formed, but not a layout HLSL produces
+        CHECK(parseFails("cbuffer x 0 20\n    a 0 4\n", "isn't a multiple of 16"));
+        CHECK(parseFails("cbuffer x 0 0\n", "isn't a multiple of 16"));
+        CHECK(parseFails("cbuffer x 0 32\n    a 24 12\n", "a ends past the buffer"));
+        CHECK(parseFails("cbuffer x 0 32\n    a 4294967292 8\n", "a ends past the buffer"));
+        CHECK(parseFails("cbuffer x 0 32\n    a 8 12\n", "a straddles a register"));
+        // a variable that starts a register may span several
+        CHECK(!parseFails("cbuffer x 0 32\n    a 0 28\n", ""));
+    }
+
+    void testDirtyRanges()
+    {
+        ConstantBufferShadow shadow(perObject());
+        CHECK(shadow.getSize() == 208);
+        CHECK(!shadow.isDirty());
+
+        float matrix[16] = { 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1 };
+        CHECK(shadow.set("gWorld", matrix, sizeof(matrix)));
+        CHECK(hasRanges(shadow, "[0,64)"));
+        CHECK(memcmp(shadow.getData(), matrix, sizeof(matrix)) == 0);
+
+        // the same value again uploads nothing
+        shadow.clearDirty();
+        CHECK(shadow.set("gWorld", matrix, sizeof(matrix)));
+        CHECK(!shadow.isDirty());
+
+        // 1.0f to 2.0f changes only the two high bytes, the range still covers the whole float
+        matrix[15] = 2;
+        CHECK(shadow.set("gWorld", matrix, sizeof(matrix)));
+        CHECK(hasRanges(shadow, "[60,64)"));
+
+        // touching ranges merge
+        float material[4] = { 1, 2, 3, 4 };
+        CHECK(shadow.set("gMaterial", material));
+        CHECK(hasRanges(shadow, "[60,64)[192,208)"));
+        CHECK(shadow.set("gWorldViewProj", matrix, sizeof(matrix)));
+        CHECK(hasRanges(shadow, "[60,64)[128,208)"));
+    }
+
+    void testMerging()
+    {
+        ConstantBufferShadow shadow(perObject());
+        float ones[10] = { 1, 1, 1, 1, 1, 1, 1, 1, 1, 1 };
+        CHECK(shadow.write(100, ones, 4));
+        CHECK(shadow.write(20, ones, 4));
+        CHECK(shadow.write(60, ones, 4));
+        CHECK(hasRanges(shadow, "[20,24)[60,64)[100,104)"));
+        CHECK(shadow.write(24, ones, 4));
+        CHECK(hasRanges(shadow, "[20,28)[60,64)[100,104)"));
+        // one write swallowing a range and touching the next
+        CHECK(shadow.write(28, ones, sizeof(ones)));
+        CHECK(hasRanges(shadow, "[20,68)[100,104)"));
+
+        // a single byte still dirties its whole component
+        uint8_t byte = 7;
+        CHECK(shadow.write(201, &byte, 1));
+        CHECK(hasRanges(shadow, "[20,68)[100,104)[200,204)"));
+    }
+
+    void testSetErrors()
+    {
+        ConstantBufferShadow shadow(perObject());
+        float values[5] = { 1, 2, 3, 4, 5 };
+        CHECK(!shadow.set("gNothing", values[0]));
+        CHECK(shadow.findVariable("gNothing") == -1);
+        CHECK(!shadow.set("gMaterial", values, sizeof(values)));
+        CHECK(!shadow.set(4, values, 4));
+        CHECK(!shadow.set(-1, values, 4));
+        CHECK(!shadow.write(200, values, 12));
+        CHECK(!shadow.write(4000000000u, values, 4));
+        CHECK(shadow.write(208, values, 0));
+        CHECK(!shadow.isDirty());
+
+        // writing only the start of a variable is fine
+        CHECK(shadow.set("gMaterial", values, 8));
+        CHECK(hasRanges(shadow, "[192,200)"));
+    }
+
+    void testCopyVariables()
+    {
+        ConstantBufferShadow source(perObject());
+        float matrix[16] = { 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 5, 6, 7, 1 };
+        float material[4] = { 1, 2, 3, 4 };
+        source.set("gWorld", matrix, sizeof(matrix));
+        source.set("gMaterial", material);
+
+        ConstantBufferShadow same(perObject());
+        same.copyVariables(source);
+        CHECK(memcmp(same.getData(), source.getData(), source.getSize()) == 0);
+        CHECK(hasRanges(same, "[0,64)[192,208)"));
+
+        // after a reload the variables may have moved, shrunk or gone
+        std::vector<ConstantBufferDesc> descs;
+        CHECK(ConstantBufferDesc::parse("cbuffer cbPerObject 1 32\n    gMaterial 0 8\n    gWorld 16 16\n", &descs));
+        ConstantBufferShadow reloaded(descs[0]);
+        reloaded.copyVariables(source);
+        const float* data = reinterpret_cast<const float*>(reloaded.getData());
+        CHECK(data[0] == 1 && data[1] == 2 && data[2] == 0);
+        CHECK(data[4] == 1 && data[5] == 0 && data[7] == 0);
+        CHECK(hasRanges(reloaded, "[0,8)[16,20)"));
+    }
+}
+
+int main()
+{
+    testParse();
+    testParseErrors();
+    testDirtyRanges();
+    testMerging();
+    testSetErrors();
+    testCopyVariables();
+
+    return test::finish("ConstantBufferLayoutTest");
+}
@@ -0,0 +1,164 @@
+// ShaderArchive and ShaderArchiveWriter on real files: what the writer packs, the reader maps and finds again, and
+// verify() catches damage to it.
+
+#include "dx11/ShaderArchive.h"
+#include "cinder/Filesystem.h"
+#include "Test.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+using namespace cinder::dx11;
+
+namespace
+{
+    const fs::path kScratch = "scratch/ShaderArchiveTest";
+
+    std::string blobOf( const std::string& name, int variant )
+    {
+        char blob[64];
+        sprintf(blob, "DXBC%s-%d", name.c_str(), variant);
+        return blob;
+    }
+
+    std::vector<ShaderMacro> fogMacros()
+    {
+        std::vector<ShaderMacro> macros;
+        macros.push_back(ShaderMacro("FOG"));
+        macros.push_back(ShaderMacro("NUM_LIGHTS", "4"));
+        return macros;
+    }
+
+    std::string found( const ShaderArchiveRef& archive, const std::string& name, const std::string& entry,
+        const std::string& profile, const std::vector<ShaderMacro>& macros )
+    {
+        const void* bytecode = NULL;
+        size_t size = 0;
+        if (!archive->find(name, entry, profile, macros, &bytecode, &size))
+            return "";
+        return std::string(static_cast<const char*>(bytecode), size);
+    }
+
+    std::string writeArchive( const std::string& file )
+    {
+        const char* names[] = { "Lighting.fx", "Basic.fx", "Zed.fx" };
+        ShaderArchiveWriter writer;
+        for (int n=0;n<3;n++)
+        {
+            for (int v=0;v<2;v++)
+            {
+                std::string blob = blobOf(names[n], v);
+                writer.add(names[n], "VS", "vs_4_0", v ? fogMacros() : std::vector<ShaderMacro>(), blob.data(), blob.size());
+            }
+        }
+        writer.add("Lighting.fx", "PS", "ps_4_0", fogMacros(), "DXBCps", 6);
+        // the same key again replaces the first
+        writer.add("Lighting.fx", "PS", "ps_4_0", fogMacros(), "DXBCps-2", 8);
+        CHECK(writer.getNumEntries() == 7);
+
+        std::string path = (kScratch / file).string();
+        CHECK(writer.write(path));
+        return path;
+    }
+
+    void testRoundTrip()
+    {
+        std::string path = writeArchive("round.dxsa");
+        ShaderArchiveRef archive = ShaderArchive::create(path);
+        CHECK(archive);
+        if (!archive)
+            return;
+
+        std::string error;
+        CHECK(archive->verify(&error));
+        CHECK(error.empty());
+        CHECK(archive->getNumEntries() == 7);
+
+        CHECK(found(archive, "Basic.fx", "VS", "vs_4_0", std::vector<ShaderMacro>()) == blobOf("Basic.fx", 0));
+        CHECK(found(archive, "Zed.fx", "VS", "vs_4_0", fogMacros()) == blobOf("Zed.fx", 1));
+        CHECK(found(archive, "Lighting.fx", "PS", "ps_4_0", fogMacros()) == "DXBCps-2");
+
+        // the macro order doesn't matter
+        std::vector<ShaderMacro> macros = fogMacros();
+        std::vector<ShaderMacro> reversed(macros.rbegin(), macros.rend());
+        CHECK(ShaderArchive::hashMacros(reversed) == ShaderArchive::hashMacros(macros));
+        CHECK(found(archive, "Lighting.fx", "VS", "vs_4_0", reversed) == blobOf("Lighting.fx", 1));
+
+        // anything else differing is a miss
+        CHECK(found(archive, "Lighting.fx", "VS", "vs_5_0", fogMacros()).empty());
+        CHECK(found(archive, "Lighting.fx", "PS", "ps_4_0", std::vector<ShaderMacro>()).empty());
+        CHECK(found(archive, "Missing.fx", "VS", "vs_4_0", fogMacros()).empty());
+
+        // sorted, and every blob 16-byte aligned in the file and so in the mapping
+        for (size_t i=0;i<archive->getNumEntries();i++)
+        {
+            const ShaderArchive::Entry& entry = archive->getEntry(i);
+            CHECK(entry.offset % ShaderArchive::kBlobAlignment == 0);
+            CHECK(reinterpret_cast<uintptr_t>(archive->getBlob(entry)) % ShaderArchive::kBlobAlignment == 0);
+            if (i > 0)
+                CHECK(strcmp(archive->getString(archive->getEntry(i - 1).name), archive->getString(entry.name)) <= 0);
+        }
+    }
+
+    void testCorruption()
+    {
+        std::string path = writeArchive("corrupt.dxsa");
+        uintmax_t size = fs::file_size(path);
+
+        // the last byte belongs to the last blob
+        {
+            std::fstream file(path.c_str(), std::ios::binary | std::ios::in | std::ios::out);
+            file.seekp(-1, std::ios::end);
+            file.put('z');
+        }
+        ShaderArchiveRef archive = ShaderArchive::create(path);
+        CHECK(archive);
+        std::string error;
+        CHECK(archive && !archive->verify(&error));
+        CHECK(!error.empty());
+
+        // a truncated file doesn't even open
+        archive.reset();
+        fs::resize_file(path, size - 3);
+        CHECK(!ShaderArchive::create(path));
+
+        // neither does something that isn't an archive
+        std::ofstream((kScratch / "text.dxsa").string().c_str()) << "not an archive, but longer than the header is";
+        CHECK(!ShaderArchive::create((kScratch / "text.dxsa").string()));
+        CHECK(!ShaderArchive::create((kScratch / "missing.dxsa").string()));
+    }
+
+    void testEmpty()
+    {
+        ShaderArchiveWriter writer;
+        std::string path = (kScratch / "empty.dxsa").string();
+        CHECK(writer.write(path));
+
+        ShaderArchiveRef archive = ShaderArchive::create(path);
+        CHECK(archive);
+        if (!archive)
+            return;
+        std::string error;
+        CHECK(archive->verify(&error));
+        CHECK(archive->getNumEntries() == 0);
+        CHECK(found(archive, "Basic.fx", "VS", "vs_4_0", std::vector<ShaderMacro>()).empty());
+
+        // an empty file is no archive
+        std::ofstream((kScratch / "zero.dxsa").string().c_str());
+        CHECK(!ShaderArchive::create((kScratch / "zero.dxsa").string()));
+    }
+}
+
+int main()
+{
+    fs::remove_all(kScratch);
+    fs::create_directories(kScratch);
+
+    testRoundTrip();
+    testCorruption();
+    testEmpty();
+
+    fs::remove_all(kScratch);
+    return test::finish("ShaderArchiveTest");
+}
@@ -0,0 +1,328 @@
+// ShaderCache and IncludeCache against real files, with a stub compiler that expands #include lines, so the
+// bytecode says exactly which include contents a compile saw.
+
+#include "dx11/ShaderCache.h"
+#include "dx11/IncludeCache.h"
+#include "Test.h"
+
+#include <fstream>
+#include <cstring>
+#include <sstream>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+using namespace cinder::dx11;
+
+namespace
+{
+    const fs::path kScratch = "scratch/ShaderCacheTest";
+
+    class StubCompiler : public ShaderCompiler
+    {
+    public:
+        StubCompiler():compiles(0), version(1){}
+
+        bool compile( const ShaderRequest& request, ShaderIncludes* includes, std::vector<uint8_t>* bytecode,
+            std::string* errors, ShaderDependencies* dependencies )
+        {
+            compiles++;
+            std::string source(static_cast<const char*>(request.source), request.sourceSize);
+            std::string output = request.entry + "/" + request.profile + ":";
+            if (!expand(source, "", includes, &output, dependencies))
+            {
+                *errors = "missing include";
+                return false;
+            }
+            bytecode->assign(output.begin(), output.end());
+            return true;
+        }
+
+        uint32_t getVersion() const { return version; }
+
+        int         compiles;
+        uint32_t    version;
+
+    private:
+        bool expand( const std::string& text, const std::string& includer, ShaderIncludes* includes,
+            std::string* output, ShaderDependencies* dependencies )
+        {
+            std::istringstream lines(text);
+            std::string line;
+            while (std::getline(lines, line))
+            {
+                if (line.compare(0, 10, "#include \"") != 0)
+                {
+                    *output += line + "\n";
+                    continue;
+                }
+                std::string name = line.substr(10, line.find('"', 10) - 10);
+                ShaderIncludes::Contents contents = includes->open(name);
+                if (!contents)
+                    return false;
+                if (dependencies)
+                {
+                    ShaderDependencies::Edge edge;
+                    edge.includer = includer;
+                    edge.included = name;
+                    dependencies->edges.push_back(edge);
+                }
+                if (!expand(*contents, name, includes, output, dependencies))
+                    return false;
+            }
+            return true;
+        }
+    };
+
+    fs::path resolve( const std::string& name )
+    {
+        fs::path path = kScratch / "src" / name;
+        return fs::exists(path) ? path : fs::path();
+    }
+
+    void writeFile( const fs::path& path, const std::string& contents )
+    {
+        std::ofstream file(path.string().c_str(), std::ios::binary | std::ios::trunc);
+        file << contents;
+    }
+
+    std::string toString( const std::vector<uint8_t>& bytes )
+    {
+        return std::string(bytes.begin(), bytes.end());
+    }
+
+    bool contains( const std::vector<uint8_t>& bytes, const std::string& text )
+    {
+        return toString(bytes).find(text) != std::string::npos;
+    }
+
+    size_t countFiles( const fs::path& directory, const std::string& extension )
+    {
+        size_t count = 0;
+        for (fs::directory_iterator it(directory); it != fs::directory_iterator(); ++it)
+        {
+            if (it->path().extension() == extension)
+                count++;
+        }
+        return count;
+    }
+
+    struct Fixture
+    {
+        Fixture()
+        :includes(&resolve), cache((kScratch / "cache").string(), &compiler, &includes)
+        {
+            request.source = source.c_str();
+            request.sourceSize = source.size();
+            request.entry = "main";
+            request.profile = "ps_4_0";
+        }
+
+        bool get( std::vector<uint8_t>* bytecode, ShaderDependencies* dependencies = NULL )
+        {
+            std::string errors;
+            return cache.get(request, bytecode, &errors, dependencies);
+        }
+
+        static const std::string source;
+
+        StubCompiler    compiler;
+        IncludeCache    includes;
+        ShaderCache     cache;
+        ShaderRequest   request;
+    };
+
+    const std::string Fixture::source = "#include \"lighting.hlsl\"\nfloat4 main() {}\n";
+
+    void testHitAndMiss()
+    {
+        Fixture f;
+        std::vector<uint8_t> first, second;
+        ShaderDependencies compiled, loaded;
+        CHECK(f.get(&first, &compiled));
+        CHECK(f.get(&second, &loaded));
+
+        CHECK(f.compiler.compiles == 1);
+        CHECK(f.cache.getStats().misses == 1);
+        CHECK(f.cache.getStats().hits == 1);
+        CHECK(first == second);
+        CHECK(contains(first, "float3 light;"));
+        CHECK(contains(first, "float3 common;"));
+
+        // a hit reports the graph of the compile that wrote the entry
+        CHECK(loaded.edges.size() == 2);
+        CHECK(loaded.getIncludes("") == compiled.getIncludes(""));
+        CHECK(loaded.getIncludes("lighting.hlsl").size() == 1 && loaded.getIncludes("lighting.hlsl")[0] == "common.hlsl");
+
+        // another entry point is another entry
+        f.request.entry = "other";
+        CHECK(f.get(&second));
+        CHECK(f.compiler.compiles == 2);
+    }
+
+    void testIncludeChange()
+    {
+        Fixture f;
+        std::vector<uint8_t> bytecode;
+        CHECK(f.get(&bytecode));
+
+        // a nested include, edited twice within the same second and keeping its size
+        writeFile(kScratch / "src/common.hlsl", "float3 edited;\n");
+        CHECK(f.get(&bytecode));
+        CHECK(contains(bytecode, "float3 edited;"));
+        writeFile(kScratch / "src/common.hlsl", "float3 second;\n");
+        CHECK(f.get(&bytecode));
+        CHECK(contains(bytecode, "float3 second;"));
+        CHECK(f.compiler.compiles == 3);
+
+        // the entry was rewritten for the latest contents, going back compiles again
+        writeFile(kScratch / "src/common.hlsl", "float3 common;\n");
+        CHECK(f.get(&bytecode));
+        CHECK(contains(bytecode, "float3 common;"));
+        CHECK(f.compiler.compiles == 4);
+        CHECK(f.get(&bytecode));
+        CHECK(f.compiler.compiles == 4);
+    }
+
+    void testInvalidate()
+    {
+        Fixture f;
+        std::vector<uint8_t> bytecode;
+        CHECK(f.get(&bytecode));
+
+        // an edit that keeps the size and puts the time stamp back looks unchanged to the include cache
+        fs::path path = kScratch / "src/lighting.hlsl";
+        struct stat before;
+        CHECK(stat(path.string().c_str(), &before) == 0);
+        writeFile(path, "#include \"common.hlsl\"\nfloat3 LIGHT;\n");
+        struct timespec times[2] = { before.st_atim, before.st_mtim };
+        CHECK(utimensat(AT_FDCWD, path.string().c_str(), times, 0) == 0);
+        CHECK(f.get(&bytecode));
+        CHECK(contains(bytecode, "float3 light;"));
+
+        // which is what the ShaderReloader drops the changed files for
+        f.includes.invalidate(path);
+        CHECK(f.get(&bytecode));
+        CHECK(contains(bytecode, "float3 LIGHT;"));
+        CHECK(f.includes.getStats().loads == 3);
+    }
+
+    void testVersions()
+    {
+        Fixture f;
+        std::vector<uint8_t> bytecode;
+        CHECK(f.get(&bytecode));
+        std::string path = f.cache.getPath(f.request);
+
+        // another compiler is another key
+        f.compiler.version = 2;
+        CHECK(f.cache.getPath(f.request) != path);
+        CHECK(f.get(&bytecode));
+        CHECK(f.compiler.compiles == 2);
+        f.compiler.version = 1;
+
+        // an entry of another format version is a miss and gets rewritten
+        {
+            std::fstream file(path.c_str(), std::ios::binary | std::ios::in | std::ios::out);
+            uint32_t version = 1;
+            file.seekp(4);
+            file.write(reinterpret_cast<const char*>(&version), sizeof(version));
+        }
+        CHECK(f.get(&bytecode));
+        CHECK(f.compiler.compiles == 3);
+        CHECK(f.get(&bytecode));
+        CHECK(f.compiler.compiles == 3);
+
+        // a truncated entry too
+        fs::resize_file(path, 20);
+        CHECK(f.get(&bytecode));
+        CHECK(f.compiler.compiles == 4);
+        CHECK(contains(bytecode, "float3 light;"));
+    }
+
+    void overwrite( const std::string& path, std::streamoff offset, uint32_t value )
+    {
+        std::fstream file(path.c_str(), std::ios::binary | std::ios::in | std::ios::out);
+        file.seekp(offset);
+        file.write(reinterpret_cast<const char*>(&value), sizeof(value));
+    }
+
+    void testCorruptLengths()
+    {
+        Fixture f;
+        std::vector<uint8_t> bytecode;
+        CHECK(f.get(&bytecode));
+        std::string path = f.cache.getPath(f.request);
+        std::streamoff size = (std::streamoff)fs::file_size(path);
+        std::streamoff bytecodeOffset = size - (std::streamoff)bytecode.size() - 4;
+
+        // lengths past the end of the file are a miss, not a 4 GB allocation
+        const std::streamoff offsets[] = { 8, 12, bytecodeOffset };
+        for (int i=0;i<3;i++)
+        {
+            overwrite(path, offsets[i], 0xFFFFFFF0u);
+            CHECK(f.get(&bytecode));
+            CHECK(f.compiler.compiles == 2 + i);
+            CHECK(contains(bytecode, "float3 light;"));
+        }
+        CHECK(f.get(&bytecode));
+        CHECK(f.compiler.compiles == 4);
+    }
+
+    void testWrites()
+    {
+        Fixture f;
+        std::vector<uint8_t> bytecode;
+        CHECK(f.get(&bytecode));
+        f.request.profile = "vs_4_0";
+        CHECK(f.get(&bytecode));
+
+        // every entry got renamed into place, no temporary file is left
+        CHECK(countFiles(kScratch / "cache", ".cso") == 2);
+        CHECK(countFiles(kScratch / "cache", ".tmp") == 0);
+        CHECK(fs::exists(f.cache.getPath(f.request)));
+        CHECK(f.cache.getStats().writeFailures == 0);
+
+        // failing to write costs the next launch a compile, not this one its shader
+        StubCompiler compiler;
+        ShaderCache missing((kScratch / "missing").string(), &compiler, &f.includes);
+        std::string errors;
+        CHECK(missing.get(f.request, &bytecode, &errors));
+        CHECK(missing.getStats().writeFailures == 1);
+
+        // failed compiles aren't cached
+        f.request.source = "#include \"nothing.hlsl\"\n";
+        f.request.sourceSize = strlen("#include \"nothing.hlsl\"\n");
+        CHECK(!f.get(&bytecode));
+        CHECK(!f.get(&bytecode));
+        CHECK(f.compiler.compiles == 4);
+        CHECK(!fs::exists(f.cache.getPath(f.request)));
+    }
+
+    void reset()
+    {
+        fs::remove_all(kScratch);
+        fs::create_directories(kScratch / "src");
+        fs::create_directories(kScratch / "cache");
+        writeFile(kScratch / "src/lighting.hlsl", "#include \"common.hlsl\"\nfloat3 light;\n");
+        writeFile(kScratch / "src/common.hlsl", "float3 common;\n");
+    }
+}
+
+int main()
+{
+    reset();
+    testHitAndMiss();
+    reset();
+    testIncludeChange();
+    reset();
+    testInvalidate();
+    reset();
+    testVersions();
+    reset();
+    testCorruptLengths();
+    reset();
+    testWrites();
+
+    fs::remove_all(kScratch);
+    return test::finish("ShaderCacheTest");
+}
@@ -0,0 +1,33 @@
+// The few checks the off-device tests need. A failed check prints where and carries on, main() returns the
+// number of failures.
+
+#pragma once
+
+#include <cstdio>
+
+namespace test {
+
+inline int& failures()
+{
+    static int count = 0;
+    return count;
+}
+
+inline void check(bool passed, const char* expression, const char* file, int line)
+{
+    if (!passed)
+    {
+        std::printf("%s:%d: CHECK(%s) failed\n", file, line, expression);
+        failures()++;
+    }
+}
+
+inline int finish(const char* name)
+{
+    std::printf("%s: %s\n", name, failures() == 0 ? "passed" : "FAILED");
+    return failures();
+}
+
+} // namespace test
+
+#define CHECK(expression) test::check((expression) ? true : false, #expression, __FILE__, __LINE__)
@@ -0,0 +1,6 @@
+// Stands in for cinder/Cinder.h when the D3D-free modules are built off-device, see test/Makefile
+#pragma once
+
+#include <cstddef>
+#include <stdint.h>
+#include <memory>
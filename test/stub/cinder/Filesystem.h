@@ -0,0 +1,6 @@
+// Stands in for cinder/Filesystem.h
+#pragma once
+
+#include <boost/filesystem.hpp>
+
+namespace fs = boost::filesystem;
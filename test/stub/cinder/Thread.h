@@ -0,0 +1,6 @@
+// Stands in for cinder/Thread.h, which maps std::thread and friends to boost on VS2008
+#pragma once
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
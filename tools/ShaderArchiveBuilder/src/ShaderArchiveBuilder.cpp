@@ -0,0 +1,215 @@
+// ShaderArchiveBuilder compiles the shader variants listed in a manifest into one ShaderArchive, and checks or
+// lists existing archives. Building needs the D3D compiler and so Windows; verify and list only need the archive
+// reader and build anywhere, e.g. on a Linux build machine:
+//
+//   g++ -I../../include -I<cinder>/include -I<boost> src/ShaderArchiveBuilder.cpp ../../src/dx11/{ShaderArchive,MappedFile}.cpp
+//
+// The manifest lists one variant per line, '#' starts a comment:
+//
+//   <file> <entry> <profile> [NAME[=value] ...]
+//
+// Files and the files they include are looked up relative to the manifest. <file> is also the name the variant
+// is found by, e.g. Shader::create(archive, Shader_PS, "Lighting.fx", "PS", macros).
+
+#include "dx11/ShaderArchive.h"
+
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <list>
+
+#if defined( _WIN32 )
+#include <windows.h>
+#include <d3dcompiler.h>
+#pragma comment( lib, "d3dcompiler.lib" )
+#endif
+
+using namespace cinder::dx11;
+
+namespace
+{
+#if defined( _WIN32 )
+    bool readFile(const std::string& path, std::string* contents)
+    {
+        std::ifstream file(path.c_str(), std::ios::binary);
+        if (!file)
+            return false;
+        std::ostringstream stream;
+        stream << file.rdbuf();
+        *contents = stream.str();
+        return true;
+    }
+
+    std::string getDirectory(const std::string& path)
+    {
+        size_t slash = path.find_last_of("/\\");
+        return slash == std::string::npos ? std::string() : path.substr(0, slash + 1);
+    }
+
+    class IncludeHandler : public ID3DInclude
+    {
+    public:
+        explicit IncludeHandler(const std::string& directory):mDirectory(directory){}
+
+        STDMETHOD(Open(D3D_INCLUDE_TYPE IncludeType, LPCSTR pFileName, LPCVOID pParentData, LPCVOID *ppData, UINT *pBytes))
+        {
+            mContents.push_back(std::string());
+            if (!readFile(mDirectory + pFileName, &mContents.back()))
+            {
+                mContents.pop_back();
+                return E_FAIL;
+            }
+            *ppData = mContents.back().data();
+            *pBytes = (UINT)mContents.back().size();
+            return S_OK;
+        }
+
+        STDMETHOD(Close(LPCVOID pData))
+        {
+            return S_OK;
+        }
+
+    private:
+        std::string             mDirectory;
+        std::list<std::string>  mContents;
+    };
+
+    int build(const std::string& manifestPath, const std::string& archivePath)
+    {
+        std::ifstream manifest(manifestPath.c_str());
+        if (!manifest)
+        {
+            std::cerr << "can't open " << manifestPath << std::endl;
+            return 1;
+        }
+
+        std::string directory = getDirectory(manifestPath);
+        ShaderArchiveWriter writer;
+        std::string line;
+        for (int lineNumber = 1; std::getline(manifest, line); lineNumber++)
+        {
+            line = line.substr(0, line.find('#'));
+            std::istringstream fields(line);
+            std::string file, entry, profile, define;
+            if (!(fields >> file))
+                continue;
+            if (!(fields >> entry >> profile))
+            {
+                std::cerr << manifestPath << "(" << lineNumber << "): expected <file> <entry> <profile>" << std::endl;
+                return 1;
+            }
+
+            // the same macros the ShaderMacros of the program would give D3DCompile
+            std::vector<ShaderMacro> macros;
+            while (fields >> define)
+            {
+                size_t equals = define.find('=');
+                macros.push_back(equals == std::string::npos ? ShaderMacro(define) :
+                    ShaderMacro(define.substr(0, equals), define.substr(equals + 1)));
+            }
+            std::vector<D3D_SHADER_MACRO> d3dMacros(macros.size() + 1);
+            for (size_t i=0;i<macros.size();i++)
+            {
+                d3dMacros[i].Name = macros[i].name.c_str();
+                d3dMacros[i].Definition = macros[i].definition.c_str();
+            }
+            d3dMacros.back().Name = NULL;
+            d3dMacros.back().Definition = NULL;
+
+            std::string source;
+            if (!readFile(directory + file, &source))
+            {
+                std::cerr << manifestPath << "(" << lineNumber << "): can't open " << file << std::endl;
+                return 1;
+            }
+
+            IncludeHandler includes(directory);
+            ID3DBlob* bytecode = NULL;
+            ID3DBlob* errors = NULL;
+            HRESULT hr = D3DCompile(source.data(), source.size(), file.c_str(), &d3dMacros[0], &includes,
+                entry.c_str(), profile.c_str(), D3DCOMPILE_ENABLE_STRICTNESS, 0, &bytecode, &errors);
+            if (errors != NULL)
+            {
+                std::cerr << static_cast<const char*>(errors->GetBufferPointer());
+                errors->Release();
+            }
+            if (FAILED(hr))
+            {
+                std::cerr << manifestPath << "(" << lineNumber << "): " << file << " " << entry << " failed to compile" << std::endl;
+                return 1;
+            }
+
+            writer.add(file, entry, profile, macros, bytecode->GetBufferPointer(), bytecode->GetBufferSize());
+            bytecode->Release();
+        }
+
+        if (!writer.write(archivePath))
+        {
+            std::cerr << "can't write " << archivePath << std::endl;
+            return 1;
+        }
+        std::cout << archivePath << ": " << writer.getNumEntries() << " variants" << std::endl;
+        return 0;
+    }
+#endif
+
+    ShaderArchiveRef open(const std::string& archivePath)
+    {
+        ShaderArchiveRef archive = ShaderArchive::create(archivePath);
+        if (!archive)
+            std::cerr << archivePath << ": not a shader archive, or truncated" << std::endl;
+        return archive;
+    }
+
+    int verify(const std::string& archivePath)
+    {
+        ShaderArchiveRef archive = open(archivePath);
+        if (!archive)
+            return 1;
+
+        std::string error;
+        if (!archive->verify(&error))
+        {
+            std::cerr << archivePath << ": " << error << std::endl;
+            return 1;
+        }
+        std::cout << archivePath << ": " << archive->getNumEntries() << " variants, OK" << std::endl;
+        return 0;
+    }
+
+    int list(const std::string& archivePath)
+    {
+        ShaderArchiveRef archive = open(archivePath);
+        if (!archive)
+            return 1;
+
+        for (size_t i=0;i<archive->getNumEntries();i++)
+        {
+            const ShaderArchive::Entry& entry = archive->getEntry(i);
+            char hash[20];
+            sprintf(hash, "%08x%08x", (uint32_t)(entry.variantHash >> 32), (uint32_t)entry.variantHash);
+            std::cout << archive->getString(entry.name) << " " << archive->getString(entry.entry) << " "
+                << archive->getString(entry.profile) << " " << hash << " " << entry.size << " bytes" << std::endl;
+        }
+        return 0;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    std::string command = argc > 1 ? argv[1] : "";
+#if defined( _WIN32 )
+    if (command == "build" && argc == 4)
+        return build(argv[2], argv[3]);
+#endif
+    if (command == "verify" && argc == 3)
+        return verify(argv[2]);
+    if (command == "list" && argc == 3)
+        return list(argv[2]);
+
+    std::cerr << "usage: ShaderArchiveBuilder build <manifest> <archive>\n"
+                 "       ShaderArchiveBuilder verify <archive>\n"
+                 "       ShaderArchiveBuilder list <archive>" << std::endl;
+    return 2;
+}